@@ -0,0 +1,104 @@
+//
+//  BridgeOptions.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BridgeOptions.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+
+namespace MidiBridgeCore
+{
+	// case-insensitive prefix match like the app's _wcsnicmp(), the value follows the prefix
+	static bool MatchOption(const std::string& arg, const char* key, std::string* value)
+	{
+		size_t n = std::char_traits<char>::length(key);
+		if(arg.size() < n) return false;
+		for(size_t i = 0; i < n; ++i) { if(std::tolower((unsigned char)arg[i]) != std::tolower((unsigned char)key[i])) return false; }
+		if(value) *value = arg.substr(n);
+		return true;
+	}
+
+	static bool ParseFlag(const std::string& v)
+	{
+		return v.empty() || ((v != "0") && (v != "false") && (v != "no") && (v != "off"));
+	}
+
+	void BridgeOptions::Parse(const std::string& arg)
+	{
+		std::string v;
+		if     (MatchOption(arg, "pipename=", &v))	{ if(!pipeName			.has_value()) pipeName			= v; }
+		else if(MatchOption(arg, "midiin=", &v))	{ if(!midiInDeviceName	.has_value()) midiInDeviceName	= v; }
+		else if(MatchOption(arg, "midiout=", &v))	{ if(!midiOutDeviceName	.has_value()) midiOutDeviceName	= v; }
+		else if(MatchOption(arg, "instances=", &v))	{ if(!maxInstances		.has_value()) maxInstances		= std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "sysextimeout=", &v)){ if(!sysExOwnerTimeoutMsec.has_value()) sysExOwnerTimeoutMsec = std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "readahead=", &v))	{ if(!readAhead			.has_value()) readAhead			= std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "zerocopy=", &v))	{ if(!zeroCopyRead		.has_value()) zeroCopyRead		= ParseFlag(v); }
+		else if(MatchOption(arg, "rtlane=", &v))	{ if(!realTimeLane		.has_value()) realTimeLane		= ParseFlag(v); }
+		else if(MatchOption(arg, "flightsize=", &v)){ if(!flightLogSize		.has_value()) flightLogSize		= (size_t)std::strtoull(v.c_str(), nullptr, 0); }
+		else if(MatchOption(arg, "flight=", &v))	{ if(!flightLog			.has_value()) flightLog			= v; }
+		else if(MatchOption(arg, "p2mfilter=", &v))	{ if(!pipeToMidiFilter	.has_value()) pipeToMidiFilter	= v; }
+		else if(MatchOption(arg, "m2pfilter=", &v))	{ if(!midiToPipeFilter	.has_value()) midiToPipeFilter	= v; }
+		else if(MatchOption(arg, "pacing=", &v))	{ if(!midiOutPacing		.has_value()) midiOutPacing		= v; }
+		else if(MatchOption(arg, "outlatency=", &v)){ if(!midiOutLatencyMsec	.has_value()) midiOutLatencyMsec	= std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "outsmooth=", &v))	{ if(!midiOutSmoothingMsec.has_value()) midiOutSmoothingMsec = std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "clockregen=", &v)){ if(!midiClockRegenMsec	.has_value()) midiClockRegenMsec	= std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "runfor=", &v))	{ if(!runForMsec		.has_value()) runForMsec		= std::atoi(v.c_str()); }
+		else if(MatchOption(arg, "config=", &v))	{ if(!configFile		.has_value()) configFile		= v; }
+		else if(MatchOption(arg, "server=", &v))	{ if(!runAsServer		.has_value()) runAsServer		= ParseFlag(v); }
+		else if(MatchOption(arg, "server", &v) && v.empty()) { if(!runAsServer.has_value()) runAsServer = true; }
+		else unknown.push_back(arg);
+	}
+	ResultCode BridgeOptions::ParseCommandLine(int argc, const char* const* argv)
+	{
+		for(int i = 0; i < argc; ++i) Parse(argv[i]);
+		return configFile.has_value() ? LoadConfigFile(configFile.value()) : ResultOk;
+	}
+	ResultCode BridgeOptions::LoadConfigFile(const std::filesystem::path& path)
+	{
+		std::ifstream ifs(path);
+		if(!ifs) return ENOENT;
+		auto trim = [](std::string s)
+		{
+			auto isspace = [](unsigned char c) { return std::isspace(c) != 0; };
+			s.erase(s.begin(), std::find_if_not(s.begin(), s.end(), isspace));
+			s.erase(std::find_if_not(s.rbegin(), s.rend(), isspace).base(), s.end());
+			return s;
+		};
+		std::string line;
+		while(std::getline(ifs, line))
+		{
+			size_t hash = line.find('#');
+			if(hash != std::string::npos) line.erase(hash);
+			line = trim(line);
+			if(line.empty()) continue;
+			// spaces around the '=' are allowed, a quoted value keeps its own: pipename = "unix:/tmp/midi pipe"
+			size_t eq = line.find('=');
+			if(eq != std::string::npos)
+			{
+				std::string value = trim(line.substr(eq + 1));
+				if((value.size() >= 2) && (value.front() == '"') && (value.back() == '"')) value = value.substr(1, value.size() - 2);
+				line = trim(line.substr(0, eq)) + "=" + value;
+			}
+			Parse(line);
+		}
+		return ResultOk;
+	}
+	std::vector<std::string> BridgeOptions::SplitDeviceList(const std::string& s)
+	{
+		std::vector<std::string> v;
+		if(s.empty()) return v;
+		for(size_t pos = 0; ; )
+		{
+			size_t end = s.find('|', pos);
+			v.push_back(s.substr(pos, end - pos));
+			if(end == std::string::npos) break;
+			pos = end + 1;
+		}
+		return v;
+	}
+}
@@ -0,0 +1,75 @@
+//
+//  BridgeOptions.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// the settings of a headless bridge, the same key=value syntax as the app's command line:
+	//		pipename=<name>		the named pipe on Windows, a socket address ("unix:/path", "tcp:host:port") or "pty:<link>" elsewhere
+	//		midiin=<device>		the device name on Windows, a raw MIDI device (/dev/snd/midiC1D0) elsewhere, empty selects none
+	//		midiout=<device>	either may list several devices separated by '|', the ports 1, 2, ... of a multi-port interface
+	//							that the guest selects with F5 nn
+	//		server				accept connections instead of connecting
+	//		instances=<n>		serve up to n guests at once (server only)
+	//		sysextimeout=<msec>	with instances, a guest that stops inside a SysEx this long while another waits loses the
+	//							MIDI out, its SysEx is closed with EOX. 0 waits for it forever
+	//		readahead=<n> zerocopy=0|1 flight=<logfile> flightsize=<bytes> runfor=<msec>
+	//		rtlane=0|1			send real-time bytes ahead of queued SysEx, with readahead=2 or more
+	//		p2mfilter=<spec>	filter and transform the pipe to MIDI direction, see ParseMessageFilter()
+	//		m2pfilter=<spec>	the same for MIDI to pipe
+	//		pacing=<spec>		pace the MIDI out devices for slow receivers, see ParsePacingProfile(). '|' separates
+	//							the specs of several midiout devices, a single one applies to all of them
+	//		outlatency=<msec>	play MIDI out through the stream API, each message due this long after it arrived (Windows)
+	//		outsmooth=<msec>	spread a burst back over up to this long before it is timed, with outlatency
+	//		clockregen=<msec>	regenerate the MIDI clock (F8) through a PLL, played this long after its estimated send time
+	//		config=<file>		read further options from a file, one per line, '#' starts a comment
+	// the options on the command line win over the ones in the file. strings are UTF-8.
+	//
+	struct BridgeOptions
+	{
+		std::optional<std::string> pipeName;
+		std::optional<std::string> midiInDeviceName;
+		std::optional<std::string> midiOutDeviceName;
+		std::optional<bool> runAsServer;
+		std::optional<int> maxInstances;
+		std::optional<int> sysExOwnerTimeoutMsec;
+		std::optional<int> readAhead;
+		std::optional<bool> zeroCopyRead;
+		std::optional<bool> realTimeLane;
+		std::optional<std::string> flightLog;
+		std::optional<size_t> flightLogSize;
+		std::optional<std::string> pipeToMidiFilter;
+		std::optional<std::string> midiToPipeFilter;
+		std::optional<std::string> midiOutPacing;
+		// 0 or unset sends each message when it arrives
+		std::optional<int> midiOutLatencyMsec;
+		std::optional<int> midiOutSmoothingMsec;
+		// the holdback of the clock regenerator, 0 or unset passes the clock through
+		std::optional<int> midiClockRegenMsec;
+		// stop after this long, 0 or unset runs until told to stop
+		std::optional<int> runForMsec;
+		std::optional<std::string> configFile;
+		// arguments that were not recognized, for the caller to warn about
+		std::vector<std::string> unknown;
+		// an option that is already set is not overwritten, so the first source wins
+		void Parse(const std::string& arg);
+		// the arguments without the program name, a config= among them is loaded after them
+		ResultCode ParseCommandLine(int argc, const char* const* argv);
+		// an unreadable file is reported as an errno value
+		ResultCode LoadConfigFile(const std::filesystem::path& path);
+		// "a|b|c" into its device names, an empty string into none
+		static std::vector<std::string> SplitDeviceList(const std::string& s);
+	};
+}
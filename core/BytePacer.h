@@ -0,0 +1,79 @@
+//
+//  BytePacer.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace MidiBridgeCore
+{
+	//
+	// meters bytes out at a serial line rate so a guest UART is never fed faster than its wire.
+	// the pacer never reads a clock, the caller passes the time in, so it runs the same against a virtual clock.
+	//
+	class BytePacer
+	{
+	public:
+		using TimePoint = std::chrono::steady_clock::time_point;
+		using Duration = std::chrono::steady_clock::duration;
+		// 8N1 framing: start bit, 8 data bits, stop bit
+		static constexpr int BitsPerByte = 10;
+	private:
+		double bitRate = 0;
+		int fifoBytes = 1;
+		Duration byteTime{ 0 };
+		TimePoint lineFree{};
+	public:
+		// a bit rate of 0 disables pacing, fifobytes is how far the sender may run ahead of the line
+		void SetRate(double bitrate, int fifobytes)
+		{
+			bitRate = std::max(bitrate, 0.0);
+			fifoBytes = std::max(fifobytes, 1);
+			// round the byte time up so that the long-term rate never exceeds the line
+			byteTime = (bitRate > 0) ? std::chrono::ceil<Duration>(std::chrono::duration<double>(BitsPerByte / bitRate)) : Duration(0);
+		}
+		bool IsEnabled() const
+		{
+			return bitRate > 0;
+		}
+		double GetBitRate() const
+		{
+			return bitRate;
+		}
+		Duration GetByteTime() const
+		{
+			return byteTime;
+		}
+		void Reset(TimePoint now)
+		{
+			lineFree = now;
+		}
+		// bytes that may be sent at this moment
+		size_t GetAllowance(TimePoint now) const
+		{
+			if(!IsEnabled()) return SIZE_MAX;
+			Duration room = (now + fifoBytes * byteTime) - std::max(lineFree, now);
+			return (room.count() > 0) ? (size_t)(room / byteTime) : 0;
+		}
+		// the earliest time at which at least one byte is allowed
+		TimePoint GetNextSendTime() const
+		{
+			return lineFree - (fifoBytes - 1) * byteTime;
+		}
+		// when the last consumed byte has left the line
+		TimePoint GetLineFreeTime() const
+		{
+			return lineFree;
+		}
+		void Consume(size_t n, TimePoint now)
+		{
+			lineFree = std::max(lineFree, now) + (Duration::rep)n * byteTime;
+		}
+	};
+}
@@ -0,0 +1,543 @@
+//
+//  ClientHub.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "ClientHub.h"
+#include "CoreDebugPrint.h"
+#include "MidiFramer.h"
+#include "SpscRing.h"
+#include "WorkerThread.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// ClientHub::Client
+
+	class ClientHub::Client
+	{
+	private:
+		class Reader : public WorkerThread
+		{
+		private:
+			Client& client;
+		public:
+			Reader(Client& c) : WorkerThread("ClientHub.Reader"), client(c) {}
+			virtual ~Reader() override { StopThread(); }
+			virtual unsigned int Run() override { return client.RunReader(quitFlag); }
+			virtual void RequestToQuitThread() override
+			{
+				quitFlag = true;
+				client.transport->SetReadCancelled(true);
+				client.hub.merger.SetSourceCancelled(client.slot, true);
+				WorkerThread::RequestToQuitThread();
+			}
+		};
+		class Writer : public WorkerThread
+		{
+		private:
+			Client& client;
+		public:
+			Writer(Client& c) : WorkerThread("ClientHub.Writer"), client(c) {}
+			virtual ~Writer() override { StopThread(); }
+			virtual unsigned int Run() override { return client.RunWriter(quitFlag); }
+			virtual void RequestToQuitThread() override
+			{
+				std::lock_guard<std::mutex> lock(client.wakeMutex);
+				quitFlag = true;
+				client.transport->SetWriteCancelled(true);
+				WorkerThread::RequestToQuitThread();
+				client.wakeCond.notify_all();
+			}
+		};
+		ClientHub& hub;
+		int slot;
+		ITransport* transport = nullptr;
+		bool isServer = false;
+		MidiFramer framer;
+		SpscRing<SharedMidiBlock*> queue;
+		std::mutex wakeMutex;
+		std::condition_variable wakeCond;
+		std::atomic<bool> writerWaiting{ false };
+		std::atomic<bool> stopReported{ false };
+		std::atomic<ResultCode> pipeError{ ResultOk };
+		Reader reader;
+		Writer writer;
+		bool NeedToReportPipeError(ResultCode r) const
+		{
+			if(!ResultIsError(r)) return false;
+			if(isServer && transport->IsBrokenPipe(r)) return false;
+			return true;
+		}
+		void ReportPipeError(ResultCode r)
+		{
+			pipeError = r;
+			if(NeedToReportPipeError(r)) { if(hub.OnPipeError) hub.OnPipeError(r); }
+		}
+		void ReportStopped()
+		{
+			if(stopReported.exchange(true)) return;
+			if(hub.OnClientStopped) hub.OnClientStopped(slot);
+		}
+		void DrainQueue()
+		{
+			SharedMidiBlock* b = nullptr;
+			while(queue.Pop(&b)) hub.blockPool.Release(b);
+		}
+		void WaitForBlocks(const std::atomic<bool>& quit)
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			writerWaiting.store(true, std::memory_order_relaxed);
+			// pairs with the fence in Post(), either we see the block or the callback sees us waiting
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wakeCond.wait(lock, [this, &quit]() { return quit || !queue.IsEmpty(); });
+			writerWaiting.store(false, std::memory_order_relaxed);
+		}
+		unsigned int RunReader(const std::atomic<bool>& quit)
+		{
+			CoreDebugPrint(L"[ClientHub] reader begin\n");
+			std::vector<uint8_t> buffer(ReadBufferSize);
+			framer.Reset();
+			uint64_t discarded = framer.GetDiscardedBytes();
+			while(1)
+			{
+				if(quit) break;
+				int cr = 0;
+				ResultCode r = transport->Read(buffer.data(), (int)buffer.size(), &cr);
+				if(ResultIsError(r))
+				{
+					if(quit) break;
+					ReportPipeError(r);
+					ReportStopped();
+					break;
+				}
+				hub.pipeReadCalls.Add();
+				hub.pipeReadBytes.Add((uint64_t)cr);
+				FlightRecorder* recorder = hub.flightRecorder.load(std::memory_order_relaxed);
+				IMessageFilter* filter = hub.pipeToMidiFilter.load(std::memory_order_relaxed);
+				std::chrono::steady_clock::time_point readtime = recorder ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+				framer.Process(buffer.data(), cr, [&](const MidiMessage& m)
+				{
+					hub.mergedMessages.Add();
+					if(recorder) recorder->Record(FlightDirection::PipeToMidi, m.data, m.length, readtime, (uint16_t)slot);
+					if(ResultIsError(r)) return;
+					if(!filter) { r = hub.merger.Dispatch(slot, m); return; }
+					MidiMessage fm;
+					uint8_t w[3];
+					if(ApplyMessageFilter(*filter, m, fm, w))	r = hub.merger.Dispatch(slot, fm);
+					else										hub.pipeFilteredMessages.Add();
+				});
+				if(!ResultIsError(r)) r = hub.merger.Flush(slot);
+				hub.discardedBytes.Add(framer.GetDiscardedBytes() - discarded);
+				discarded = framer.GetDiscardedBytes();
+				if(ResultIsError(r))
+				{
+					if(quit) break;
+					hub.ReportMidiOutError(r);
+					ReportStopped();
+					break;
+				}
+			}
+			CoreDebugPrint(L"[ClientHub] reader end\n");
+			return 0;
+		}
+		unsigned int RunWriter(const std::atomic<bool>& quit)
+		{
+			CoreDebugPrint(L"[ClientHub] writer begin\n");
+			std::vector<uint8_t> buffer(WriteBufferSize);
+			SharedMidiBlock* batch[WriterBatchBlocks];
+			while(1)
+			{
+				if(quit) break;
+				if(queue.IsEmpty())
+				{
+					WaitForBlocks(quit);
+					continue;
+				}
+				int n = 0;
+				size_t c = 0;
+				SharedMidiBlock* b = nullptr;
+				while((n < WriterBatchBlocks) && queue.Peek(&b) && (c + (size_t)b->length <= buffer.size()))
+				{
+					queue.Pop(&b);
+					batch[n++] = b;
+					c += (size_t)b->length;
+				}
+				// a lone block is written straight from the shared copy, a backlog is gathered into one write
+				const uint8_t* p = batch[0]->data;
+				if(n > 1)
+				{
+					size_t i = 0;
+					for(int k = 0; k < n; ++k) { memcpy(buffer.data() + i, batch[k]->data, batch[k]->length); i += (size_t)batch[k]->length; }
+					p = buffer.data();
+				}
+				int cw = 0;
+				ResultCode r = transport->Write(p, (int)c, &cw);
+				for(int k = 0; k < n; ++k) hub.blockPool.Release(batch[k]);
+				if(ResultIsError(r))
+				{
+					if(quit) break;
+					ReportPipeError(r);
+					ReportStopped();
+					break;
+				}
+				hub.writtenBytes.Add(c);
+				hub.pipeWriteCalls.Add();
+			}
+			CoreDebugPrint(L"[ClientHub] writer end\n");
+			return 0;
+		}
+	public:
+		// read by the driver callback, true while the writer takes blocks
+		std::atomic<bool> active{ false };
+		RelaxedCounter overrunBytes;
+		RelaxedCounter connectCount;
+		Client(ClientHub& h, int s) : hub(h), slot(s), queue(ClientQueueBlocks), reader(*this), writer(*this)
+		{
+		}
+		~Client()
+		{
+			Stop();
+		}
+		ITransport* GetTransport() const
+		{
+			return transport;
+		}
+		bool IsRunning() const
+		{
+			return active && reader.IsThreadRunning() && writer.IsThreadRunning();
+		}
+		ResultCode GetPipeError() const
+		{
+			return pipeError;
+		}
+		// callback side, room for a whole message group
+		bool HasQueueRoom(size_t n) const
+		{
+			return queue.GetCapacity() - queue.GetCount() >= n;
+		}
+		void Post(SharedMidiBlock* const* blocks, int n)
+		{
+			for(int k = 0; k < n; ++k)
+			{
+				SharedBlockPool::AddRef(blocks[k]);
+				queue.Push(blocks[k]);
+			}
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(writerWaiting.load(std::memory_order_relaxed))
+			{
+				std::lock_guard<std::mutex> lock(wakeMutex);
+				wakeCond.notify_one();
+			}
+		}
+		// the callers below hold the hub's controlMutex
+		void Start(ITransport* t, bool server)
+		{
+			Stop();
+			transport = t;
+			isServer = server;
+			if(!transport) return;
+			connectCount.Add();
+			pipeError = ResultOk;
+			stopReported = false;
+			transport->SetReadCancelled(false);
+			transport->SetWriteCancelled(false);
+			hub.merger.SetSourceCancelled(slot, false);
+			DrainQueue();
+			writer.StartThread();
+			reader.StartThread();
+			active = true;
+		}
+		void Stop()
+		{
+			if(!transport) return;
+			active = false;
+			hub.WaitForCallbacks();
+			reader.StopThread();
+			writer.StopThread();
+			DrainQueue();
+			hub.merger.ReleaseSource(slot);
+			transport = nullptr;
+		}
+		// for a port change, the client stays connected
+		void StopReader()
+		{
+			if(transport) reader.StopThread();
+		}
+		void StartReader()
+		{
+			if(!transport || stopReported) return;
+			transport->SetReadCancelled(false);
+			hub.merger.SetSourceCancelled(slot, false);
+			reader.StartThread();
+		}
+	};
+
+	// ================================================================================
+	// ClientHub
+
+	ClientHub::ClientHub(int maxclients) : merger(std::clamp(maxclients, 1, MaxClients))
+	{
+		int n = std::clamp(maxclients, 1, MaxClients);
+		blockPool.Reset((size_t)n * (ClientQueueBlocks + WriterBatchBlocks) + MessageGroupBlocks);
+		for(int i = 0; i < n; ++i) clients.push_back(std::make_unique<Client>(*this, i));
+	}
+	ClientHub::~ClientHub()
+	{
+		SetMidiInPort(nullptr);
+		std::lock_guard<std::mutex> lock(controlMutex);
+		if(midiOutPort) midiOutPort->SetSendCancelled(true);
+		for(auto&& cl : clients) cl->Stop();
+		if(midiOutPort) midiOutPort->SetSendCancelled(false);
+	}
+	void ClientHub::OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t)
+	{
+		callbacksInFlight.fetch_add(1);
+		// loaded after the count is raised, so SetFlightRecorder() can wait out the callbacks still using the old one
+		if(FlightRecorder* recorder = flightRecorder.load()) recorder->Record(FlightDirection::MidiToPipe, p, c, t);
+		uint8_t w[3];
+		if(IMessageFilter* filter = midiToPipeFilter.load(); filter && (c > 0))
+		{
+			MidiMessage fm;
+			if(!ApplyMessageFilter(*filter, ClassifyMidiMessage(p, c), fm, w))
+			{
+				midiFilteredMessages.Add();
+				callbacksInFlight.fetch_sub(1);
+				return;
+			}
+			p = fm.data;
+			c = fm.length;
+		}
+		fanOutMessages.Add();
+		int i = 0; while(i < c)
+		{
+			// one copy into shared blocks, a group goes to a client whole or not at all so its stream is never torn
+			SharedMidiBlock* group[MessageGroupBlocks];
+			int n = 0;
+			int i0 = i;
+			while((i < c) && (n < MessageGroupBlocks))
+			{
+				SharedMidiBlock* b = blockPool.Acquire();
+				if(!b) break;
+				int lseg = std::min(SharedMidiBlock::Capacity, c - i);
+				memcpy(b->data, p + i, lseg);
+				b->length = lseg;
+				group[n++] = b;
+				i += lseg;
+			}
+			bool exhausted = (i < c) && (n < MessageGroupBlocks);
+			if(!exhausted)
+			{
+				for(auto&& cl : clients)
+				{
+					if(!cl->active) continue;
+					if(cl->HasQueueRoom((size_t)n))	cl->Post(group, n);
+					else							cl->overrunBytes.Add((uint64_t)(i - i0));
+				}
+			}
+			for(int k = 0; k < n; ++k) blockPool.Release(group[k]);
+			if(exhausted)
+			{
+				poolOverrunBytes.Add((uint64_t)(c - i0));
+				break;
+			}
+		}
+		callbacksInFlight.fetch_sub(1);
+	}
+	void ClientHub::WaitForCallbacks() const
+	{
+		while(callbacksInFlight.load() > 0) std::this_thread::yield();
+	}
+	void ClientHub::ReportMidiOutError(ResultCode r)
+	{
+		ResultCode expected = ResultOk;
+		if(!midiOutError.compare_exchange_strong(expected, r)) return;
+		if(OnMidiOutError) OnMidiOutError(r);
+	}
+	int ClientHub::GetMaxClients() const
+	{
+		return (int)clients.size();
+	}
+	void ClientHub::SetClientTransport(int slot, ITransport* t, bool server)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		if((slot < 0) || ((int)clients.size() <= slot)) return;
+		// a reconnect retries the device like the single client engine does
+		if(t) midiOutError = ResultOk;
+		clients[slot]->Start(t, server);
+	}
+	ITransport* ClientHub::GetClientTransport(int slot) const
+	{
+		return ((0 <= slot) && (slot < (int)clients.size())) ? clients[slot]->GetTransport() : nullptr;
+	}
+	bool ClientHub::IsClientRunning(int slot) const
+	{
+		return ((0 <= slot) && (slot < (int)clients.size())) ? clients[slot]->IsRunning() : false;
+	}
+	int ClientHub::GetClientCount() const
+	{
+		int n = 0;
+		for(auto&& cl : clients) if(cl->active) ++n;
+		return n;
+	}
+	ResultCode ClientHub::GetClientPipeError(int slot) const
+	{
+		return ((0 <= slot) && (slot < (int)clients.size())) ? clients[slot]->GetPipeError() : ResultOk;
+	}
+	uint64_t ClientHub::GetClientOverrunBytes(int slot) const
+	{
+		return ((0 <= slot) && (slot < (int)clients.size())) ? clients[slot]->overrunBytes.Get() : 0;
+	}
+	ResultCode ClientHub::GetMidiInError() const
+	{
+		return midiInError;
+	}
+	ResultCode ClientHub::GetMidiOutError() const
+	{
+		return midiOutError;
+	}
+	IMidiOutPort* ClientHub::GetMidiOutPort() const
+	{
+		return midiOutPort;
+	}
+	void ClientHub::SetMidiOutPort(IMidiOutPort* p)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		// readers blocked on the old device are woken, the clients stay connected
+		if(midiOutPort) midiOutPort->SetSendCancelled(true);
+		for(auto&& cl : clients) cl->StopReader();
+		if(midiOutPort) midiOutPort->SetSendCancelled(false);
+		midiOutPort = p;
+		midiOutError = ResultOk;
+		merger.SetMidiOutPort((p && p->IsDeviceOpen()) ? p : nullptr);
+		for(auto&& cl : clients) cl->StartReader();
+	}
+	FlightRecorder* ClientHub::GetFlightRecorder() const
+	{
+		return flightRecorder;
+	}
+	void ClientHub::SetFlightRecorder(FlightRecorder* p)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		if(midiOutPort) midiOutPort->SetSendCancelled(true);
+		for(auto&& cl : clients) cl->StopReader();
+		if(midiOutPort) midiOutPort->SetSendCancelled(false);
+		flightRecorder = p;
+		WaitForCallbacks();
+		for(auto&& cl : clients) cl->StartReader();
+	}
+	IMessageFilter* ClientHub::GetPipeToMidiFilter() const
+	{
+		return pipeToMidiFilter;
+	}
+	void ClientHub::SetPipeToMidiFilter(IMessageFilter* p)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		if(midiOutPort) midiOutPort->SetSendCancelled(true);
+		for(auto&& cl : clients) cl->StopReader();
+		if(midiOutPort) midiOutPort->SetSendCancelled(false);
+		pipeToMidiFilter = p;
+		for(auto&& cl : clients) cl->StartReader();
+	}
+	IMessageFilter* ClientHub::GetMidiToPipeFilter() const
+	{
+		return midiToPipeFilter;
+	}
+	void ClientHub::SetMidiToPipeFilter(IMessageFilter* p)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		midiToPipeFilter = p;
+		WaitForCallbacks();
+	}
+	std::chrono::milliseconds ClientHub::GetSysExOwnerTimeout() const
+	{
+		return merger.GetSysExOwnerTimeout();
+	}
+	void ClientHub::SetSysExOwnerTimeout(std::chrono::milliseconds v)
+	{
+		merger.SetSysExOwnerTimeout(v);
+	}
+	IMidiInPort* ClientHub::GetMidiInPort() const
+	{
+		return midiInPort;
+	}
+	void ClientHub::SetMidiInPort(IMidiInPort* p)
+	{
+		std::lock_guard<std::mutex> lock(controlMutex);
+		if(midiInPort)
+		{
+			if(isStarted) midiInPort->StopDevice();
+			midiInPort->OnMidiInReceived = nullptr;
+			WaitForCallbacks();
+		}
+		isStarted = false;
+		midiInError = ResultOk;
+		midiInPort = p;
+		if(!midiInPort) return;
+		midiInPort->OnMidiInReceived = [this](const uint8_t* data, int c, MidiTimestamp t) { OnMidiMessageReceived(data, c, t); };
+		if(!midiInPort->IsDeviceOpen()) return;
+		ResultCode r = midiInPort->StartDevice();
+		if(ResultIsError(r))
+		{
+			midiInError = r;
+			if(OnMidiInError) OnMidiInError(r);
+			return;
+		}
+		isStarted = true;
+	}
+	BridgeStatistics ClientHub::GetStatistics() const
+	{
+		BridgeStatistics st;
+		PipeInMidiOutStatistics& p = st.pipeToMidi;
+		p.pipeReadCalls = pipeReadCalls.Get();
+		p.pipeReadBytes = pipeReadBytes.Get();
+		p.messages = mergedMessages.Get();
+		p.shortSends = merger.GetShortSendCount();
+		p.longSends = merger.GetLongSendCount();
+		p.discardedBytes = discardedBytes.Get();
+		p.filteredMessages = pipeFilteredMessages.Get();
+		IMidiOutPort* port = midiOutPort;
+		p.bufferLowWater = port ? port->GetBufferLowWater() : -1;
+		MidiInPipeOutStatistics& m = st.midiToPipe;
+		m.messages = fanOutMessages.Get();
+		m.bytes = writtenBytes.Get();
+		m.pipeWriteCalls = pipeWriteCalls.Get();
+		m.droppedBytes = poolOverrunBytes.Get();
+		m.filteredMessages = midiFilteredMessages.Get();
+		for(auto&& cl : clients)
+		{
+			m.droppedBytes += cl->overrunBytes.Get();
+			uint64_t n = cl->connectCount.Get();
+			p.connects += n;
+			p.reconnects += (n > 0) ? n - 1 : 0;
+		}
+		m.connects = p.connects;
+		m.reconnects = p.reconnects;
+		return st;
+	}
+	void ClientHub::ResetStatistics()
+	{
+		fanOutMessages.Reset();
+		poolOverrunBytes.Reset();
+		pipeReadCalls.Reset();
+		pipeReadBytes.Reset();
+		mergedMessages.Reset();
+		discardedBytes.Reset();
+		pipeFilteredMessages.Reset();
+		midiFilteredMessages.Reset();
+		writtenBytes.Reset();
+		pipeWriteCalls.Reset();
+		merger.ResetCounters();
+		for(auto&& cl : clients)
+		{
+			cl->overrunBytes.Reset();
+			cl->connectCount.Reset();
+		}
+	}
+}
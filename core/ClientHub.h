@@ -0,0 +1,116 @@
+//
+//  ClientHub.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "Transport.h"
+#include "MidiPort.h"
+#include "MidiOutMerger.h"
+#include "SharedBlockPool.h"
+#include "Statistics.h"
+#include "FlightRecorder.h"
+#include "MessageFilter.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// one device pair shared by several pipe clients:
+	// - MIDI in is fanned out, the driver callback copies each message once into a refcounted block and queues a reference to every client
+	// - the pipe input of all clients is merged into the single MIDI out through a MidiOutMerger
+	// - each connected client has a reader and a writer thread, a stalled client only overruns its own queue
+	//
+	class ClientHub
+	{
+	public:
+		static constexpr int MaxClients = 16;
+	private:
+		static constexpr int ReadBufferSize = 256;
+		static constexpr int WriteBufferSize = 4096;
+		static constexpr size_t ClientQueueBlocks = 256;
+		// blocks a writer may hold outside its queue while it writes
+		static constexpr int WriterBatchBlocks = 64;
+		// blocks of one message that are queued all or nothing
+		static constexpr int MessageGroupBlocks = 16;
+		class Client;
+		std::vector<std::unique_ptr<Client> > clients;
+		SharedBlockPool blockPool;
+		MidiOutMerger merger;
+		IMidiOutPort* midiOutPort = nullptr;
+		IMidiInPort* midiInPort = nullptr;
+		// serializes the control calls, the slots and the ports are only changed under it
+		std::mutex controlMutex;
+		std::atomic<int> callbacksInFlight{ 0 };
+		std::atomic<ResultCode> midiInError{ ResultOk };
+		std::atomic<ResultCode> midiOutError{ ResultOk };
+		std::atomic<FlightRecorder*> flightRecorder{ nullptr };
+		std::atomic<IMessageFilter*> pipeToMidiFilter{ nullptr };
+		std::atomic<IMessageFilter*> midiToPipeFilter{ nullptr };
+		bool isStarted = false;
+		RelaxedCounter fanOutMessages;
+		RelaxedCounter poolOverrunBytes;
+		RelaxedCounter pipeReadCalls;
+		RelaxedCounter pipeReadBytes;
+		RelaxedCounter mergedMessages;
+		RelaxedCounter discardedBytes;
+		RelaxedCounter pipeFilteredMessages;
+		RelaxedCounter midiFilteredMessages;
+		RelaxedCounter writtenBytes;
+		RelaxedCounter pipeWriteCalls;
+		void OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t);
+		void WaitForCallbacks() const;
+		void ReportMidiOutError(ResultCode r);
+	public:
+		std::function<void(ResultCode)> OnMidiInError;
+		std::function<void(ResultCode)> OnMidiOutError;
+		std::function<void(ResultCode)> OnPipeError;
+		// called on a client thread when the client's transfer has ended, the owner detaches the transport from another thread
+		std::function<void(int slot)> OnClientStopped;
+		ClientHub(int maxclients);
+		~ClientHub();
+		ClientHub(const ClientHub&) = delete;
+		ClientHub& operator=(const ClientHub&) = delete;
+		int GetMaxClients() const;
+		// attach a connected transport to the slot, nullptr disconnects it, the same rules as PipeInMidiOut::SetTransport()
+		void SetClientTransport(int slot, ITransport* t, bool server);
+		ITransport* GetClientTransport(int slot) const;
+		bool IsClientRunning(int slot) const;
+		int GetClientCount() const;
+		ResultCode GetClientPipeError(int slot) const;
+		// MIDI in bytes the client missed because its queue was full
+		uint64_t GetClientOverrunBytes(int slot) const;
+		ResultCode GetMidiInError() const;
+		ResultCode GetMidiOutError() const;
+		IMidiOutPort* GetMidiOutPort() const;
+		void SetMidiOutPort(IMidiOutPort* p);
+		IMidiInPort* GetMidiInPort() const;
+		// the device runs while it is attached, messages that arrive while no client is connected are dropped
+		void SetMidiInPort(IMidiInPort* p);
+		FlightRecorder* GetFlightRecorder() const;
+		// captures the pipe input of every client tagged with its slot, and MIDI in once before the fan-out.
+		// the recorder stays open while it is attached, the readers are restarted, the clients stay connected
+		void SetFlightRecorder(FlightRecorder* p);
+		IMessageFilter* GetPipeToMidiFilter() const;
+		// the pipe input of every client passes it before the merge, called from several reader threads at once.
+		// the filter stays alive while it is attached, the readers are restarted, the clients stay connected
+		void SetPipeToMidiFilter(IMessageFilter* p);
+		IMessageFilter* GetMidiToPipeFilter() const;
+		// MIDI in passes it once before the fan-out
+		void SetMidiToPipeFilter(IMessageFilter* p);
+		std::chrono::milliseconds GetSysExOwnerTimeout() const;
+		// a guest that stops in the middle of a SysEx for this long while another waits loses the MIDI out, see MidiOutMerger
+		void SetSysExOwnerTimeout(std::chrono::milliseconds v);
+		// summed over the clients, the latency histograms are not recorded in this mode
+		BridgeStatistics GetStatistics() const;
+		void ResetStatistics();
+	};
+}
@@ -0,0 +1,423 @@
+//
+//  ClockRegenerator.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "ClockRegenerator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace MidiBridgeCore
+{
+	// how fast the averaged phase error that decides the lock follows the error
+	static constexpr double LockAverageGain = 0.05;
+	// the lock is let go when the averaged error leaves this many windows
+	static constexpr double LockHysteresis = 4;
+	// how many clocks into an acquisition the period is still the mean interval
+	static constexpr int64_t MeanPeriodClocks = 192;
+	// the first clocks of an acquisition pass at their raw timing, the mean of fewer intervals is mostly the jitter
+	static constexpr int64_t RawTimingClocks = 8;
+	// how much of the largest phase error is still remembered a clock later
+	static constexpr double PeakDecay = 0.99;
+	// how far past that peak a locked clock may still be held
+	static constexpr double PeakMargin = 1.25;
+
+	// ================================================================================
+	// MidiClockPll
+
+	bool MidiClockPll::IsClockStatus(uint8_t stat)
+	{
+		return (stat == 0xf8) || (stat == 0xfa) || (stat == 0xfb) || (stat == 0xfc);
+	}
+	MidiClockPll::MidiClockPll()
+	{
+	}
+	void MidiClockPll::SetSettings(const ClockPllSettings& v)
+	{
+		settings = v;
+		settings.acquireGain = std::clamp(settings.acquireGain, 0.001, 1.0);
+		settings.trackGain = std::clamp(settings.trackGain, 0.001, 1.0);
+		settings.lockClocks = std::max(settings.lockClocks, 1);
+		settings.dropoutPeriods = std::max(settings.dropoutPeriods, 1.5);
+	}
+	const ClockPllSettings& MidiClockPll::GetSettings() const
+	{
+		return settings;
+	}
+	void MidiClockPll::Reset()
+	{
+		queue.clear();
+		hasPhase = false;
+		hasPeriod = false;
+		rephase = false;
+		period = 0;
+		errorAverage = 0;
+		errorPeak = 0;
+		locked = false;
+		clockCount = 0;
+		lastOut = {};
+		lastLockTime = Duration(0);
+		relockCount = 0;
+	}
+	void MidiClockPll::Track(TimePoint arrival, int64_t clock)
+	{
+		auto startover = [this, arrival, clock]()
+		{
+			if(hasPeriod) ++relockCount;
+			hasPhase = true;
+			hasPeriod = false;
+			phase = arrival;
+			phaseClock = clock;
+			acquireStart = arrival;
+			acquireClock = clock;
+			errorAverage = 0;
+			locked = false;
+		};
+		double window = (double)std::chrono::duration_cast<Duration>(settings.lockWindow).count();
+		double holdback = (double)std::chrono::duration_cast<Duration>(settings.holdback).count();
+		// a pause, the clock was stopped
+		if(hasPeriod && ((double)(arrival - lastArrival).count() > settings.dropoutPeriods * period)) startover();
+		else if(!hasPhase) startover();
+		else if(rephase && hasPeriod)
+		{
+			// the first clock after a start or continue is the downbeat, the tempo carries on
+			phase = arrival;
+			phaseClock = clock;
+		}
+		else if(!locked)
+		{
+			// acquiring: the period is the mean interval since the acquisition began, which a coarse host timer cannot fool
+			// for long, the phase follows with the acquisition gain
+			int64_t n = clock - acquireClock;
+			period = (double)(arrival - acquireStart).count() / (double)n;
+			TimePoint predicted = hasPeriod ? phase + Duration((Duration::rep)std::llround(period * (double)(clock - phaseClock))) : arrival;
+			double e = (double)(arrival - predicted).count();
+			phase = predicted + Duration((Duration::rep)std::llround(settings.acquireGain * e));
+			phaseClock = clock;
+			hasPeriod = true;
+			errorAverage += LockAverageGain * (e - errorAverage);
+			TrackPeak(e);
+			if((n >= settings.lockClocks) && (std::fabs(errorAverage) <= window))
+			{
+				locked = true;
+				lastLockTime = arrival - acquireStart;
+			}
+		}
+		else
+		{
+			TimePoint predicted = phase + Duration((Duration::rep)std::llround(period * (double)(clock - phaseClock)));
+			double e = (double)(arrival - predicted).count();
+			errorAverage += LockAverageGain * (e - errorAverage);
+			TrackPeak(e);
+			// a jump, or an error that stays well outside the window, is a new tempo
+			if((std::fabs(e) > std::min(period / 2, holdback)) || (std::fabs(errorAverage) > LockHysteresis * window)) startover();
+			else
+			{
+				double g = settings.trackGain;
+				phase = predicted + Duration((Duration::rep)std::llround(g * e));
+				phaseClock = clock;
+				// the mean interval keeps getting steadier for a while after the lock, the loop takes over once it has settled
+				int64_t n = clock - acquireClock;
+				if(n < MeanPeriodClocks) period = (double)(arrival - acquireStart).count() / (double)n;
+				else period += g * g / (2 - g) * e;
+			}
+		}
+		rephase = false;
+		lastArrival = arrival;
+	}
+	void MidiClockPll::TrackPeak(double e)
+	{
+		// it rises slowly, the clocks of a tempo change must not widen the room they are held in
+		double a = std::fabs(e);
+		if(a > errorPeak) errorPeak += LockAverageGain * (a - errorPeak);
+		else errorPeak *= PeakDecay;
+	}
+	MidiClockPll::TimePoint MidiClockPll::GetTime(const Pending& p) const
+	{
+		Duration holdback = std::chrono::duration_cast<Duration>(settings.holdback);
+		if(p.released) return std::max(p.arrival, lastOut);
+		TimePoint t = p.arrival + holdback;
+		// past its first clocks the acquisition's estimate is rough but already steadier than the arrivals, and leads into
+		// the lock without a step
+		if(hasPeriod && (p.clock >= phaseClock - 1) && (p.clock - acquireClock >= RawTimingClocks))
+		{
+			t = phase + Duration((Duration::rep)std::llround(period * (double)(p.clock - phaseClock))) + holdback;
+			t = std::clamp(t, p.arrival, p.latest);
+		}
+		return std::max(t, lastOut);
+	}
+	void MidiClockPll::Push(uint8_t stat, TimePoint arrival)
+	{
+		if(!IsClockStatus(stat)) return;
+		if(stat == 0xf8)
+		{
+			int64_t clock = clockCount++;
+			// a locked clock is held no longer than the arrivals have lately scattered, one further off is the start of a
+			// tempo change more likely than jitter, and would otherwise wait on the old estimate until the jump shows
+			Duration holdback = std::chrono::duration_cast<Duration>(settings.holdback);
+			Duration margin = holdback;
+			if(locked) margin = std::min(holdback, std::max(Duration((Duration::rep)std::llround(PeakMargin * errorPeak)), std::chrono::duration_cast<Duration>(settings.lockWindow)));
+			Track(arrival, clock);
+			queue.push_back({ arrival, clock, arrival + holdback + margin, false });
+			return;
+		}
+		if((stat == 0xfa) || (stat == 0xfb)) rephase = true;
+		for(auto& p : queue) p.released = true;
+	}
+	MidiClockPll::TimePoint MidiClockPll::GetNextTime() const
+	{
+		return queue.empty() ? TimePoint::max() : GetTime(queue.front());
+	}
+	bool MidiClockPll::TakeDue(TimePoint now)
+	{
+		if(queue.empty()) return false;
+		TimePoint t = GetTime(queue.front());
+		if(now < t) return false;
+		// the schedule goes on from when it was due, a late wakeup does not push the next ones
+		lastOut = t;
+		queue.pop_front();
+		return true;
+	}
+	size_t MidiClockPll::GetPendingCount() const
+	{
+		return queue.size();
+	}
+	bool MidiClockPll::IsLocked() const
+	{
+		return locked;
+	}
+	MidiClockPll::Duration MidiClockPll::GetPeriod() const
+	{
+		return hasPeriod ? Duration((Duration::rep)std::llround(period)) : Duration(0);
+	}
+	MidiClockPll::Duration MidiClockPll::GetLastLockTime() const
+	{
+		return lastLockTime;
+	}
+	uint64_t MidiClockPll::GetRelockCount() const
+	{
+		return relockCount;
+	}
+
+	// ================================================================================
+	// ClockRegenMidiOut
+
+	ClockRegenMidiOut::ClockRegenMidiOut() : WorkerThread("ClockRegenMidiOut")
+	{
+	}
+	ClockRegenMidiOut::~ClockRegenMidiOut()
+	{
+		Stop();
+	}
+	ResultCode ClockRegenMidiOut::SendToDevice(IMidiOutPort* p, uint32_t msg)
+	{
+		if(p->IsShortMessageConcurrent()) return p->SendShortMessage(msg);
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		return p->SendShortMessage(msg);
+	}
+	unsigned int ClockRegenMidiOut::Run()
+	{
+		using Clock = std::chrono::steady_clock;
+		while(1)
+		{
+			IMidiOutPort* p = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				// an FA, FB or FC playing the released clocks on the caller's thread goes first
+				pendingCond.wait(lock, [this]() { return quitFlag || ((pll.GetPendingCount() > 0) && !sending); });
+				if(quitFlag) break;
+				Clock::time_point now = Clock::now();
+				if(!pll.TakeDue(now))
+				{
+					// short naps, the estimate moves a little with each clock that comes in
+					Clock::time_point t = pll.GetNextTime();
+					lock.unlock();
+					timer.SleepUntil(std::min<Clock::time_point>(t, now + std::chrono::milliseconds(1)));
+					continue;
+				}
+				// with no device attached the clock is dropped
+				if(!port) continue;
+				p = port;
+				sending = true;
+			}
+			ResultCode r = SendToDevice(p, 0xf8);
+			clockCount.Add();
+			std::lock_guard<std::mutex> lock(mutex);
+			sending = false;
+			if((r != ResultOk) && (deviceResult == ResultOk)) deviceResult = r;
+			doneCond.notify_all();
+		}
+		return 0;
+	}
+	void ClockRegenMidiOut::RequestToQuitThread()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		WorkerThread::RequestToQuitThread();
+		pendingCond.notify_all();
+	}
+	void ClockRegenMidiOut::SetMidiOutPort(IMidiOutPort* p)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCond.wait(lock, [this]() { return !sending; });
+		port = p;
+	}
+	IMidiOutPort* ClockRegenMidiOut::GetMidiOutPort() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return port;
+	}
+	void ClockRegenMidiOut::SetSettings(const ClockPllSettings& v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pll.SetSettings(v);
+	}
+	ClockPllSettings ClockRegenMidiOut::GetSettings() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pll.GetSettings();
+	}
+	bool ClockRegenMidiOut::Start()
+	{
+		Stop();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!port) return false;
+			pll.Reset();
+		}
+		return StartThread();
+	}
+	void ClockRegenMidiOut::Stop()
+	{
+		StopThread();
+		std::lock_guard<std::mutex> lock(mutex);
+		pll.Reset();
+		deviceResult = ResultOk;
+		sending = false;
+		doneCond.notify_all();
+	}
+	bool ClockRegenMidiOut::IsRunning() const
+	{
+		return IsThreadRunning();
+	}
+	bool ClockRegenMidiOut::Flush(std::chrono::nanoseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return doneCond.wait_for(lock, timeout, [this]() { return (pll.GetPendingCount() == 0) && !sending; });
+	}
+	bool ClockRegenMidiOut::IsLocked() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pll.IsLocked();
+	}
+	MidiClockPll::Duration ClockRegenMidiOut::GetPeriod() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pll.GetPeriod();
+	}
+	MidiClockPll::Duration ClockRegenMidiOut::GetLastLockTime() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pll.GetLastLockTime();
+	}
+	uint64_t ClockRegenMidiOut::GetRelockCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pll.GetRelockCount();
+	}
+	uint64_t ClockRegenMidiOut::GetClockCount() const
+	{
+		return clockCount.Get();
+	}
+	bool ClockRegenMidiOut::IsDeviceOpen() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return port && port->IsDeviceOpen();
+	}
+	ResultCode ClockRegenMidiOut::Send(const uint8_t* p, int c)
+	{
+		if(!port) return ResultBrokenPipe;
+		if(port->IsShortMessageConcurrent()) return port->Send(p, c);
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		return port->Send(p, c);
+	}
+	ResultCode ClockRegenMidiOut::SendShortMessage(uint32_t msg)
+	{
+		uint8_t stat = (uint8_t)msg;
+		if(!port) return ResultBrokenPipe;
+		if(!MidiClockPll::IsClockStatus(stat)) return SendToDevice(port, msg);
+		std::unique_lock<std::mutex> lock(mutex);
+		if(!IsThreadRunning()) return ResultBrokenPipe;
+		if(deviceResult != ResultOk) return deviceResult;
+		if(stat == 0xf8)
+		{
+			pll.Push(stat, std::chrono::steady_clock::now());
+			pendingCond.notify_one();
+			return ResultOk;
+		}
+		// a start, continue or stop is not held, what follows it must not reach the device first. the clocks still
+		// pending are released and played ahead of it, after the one the thread may be playing
+		doneCond.wait(lock, [this]() { return !sending; });
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		pll.Push(stat, now);
+		int released = 0;
+		while(pll.TakeDue(now)) ++released;
+		IMidiOutPort* p = port;
+		if(!p) return ResultBrokenPipe;
+		sending = true;
+		lock.unlock();
+		ResultCode r = ResultOk;
+		for(; (released > 0) && (r == ResultOk); --released)
+		{
+			r = SendToDevice(p, 0xf8);
+			clockCount.Add();
+		}
+		if(r == ResultOk) r = SendToDevice(p, msg);
+		lock.lock();
+		sending = false;
+		doneCond.notify_all();
+		pendingCond.notify_one();
+		return r;
+	}
+	bool ClockRegenMidiOut::IsShortMessageConcurrent() const
+	{
+		// the clock is only queued, the rest is the device's
+		return port && port->IsShortMessageConcurrent();
+	}
+	ResultCode ClockRegenMidiOut::AcquireSendBuffer(uint8_t** pp, int* capacity)
+	{
+		*pp = nullptr;
+		*capacity = 0;
+		if(!port) return ResultBrokenPipe;
+		if(port->IsShortMessageConcurrent()) return port->AcquireSendBuffer(pp, capacity);
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		return port->AcquireSendBuffer(pp, capacity);
+	}
+	ResultCode ClockRegenMidiOut::SubmitSendBuffer(uint8_t* p, int c)
+	{
+		if(!port) return ResultBrokenPipe;
+		if(port->IsShortMessageConcurrent()) return port->SubmitSendBuffer(p, c);
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		return port->SubmitSendBuffer(p, c);
+	}
+	void ClockRegenMidiOut::ReturnSendBuffer(uint8_t* p)
+	{
+		if(port) port->ReturnSendBuffer(p);
+	}
+	void ClockRegenMidiOut::SetSendCancelled(bool v)
+	{
+		IMidiOutPort* p = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			// re-armed for a new session, a clock that failed on the device does not fail the ones after it
+			if(!v) deviceResult = ResultOk;
+			p = port;
+		}
+		if(p) p->SetSendCancelled(v);
+	}
+	int64_t ClockRegenMidiOut::GetBufferLowWater() const
+	{
+		return port ? port->GetBufferLowWater() : -1;
+	}
+}
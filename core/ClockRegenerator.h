@@ -0,0 +1,159 @@
+//
+//  ClockRegenerator.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiPort.h"
+#include "PreciseTimer.h"
+#include "Statistics.h"
+#include "WorkerThread.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace MidiBridgeCore
+{
+	struct ClockPllSettings
+	{
+		// how long after the loop's estimate of when the guest sent a clock it is played, room for the input's jitter
+		std::chrono::microseconds holdback{ 8000 };
+		// the phase gain while the loop acquires and once it is locked, the period gain follows for a critically damped loop
+		double acquireGain = 0.3;
+		double trackGain = 0.05;
+		// locked once the acquisition has measured this many periods and the averaged phase error is within the window
+		std::chrono::microseconds lockWindow{ 1000 };
+		int lockClocks = 24;
+		// a pause of this many periods lets go of the loop, the next clock starts it over
+		double dropoutPeriods = 4;
+	};
+
+	//
+	// a software PLL locked to the guest's MIDI clock. every F8 that comes in goes out once, at the loop's estimate of when
+	// it was sent plus the holdback instead of when it happened to arrive. a clock never goes out before it arrived nor later
+	// than twice the holdback after, a locked one no later than the arrivals have lately scattered past the estimate; the
+	// first clocks of an acquisition pass at their raw timing. FA, FB and FC are not held, the caller plays them as they
+	// come after the clocks they release: the ones still pending are due at once. a start or continue lets the next clock
+	// set the phase, an error of more than half a period or the holdback starts the acquisition over.
+	// the loop never reads a clock, the caller passes the time in, so it runs the same against a virtual clock
+	//
+	class MidiClockPll
+	{
+	public:
+		using TimePoint = std::chrono::steady_clock::time_point;
+		using Duration = std::chrono::steady_clock::duration;
+		// F8 FA FB FC, what the loop takes
+		static bool IsClockStatus(uint8_t stat);
+	private:
+		struct Pending
+		{
+			TimePoint arrival;
+			int64_t clock; // the clock's index
+			TimePoint latest; // when it is played at the latest
+			bool released; // a start, continue or stop came in behind it
+		};
+		ClockPllSettings settings;
+		std::deque<Pending> queue;
+		// the loop: when clock phaseClock was sent and the period since
+		bool hasPhase = false;
+		bool hasPeriod = false;
+		bool rephase = false;
+		TimePoint phase{};
+		int64_t phaseClock = 0;
+		double period = 0; // in Duration ticks, fractional
+		double errorAverage = 0;
+		double errorPeak = 0; // the largest recent phase error, decaying
+		bool locked = false;
+		int64_t clockCount = 0;
+		TimePoint lastArrival{};
+		TimePoint lastOut{};
+		// the first clock of the acquisition
+		TimePoint acquireStart{};
+		int64_t acquireClock = 0;
+		Duration lastLockTime{ 0 };
+		uint64_t relockCount = 0;
+		void Track(TimePoint arrival, int64_t clock);
+		void TrackPeak(double e);
+		TimePoint GetTime(const Pending& p) const;
+	public:
+		MidiClockPll();
+		void SetSettings(const ClockPllSettings& v);
+		const ClockPllSettings& GetSettings() const;
+		void Reset();
+		// an F8 is queued, an FA, FB or FC releases the pending ones, a status that is not a clock one is ignored
+		void Push(uint8_t stat, TimePoint arrival);
+		// when the next clock is due, TimePoint::max() while none is pending
+		TimePoint GetNextTime() const;
+		// takes the next clock once it is due
+		bool TakeDue(TimePoint now);
+		size_t GetPendingCount() const;
+		bool IsLocked() const;
+		// the estimated clock period, 0 before two clocks came in
+		Duration GetPeriod() const;
+		// how long the last acquisition took from its first clock until the loop locked
+		Duration GetLastLockTime() const;
+		// acquisitions started over by a dropout or a jump
+		uint64_t GetRelockCount() const;
+	};
+
+	//
+	// regenerates the MIDI clock for a device, attach it where the device would go. F8 sent as a short message goes through
+	// the PLL and is played by a thread on a precise timer; everything else, FA, FB, FC and SysEx included, goes straight
+	// through on the caller's thread. an FA, FB or FC plays the clocks still held ahead of it, so it neither passes a clock
+	// nor waits behind one while the messages after it go out. with a port select demux put one behind it for each port,
+	// in front of it a clock held back would go to the port an F5 selected after it. a clock the device failed is
+	// reported to the clock statuses that follow until the engine re-arms the port with SetSendCancelled(false)
+	//
+	class ClockRegenMidiOut : public IMidiOutPort, private WorkerThread
+	{
+	private:
+		mutable std::mutex mutex;
+		std::condition_variable pendingCond;
+		std::condition_variable doneCond;
+		IMidiOutPort* port = nullptr;
+		MidiClockPll pll;
+		bool sending = false;
+		ResultCode deviceResult = ResultOk;
+		// held around the device's calls when it does not take a short message beside a long one
+		std::mutex deviceMutex;
+		PreciseTimer timer;
+		RelaxedCounter clockCount;
+		ResultCode SendToDevice(IMidiOutPort* p, uint32_t msg);
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+	public:
+		ClockRegenMidiOut();
+		virtual ~ClockRegenMidiOut() override;
+		// waits for a clock that is being played, nullptr drops the clocks until a device is attached again
+		void SetMidiOutPort(IMidiOutPort* p);
+		IMidiOutPort* GetMidiOutPort() const;
+		void SetSettings(const ClockPllSettings& v);
+		ClockPllSettings GetSettings() const;
+		// starts the clock thread, Stop() drops what is still pending
+		bool Start();
+		void Stop();
+		bool IsRunning() const;
+		// waits until the pending clocks have been played, false on timeout
+		bool Flush(std::chrono::nanoseconds timeout);
+		bool IsLocked() const;
+		MidiClockPll::Duration GetPeriod() const;
+		MidiClockPll::Duration GetLastLockTime() const;
+		uint64_t GetRelockCount() const;
+		// F8 played
+		uint64_t GetClockCount() const;
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		virtual ResultCode SendShortMessage(uint32_t msg) override;
+		virtual bool IsShortMessageConcurrent() const override;
+		virtual ResultCode AcquireSendBuffer(uint8_t** pp, int* capacity) override;
+		virtual ResultCode SubmitSendBuffer(uint8_t* p, int c) override;
+		virtual void ReturnSendBuffer(uint8_t* p) override;
+		virtual void SetSendCancelled(bool v) override;
+		virtual int64_t GetBufferLowWater() const override;
+	};
+}
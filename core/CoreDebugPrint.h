@@ -0,0 +1,16 @@
+//
+//  CoreDebugPrint.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#if defined(_WIN32) && defined(_DEBUG)
+#include <windows.h>
+#include <format>
+#define CoreDebugPrint(...) OutputDebugStringW(std::format(__VA_ARGS__).c_str())
+#else
+#define CoreDebugPrint(...) ((void)0)
+#endif
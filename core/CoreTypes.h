@@ -0,0 +1,32 @@
+//
+//  CoreTypes.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+
+namespace MidiBridgeCore
+{
+	//
+	// NOTE:
+	// The core does not interpret result codes, it only tests them against ResultOk and passes them to the owner.
+	// The platform layer decides what they mean: HRESULT/MMRESULT on Windows, errno values on POSIX.
+	// Errors raised by the core itself use the portable errno constants.
+	//
+	typedef int32_t ResultCode;
+	static constexpr ResultCode ResultOk = 0;
+	static constexpr ResultCode ResultCancelled = ECANCELED;
+	static constexpr ResultCode ResultBrokenPipe = EPIPE;
+	static constexpr ResultCode ResultTimedOut = ETIMEDOUT;
+	static constexpr ResultCode ResultNotSupported = ENOTSUP;
+
+	static inline bool ResultIsError(ResultCode r)
+	{
+		return r != ResultOk;
+	}
+}
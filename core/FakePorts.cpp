@@ -0,0 +1,397 @@
+//
+//  FakePorts.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "FakePorts.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// MemoryPipe
+
+	MemoryPipe::Endpoint::Endpoint(Channel& r, Channel& t) : rx(r), tx(t)
+	{
+	}
+	ResultCode MemoryPipe::Endpoint::Read(uint8_t* p, int c, int* cr)
+	{
+		*cr = 0;
+		std::unique_lock<std::mutex> lock(rx.mutex);
+		rx.cond.wait(lock, [this]() { return readCancelled || rx.closed || (rx.count > 0); });
+		if(readCancelled) return ResultCancelled;
+		if(rx.count == 0) return ResultBrokenPipe;
+		size_t cap = rx.ring.size();
+		size_t n = std::min((size_t)c, rx.count);
+		for(size_t i = 0; i < n; )
+		{
+			size_t lseg = std::min(n - i, cap - rx.head);
+			memcpy(p + i, rx.ring.data() + rx.head, lseg);
+			rx.head = (rx.head + lseg) % cap;
+			i += lseg;
+		}
+		rx.count -= n;
+		rx.cond.notify_all();
+		*cr = (int)n;
+		return ResultOk;
+	}
+	ResultCode MemoryPipe::Endpoint::Write(const uint8_t* p, int c, int* cw)
+	{
+		*cw = 0;
+		std::unique_lock<std::mutex> lock(tx.mutex);
+		size_t cap = tx.ring.size();
+		size_t i = 0; while(i < (size_t)c)
+		{
+			tx.cond.wait(lock, [this, cap]() { return writeCancelled || tx.closed || (tx.count < cap); });
+			if(writeCancelled) return ResultCancelled;
+			if(tx.closed) return ResultBrokenPipe;
+			size_t tail = (tx.head + tx.count) % cap;
+			size_t lseg = std::min({ (size_t)c - i, cap - tx.count, cap - tail });
+			memcpy(tx.ring.data() + tail, p + i, lseg);
+			tx.count += lseg;
+			i += lseg;
+			*cw = (int)i;
+			tx.cond.notify_all();
+		}
+		return ResultOk;
+	}
+	void MemoryPipe::Endpoint::SetReadCancelled(bool v)
+	{
+		std::lock_guard<std::mutex> lock(rx.mutex);
+		readCancelled = v;
+		rx.cond.notify_all();
+	}
+	void MemoryPipe::Endpoint::SetWriteCancelled(bool v)
+	{
+		std::lock_guard<std::mutex> lock(tx.mutex);
+		writeCancelled = v;
+		tx.cond.notify_all();
+	}
+	bool MemoryPipe::Endpoint::IsBrokenPipe(ResultCode r) const
+	{
+		return r == ResultBrokenPipe;
+	}
+	MemoryPipe::MemoryPipe(size_t capacity)
+		: guestEnd(hostToGuest, guestToHost)
+		, hostEnd(guestToHost, hostToGuest)
+	{
+		guestToHost.ring.resize(std::max<size_t>(capacity, 1));
+		hostToGuest.ring.resize(std::max<size_t>(capacity, 1));
+	}
+	MemoryPipe::Endpoint& MemoryPipe::GuestEnd()
+	{
+		return guestEnd;
+	}
+	MemoryPipe::Endpoint& MemoryPipe::HostEnd()
+	{
+		return hostEnd;
+	}
+	void MemoryPipe::Close()
+	{
+		for(Channel* ch : { &guestToHost, &hostToGuest })
+		{
+			std::lock_guard<std::mutex> lock(ch->mutex);
+			ch->closed = true;
+			ch->cond.notify_all();
+		}
+	}
+	void MemoryPipe::Reset()
+	{
+		for(Channel* ch : { &guestToHost, &hostToGuest })
+		{
+			std::lock_guard<std::mutex> lock(ch->mutex);
+			ch->head = 0;
+			ch->count = 0;
+			ch->closed = false;
+			ch->cond.notify_all();
+		}
+	}
+
+	// ================================================================================
+	// FakeMidiOutPort
+
+	void FakeMidiOutPort::OpenDevice()
+	{
+		isOpen = true;
+	}
+	void FakeMidiOutPort::CloseDevice()
+	{
+		isOpen = false;
+	}
+	void FakeMidiOutPort::SetCaptureEnabled(bool v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		captureEnabled = v;
+	}
+	std::vector<uint8_t> FakeMidiOutPort::GetReceivedData() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return receivedData;
+	}
+	uint64_t FakeMidiOutPort::GetByteCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return byteCount;
+	}
+	uint64_t FakeMidiOutPort::GetSendCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sendCount;
+	}
+	uint64_t FakeMidiOutPort::GetShortSendCount() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return shortSendCount;
+	}
+	bool FakeMidiOutPort::WaitForBytes(uint64_t n, std::chrono::nanoseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return cond.wait_for(lock, timeout, [this, n]() { return byteCount >= n; });
+	}
+	void FakeMidiOutPort::Clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		receivedData.clear();
+		byteCount = 0;
+		sendCount = 0;
+		shortSendCount = 0;
+	}
+	bool FakeMidiOutPort::IsDeviceOpen() const
+	{
+		return isOpen;
+	}
+	ResultCode FakeMidiOutPort::Send(const uint8_t* p, int c)
+	{
+		if(!isOpen) return ResultBrokenPipe;
+		if(OnSend)
+		{
+			ResultCode r = OnSend(p, c);
+			if(ResultIsError(r)) return r;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if(captureEnabled) receivedData.insert(receivedData.end(), p, p + c);
+		byteCount += (uint64_t)c;
+		++sendCount;
+		cond.notify_all();
+		return ResultOk;
+	}
+	ResultCode FakeMidiOutPort::SendShortMessage(uint32_t msg)
+	{
+		ResultCode r = IMidiOutPort::SendShortMessage(msg);
+		if(ResultIsError(r)) return r;
+		std::lock_guard<std::mutex> lock(mutex);
+		++shortSendCount;
+		return ResultOk;
+	}
+	bool FakeMidiOutPort::IsShortMessageConcurrent() const
+	{
+		return true;
+	}
+
+	// ================================================================================
+	// FakeQueuedMidiOutPort
+
+	FakeQueuedMidiOutPort::FakeQueuedMidiOutPort(int numbuffers, int buffersize) : WorkerThread("FakeQueuedMidiOutPort"), freePool(numbuffers)
+	{
+		for(int i = 0; i < numbuffers; ++i)
+		{
+			std::unique_ptr<Header> hdr = std::make_unique<Header>();
+			hdr->data.resize(std::max(buffersize, 1));
+			hdrList.push_back(std::move(hdr));
+		}
+	}
+	FakeQueuedMidiOutPort::~FakeQueuedMidiOutPort()
+	{
+		CloseDevice();
+	}
+	unsigned int FakeQueuedMidiOutPort::Run()
+	{
+		using Clock = std::chrono::steady_clock;
+		Clock::time_point due = Clock::now();
+		while(1)
+		{
+			Header* hdr = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCond.wait(lock, [this]() { return quitFlag || !queue.empty(); });
+				if(quitFlag) break;
+				hdr = queue.front();
+				queue.pop_front();
+			}
+			// pace on an absolute schedule so the sleep granularity does not accumulate
+			double bps = bytesPerSecond;
+			if(bps > 0)
+			{
+				Clock::time_point now = Clock::now();
+				if(due + std::chrono::milliseconds(10) < now) due = now; // idle, restart the schedule
+				due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(hdr->length / bps));
+				if(quitEvent.WaitFor(due - now)) break;
+			}
+			{
+				std::lock_guard<std::mutex> lock(recordMutex);
+				receivedData.insert(receivedData.end(), hdr->data.begin(), hdr->data.begin() + hdr->length);
+				byteCount += (uint64_t)hdr->length;
+				recordCond.notify_all();
+			}
+			freePool.Release(hdr);
+		}
+		return 0;
+	}
+	void FakeQueuedMidiOutPort::RequestToQuitThread()
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		WorkerThread::RequestToQuitThread();
+		queueCond.notify_all();
+	}
+	void FakeQueuedMidiOutPort::SetBytesPerSecond(double v)
+	{
+		bytesPerSecond = v;
+	}
+	void FakeQueuedMidiOutPort::SetSendTimeout(std::chrono::milliseconds t)
+	{
+		sendTimeout = t;
+	}
+	void FakeQueuedMidiOutPort::OpenDevice()
+	{
+		CloseDevice();
+		freePool.SetCapacity(hdrList.size());
+		for(auto&& hdr : hdrList) freePool.Release(hdr.get());
+		StartThread();
+		isOpen = true;
+	}
+	void FakeQueuedMidiOutPort::CloseDevice()
+	{
+		isOpen = false;
+		StopThread();
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.clear();
+		freePool.Clear();
+		lentHeader = nullptr;
+	}
+	std::vector<uint8_t> FakeQueuedMidiOutPort::GetReceivedData() const
+	{
+		std::lock_guard<std::mutex> lock(recordMutex);
+		return receivedData;
+	}
+	uint64_t FakeQueuedMidiOutPort::GetByteCount() const
+	{
+		std::lock_guard<std::mutex> lock(recordMutex);
+		return byteCount;
+	}
+	uint64_t FakeQueuedMidiOutPort::GetWaitCount() const
+	{
+		return freePool.GetWaitCount();
+	}
+	bool FakeQueuedMidiOutPort::WaitForBytes(uint64_t n, std::chrono::nanoseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(recordMutex);
+		return recordCond.wait_for(lock, timeout, [this, n]() { return byteCount >= n; });
+	}
+	bool FakeQueuedMidiOutPort::IsDeviceOpen() const
+	{
+		return isOpen;
+	}
+	ResultCode FakeQueuedMidiOutPort::Send(const uint8_t* p, int c)
+	{
+		if(!isOpen) return ResultBrokenPipe;
+		int i = 0; while(i < c)
+		{
+			Header* hdr = nullptr;
+			ResultCode r = freePool.Acquire(&hdr, sendTimeout);
+			if(ResultIsError(r)) return r;
+			int lseg = std::min((int)hdr->data.size(), c - i);
+			memcpy(hdr->data.data(), p + i, lseg);
+			hdr->length = lseg;
+			QueueHeader(hdr);
+			i += lseg;
+		}
+		return ResultOk;
+	}
+	void FakeQueuedMidiOutPort::QueueHeader(Header* hdr)
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back(hdr);
+		queueCond.notify_all();
+	}
+	uint64_t FakeQueuedMidiOutPort::GetSubmitCount() const
+	{
+		return submitCount;
+	}
+	ResultCode FakeQueuedMidiOutPort::AcquireSendBuffer(uint8_t** pp, int* capacity)
+	{
+		*pp = nullptr;
+		*capacity = 0;
+		if(!isOpen) return ResultBrokenPipe;
+		ResultCode r = freePool.Acquire(&lentHeader, sendTimeout);
+		if(ResultIsError(r)) return r;
+		*pp = lentHeader->data.data();
+		*capacity = (int)lentHeader->data.size();
+		return ResultOk;
+	}
+	ResultCode FakeQueuedMidiOutPort::SubmitSendBuffer(uint8_t* p, int c)
+	{
+		if(!lentHeader || (p != lentHeader->data.data())) return EINVAL;
+		Header* hdr = lentHeader;
+		lentHeader = nullptr;
+		hdr->length = std::min(c, (int)hdr->data.size());
+		++submitCount;
+		QueueHeader(hdr);
+		return ResultOk;
+	}
+	void FakeQueuedMidiOutPort::ReturnSendBuffer(uint8_t* p)
+	{
+		if(!lentHeader || (p != lentHeader->data.data())) return;
+		freePool.Return(lentHeader);
+		lentHeader = nullptr;
+	}
+	void FakeQueuedMidiOutPort::SetSendCancelled(bool v)
+	{
+		freePool.SetCancelled(v);
+	}
+	int64_t FakeQueuedMidiOutPort::GetBufferLowWater() const
+	{
+		return (int64_t)freePool.GetLowWater();
+	}
+
+	// ================================================================================
+	// FakeMidiInPort
+
+	void FakeMidiInPort::OpenDevice()
+	{
+		isOpen = true;
+	}
+	void FakeMidiInPort::CloseDevice()
+	{
+		isStarted = false;
+		isOpen = false;
+	}
+	bool FakeMidiInPort::Inject(const uint8_t* p, int c)
+	{
+		return Inject(p, c, std::chrono::steady_clock::now());
+	}
+	bool FakeMidiInPort::Inject(const uint8_t* p, int c, MidiTimestamp t)
+	{
+		if(!isStarted) return false;
+		if(OnMidiInReceived) OnMidiInReceived(p, c, t);
+		return true;
+	}
+	bool FakeMidiInPort::IsDeviceOpen() const
+	{
+		return isOpen;
+	}
+	ResultCode FakeMidiInPort::StartDevice()
+	{
+		if(!isOpen) return ResultBrokenPipe;
+		isStarted = true;
+		return ResultOk;
+	}
+	ResultCode FakeMidiInPort::StopDevice()
+	{
+		if(!isOpen) return ResultBrokenPipe;
+		isStarted = false;
+		return ResultOk;
+	}
+}
@@ -0,0 +1,177 @@
+//
+//  FakePorts.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "Transport.h"
+#include "MidiPort.h"
+#include "HeaderPool.h"
+#include "WorkerThread.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// in-memory full-duplex pipe with a bounded buffer per direction, behaves like a byte-mode named pipe
+
+	class MemoryPipe
+	{
+	private:
+		struct Channel
+		{
+			std::mutex mutex;
+			std::condition_variable cond;
+			std::vector<uint8_t> ring;
+			size_t head = 0;
+			size_t count = 0;
+			bool closed = false;
+		};
+	public:
+		class Endpoint : public ITransport
+		{
+		private:
+			Channel& rx;
+			Channel& tx;
+			bool readCancelled = false;	// guarded by rx.mutex
+			bool writeCancelled = false;	// guarded by tx.mutex
+		public:
+			Endpoint(Channel& r, Channel& t);
+			virtual ResultCode Read(uint8_t* p, int c, int* cr) override;
+			virtual ResultCode Write(const uint8_t* p, int c, int* cw) override;
+			virtual void SetReadCancelled(bool v) override;
+			virtual void SetWriteCancelled(bool v) override;
+			virtual bool IsBrokenPipe(ResultCode r) const override;
+		};
+	private:
+		Channel guestToHost;
+		Channel hostToGuest;
+		Endpoint guestEnd;
+		Endpoint hostEnd;
+	public:
+		MemoryPipe(size_t capacity = 4096);
+		MemoryPipe(const MemoryPipe&) = delete;
+		MemoryPipe& operator=(const MemoryPipe&) = delete;
+		// the side attached by the VM
+		Endpoint& GuestEnd();
+		// the side attached to the transfer engines
+		Endpoint& HostEnd();
+		// break the pipe, readers drain the remaining bytes and then fail with ResultBrokenPipe
+		void Close();
+		// discard the buffered bytes and reconnect
+		void Reset();
+	};
+
+	// ================================================================================
+	// MIDI out port that records what it receives
+
+	class FakeMidiOutPort : public IMidiOutPort
+	{
+	private:
+		mutable std::mutex mutex;
+		std::condition_variable cond;
+		std::vector<uint8_t> receivedData;
+		uint64_t byteCount = 0;
+		uint64_t sendCount = 0;
+		uint64_t shortSendCount = 0;
+		std::atomic<bool> isOpen{ false };
+		bool captureEnabled = true;
+	public:
+		// optional hook to emulate a slow or failing device, called before the bytes are recorded
+		std::function<ResultCode(const uint8_t* p, int c)> OnSend;
+		void OpenDevice();
+		void CloseDevice();
+		void SetCaptureEnabled(bool v);
+		std::vector<uint8_t> GetReceivedData() const;
+		uint64_t GetByteCount() const;
+		uint64_t GetSendCount() const;
+		uint64_t GetShortSendCount() const;
+		bool WaitForBytes(uint64_t n, std::chrono::nanoseconds timeout);
+		void Clear();
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		virtual ResultCode SendShortMessage(uint32_t msg) override;
+		virtual bool IsShortMessageConcurrent() const override;
+	};
+
+	// ================================================================================
+	// MIDI out port modeled on an MME device: a fixed set of buffers is queued to a driver thread
+	// that drains them at the wire rate and hands them back, Send() blocks while all buffers are in flight
+
+	class FakeQueuedMidiOutPort : public IMidiOutPort, private WorkerThread
+	{
+	private:
+		struct Header
+		{
+			std::vector<uint8_t> data;
+			int length = 0;
+		};
+		std::vector<std::unique_ptr<Header> > hdrList;
+		HeaderPool<Header> freePool;
+		std::mutex queueMutex;
+		std::condition_variable queueCond;
+		std::deque<Header*> queue;
+		mutable std::mutex recordMutex;
+		std::condition_variable recordCond;
+		std::vector<uint8_t> receivedData;
+		uint64_t byteCount = 0;
+		std::atomic<bool> isOpen{ false };
+		std::atomic<double> bytesPerSecond{ 0 };
+		std::chrono::milliseconds sendTimeout{ 2000 };
+		Header* lentHeader = nullptr;
+		std::atomic<uint64_t> submitCount{ 0 };
+		void QueueHeader(Header* hdr);
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+	public:
+		FakeQueuedMidiOutPort(int numbuffers = 16, int buffersize = 256);
+		virtual ~FakeQueuedMidiOutPort() override;
+		// 0 drains as fast as possible, 3125 is the MIDI 1.0 wire rate
+		void SetBytesPerSecond(double v);
+		// how long Send() waits for a buffer, 0 restores the fail-fast behavior
+		void SetSendTimeout(std::chrono::milliseconds t);
+		void OpenDevice();
+		// discards the queued buffers like midiOutReset()
+		void CloseDevice();
+		std::vector<uint8_t> GetReceivedData() const;
+		uint64_t GetByteCount() const;
+		uint64_t GetWaitCount() const;
+		bool WaitForBytes(uint64_t n, std::chrono::nanoseconds timeout);
+		virtual bool IsDeviceOpen() const override;
+		// buffers handed over through SubmitSendBuffer()
+		uint64_t GetSubmitCount() const;
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		virtual ResultCode AcquireSendBuffer(uint8_t** pp, int* capacity) override;
+		virtual ResultCode SubmitSendBuffer(uint8_t* p, int c) override;
+		virtual void ReturnSendBuffer(uint8_t* p) override;
+		virtual void SetSendCancelled(bool v) override;
+		virtual int64_t GetBufferLowWater() const override;
+	};
+
+	// ================================================================================
+	// MIDI in port driven by the test, Inject() plays the role of the driver callback
+
+	class FakeMidiInPort : public IMidiInPort
+	{
+	private:
+		std::atomic<bool> isOpen{ false };
+		std::atomic<bool> isStarted{ false };
+	public:
+		void OpenDevice();
+		void CloseDevice();
+		bool Inject(const uint8_t* p, int c);
+		bool Inject(const uint8_t* p, int c, MidiTimestamp t);
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode StartDevice() override;
+		virtual ResultCode StopDevice() override;
+	};
+}
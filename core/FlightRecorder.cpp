@@ -0,0 +1,180 @@
+//
+//  FlightRecorder.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "FlightRecorder.h"
+#include <bit>
+#include <fstream>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// FlightRecorder
+
+	static bool IsValidLogHeader(const FlightLogHeader& h, uint64_t capacity)
+	{
+		return (memcmp(h.magic, FlightLogHeader::Magic, sizeof(h.magic)) == 0)
+			&& (h.version == FlightLogHeader::CurrentVersion)
+			&& (h.headerSize == sizeof(FlightLogHeader))
+			&& ((capacity == 0) ? std::has_single_bit(h.capacity) : (h.capacity == capacity));
+	}
+
+	FlightRecorder::FlightRecorder()
+	{
+	}
+	FlightRecorder::~FlightRecorder()
+	{
+		Close();
+	}
+	ResultCode FlightRecorder::Open(const std::filesystem::path& path, size_t cap)
+	{
+		Close();
+		uint64_t newcapacity = std::bit_ceil((uint64_t)std::max(cap, MinCapacity));
+		size_t size = (size_t)(sizeof(FlightLogHeader) + newcapacity);
+#if defined(_WIN32)
+		hFile = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(hFile == INVALID_HANDLE_VALUE) { hFile = nullptr; return (ResultCode)GetLastError(); }
+		hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+		if(!hMapping) { ResultCode r = (ResultCode)GetLastError(); Close(); return r; }
+		void* view = MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
+		if(!view) { ResultCode r = (ResultCode)GetLastError(); Close(); return r; }
+#else
+		fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if(fd < 0) return errno;
+		struct stat st;
+		if((fstat(fd, &st) != 0) || ((st.st_size != (off_t)size) && (ftruncate(fd, (off_t)size) != 0))) { ResultCode r = errno; Close(); return r; }
+		void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(view == MAP_FAILED) { ResultCode r = errno; Close(); return r; }
+#endif
+		mappedSize = size;
+		header = static_cast<FlightLogHeader*>(view);
+		if(!IsValidLogHeader(*header, newcapacity))
+		{
+			// a fresh log, the stale data area is harmless since no position in it matches its place
+			memset(header, 0, sizeof(FlightLogHeader));
+			memcpy(header->magic, FlightLogHeader::Magic, sizeof(header->magic));
+			header->version = FlightLogHeader::CurrentVersion;
+			header->headerSize = sizeof(FlightLogHeader);
+			header->capacity = newcapacity;
+			header->cursor = 0;
+		}
+		// re-anchored on every open, the timestamps of an earlier run map to wall time only roughly after a reboot
+		header->steadyOrigin = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		header->systemOrigin = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		capacity = newcapacity;
+		data = reinterpret_cast<uint8_t*>(header) + sizeof(FlightLogHeader);
+		return ResultOk;
+	}
+	void FlightRecorder::Close()
+	{
+		data = nullptr;
+		capacity = 0;
+#if defined(_WIN32)
+		if(header) UnmapViewOfFile(header);
+		if(hMapping) CloseHandle(hMapping);
+		if(hFile) CloseHandle(hFile);
+		hMapping = nullptr;
+		hFile = nullptr;
+#else
+		if(header) munmap(header, mappedSize);
+		if(fd >= 0) close(fd);
+		fd = -1;
+#endif
+		header = nullptr;
+		mappedSize = 0;
+	}
+	bool FlightRecorder::IsOpen() const
+	{
+		return data != nullptr;
+	}
+	uint64_t FlightRecorder::GetCapacity() const
+	{
+		return capacity;
+	}
+	uint64_t FlightRecorder::GetCursor() const
+	{
+		return header ? std::atomic_ref<uint64_t>(header->cursor).load(std::memory_order_relaxed) : 0;
+	}
+	ResultCode FlightRecorder::Flush()
+	{
+		if(!header) return ResultOk;
+#if defined(_WIN32)
+		if(!FlushViewOfFile(header, mappedSize)) return (ResultCode)GetLastError();
+#else
+		if(msync(header, mappedSize, MS_SYNC) != 0) return errno;
+#endif
+		return ResultOk;
+	}
+
+	// ================================================================================
+	// FlightLogReader
+
+	void FlightLogReader::CopyOut(uint64_t position, void* p, size_t c) const
+	{
+		size_t offset = (size_t)(position & (header.capacity - 1));
+		size_t lseg = std::min(c, (size_t)header.capacity - offset);
+		memcpy(p, area.data() + offset, lseg);
+		if(lseg < c) memcpy((uint8_t*)p + lseg, area.data(), c - lseg);
+	}
+	ResultCode FlightLogReader::Open(const std::filesystem::path& path)
+	{
+		header = {};
+		area.clear();
+		std::ifstream ifs(path, std::ios::binary);
+		if(!ifs) return ENOENT;
+		if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) || !IsValidLogHeader(header, 0)) { header = {}; return EINVAL; }
+		area.resize((size_t)header.capacity);
+		if(!ifs.read(reinterpret_cast<char*>(area.data()), (std::streamsize)area.size())) { header = {}; area.clear(); return EINVAL; }
+		return ResultOk;
+	}
+	const FlightLogHeader& FlightLogReader::GetHeader() const
+	{
+		return header;
+	}
+	void FlightLogReader::ForEach(const std::function<void(const FlightRecordView&)>& sink)
+	{
+		skippedBytes = 0;
+		if(area.empty()) return;
+		uint64_t end = header.cursor;
+		uint64_t position = (end > header.capacity) ? end - header.capacity : 0;
+		FlightRecordView view;
+		while(position + sizeof(FlightRecordHeader) <= end)
+		{
+			FlightRecordHeader rh;
+			CopyOut(position, &rh, sizeof(rh));
+			uint64_t size = FlightRecorder::GetRecordSize(rh.length);
+			bool intact = (rh.position == position) && (rh.length <= FlightRecorder::MaxRecordBytes) && (rh.direction <= (uint8_t)FlightDirection::MidiToPipe) && (position + size <= end);
+			if(!intact)
+			{
+				position += 8;
+				skippedBytes += 8;
+				continue;
+			}
+			view.position = position;
+			view.timestamp = rh.timestamp;
+			view.direction = (FlightDirection)rh.direction;
+			view.flags = rh.flags;
+			view.source = rh.source;
+			view.data.resize(rh.length);
+			CopyOut(position + sizeof(rh), view.data.data(), rh.length);
+			sink(view);
+			position += size;
+		}
+	}
+	uint64_t FlightLogReader::GetSkippedBytes() const
+	{
+		return skippedBytes;
+	}
+}
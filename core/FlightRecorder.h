@@ -0,0 +1,169 @@
+//
+//  FlightRecorder.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// on-disk format, little endian, every record starts at a multiple of 8 bytes of the data area
+	//
+	// [FlightLogHeader][data area of capacity bytes, used as a ring]
+	// a record is [FlightRecordHeader][length bytes][padding to 8], it may wrap around the end of the data area.
+	// the header's position field is the record's logical offset in the endless stream and is stored last,
+	// so a record whose position does not match where it sits was overwritten or never completed.
+
+	struct FlightLogHeader
+	{
+		static constexpr char Magic[8] = { 'M', 'P', 'B', 'F', 'L', 'O', 'G', '1' };
+		static constexpr uint32_t CurrentVersion = 1;
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint64_t capacity;
+		// logical end of the stream, records are reserved by advancing it atomically
+		uint64_t cursor;
+		// the same instant on steady_clock and system_clock in nanoseconds, maps the record timestamps to wall time
+		int64_t steadyOrigin;
+		int64_t systemOrigin;
+		uint64_t reserved[2];
+	};
+	static_assert(sizeof(FlightLogHeader) == 64);
+
+	enum class FlightDirection : uint8_t { PipeToMidi = 0, MidiToPipe = 1 };
+
+	struct FlightRecordHeader
+	{
+		static constexpr uint8_t FlagTruncated = 0x01;
+		uint64_t position;
+		// steady_clock nanoseconds, the pipe read completion or the driver's source timestamp
+		int64_t timestamp;
+		uint32_t length;
+		uint8_t direction;
+		uint8_t flags;
+		// the client slot a pipe message came from in the multi-client mode, 0 otherwise
+		uint16_t source;
+	};
+	static_assert(sizeof(FlightRecordHeader) == 24);
+
+	// ================================================================================
+	// writer
+
+	//
+	// always-on capture of the bridged traffic into a memory-mapped, fixed-size circular log file.
+	// Record() reserves its space with one atomic add on the mapped cursor and copies the message in,
+	// no lock and no system call, so any number of engine threads and driver callbacks may record at once.
+	// the pages belong to the file mapping, a crashed process leaves them to the kernel to write back.
+	// a writer held off for a whole lap of the ring between its reservation and its commit can garble newer records,
+	// so the capacity is meant to hold minutes of traffic, not milliseconds.
+	// result codes are errno values on POSIX and GetLastError() values on Windows.
+	//
+	class FlightRecorder
+	{
+	public:
+		// a longer message (a SysEx dump) keeps its first bytes and is flagged truncated
+		static constexpr uint32_t MaxRecordBytes = 4096;
+		static constexpr size_t MinCapacity = 64 * 1024;
+		static constexpr size_t DefaultCapacity = 16 * 1024 * 1024;
+	private:
+		FlightLogHeader* header = nullptr;
+		uint8_t* data = nullptr;
+		uint64_t capacity = 0;
+#if defined(_WIN32)
+		void* hFile = nullptr;
+		void* hMapping = nullptr;
+#else
+		int fd = -1;
+#endif
+		size_t mappedSize = 0;
+		void CopyIn(uint64_t position, const void* p, size_t c)
+		{
+			size_t offset = (size_t)(position & (capacity - 1));
+			size_t lseg = std::min(c, (size_t)capacity - offset);
+			memcpy(data + offset, p, lseg);
+			if(lseg < c) memcpy(data, (const uint8_t*)p + lseg, c - lseg);
+		}
+	public:
+		FlightRecorder();
+		~FlightRecorder();
+		FlightRecorder(const FlightRecorder&) = delete;
+		FlightRecorder& operator=(const FlightRecorder&) = delete;
+		// the capacity is rounded up to a power of two, an existing log of the same capacity is appended to, anything else is started over
+		ResultCode Open(const std::filesystem::path& path, size_t capacity = DefaultCapacity);
+		// the engines must have been detached
+		void Close();
+		bool IsOpen() const;
+		uint64_t GetCapacity() const;
+		// bytes reserved since the log was created, including what has wrapped away
+		uint64_t GetCursor() const;
+		// hot path, a no-op while closed
+		void Record(FlightDirection d, const uint8_t* p, int c, std::chrono::steady_clock::time_point t, uint16_t source = 0)
+		{
+			if(!data || (c <= 0)) return;
+			uint32_t n = ((uint32_t)c > MaxRecordBytes) ? MaxRecordBytes : (uint32_t)c;
+			uint64_t size = GetRecordSize(n);
+			uint64_t position = std::atomic_ref<uint64_t>(header->cursor).fetch_add(size, std::memory_order_relaxed);
+			FlightRecordHeader rh;
+			rh.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+			rh.length = n;
+			rh.direction = (uint8_t)d;
+			rh.flags = (n < (uint32_t)c) ? FlightRecordHeader::FlagTruncated : 0;
+			rh.source = source;
+			CopyIn(position + sizeof(rh.position), &rh.timestamp, sizeof(rh) - sizeof(rh.position));
+			CopyIn(position + sizeof(rh), p, n);
+			// the position goes in last, a reader that finds it in place finds the whole record
+			std::atomic_ref<uint64_t>(*(uint64_t*)(data + (position & (capacity - 1)))).store(position, std::memory_order_release);
+		}
+		// writes the dirty pages back now, not needed for crash safety, only against a power loss
+		ResultCode Flush();
+		static uint64_t GetRecordSize(uint32_t length)
+		{
+			return (sizeof(FlightRecordHeader) + (uint64_t)length + 7) & ~(uint64_t)7;
+		}
+	};
+
+	// ================================================================================
+	// offline reader
+
+	struct FlightRecordView
+	{
+		uint64_t position = 0;
+		int64_t timestamp = 0;
+		FlightDirection direction = FlightDirection::PipeToMidi;
+		uint8_t flags = 0;
+		uint16_t source = 0;
+		std::vector<uint8_t> data;
+	};
+
+	class FlightLogReader
+	{
+	private:
+		FlightLogHeader header = {};
+		std::vector<uint8_t> area;
+		uint64_t skippedBytes = 0;
+		void CopyOut(uint64_t position, void* p, size_t c) const;
+	public:
+		// reads a copy of the file, a log that is being written may be read too, its newest records may be incomplete
+		ResultCode Open(const std::filesystem::path& path);
+		const FlightLogHeader& GetHeader() const;
+		// walks the records still held by the ring from the oldest to the newest,
+		// a record that was overwritten or torn is skipped and the walk resynchronizes on the next intact one
+		void ForEach(const std::function<void(const FlightRecordView&)>& sink);
+		// bytes passed over by the last ForEach()
+		uint64_t GetSkippedBytes() const;
+	};
+}
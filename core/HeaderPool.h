@@ -0,0 +1,122 @@
+//
+//  HeaderPool.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace MidiBridgeCore
+{
+	//
+	// free list of output buffers that the device driver hands back on completion.
+	// Acquire() blocks until a buffer comes back, so a slow device throttles the pipe reader instead of failing the stream.
+	//
+	// NOTE:
+	// Release() runs on the driver callback and Acquire() on the pipe reader, the buffers pass through a lock-free ring.
+	// The mutex is only taken when the reader actually has to sleep, and by Release() when it sees a sleeper.
+	//
+	template<typename T> class HeaderPool
+	{
+	private:
+		SpscRing<T*> freeRing;
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::atomic<bool> waiting{ false };
+		std::atomic<bool> cancelled{ false };
+		std::atomic<uint64_t> waitCount{ 0 };
+		std::atomic<size_t> lowWater{ SIZE_MAX };
+		// a buffer the consumer acquired and gave back unused, kept out of the ring which has only one producer
+		std::atomic<T*> returned{ nullptr };
+		void NoteLowWater()
+		{
+			size_t n = freeRing.GetCount();
+			if(n < lowWater.load(std::memory_order_relaxed)) lowWater.store(n, std::memory_order_relaxed);
+		}
+	public:
+		HeaderPool(size_t capacity = 0) : freeRing(capacity)
+		{
+		}
+		// not thread safe, call before the device is opened, the pool holds at least this many buffers
+		void SetCapacity(size_t capacity)
+		{
+			freeRing.Reset(capacity);
+			lowWater = SIZE_MAX;
+		}
+		// consumer side, call after the device has stopped calling back
+		void Clear()
+		{
+			T* p = nullptr;
+			while(freeRing.Pop(&p)) {}
+			returned = nullptr;
+		}
+		// called on the driver's completion callback, or when the buffer is first prepared
+		void Release(T* p)
+		{
+			freeRing.Push(p);
+			// pairs with the fence in Acquire(), either the sleeper sees the buffer or we see the sleeper
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(waiting.load(std::memory_order_relaxed))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				cond.notify_one();
+			}
+		}
+		// a zero timeout fails immediately when the pool is empty
+		ResultCode Acquire(T** pp, std::chrono::milliseconds timeout)
+		{
+			*pp = nullptr;
+			if(cancelled) return ResultCancelled;
+			if((*pp = returned.exchange(nullptr)) != nullptr) return ResultOk;
+			if(freeRing.Pop(pp)) { NoteLowWater(); return ResultOk; }
+			if(timeout.count() <= 0) return ResultTimedOut;
+			++waitCount;
+			std::unique_lock<std::mutex> lock(mutex);
+			waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			bool ready = cond.wait_for(lock, timeout, [this]() { return cancelled || !freeRing.IsEmpty(); });
+			waiting.store(false, std::memory_order_relaxed);
+			if(cancelled) return ResultCancelled;
+			if(!ready) return ResultTimedOut;
+			freeRing.Pop(pp);
+			NoteLowWater();
+			return ResultOk;
+		}
+		// consumer side, a buffer that was acquired but not submitted, the next Acquire() takes it first
+		void Return(T* p)
+		{
+			returned = p;
+		}
+		// wakes a blocked Acquire(), sticky until reset like ITransport::SetReadCancelled()
+		void SetCancelled(bool v)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = v;
+			cond.notify_all();
+		}
+		size_t GetFreeCount() const
+		{
+			return freeRing.GetCount() + (returned.load() ? 1 : 0);
+		}
+		// the fewest buffers left free right after an Acquire(), the current count before the first one
+		size_t GetLowWater() const
+		{
+			size_t n = lowWater.load(std::memory_order_relaxed);
+			return (n == SIZE_MAX) ? freeRing.GetCount() : n;
+		}
+		// how many times Acquire() had to wait for the device
+		uint64_t GetWaitCount() const
+		{
+			return waitCount;
+		}
+	};
+}
@@ -0,0 +1,150 @@
+//
+//  MessageFilter.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "MessageFilter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <variant>
+
+namespace MidiBridgeCore
+{
+	static std::vector<std::string> SplitString(const std::string& s, char sep)
+	{
+		std::vector<std::string> v;
+		size_t i = 0;
+		while(i <= s.size())
+		{
+			size_t j = s.find(sep, i);
+			if(j == std::string::npos) j = s.size();
+			if(j > i) v.push_back(s.substr(i, j - i));
+			i = j + 1;
+		}
+		return v;
+	}
+
+	static bool ParseInt(const std::string& s, int base, int lo, int hi, int* v)
+	{
+		if(s.empty()) return false;
+		char* end = nullptr;
+		long n = std::strtol(s.c_str(), &end, base);
+		if((*end != '\0') || (n < lo) || (n > hi)) return false;
+		*v = (int)n;
+		return true;
+	}
+
+	// "a" or "a-b"
+	static bool ParseRange(const std::string& s, int lo, int hi, int* a, int* b)
+	{
+		size_t dash = s.find('-', 1);
+		if(dash == std::string::npos) { if(!ParseInt(s, 10, lo, hi, a)) return false; *b = *a; return true; }
+		return ParseInt(s.substr(0, dash), 10, lo, hi, a) && ParseInt(s.substr(dash + 1), 10, lo, hi, b) && (*a <= *b);
+	}
+
+	using StockStage = std::variant<DropRealTime, DropSysEx, KeepChannels, RemapChannels, ClampVelocity, Transpose>;
+	// the longest chain instantiated for every order of the stock stages, 6 + 36 + 216 of them
+	static constexpr size_t MaxStaticStages = 3;
+
+	template<typename... Stages> static std::unique_ptr<IMessageFilter> MakeStaticChain(const StockStage* p, size_t n, const Stages&... s);
+
+	// appends the stage at p, whose type is the I-th alternative or a later one, and goes on with the rest
+	template<size_t I, typename... Stages> static std::unique_ptr<IMessageFilter> AppendStage(const StockStage* p, size_t n, const Stages&... s)
+	{
+		if constexpr(I + 1 < std::variant_size_v<StockStage>) { if(p->index() != I) return AppendStage<I + 1>(p, n, s...); }
+		return MakeStaticChain(p + 1, n - 1, s..., std::get<I>(*p));
+	}
+
+	// the static chain of the stages s followed by the n stages at p
+	template<typename... Stages> static std::unique_ptr<IMessageFilter> MakeStaticChain(const StockStage* p, size_t n, const Stages&... s)
+	{
+		if constexpr(sizeof...(Stages) < MaxStaticStages) { if(n > 0) return AppendStage<0>(p, n, s...); }
+		return std::make_unique<StaticMessageFilter<Stages...> >(s...);
+	}
+
+	ResultCode ParseMessageFilter(const std::string& spec, std::unique_ptr<IMessageFilter>* filter)
+	{
+		filter->reset();
+		std::vector<std::string> tokens = SplitString(spec, ';');
+		if(tokens.empty()) return ResultOk;
+		std::vector<StockStage> stages;
+		auto add = [&](auto stage) { stages.push_back(stage); };
+		for(const auto& token : tokens)
+		{
+			size_t colon = token.find(':');
+			std::string name = token.substr(0, colon);
+			std::vector<std::string> args = (colon == std::string::npos) ? std::vector<std::string>() : SplitString(token.substr(colon + 1), ',');
+			if(name == "droprt")
+			{
+				DropRealTime s;
+				if(!args.empty()) s.mask = 0;
+				for(const auto& a : args)
+				{
+					int stat;
+					if(!ParseInt(a, 16, 0xf8, 0xff, &stat)) return EINVAL;
+					s.mask |= DropRealTime::Bit((uint8_t)stat);
+				}
+				add(s);
+			}
+			else if(name == "dropsysex")
+			{
+				if(!args.empty()) return EINVAL;
+				add(DropSysEx());
+			}
+			else if(name == "channels")
+			{
+				KeepChannels s;
+				s.mask = 0;
+				for(const auto& a : args)
+				{
+					int c0, c1;
+					if(!ParseRange(a, 1, 16, &c0, &c1)) return EINVAL;
+					for(int c = c0; c <= c1; ++c) s.mask |= (uint16_t)(1u << (c - 1));
+				}
+				if(!s.mask) return EINVAL;
+				add(s);
+			}
+			else if(name == "remap")
+			{
+				RemapChannels s;
+				if(args.empty()) return EINVAL;
+				for(const auto& a : args)
+				{
+					size_t gt = a.find('>');
+					int from, to;
+					if((gt == std::string::npos) || !ParseInt(a.substr(0, gt), 10, 1, 16, &from) || !ParseInt(a.substr(gt + 1), 10, 1, 16, &to)) return EINVAL;
+					s.map[from - 1] = (uint8_t)(to - 1);
+				}
+				add(s);
+			}
+			else if(name == "velocity")
+			{
+				int lo, hi;
+				if((args.size() != 1) || !ParseRange(args[0], 1, 127, &lo, &hi)) return EINVAL;
+				ClampVelocity s;
+				s.lo = (uint8_t)lo;
+				s.hi = (uint8_t)hi;
+				add(s);
+			}
+			else if(name == "transpose")
+			{
+				Transpose s;
+				if((args.size() != 1) || !ParseInt(args[0], 10, -127, 127, &s.semitones)) return EINVAL;
+				add(s);
+			}
+			else return EINVAL;
+		}
+		if(stages.size() <= MaxStaticStages)
+		{
+			*filter = MakeStaticChain(stages.data(), stages.size());
+			return ResultOk;
+		}
+		auto chain = std::make_unique<DynamicMessageFilter>();
+		for(size_t i = 0; i < stages.size(); i += MaxStaticStages) chain->AddFilter(MakeStaticChain(stages.data() + i, std::min(MaxStaticStages, stages.size() - i)));
+		*filter = std::move(chain);
+		return ResultOk;
+	}
+}
@@ -0,0 +1,192 @@
+//
+//  MessageFilter.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiFramer.h"
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// filter and transform stages between the framer and the output:
+	// a stage is a callable bool(MidiMessage& m, uint8_t* w), false drops the message.
+	// a short message arrives as a writable copy, m.data == w, which the stage may rewrite (not resize),
+	// a SysEx segment arrives read-only with w == nullptr and can only be passed or dropped.
+	// StaticMessageFilter composes stages at compile time into one inlined expression,
+	// DynamicMessageFilter chains them, or such compositions, at run time one virtual call per link.
+	//
+
+	struct IMessageFilter
+	{
+		virtual ~IMessageFilter() {}
+		// may be called from several engine threads at once, the stock stages keep no state
+		virtual bool Process(MidiMessage& m, uint8_t* w) = 0;
+		bool operator()(MidiMessage& m, uint8_t* w) { return Process(m, w); }
+	};
+
+	// runs a framed message through a filter, true when it passes with out ready to dispatch
+	template<typename Filter> inline bool ApplyMessageFilter(Filter& f, const MidiMessage& in, MidiMessage& out, uint8_t (&w)[3])
+	{
+		out = in;
+		if(in.kind == MidiMessageKind::SysEx) return f(out, nullptr);
+		memcpy(w, in.data, (size_t)in.length);
+		out.data = w;
+		return f(out, w);
+	}
+
+	// what the framer would have said about a message that comes whole from a driver callback.
+	// a lone F7 is the end of a SysEx whose bytes came in an earlier callback
+	inline MidiMessage ClassifyMidiMessage(const uint8_t* p, int c)
+	{
+		MidiMessage m;
+		m.data = p;
+		m.length = c;
+		if((c > 3) || (p[0] == 0xf0) || (p[0] == 0xf7) || (p[0] < 0x80))
+		{
+			m.kind = MidiMessageKind::SysEx;
+			m.sysexFlags = (uint8_t)(((p[0] == 0xf0) ? SysExBegin : 0) | ((p[c - 1] == 0xf7) ? SysExEnd : 0));
+		}
+		else if(MidiFramer::IsRealTime(p[0]))	m.kind = MidiMessageKind::RealTime;
+		else if(p[0] >= 0xf0)					m.kind = MidiMessageKind::SystemCommon;
+		else									m.kind = MidiMessageKind::Channel;
+		return m;
+	}
+
+	// ================================================================================
+	// stock stages
+
+	// drops the real-time statuses whose bit is set, bit n is status F8 + n
+	struct DropRealTime
+	{
+		static constexpr uint8_t Bit(uint8_t stat) { return (uint8_t)(1u << (stat - 0xf8)); }
+		// timing clock and active sensing, the chatter of old sequencers
+		static constexpr uint8_t DefaultMask = 0x41;
+		uint8_t mask = DefaultMask;
+		bool operator()(MidiMessage& m, uint8_t*) const
+		{
+			return (m.kind != MidiMessageKind::RealTime) || !(mask & Bit(m.data[0]));
+		}
+	};
+
+	struct DropSysEx
+	{
+		bool operator()(MidiMessage& m, uint8_t*) const
+		{
+			return m.kind != MidiMessageKind::SysEx;
+		}
+	};
+
+	// passes the channel messages of the channels whose bit is set, bit 0 is channel 1
+	struct KeepChannels
+	{
+		uint16_t mask = 0xffff;
+		bool operator()(MidiMessage& m, uint8_t*) const
+		{
+			return (m.kind != MidiMessageKind::Channel) || (mask & (1u << (m.data[0] & 0x0f)));
+		}
+	};
+
+	struct RemapChannels
+	{
+		uint8_t map[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+		bool operator()(MidiMessage& m, uint8_t* w) const
+		{
+			if(m.kind == MidiMessageKind::Channel) w[0] = (uint8_t)((w[0] & 0xf0) | map[w[0] & 0x0f]);
+			return true;
+		}
+	};
+
+	// note-on velocities into [lo, hi], a note-on with velocity 0 stays a note-off
+	struct ClampVelocity
+	{
+		uint8_t lo = 1;
+		uint8_t hi = 127;
+		bool operator()(MidiMessage& m, uint8_t* w) const
+		{
+			if((m.kind == MidiMessageKind::Channel) && ((w[0] & 0xf0) == 0x90) && w[2]) w[2] = (w[2] < lo) ? lo : (w[2] > hi) ? hi : w[2];
+			return true;
+		}
+	};
+
+	// shifts note on, note off and poly aftertouch, a note pushed out of 0..127 is dropped
+	struct Transpose
+	{
+		int semitones = 0;
+		bool operator()(MidiMessage& m, uint8_t* w) const
+		{
+			if((m.kind != MidiMessageKind::Channel) || ((w[0] & 0xf0) > 0xa0)) return true;
+			int note = w[1] + semitones;
+			w[1] = (uint8_t)note;
+			return (unsigned)note < 128;
+		}
+	};
+
+	// ================================================================================
+	// chains
+
+	template<typename... Stages> class StaticMessageFilter : public IMessageFilter
+	{
+	private:
+		std::tuple<Stages...> stages;
+	public:
+		StaticMessageFilter() {}
+		explicit StaticMessageFilter(Stages... s) requires (sizeof...(Stages) > 0) : stages(std::move(s)...) {}
+		template<size_t I> auto& GetStage() { return std::get<I>(stages); }
+		// stops at the first stage that drops, no stages passes everything
+		bool operator()(MidiMessage& m, uint8_t* w)
+		{
+			return std::apply([&](auto&... s) { return (true && ... && s(m, w)); }, stages);
+		}
+		virtual bool Process(MidiMessage& m, uint8_t* w) override final
+		{
+			return (*this)(m, w);
+		}
+	};
+
+	class DynamicMessageFilter : public IMessageFilter
+	{
+	private:
+		std::vector<std::unique_ptr<IMessageFilter> > stages;
+	public:
+		template<typename Stage> void AddStage(Stage s)
+		{
+			stages.push_back(std::make_unique<StaticMessageFilter<Stage> >(std::move(s)));
+		}
+		void AddFilter(std::unique_ptr<IMessageFilter> f)
+		{
+			stages.push_back(std::move(f));
+		}
+		size_t GetStageCount() const
+		{
+			return stages.size();
+		}
+		bool operator()(MidiMessage& m, uint8_t* w)
+		{
+			for(auto&& s : stages) { if(!s->Process(m, w)) return false; }
+			return true;
+		}
+		virtual bool Process(MidiMessage& m, uint8_t* w) override
+		{
+			return (*this)(m, w);
+		}
+	};
+
+	//
+	// builds a filter from a spec such as "droprt:f8,fe;channels:1-9,16;remap:10>16;velocity:1-100;transpose:-12;dropsysex",
+	// the stages run in the order given, channels are 1-based, real-time statuses are hex. droprt alone means F8 and FE.
+	// up to three stages become one StaticMessageFilter with nothing between them and the engine, a longer spec a
+	// DynamicMessageFilter of such chains, three stages to a virtual call. an empty spec gives nullptr.
+	// EINVAL on a syntax error
+	//
+	ResultCode ParseMessageFilter(const std::string& spec, std::unique_ptr<IMessageFilter>* filter);
+}
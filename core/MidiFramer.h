@@ -0,0 +1,188 @@
+//
+//  MidiFramer.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace MidiBridgeCore
+{
+	enum class MidiMessageKind : uint8_t
+	{
+		Channel,		// 8n..En, status byte always present (running status is expanded)
+		SystemCommon,	// F1..F6
+		RealTime,		// F8..FF
+		SysEx,			// a segment of F0 ... F7
+	};
+
+	enum MidiSysExFlags : uint8_t
+	{
+		SysExBegin = 0x01,	// the segment starts with F0
+		SysExEnd = 0x02,	// the last segment, ends with F7 unless the SysEx was terminated by another status byte.
+							// then it has no F7 and may be empty, MidiOutDispatcher adds one
+	};
+
+	struct MidiMessage
+	{
+		const uint8_t* data = nullptr;	// valid only during the sink call
+		int length = 0;
+		MidiMessageKind kind = MidiMessageKind::Channel;
+		uint8_t sysexFlags = 0;
+	};
+
+	//
+	// reassembles MIDI 1.0 messages from a byte stream that may be chunked at any position
+	// - short messages are collected in an internal buffer, SysEx is emitted as segments that point into the input chunk
+	// - real-time bytes are emitted immediately, also in the middle of a short message or a SysEx
+	// - no allocation, the sink is inlined
+	//
+	class MidiFramer
+	{
+	public:
+		static int GetShortMessageLength(uint8_t stat)
+		{
+			switch(stat & 0xf0)
+			{
+				case 0x80: // noteoff
+				case 0x90: // noteon
+				case 0xa0: // poly.aftertouch
+				case 0xb0: // control
+				case 0xe0: return 3; // pichbend
+				case 0xc0: // program
+				case 0xd0: return 2; // aftertouch
+			}
+			switch(stat)
+			{
+				case 0xf1: return 2; // MTC quarter frame
+				case 0xf2: return 3; // SPP
+				case 0xf3: return 2; // SS
+				case 0xf5: return 2; // port select, undefined in MIDI 1.0 but what the multi-port serial interfaces use
+			}
+			return 1;
+		}
+		static bool IsRealTime(uint8_t b)
+		{
+			return 0xf8 <= b;
+		}
+	private:
+		uint8_t shortMessage[3] = {};
+		int shortCount = 0;
+		int shortLength = 0;
+		uint8_t runningStatus = 0;
+		bool inSysEx = false;
+		bool sysexBegun = false;
+		uint64_t discardedBytes = 0;
+		template<typename Sink> void EmitSysEx(const uint8_t* p, int c, bool end, Sink& sink)
+		{
+			if((c <= 0) && !end) return;
+			MidiMessage m;
+			m.data = p;
+			m.length = c;
+			m.kind = MidiMessageKind::SysEx;
+			m.sysexFlags = (uint8_t)((sysexBegun ? 0 : SysExBegin) | (end ? SysExEnd : 0));
+			sysexBegun = true;
+			sink(m);
+		}
+		template<typename Sink> void EmitShort(MidiMessageKind kind, Sink& sink)
+		{
+			MidiMessage m;
+			m.data = shortMessage;
+			m.length = shortLength;
+			m.kind = kind;
+			sink(m);
+		}
+	public:
+		void Reset()
+		{
+			shortCount = 0;
+			shortLength = 0;
+			runningStatus = 0;
+			inSysEx = false;
+			sysexBegun = false;
+		}
+		bool IsInSysEx() const
+		{
+			return inSysEx;
+		}
+		uint64_t GetDiscardedBytes() const
+		{
+			return discardedBytes;
+		}
+		template<typename Sink> void Process(const uint8_t* p, int c, Sink&& sink)
+		{
+			int sysexStart = 0; // start of the pending SysEx run within this chunk
+			for(int i = 0; i < c; ++i)
+			{
+				uint8_t b = p[i];
+				if(IsRealTime(b))
+				{
+					if(inSysEx) { EmitSysEx(p + sysexStart, i - sysexStart, false, sink); sysexStart = i + 1; }
+					MidiMessage m;
+					m.data = p + i;
+					m.length = 1;
+					m.kind = MidiMessageKind::RealTime;
+					sink(m);
+					continue;
+				}
+				if(inSysEx)
+				{
+					if(b < 0x80) continue;
+					if(b == 0xf7)
+					{
+						EmitSysEx(p + sysexStart, i + 1 - sysexStart, true, sink);
+						inSysEx = false;
+						continue;
+					}
+					// any other status byte terminates the SysEx
+					EmitSysEx(p + sysexStart, i - sysexStart, true, sink);
+					inSysEx = false;
+				}
+				if(b == 0xf0)
+				{
+					discardedBytes += (uint64_t)shortCount;
+					shortCount = 0;
+					runningStatus = 0;
+					inSysEx = true;
+					sysexBegun = false;
+					sysexStart = i;
+					continue;
+				}
+				if(b == 0xf7)
+				{
+					// stray EOX
+					++discardedBytes;
+					continue;
+				}
+				if(b & 0x80)
+				{
+					discardedBytes += (uint64_t)shortCount;
+					shortMessage[0] = b;
+					shortCount = 1;
+					shortLength = GetShortMessageLength(b);
+					runningStatus = (b < 0xf0) ? b : 0;
+				}
+				else
+				{
+					if(shortCount == 0)
+					{
+						if(!runningStatus) { ++discardedBytes; continue; }
+						shortMessage[0] = runningStatus;
+						shortCount = 1;
+						shortLength = GetShortMessageLength(runningStatus);
+					}
+					shortMessage[shortCount++] = b;
+				}
+				if(shortCount >= shortLength)
+				{
+					EmitShort((shortMessage[0] < 0xf0) ? MidiMessageKind::Channel : MidiMessageKind::SystemCommon, sink);
+					shortCount = 0;
+				}
+			}
+			if(inSysEx) EmitSysEx(p + sysexStart, c - sysexStart, false, sink);
+		}
+	};
+}
@@ -0,0 +1,98 @@
+//
+//  MidiOutDispatcher.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "MidiOutDispatcher.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MidiBridgeCore
+{
+	MidiOutDispatcher::MidiOutDispatcher(int longbuffersize) : sysexBuffer(std::max(longbuffersize, 1))
+	{
+	}
+	void MidiOutDispatcher::SetMidiOutPort(IMidiOutPort* p)
+	{
+		midiOutPort = p;
+		Reset();
+	}
+	void MidiOutDispatcher::Reset()
+	{
+		sysexLength = 0;
+	}
+	ResultCode MidiOutDispatcher::Dispatch(const MidiMessage& m)
+	{
+		if((m.length <= 0) && !(m.sysexFlags & SysExEnd)) return ResultOk;
+		if(IsShortMessage(m))
+		{
+			shortSendCount.Add();
+			return midiOutPort->SendShortMessage(PackShortMessage(m));
+		}
+		int cap = (int)sysexBuffer.size();
+		int i = 0; while(i < m.length)
+		{
+			if(sysexLength == cap)
+			{
+				ResultCode r = Flush();
+				if(ResultIsError(r)) return r;
+			}
+			int lseg = std::min(cap - sysexLength, m.length - i);
+			memcpy(sysexBuffer.data() + sysexLength, m.data + i, lseg);
+			sysexLength += lseg;
+			i += lseg;
+		}
+		if(!(m.sysexFlags & SysExEnd)) return ResultOk;
+		// a SysEx cut off by another status byte is closed here, a receiver left inside it would swallow what follows
+		if((m.length == 0) || (m.data[m.length - 1] != 0xf7))
+		{
+			if(sysexLength == cap)
+			{
+				ResultCode r = Flush();
+				if(ResultIsError(r)) return r;
+			}
+			sysexBuffer[sysexLength++] = 0xf7;
+			closedCount.Add();
+		}
+		return Flush();
+	}
+	ResultCode MidiOutDispatcher::Flush()
+	{
+		if(sysexLength == 0) return ResultOk;
+		int c = sysexLength;
+		sysexLength = 0;
+		longSendCount.Add();
+		return midiOutPort->Send(sysexBuffer.data(), c);
+	}
+	ResultCode MidiOutDispatcher::SendInPlace(uint8_t* p, int c)
+	{
+		longSendCount.Add();
+		inPlaceSendCount.Add();
+		return midiOutPort->SubmitSendBuffer(p, c);
+	}
+	uint64_t MidiOutDispatcher::GetShortSendCount() const
+	{
+		return shortSendCount.Get();
+	}
+	uint64_t MidiOutDispatcher::GetLongSendCount() const
+	{
+		return longSendCount.Get();
+	}
+	uint64_t MidiOutDispatcher::GetInPlaceSendCount() const
+	{
+		return inPlaceSendCount.Get();
+	}
+	uint64_t MidiOutDispatcher::GetClosedSysExCount() const
+	{
+		return closedCount.Get();
+	}
+	void MidiOutDispatcher::ResetCounters()
+	{
+		shortSendCount.Reset();
+		longSendCount.Reset();
+		inPlaceSendCount.Reset();
+		closedCount.Reset();
+	}
+}
@@ -0,0 +1,64 @@
+//
+//  MidiOutDispatcher.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiFramer.h"
+#include "MidiPort.h"
+#include "Statistics.h"
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// routes framed messages to the cheapest output path:
+	// channel, system common and real-time messages go to the short message path, SysEx segments are gathered into long messages.
+	// a SysEx that another status byte cut off is closed with an F7 of its own
+	//
+	class MidiOutDispatcher
+	{
+	public:
+		static uint32_t PackShortMessage(const MidiMessage& m)
+		{
+			uint32_t v = m.data[0];
+			if(m.length > 1) v |= (uint32_t)m.data[1] << 8;
+			if(m.length > 2) v |= (uint32_t)m.data[2] << 16;
+			return v;
+		}
+		static bool IsShortMessage(const MidiMessage& m)
+		{
+			return m.kind != MidiMessageKind::SysEx;
+		}
+	private:
+		IMidiOutPort* midiOutPort = nullptr;
+		std::vector<uint8_t> sysexBuffer;
+		int sysexLength = 0;
+		RelaxedCounter shortSendCount;
+		RelaxedCounter longSendCount;
+		RelaxedCounter inPlaceSendCount;
+		RelaxedCounter closedCount;
+	public:
+		MidiOutDispatcher(int longbuffersize = 256);
+		void SetMidiOutPort(IMidiOutPort* p);
+		void Reset();
+		// the message must come from a MidiFramer, a SysEx segment is buffered until it ends or the buffer is full
+		ResultCode Dispatch(const MidiMessage& m);
+		// send the buffered SysEx bytes, called when the input chunk is exhausted
+		ResultCode Flush();
+		// a SysEx segment that already lies in a buffer lent by IMidiOutPort::AcquireSendBuffer(), nothing may be buffered
+		ResultCode SendInPlace(uint8_t* p, int c);
+		// safe to read while dispatching
+		uint64_t GetShortSendCount() const;
+		uint64_t GetLongSendCount() const;
+		// the long sends that went out without a copy, included in GetLongSendCount()
+		uint64_t GetInPlaceSendCount() const;
+		// SysEx cut off by a status byte and closed with an F7 that was not in the stream
+		uint64_t GetClosedSysExCount() const;
+		void ResetCounters();
+	};
+}
@@ -0,0 +1,151 @@
+//
+//  MidiOutMerger.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "MidiOutMerger.h"
+#include <algorithm>
+
+namespace MidiBridgeCore
+{
+	MidiOutMerger::MidiOutMerger(int numsources, int longbuffersize) : dispatcher(longbuffersize), sourceCancelled(std::max(numsources, 1), 0), sourceOrphaned(std::max(numsources, 1), 0)
+	{
+	}
+	ResultCode MidiOutMerger::InternalDispatch(const MidiMessage& m)
+	{
+		// without a port the messages are consumed, so the guests never stall
+		if(!midiOutPort) return ResultOk;
+		return dispatcher.Dispatch(m);
+	}
+	ResultCode MidiOutMerger::SendUnlocked(std::unique_lock<std::mutex>& lock, const MidiMessage* m)
+	{
+		// the port is this caller's while sending is set, the others wait on the flag and not on the lock held across the device
+		sending = true;
+		lock.unlock();
+		ResultCode r = m ? InternalDispatch(*m) : midiOutPort ? dispatcher.Flush() : ResultOk;
+		lock.lock();
+		sending = false;
+		cond.notify_all();
+		return r;
+	}
+	ResultCode MidiOutMerger::CloseSysEx(std::unique_lock<std::mutex>& lock)
+	{
+		static const uint8_t Eox = 0xf7;
+		MidiMessage m;
+		m.data = &Eox;
+		m.length = 1;
+		m.kind = MidiMessageKind::SysEx;
+		m.sysexFlags = SysExEnd;
+		ResultCode r = SendUnlocked(lock, &m);
+		sysexOwner = NoSource;
+		cond.notify_all();
+		return r;
+	}
+	void MidiOutMerger::SetMidiOutPort(IMidiOutPort* p)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		midiOutPort = p;
+		dispatcher.SetMidiOutPort(p);
+		sysexOwner = NoSource;
+		cond.notify_all();
+	}
+	ResultCode MidiOutMerger::Dispatch(int source, const MidiMessage& m)
+	{
+		if(m.kind == MidiMessageKind::RealTime)
+		{
+			// beside a send that is blocked on the device when the port takes it, after it otherwise
+			if(midiOutPort && midiOutPort->IsShortMessageConcurrent()) return dispatcher.Dispatch(m);
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this]() { return !sending; });
+			return SendUnlocked(lock, &m);
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		if(sourceOrphaned[source])
+		{
+			// the rest of a SysEx that was closed for the source while it stalled
+			if((m.kind == MidiMessageKind::SysEx) && !(m.sysexFlags & SysExBegin))
+			{
+				if(m.sysexFlags & SysExEnd) sourceOrphaned[source] = 0;
+				return ResultOk;
+			}
+			sourceOrphaned[source] = 0;
+		}
+		auto ready = [this, source]() { return sourceCancelled[source] || (!sending && ((sysexOwner == NoSource) || (sysexOwner == source))); };
+		while(!ready())
+		{
+			// the timeout runs while the owner is not sending, a send blocked on a slow device is not a stall
+			if(sending || (sysexOwnerTimeout.count() <= 0)) { cond.wait(lock); continue; }
+			cond.wait_until(lock, sysexOwnerActive + sysexOwnerTimeout);
+			if(sending || (sysexOwner == NoSource) || (sysexOwner == source) || sourceCancelled[source]) continue;
+			if(std::chrono::steady_clock::now() < sysexOwnerActive + sysexOwnerTimeout) continue;
+			sourceOrphaned[sysexOwner] = 1;
+			sysexTimeoutCount.Add();
+			CloseSysEx(lock);
+		}
+		if(sourceCancelled[source]) return ResultCancelled;
+		if(m.kind != MidiMessageKind::SysEx) return SendUnlocked(lock, &m);
+		// the SysEx holds the port until its end has been sent
+		sysexOwner = source;
+		ResultCode r = SendUnlocked(lock, &m);
+		sysexOwnerActive = std::chrono::steady_clock::now();
+		if(m.sysexFlags & SysExEnd) sysexOwner = NoSource;
+		return r;
+	}
+	ResultCode MidiOutMerger::Flush(int source)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if((sysexOwner != source) || !midiOutPort) return ResultOk;
+		cond.wait(lock, [this]() { return !sending; });
+		return SendUnlocked(lock, nullptr);
+	}
+	ResultCode MidiOutMerger::ReleaseSource(int source)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		sourceOrphaned[source] = 0;
+		if(sysexOwner != source) return ResultOk;
+		cond.wait(lock, [this]() { return !sending; });
+		if(sysexOwner != source) return ResultOk;
+		return CloseSysEx(lock);
+	}
+	void MidiOutMerger::SetSourceCancelled(int source, bool v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sourceCancelled[source] = v ? 1 : 0;
+		cond.notify_all();
+	}
+	void MidiOutMerger::SetSysExOwnerTimeout(std::chrono::milliseconds v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		sysexOwnerTimeout = v;
+		cond.notify_all();
+	}
+	std::chrono::milliseconds MidiOutMerger::GetSysExOwnerTimeout() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sysexOwnerTimeout;
+	}
+	int MidiOutMerger::GetSysExOwner() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sysexOwner;
+	}
+	uint64_t MidiOutMerger::GetSysExTimeoutCount() const
+	{
+		return sysexTimeoutCount.Get();
+	}
+	uint64_t MidiOutMerger::GetShortSendCount() const
+	{
+		return dispatcher.GetShortSendCount();
+	}
+	uint64_t MidiOutMerger::GetLongSendCount() const
+	{
+		return dispatcher.GetLongSendCount();
+	}
+	void MidiOutMerger::ResetCounters()
+	{
+		dispatcher.ResetCounters();
+		sysexTimeoutCount.Reset();
+	}
+}
@@ -0,0 +1,76 @@
+//
+//  MidiOutMerger.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiFramer.h"
+#include "MidiPort.h"
+#include "MidiOutDispatcher.h"
+#include "Statistics.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// merges the framed streams of several sources into one MIDI out port, message by message:
+	// - a SysEx holds the port from its first segment to its end, the other sources' messages wait. a source that stops
+	//   in the middle of its SysEx for longer than the owner timeout loses the port: the SysEx is closed with EOX for it
+	//   and the rest of it is dropped when it comes
+	// - real-time messages never wait for a SysEx, they may land between the segments of another source's SysEx.
+	//   on a port with IsShortMessageConcurrent() they do not wait for a send that is blocked on the device either
+	// - every other send is serialized, so the port sees one stream. the lock is not held across the device
+	//
+	class MidiOutMerger
+	{
+	public:
+		static constexpr int NoSource = -1;
+		static constexpr std::chrono::milliseconds DefaultSysExOwnerTimeout{ 1000 };
+	private:
+		mutable std::mutex mutex;
+		std::condition_variable cond;
+		MidiOutDispatcher dispatcher;
+		IMidiOutPort* midiOutPort = nullptr;
+		std::vector<uint8_t> sourceCancelled;
+		// the source's SysEx was closed for it, its segments are dropped until the next message
+		std::vector<uint8_t> sourceOrphaned;
+		int sysexOwner = NoSource;
+		std::chrono::steady_clock::time_point sysexOwnerActive{};
+		std::chrono::milliseconds sysexOwnerTimeout = DefaultSysExOwnerTimeout;
+		bool sending = false;
+		RelaxedCounter sysexTimeoutCount;
+		ResultCode InternalDispatch(const MidiMessage& m);
+		// sends the message or flushes the buffered SysEx with nullptr, the lock is released meanwhile
+		ResultCode SendUnlocked(std::unique_lock<std::mutex>& lock, const MidiMessage* m);
+		// ends the owner's SysEx with EOX and frees the port, the lock is released meanwhile
+		ResultCode CloseSysEx(std::unique_lock<std::mutex>& lock);
+	public:
+		MidiOutMerger(int numsources, int longbuffersize = 256);
+		// stop every source first, an unfinished SysEx is forgotten
+		void SetMidiOutPort(IMidiOutPort* p);
+		// blocks while another source is in the middle of a SysEx
+		ResultCode Dispatch(int source, const MidiMessage& m);
+		// send what the source has buffered, called when its input chunk is exhausted
+		ResultCode Flush(int source);
+		// the source has gone, a SysEx it left open is closed with EOX so the device does not swallow the next message
+		ResultCode ReleaseSource(int source);
+		// wakes a Dispatch() of the source that waits for the port, sticky until reset
+		void SetSourceCancelled(int source, bool v);
+		// how long a source may stop in the middle of its SysEx while another waits, 0 waits for it forever
+		void SetSysExOwnerTimeout(std::chrono::milliseconds v);
+		std::chrono::milliseconds GetSysExOwnerTimeout() const;
+		int GetSysExOwner() const;
+		// SysEx closed because its source stopped in the middle of it
+		uint64_t GetSysExTimeoutCount() const;
+		uint64_t GetShortSendCount() const;
+		uint64_t GetLongSendCount() const;
+		void ResetCounters();
+	};
+}
@@ -0,0 +1,57 @@
+//
+//  MidiPort.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiFramer.h"
+#include <chrono>
+#include <functional>
+
+namespace MidiBridgeCore
+{
+	// when the driver saw the message, converted by the port from the driver's own time base
+	using MidiTimestamp = std::chrono::steady_clock::time_point;
+
+	struct IMidiOutPort
+	{
+		virtual ~IMidiOutPort() {}
+		virtual bool IsDeviceOpen() const = 0;
+		// long message path: SysEx segments or runs of complete messages, may block while the device is busy
+		virtual ResultCode Send(const uint8_t* p, int c) = 0;
+		// short message path: one channel, system common or real-time message packed like midiOutShortMsg (status in the low byte)
+		virtual ResultCode SendShortMessage(uint32_t msg)
+		{
+			const uint8_t b[3] = { (uint8_t)msg, (uint8_t)(msg >> 8), (uint8_t)(msg >> 16) };
+			return Send(b, MidiFramer::GetShortMessageLength(b[0]));
+		}
+		// true when SendShortMessage() may be called from another thread while a Send() is running or blocked,
+		// the way midiOutShortMsg goes out beside the queued long buffers. the real-time lane needs it
+		virtual bool IsShortMessageConcurrent() const { return false; }
+		// optional zero-copy long message path for a port that owns prepared output buffers:
+		// AcquireSendBuffer() lends the next free buffer, blocking like Send() while all of them are in flight,
+		// SubmitSendBuffer() hands its first c bytes to the device, ReturnSendBuffer() gives it back unused.
+		// one buffer at a time, from the thread that calls Send()
+		virtual ResultCode AcquireSendBuffer(uint8_t** pp, int* capacity) { *pp = nullptr; *capacity = 0; return ResultNotSupported; }
+		virtual ResultCode SubmitSendBuffer(uint8_t*, int) { return ResultNotSupported; }
+		virtual void ReturnSendBuffer(uint8_t*) {}
+		// wakes a Send() that is blocked waiting for the device to return a buffer, sticky until reset
+		virtual void SetSendCancelled(bool) {}
+		// the fewest free output buffers seen since the device was opened, -1 when the port does not queue buffers
+		virtual int64_t GetBufferLowWater() const { return -1; }
+	};
+
+	struct IMidiInPort
+	{
+		// called on the driver's callback thread
+		std::function<void(const uint8_t* p, int c, MidiTimestamp t)> OnMidiInReceived;
+		virtual ~IMidiInPort() {}
+		virtual bool IsDeviceOpen() const = 0;
+		virtual ResultCode StartDevice() = 0;
+		virtual ResultCode StopDevice() = 0;
+	};
+}
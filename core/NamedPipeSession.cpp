@@ -0,0 +1,480 @@
+//
+//  NamedPipeSession.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include "NamedPipeSession.h"
+#include "CoreDebugPrint.h"
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// primitive classes
+
+	struct ManualEvent
+	{
+		HANDLE hEvent = NULL;
+		ManualEvent()
+		{
+			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		}
+		~ManualEvent()
+		{
+			if(hEvent) CloseHandle(hEvent);
+		}
+		bool Reset()
+		{
+			return hEvent ? ResetEvent(hEvent) : false;
+		}
+		bool Set()
+		{
+			return hEvent ? SetEvent(hEvent) : false;
+		}
+		operator HANDLE()
+		{
+			return hEvent;
+		}
+	};
+
+	struct Overlapped : public OVERLAPPED
+	{
+		Overlapped()
+		{
+			ZeroMemory(this, sizeof(*this));
+			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		}
+		~Overlapped()
+		{
+			if(hEvent) CloseHandle(hEvent);
+		}
+		void Reset()
+		{
+			HANDLE hsave = this->hEvent;
+			ZeroMemory(this, sizeof(*this));
+			hEvent = hsave;
+			if(hEvent) ResetEvent(hEvent);
+		}
+	};
+
+	// ================================================================================
+	// named pipe transport
+
+	class NamedPipeTransport : public ITransport
+	{
+	private:
+		HANDLE hPipe = NULL;
+		Overlapped readOverlapped;
+		Overlapped writeOverlapped;
+		ManualEvent readCancelEvent;
+		ManualEvent writeCancelEvent;
+		std::atomic<bool> readCancelled{ false };
+		std::atomic<bool> writeCancelled{ false };
+		ResultCode CompleteOverlapped(BOOL rio, Overlapped& overlapped, HANDLE hcancel, DWORD* cb)
+		{
+			if(rio) return ResultOk;
+			DWORD r = GetLastError();
+			if(r != ERROR_IO_PENDING) return HRESULT_FROM_WIN32(r);
+			HANDLE hw[] = { overlapped.hEvent, hcancel };
+			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0)
+			{
+				// the OVERLAPPED is reused, so wait for the cancelled request to retire
+				CancelIoEx(hPipe, &overlapped);
+				GetOverlappedResult(hPipe, &overlapped, cb, TRUE);
+				return ResultCancelled;
+			}
+			if(!GetOverlappedResult(hPipe, &overlapped, cb, FALSE)) return HRESULT_FROM_WIN32(GetLastError());
+			return ResultOk;
+		}
+	public:
+		HANDLE GetHandle() const
+		{
+			return hPipe;
+		}
+		void SetHandle(HANDLE h)
+		{
+			hPipe = h;
+		}
+		virtual ResultCode Read(uint8_t* p, int c, int* cr) override
+		{
+			*cr = 0;
+			if(readCancelled) return ResultCancelled;
+			readOverlapped.Reset();
+			DWORD cb = 0;
+			ResultCode r = CompleteOverlapped(ReadFile(hPipe, p, c, &cb, &readOverlapped), readOverlapped, readCancelEvent, &cb);
+			if(ResultIsError(r)) return r;
+			*cr = (int)cb;
+			return ResultOk;
+		}
+		virtual ResultCode Write(const uint8_t* p, int c, int* cw) override
+		{
+			*cw = 0;
+			if(writeCancelled) return ResultCancelled;
+			writeOverlapped.Reset();
+			DWORD cb = 0;
+			ResultCode r = CompleteOverlapped(WriteFile(hPipe, p, c, &cb, &writeOverlapped), writeOverlapped, writeCancelEvent, &cb);
+			if(ResultIsError(r)) return r;
+			*cw = (int)cb;
+			return ResultOk;
+		}
+		virtual void SetReadCancelled(bool v) override
+		{
+			readCancelled = v;
+			if(v)	readCancelEvent.Set();
+			else	readCancelEvent.Reset();
+		}
+		virtual void SetWriteCancelled(bool v) override
+		{
+			writeCancelled = v;
+			if(v)	writeCancelEvent.Set();
+			else	writeCancelEvent.Reset();
+		}
+		virtual bool IsBrokenPipe(ResultCode r) const override
+		{
+			return r == HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE);
+		}
+	};
+
+	// ================================================================================
+	// pipe connection session classes
+
+	class PipeServer : public IPipeSession, private WorkerThread
+	{
+	private:
+		std::wstring pipeName;
+		PipeInMidiOut& pipeInMidiOut;
+		MidiInPipeOut& midiInPipeOut;
+		HANDLE hPipe = NULL;
+		Overlapped overlapped;
+		ManualEvent connectCancelEvent;
+		SignalEvent stateEvent;
+		NamedPipeTransport transport;
+		std::atomic<ResultCode> sessionError{ ResultOk };
+		bool ConnectPipeOverlapped()
+		{
+			overlapped.Reset();
+			BOOL rconnect = ConnectNamedPipe(hPipe, &overlapped);
+			DWORD r = GetLastError();
+			if(rconnect) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; } // overlapped ConnectNamedPipe() should return FALSE
+			if(r == ERROR_PIPE_CONNECTED) return true;
+			if((r != ERROR_IO_PENDING) && (r != ERROR_PIPE_LISTENING)) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; }
+			HANDLE hw[] = { overlapped.hEvent, connectCancelEvent };
+			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(GetLastError()); return false; }
+			return true;
+		}
+		virtual unsigned int Run() override
+		{
+			CoreDebugPrint(L"[PipeServer] thread begin\n");
+			while(1)
+			{
+				if(quitFlag) break;
+				if(!ConnectPipeOverlapped())
+				{
+					CoreDebugPrint(L"[PipeServer] failed ConnectNamedPipe()\n");
+					if(ResultIsError(sessionError)) { if(OnSessionError) OnSessionError(sessionError); }
+					break;
+				}
+				CoreDebugPrint(L"[PipeServer] connected\n");
+				stateEvent.Reset();
+				transport.SetHandle(hPipe);
+				pipeInMidiOut.SetTransport(&transport, true);
+				midiInPipeOut.SetTransport(&transport, true);
+				while(1)
+				{
+					stateEvent.Wait();
+					stateEvent.Reset();
+					if( ResultIsError(pipeInMidiOut.GetDeviceError()) ||
+						ResultIsError(pipeInMidiOut.GetPipeError()) ||
+						ResultIsError(midiInPipeOut.GetDeviceError()) ||
+						ResultIsError(midiInPipeOut.GetPipeError()) ||
+						quitFlag) break;
+				}
+				// FlushFileBuffers(hPipe); // unnecessary?
+				DisconnectNamedPipe(hPipe);
+				pipeInMidiOut.SetTransport(nullptr, false);
+				midiInPipeOut.SetTransport(nullptr, false);
+				CoreDebugPrint(L"[PipeServer] disconnected\n");
+			}
+			CoreDebugPrint(L"[PipeServer] thread end\n");
+			return 0;
+		}
+		virtual void RequestToQuitThread() override
+		{
+			quitFlag = true;
+			connectCancelEvent.Set();
+			CancelIoEx(hPipe, &overlapped);
+			stateEvent.Set();
+			WorkerThread::RequestToQuitThread();
+		}
+	public:
+		PipeServer(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+			: WorkerThread("PipeServer")
+			, pipeName(pipename)
+			, pipeInMidiOut(p2m)
+			, midiInPipeOut(m2p)
+		{
+			pipeInMidiOut.OnStopped = [this]() { stateEvent.Set(); };
+			midiInPipeOut.OnStopped = [this]() { stateEvent.Set(); };
+		}
+		virtual ~PipeServer() override
+		{
+			StopSession();
+			pipeInMidiOut.OnStopped = nullptr;
+			midiInPipeOut.OnStopped = nullptr;
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			constexpr DWORD BUFFERSIZE = 1024;
+			hPipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, BUFFERSIZE, BUFFERSIZE, 0, nullptr);
+			if(hPipe == INVALID_HANDLE_VALUE)
+			{
+				hPipe = NULL;
+				sessionError = HRESULT_FROM_WIN32(GetLastError());
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[PipeServer] failed CreateNamedPipe()\n");
+				return false;
+			}
+			connectCancelEvent.Reset();
+			return StartThread();
+		}
+		virtual void StopSession() override
+		{
+			StopThread();
+			if(hPipe) CloseHandle(hPipe);
+			hPipe = NULL;
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return IsThreadRunning();
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+	//
+	// several instances of the same pipe name, each one connects its own client to a ClientHub slot.
+	// an instance thread waits for a client, serves it until the transfer ends, then waits for the next one.
+	//
+	class MultiPipeServer : public IPipeSession
+	{
+	private:
+		class Instance : private WorkerThread
+		{
+		private:
+			MultiPipeServer& server;
+			int slot;
+			HANDLE hPipe = NULL;
+			Overlapped overlapped;
+			ManualEvent connectCancelEvent;
+			SignalEvent stateEvent;
+			NamedPipeTransport transport;
+			bool ConnectPipeOverlapped()
+			{
+				overlapped.Reset();
+				BOOL rconnect = ConnectNamedPipe(hPipe, &overlapped);
+				DWORD r = GetLastError();
+				if(rconnect) { if(!quitFlag) server.sessionError = HRESULT_FROM_WIN32(r); return false; } // overlapped ConnectNamedPipe() should return FALSE
+				if(r == ERROR_PIPE_CONNECTED) return true;
+				if((r != ERROR_IO_PENDING) && (r != ERROR_PIPE_LISTENING)) { if(!quitFlag) server.sessionError = HRESULT_FROM_WIN32(r); return false; }
+				HANDLE hw[] = { overlapped.hEvent, connectCancelEvent };
+				if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) server.sessionError = HRESULT_FROM_WIN32(GetLastError()); return false; }
+				return true;
+			}
+			virtual unsigned int Run() override
+			{
+				CoreDebugPrint(L"[MultiPipeServer] instance begin\n");
+				ClientHub& hub = server.clientHub;
+				while(1)
+				{
+					if(quitFlag) break;
+					if(!ConnectPipeOverlapped())
+					{
+						CoreDebugPrint(L"[MultiPipeServer] failed ConnectNamedPipe()\n");
+						if(ResultIsError(server.sessionError)) { if(server.OnSessionError) server.OnSessionError(server.sessionError); }
+						break;
+					}
+					CoreDebugPrint(L"[MultiPipeServer] connected\n");
+					stateEvent.Reset();
+					transport.SetHandle(hPipe);
+					hub.SetClientTransport(slot, &transport, true);
+					stateEvent.Wait();
+					DisconnectNamedPipe(hPipe);
+					hub.SetClientTransport(slot, nullptr, false);
+					CoreDebugPrint(L"[MultiPipeServer] disconnected\n");
+				}
+				CoreDebugPrint(L"[MultiPipeServer] instance end\n");
+				return 0;
+			}
+			virtual void RequestToQuitThread() override
+			{
+				quitFlag = true;
+				connectCancelEvent.Set();
+				CancelIoEx(hPipe, &overlapped);
+				stateEvent.Set();
+				WorkerThread::RequestToQuitThread();
+			}
+		public:
+			Instance(MultiPipeServer& s, int n) : WorkerThread("MultiPipeServer.Instance"), server(s), slot(n)
+			{
+			}
+			virtual ~Instance() override
+			{
+				Stop();
+			}
+			void NotifyClientStopped()
+			{
+				stateEvent.Set();
+			}
+			bool Start()
+			{
+				Stop();
+				constexpr DWORD BUFFERSIZE = 1024;
+				hPipe = CreateNamedPipeW(server.pipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, (DWORD)server.clientHub.GetMaxClients(), BUFFERSIZE, BUFFERSIZE, 0, nullptr);
+				if(hPipe == INVALID_HANDLE_VALUE)
+				{
+					hPipe = NULL;
+					server.sessionError = HRESULT_FROM_WIN32(GetLastError());
+					CoreDebugPrint(L"[MultiPipeServer] failed CreateNamedPipe()\n");
+					return false;
+				}
+				connectCancelEvent.Reset();
+				return StartThread();
+			}
+			void Stop()
+			{
+				StopThread();
+				if(hPipe) CloseHandle(hPipe);
+				hPipe = NULL;
+			}
+			bool IsRunning() const
+			{
+				return IsThreadRunning();
+			}
+		};
+		std::wstring pipeName;
+		ClientHub& clientHub;
+		std::vector<std::unique_ptr<Instance> > instances;
+		std::atomic<ResultCode> sessionError{ ResultOk };
+	public:
+		MultiPipeServer(const std::wstring& pipename, ClientHub& hub) : pipeName(pipename), clientHub(hub)
+		{
+			for(int i = 0; i < clientHub.GetMaxClients(); ++i) instances.push_back(std::make_unique<Instance>(*this, i));
+			clientHub.OnClientStopped = [this](int slot) { instances[slot]->NotifyClientStopped(); };
+		}
+		virtual ~MultiPipeServer() override
+		{
+			StopSession();
+			clientHub.OnClientStopped = nullptr;
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			for(auto&& inst : instances)
+			{
+				if(inst->Start()) continue;
+				// a guest can attach to the instances that already listen, the first failure is reported
+				if(ResultIsError(sessionError)) { if(OnSessionError) OnSessionError(sessionError); }
+				break;
+			}
+			return IsSessionRunning();
+		}
+		virtual void StopSession() override
+		{
+			for(auto&& inst : instances) inst->Stop();
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			for(auto&& inst : instances) { if(inst->IsRunning()) return true; }
+			return false;
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+	class PipeClient : public IPipeSession
+	{
+	private:
+		std::wstring pipeName;
+		PipeInMidiOut& pipeInMidiOut;
+		MidiInPipeOut& midiInPipeOut;
+		HANDLE hPipe = NULL;
+		NamedPipeTransport transport;
+		ResultCode sessionError = ResultOk;
+	public:
+		PipeClient(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+			: pipeName(pipename)
+			, pipeInMidiOut(p2m)
+			, midiInPipeOut(m2p)
+		{
+		}
+		virtual ~PipeClient() override
+		{
+			StopSession();
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			hPipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+			if(hPipe == INVALID_HANDLE_VALUE)
+			{
+				hPipe = NULL;
+				sessionError = HRESULT_FROM_WIN32(GetLastError());
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[PipeClient] failed CreateFile()\n");
+				return false;
+			}
+			DWORD mode = PIPE_READMODE_BYTE;
+			SetNamedPipeHandleState(hPipe, &mode, nullptr, nullptr);
+			transport.SetHandle(hPipe);
+			pipeInMidiOut.SetTransport(&transport, false);
+			midiInPipeOut.SetTransport(&transport, false);
+			return true;
+		}
+		virtual void StopSession() override
+		{
+			pipeInMidiOut.SetTransport(nullptr, false);
+			midiInPipeOut.SetTransport(nullptr, false);
+			if(hPipe) CloseHandle(hPipe);
+			hPipe = NULL;
+			transport.SetHandle(NULL);
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return hPipe != NULL;
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+	// ================================================================================
+	// factories
+
+	std::unique_ptr<IPipeSession> CreateNamedPipeServer(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+	{
+		return std::make_unique<PipeServer>(pipename, p2m, m2p);
+	}
+	std::unique_ptr<IPipeSession> CreateNamedPipeServer(const std::wstring& pipename, ClientHub& hub)
+	{
+		return std::make_unique<MultiPipeServer>(pipename, hub);
+	}
+	std::unique_ptr<IPipeSession> CreateNamedPipeClient(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+	{
+		return std::make_unique<PipeClient>(pipename, p2m, m2p);
+	}
+}
+
+#endif // _WIN32
@@ -0,0 +1,27 @@
+//
+//  NamedPipeSession.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "PipeSession.h"
+#include "TransferEngine.h"
+#include "ClientHub.h"
+#include <memory>
+#include <string>
+
+#if defined(_WIN32)
+
+namespace MidiBridgeCore
+{
+	// Win32 named pipe sessions, result codes are HRESULT
+	std::unique_ptr<IPipeSession> CreateNamedPipeServer(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p);
+	// one pipe instance per hub slot, so several clients can attach to the same name at once
+	std::unique_ptr<IPipeSession> CreateNamedPipeServer(const std::wstring& pipename, ClientHub& hub);
+	std::unique_ptr<IPipeSession> CreateNamedPipeClient(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p);
+}
+
+#endif
@@ -0,0 +1,362 @@
+//
+//  PacedMidiOut.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "PacedMidiOut.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// profiles
+
+	struct BuiltInPacingProfile
+	{
+		MidiOutPacingProfile profile;
+		std::vector<std::string> models;
+	};
+
+	// conservative figures, a custom spec overrides them for a unit that needs more or less
+	static const std::vector<BuiltInPacingProfile>& GetBuiltInPacingProfiles()
+	{
+		static const std::vector<BuiltInPacingProfile> profiles =
+		{
+			// the LA synths take the wire rate but need a rest after each SysEx, or the next one ends in "Exc. Buffer overflow"
+			{ { "mt32", 3125, std::chrono::milliseconds(40), 16 }, { "MT-32", "MT32", "CM-32", "CM-64", "LAPC" } },
+			// the 4-op FM modules store a voice to memory after each bulk, the next message is lost while they do
+			{ { "fb01", 3125, std::chrono::milliseconds(50), 16 }, { "FB-01", "FB01" } },
+			{ { "tx81z", 3125, std::chrono::milliseconds(50), 16 }, { "TX81Z", "DX11", "DX21", "DX27", "DX100" } },
+			// the plain wire rate, for a fast USB interface that would otherwise burst a dump into a serial receiver
+			{ { "wire", 3125, std::chrono::milliseconds(0), 16 }, {} },
+		};
+		return profiles;
+	}
+
+	static std::string ToUpper(std::string s)
+	{
+		for(char& c : s) c = (char)std::toupper((unsigned char)c);
+		return s;
+	}
+
+	const MidiOutPacingProfile* FindPacingProfile(const std::string& name)
+	{
+		for(const auto& b : GetBuiltInPacingProfiles()) if(b.profile.name == name) return &b.profile;
+		return nullptr;
+	}
+
+	MidiOutPacingProfile GetPacingProfileForDevice(const std::string& devicename)
+	{
+		std::string name = ToUpper(devicename);
+		for(const auto& b : GetBuiltInPacingProfiles())
+		{
+			for(const auto& model : b.models) if(name.find(model) != std::string::npos) return b.profile;
+		}
+		return MidiOutPacingProfile();
+	}
+
+	static bool ParsePacingValue(const std::string& s, double lo, double hi, double* v)
+	{
+		if(s.empty()) return false;
+		char* end = nullptr;
+		double d = std::strtod(s.c_str(), &end);
+		if((*end != '\0') || (d < lo) || (d > hi)) return false;
+		*v = d;
+		return true;
+	}
+
+	ResultCode ParsePacingProfile(const std::string& spec, const std::string& devicename, MidiOutPacingProfile* profile)
+	{
+		if(spec.empty() || (spec == "auto")) { *profile = GetPacingProfileForDevice(devicename); return ResultOk; }
+		if(spec == "off") { *profile = MidiOutPacingProfile(); return ResultOk; }
+		if(const MidiOutPacingProfile* p = FindPacingProfile(spec)) { *profile = *p; return ResultOk; }
+		MidiOutPacingProfile custom;
+		custom.name = "custom";
+		size_t i = 0;
+		while(i < spec.size())
+		{
+			size_t j = spec.find(';', i);
+			if(j == std::string::npos) j = spec.size();
+			std::string token = spec.substr(i, j - i);
+			i = j + 1;
+			if(token.empty()) continue;
+			size_t colon = token.find(':');
+			if(colon == std::string::npos) return EINVAL;
+			std::string key = token.substr(0, colon);
+			double v = 0;
+			if(key == "rate")
+			{
+				if(!ParsePacingValue(token.substr(colon + 1), 0, 1e6, &v)) return EINVAL;
+				custom.bytesPerSecond = v;
+			}
+			else if(key == "gap")
+			{
+				if(!ParsePacingValue(token.substr(colon + 1), 0, 10000, &v)) return EINVAL;
+				custom.sysexGap = std::chrono::milliseconds((int64_t)v);
+			}
+			else if(key == "outstanding")
+			{
+				if(!ParsePacingValue(token.substr(colon + 1), 1, 65536, &v)) return EINVAL;
+				custom.maxOutstandingBytes = (int)v;
+			}
+			else return EINVAL;
+		}
+		*profile = custom;
+		return ResultOk;
+	}
+
+	// ================================================================================
+	// PacedMidiOut
+
+	void PacedMidiOut::MessageBoundary::Step(uint8_t b)
+	{
+		if(MidiFramer::IsRealTime(b)) return;
+		if(b == 0xf0) { inSysEx = true; remaining = 0; runLength = 0; }
+		else if(b == 0xf7) { inSysEx = false; remaining = 0; runLength = 0; }
+		else if(b & 0x80)
+		{
+			int len = MidiFramer::GetShortMessageLength(b);
+			inSysEx = false;
+			remaining = len - 1;
+			runLength = (b < 0xf0) ? len : 0;
+		}
+		else if(inSysEx) {}
+		else if(remaining > 0) --remaining;
+		else if(runLength > 0) remaining = runLength - 2; // running status, this byte begins the next message
+	}
+
+	PacedMidiOut::PacedMidiOut() : WorkerThread("PacedMidiOut")
+	{
+		chunk.reserve(MaxChunkBytes);
+	}
+	PacedMidiOut::~PacedMidiOut()
+	{
+		Stop();
+	}
+	// the longest piece of up to n bytes that ends where the device may be left waiting, and never past an EOX
+	size_t PacedMidiOut::FindChunkLength(size_t n) const
+	{
+		MessageBoundary b = boundary;
+		size_t len = 0;
+		size_t e = std::min(n, queue.size());
+		for(size_t i = 0; i < e; )
+		{
+			uint8_t c = queue[i++];
+			b.Step(c);
+			if(b.IsAt()) len = i;
+			if(c == 0xf7) break;
+		}
+		return len;
+	}
+	void PacedMidiOut::SetDeviceResult(ResultCode r)
+	{
+		deviceResult = r;
+		queue.clear();
+		realTimeQueue.clear();
+		boundary = MessageBoundary();
+	}
+	unsigned int PacedMidiOut::Run()
+	{
+		using Clock = std::chrono::steady_clock;
+		while(1)
+		{
+			uint32_t rt = 0;
+			size_t n = 0;
+			Clock::time_point now;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queueCond.wait(lock, [this]() { return quitFlag || !realTimeQueue.empty() || !queue.empty(); });
+				if(quitFlag) break;
+				if(!realTimeQueue.empty())
+				{
+					rt = realTimeQueue.front();
+					realTimeQueue.pop_front();
+				}
+				else
+				{
+					now = Clock::now();
+					Clock::time_point due = gapUntil;
+					if(pacer.IsEnabled()) due = std::max(due, pacer.GetNextSendTime());
+					if(now >= due) n = FindChunkLength(std::min<size_t>(pacer.GetAllowance(now), MaxChunkBytes));
+					if(n == 0)
+					{
+						// the gap, or the line has no room for the whole next message yet.
+						// short naps, a real-time message that comes in meanwhile is not held for the rest of it
+						lock.unlock();
+						Clock::time_point t = (now < due) ? due : now + pacer.GetByteTime();
+						timer.SleepUntil(std::min<Clock::time_point>(t, now + std::chrono::milliseconds(1)));
+						continue;
+					}
+					chunk.assign(queue.begin(), queue.begin() + n);
+					queue.erase(queue.begin(), queue.begin() + n);
+					for(uint8_t b : chunk) boundary.Step(b);
+					spaceCond.notify_all();
+				}
+				sending = true;
+			}
+			ResultCode r = ResultOk;
+			if(rt != 0) r = port->SendShortMessage(rt);
+			else
+			{
+				uint8_t stat = chunk[0];
+				if((n <= 3) && (stat & 0x80) && (stat != 0xf0) && (stat != 0xf7) && ((int)n == MidiFramer::GetShortMessageLength(stat)))
+				{
+					uint32_t msg = 0;
+					for(size_t i = 0; i < n; ++i) msg |= (uint32_t)chunk[i] << (8 * i);
+					r = port->SendShortMessage(msg);
+				}
+				else r = port->Send(chunk.data(), (int)n);
+				pacer.Consume(n, now);
+				if(chunk.back() == 0xf7)
+				{
+					// the gap runs from when the EOX has left the line, or from when the device took it when there is no line to model
+					Clock::time_point t = Clock::now();
+					gapUntil = (pacer.IsEnabled() ? std::max(pacer.GetLineFreeTime(), t) : t) + profile.sysexGap;
+					if(profile.sysexGap.count() > 0) gapCount.Add();
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			sending = false;
+			if(r != ResultOk) SetDeviceResult(r);
+			spaceCond.notify_all();
+		}
+		return 0;
+	}
+	void PacedMidiOut::RequestToQuitThread()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		WorkerThread::RequestToQuitThread();
+		queueCond.notify_all();
+	}
+	void PacedMidiOut::SetMidiOutPort(IMidiOutPort* p)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		port = p;
+	}
+	IMidiOutPort* PacedMidiOut::GetMidiOutPort() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return port;
+	}
+	void PacedMidiOut::SetProfile(const MidiOutPacingProfile& v)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		profile = v;
+	}
+	MidiOutPacingProfile PacedMidiOut::GetProfile() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return profile;
+	}
+	bool PacedMidiOut::Start()
+	{
+		Stop();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!port) return false;
+			// the line must hold a whole channel message, or one would never fit
+			pacer.SetRate(profile.bytesPerSecond * BytePacer::BitsPerByte, std::max(profile.maxOutstandingBytes, 3));
+			pacer.Reset(std::chrono::steady_clock::now());
+			gapUntil = {};
+			boundary = MessageBoundary();
+		}
+		return StartThread();
+	}
+	void PacedMidiOut::Stop()
+	{
+		StopThread();
+		std::lock_guard<std::mutex> lock(mutex);
+		SetDeviceResult(ResultOk);
+		sending = false;
+		spaceCond.notify_all();
+	}
+	bool PacedMidiOut::IsRunning() const
+	{
+		return IsThreadRunning();
+	}
+	bool PacedMidiOut::Flush(std::chrono::nanoseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return spaceCond.wait_for(lock, timeout, [this]() { return queue.empty() && realTimeQueue.empty() && !sending; });
+	}
+	size_t PacedMidiOut::GetQueuedBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size();
+	}
+	uint64_t PacedMidiOut::GetGapCount() const
+	{
+		return gapCount.Get();
+	}
+	void PacedMidiOut::ResetCounters()
+	{
+		gapCount.Reset();
+	}
+	bool PacedMidiOut::IsDeviceOpen() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return port && port->IsDeviceOpen();
+	}
+	ResultCode PacedMidiOut::Send(const uint8_t* p, int c)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if(!port || !IsThreadRunning()) return ResultBrokenPipe;
+		int i = 0; while(i < c)
+		{
+			spaceCond.wait(lock, [this]() { return sendCancelled || (deviceResult != ResultOk) || (queue.size() < QueueBytes); });
+			if(sendCancelled) return ResultCancelled;
+			if(deviceResult != ResultOk) return deviceResult;
+			int n = std::min(c - i, (int)(QueueBytes - queue.size()));
+			queue.insert(queue.end(), p + i, p + i + n);
+			i += n;
+			queueCond.notify_one();
+		}
+		return ResultOk;
+	}
+	ResultCode PacedMidiOut::SendShortMessage(uint32_t msg)
+	{
+		const uint8_t b[3] = { (uint8_t)msg, (uint8_t)(msg >> 8), (uint8_t)(msg >> 16) };
+		if(!MidiFramer::IsRealTime(b[0])) return Send(b, MidiFramer::GetShortMessageLength(b[0]));
+		IMidiOutPort* p = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!port || !IsThreadRunning()) return ResultBrokenPipe;
+			if(deviceResult != ResultOk) return deviceResult;
+			if(!port->IsShortMessageConcurrent())
+			{
+				realTimeQueue.push_back(msg);
+				queueCond.notify_one();
+				return ResultOk;
+			}
+			p = port;
+		}
+		return p->SendShortMessage(msg);
+	}
+	bool PacedMidiOut::IsShortMessageConcurrent() const
+	{
+		return true;
+	}
+	void PacedMidiOut::SetSendCancelled(bool v)
+	{
+		IMidiOutPort* p = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			sendCancelled = v;
+			// re-armed for a new session, the device gets another try
+			if(!v) deviceResult = ResultOk;
+			spaceCond.notify_all();
+			p = port;
+		}
+		if(p) p->SetSendCancelled(v);
+	}
+	int64_t PacedMidiOut::GetBufferLowWater() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return port ? port->GetBufferLowWater() : -1;
+	}
+}
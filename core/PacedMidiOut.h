@@ -0,0 +1,125 @@
+//
+//  PacedMidiOut.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "BytePacer.h"
+#include "CoreTypes.h"
+#include "MidiPort.h"
+#include "PreciseTimer.h"
+#include "Statistics.h"
+#include "WorkerThread.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// what a slow receiver can take. the vintage modules parse SysEx on a slow CPU: fed at the full wire rate through a fast
+	// interface, or with the next message right behind the EOX, they drop bytes or report a checksum or buffer error
+	//
+	struct MidiOutPacingProfile
+	{
+		std::string name;
+		// 0 leaves the rate to the device, the MIDI 1.0 wire is 3125
+		double bytesPerSecond = 0;
+		// quiet time after a SysEx has left the line before the next message that is not real-time
+		std::chrono::milliseconds sysexGap{ 0 };
+		// how far the driver and the interface may be fed ahead of the modeled line
+		int maxOutstandingBytes = 1;
+		bool IsEnabled() const
+		{
+			return (bytesPerSecond > 0) || (sysexGap.count() > 0);
+		}
+	};
+
+	// the built-in profile of that name, null when there is none
+	const MidiOutPacingProfile* FindPacingProfile(const std::string& name);
+	// the built-in profile whose models appear in the device name (case-insensitive), a disabled one when none does
+	MidiOutPacingProfile GetPacingProfileForDevice(const std::string& devicename);
+	//
+	// resolves a pacing spec for a device: "auto" or empty picks by the device name, "off" paces nothing, a built-in profile
+	// name ("mt32", "fb01", "tx81z", "wire") or a custom profile such as "rate:3125;gap:40;outstanding:16" (bytes/s, msec, bytes,
+	// omitted keys are 0, 0 and 1). EINVAL on a syntax error
+	//
+	ResultCode ParsePacingProfile(const std::string& spec, const std::string& devicename, MidiOutPacingProfile* profile);
+
+	//
+	// an output port that paces a device by a profile, attach it where the device would go.
+	// Send() queues and returns while there is room, a scheduler thread feeds the device at the profile's rate and holds back
+	// what follows a SysEx for the gap. pieces are cut inside a SysEx or between messages, never in the middle of one.
+	// real-time messages are never held: they go straight to a device that takes short messages beside a long one,
+	// and jump the queue otherwise. an error of the device is returned to the sends that follow it until the engine
+	// re-arms the port with SetSendCancelled(false)
+	//
+	class PacedMidiOut : public IMidiOutPort, private WorkerThread
+	{
+	public:
+		static constexpr size_t QueueBytes = 4096;
+		// the most handed to the device at once, the rate cuts it shorter
+		static constexpr int MaxChunkBytes = 256;
+	private:
+		// where a piece may end, carried across pieces
+		struct MessageBoundary
+		{
+			bool inSysEx = false;
+			int remaining = 0;
+			int runLength = 0;
+			void Step(uint8_t b);
+			bool IsAt() const { return inSysEx || (remaining == 0); }
+		};
+		mutable std::mutex mutex;
+		std::condition_variable queueCond;
+		std::condition_variable spaceCond;
+		IMidiOutPort* port = nullptr;
+		MidiOutPacingProfile profile;
+		std::deque<uint8_t> queue;
+		std::deque<uint32_t> realTimeQueue;
+		bool sending = false;
+		bool sendCancelled = false;
+		ResultCode deviceResult = ResultOk;
+		// the scheduler's own
+		BytePacer pacer;
+		BytePacer::TimePoint gapUntil{};
+		MessageBoundary boundary;
+		std::vector<uint8_t> chunk;
+		PreciseTimer timer;
+		RelaxedCounter gapCount;
+		size_t FindChunkLength(size_t n) const;
+		void SetDeviceResult(ResultCode r);
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+	public:
+		PacedMidiOut();
+		virtual ~PacedMidiOut() override;
+		// set while stopped
+		void SetMidiOutPort(IMidiOutPort* p);
+		IMidiOutPort* GetMidiOutPort() const;
+		void SetProfile(const MidiOutPacingProfile& v);
+		MidiOutPacingProfile GetProfile() const;
+		// starts the scheduler, Stop() discards what is still queued
+		bool Start();
+		void Stop();
+		bool IsRunning() const;
+		// waits until the queue has gone to the device, false on timeout
+		bool Flush(std::chrono::nanoseconds timeout);
+		size_t GetQueuedBytes() const;
+		// gaps held after a SysEx
+		uint64_t GetGapCount() const;
+		void ResetCounters();
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		virtual ResultCode SendShortMessage(uint32_t msg) override;
+		virtual bool IsShortMessageConcurrent() const override;
+		virtual void SetSendCancelled(bool v) override;
+		virtual int64_t GetBufferLowWater() const override;
+	};
+}
@@ -0,0 +1,27 @@
+//
+//  PipeSession.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include <functional>
+
+namespace MidiBridgeCore
+{
+	//
+	// a pipe connection session establishes the transport and attaches it to the transfer engines
+	//
+	struct IPipeSession
+	{
+		std::function<void(ResultCode)> OnSessionError;
+		virtual ~IPipeSession() {}
+		virtual bool StartSession() = 0;
+		virtual void StopSession() = 0;
+		virtual bool IsSessionRunning() const = 0;
+		virtual ResultCode GetSessionError() const = 0;
+	};
+}
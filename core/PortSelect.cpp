@@ -0,0 +1,285 @@
+//
+//  PortSelect.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "PortSelect.h"
+#include "MessageFilter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// PortDemuxMidiOut
+
+	PortDemuxMidiOut::PortDemuxMidiOut(int numports) : ports(std::clamp(numports, 1, MaxPorts), nullptr)
+	{
+	}
+	template<typename Fn> ResultCode PortDemuxMidiOut::ForEachTarget(int target, Fn&& fn)
+	{
+		if(target == AllPorts)
+		{
+			ResultCode r = ResultOk;
+			bool sent = false;
+			for(IMidiOutPort* port : ports)
+			{
+				if(!port || !port->IsDeviceOpen()) continue;
+				sent = true;
+				ResultCode rp = fn(port);
+				if(!ResultIsError(r)) r = rp;
+			}
+			if(!sent) unroutedCount.Add();
+			return r;
+		}
+		IMidiOutPort* port = (target >= 0) ? ports[target] : nullptr;
+		if(!port || !port->IsDeviceOpen()) { unroutedCount.Add(); return ResultOk; }
+		return fn(port);
+	}
+	ResultCode PortDemuxMidiOut::Select(uint8_t nn)
+	{
+		selectCount.Add();
+		int target = (nn == 0) ? AllPorts : ((int)nn <= (int)ports.size()) ? (int)nn - 1 : NoPort;
+		int active = activePort.load(std::memory_order_relaxed);
+		ResultCode r = ResultOk;
+		if(sysexOpen && (target != active) && (active != NoPort))
+		{
+			static const uint8_t Eox = 0xf7;
+			r = ForEachTarget(active, [](IMidiOutPort* port) { return port->Send(&Eox, 1); });
+		}
+		sysexOpen = false;
+		activePort.store(target, std::memory_order_relaxed);
+		return r;
+	}
+	int PortDemuxMidiOut::GetPortCount() const
+	{
+		return (int)ports.size();
+	}
+	void PortDemuxMidiOut::SetPort(int index, IMidiOutPort* p)
+	{
+		ports[index] = p;
+	}
+	IMidiOutPort* PortDemuxMidiOut::GetPort(int index) const
+	{
+		return ports[index];
+	}
+	int PortDemuxMidiOut::GetActivePort() const
+	{
+		return activePort.load(std::memory_order_relaxed);
+	}
+	void PortDemuxMidiOut::Reset()
+	{
+		activePort.store(0, std::memory_order_relaxed);
+		sysexOpen = false;
+	}
+	uint64_t PortDemuxMidiOut::GetSelectCount() const
+	{
+		return selectCount.Get();
+	}
+	uint64_t PortDemuxMidiOut::GetUnroutedCount() const
+	{
+		return unroutedCount.Get();
+	}
+	void PortDemuxMidiOut::ResetCounters()
+	{
+		selectCount.Reset();
+		unroutedCount.Reset();
+	}
+	bool PortDemuxMidiOut::IsDeviceOpen() const
+	{
+		return std::any_of(ports.begin(), ports.end(), [](IMidiOutPort* port) { return port && port->IsDeviceOpen(); });
+	}
+	ResultCode PortDemuxMidiOut::Send(const uint8_t* p, int c)
+	{
+		if(c <= 0) return ResultOk;
+		// the dispatcher only sends SysEx this way, a segment that does not end with EOX leaves it open
+		sysexOpen = p[c - 1] != 0xf7;
+		return ForEachTarget(activePort.load(std::memory_order_relaxed), [p, c](IMidiOutPort* port) { return port->Send(p, c); });
+	}
+	ResultCode PortDemuxMidiOut::SendShortMessage(uint32_t msg)
+	{
+		uint8_t stat = (uint8_t)msg;
+		if(stat == PortSelectStatus) return Select((uint8_t)(msg >> 8));
+		// any status byte but a real-time one has ended a SysEx that was not closed
+		if(!MidiFramer::IsRealTime(stat)) sysexOpen = false;
+		return ForEachTarget(activePort.load(std::memory_order_relaxed), [msg](IMidiOutPort* port) { return port->SendShortMessage(msg); });
+	}
+	bool PortDemuxMidiOut::IsShortMessageConcurrent() const
+	{
+		// only real-time comes in beside Send(), it reads the selection but never changes it
+		return std::all_of(ports.begin(), ports.end(), [](IMidiOutPort* port) { return !port || port->IsShortMessageConcurrent(); });
+	}
+	void PortDemuxMidiOut::SetSendCancelled(bool v)
+	{
+		for(IMidiOutPort* port : ports) { if(port) port->SetSendCancelled(v); }
+	}
+	int64_t PortDemuxMidiOut::GetBufferLowWater() const
+	{
+		int64_t lw = -1;
+		for(IMidiOutPort* port : ports)
+		{
+			int64_t v = port ? port->GetBufferLowWater() : -1;
+			if((v >= 0) && ((lw < 0) || (v < lw))) lw = v;
+		}
+		return lw;
+	}
+
+	// ================================================================================
+	// PortMuxMidiIn
+
+	PortMuxMidiIn::PortMuxMidiIn(int numports) : ports(std::clamp(numports, 1, MaxPorts), nullptr)
+	{
+		heldBytes.reserve(MaxHeldBytes);
+	}
+	PortMuxMidiIn::~PortMuxMidiIn()
+	{
+		for(IMidiInPort* port : ports) { if(port) port->OnMidiInReceived = nullptr; }
+	}
+	void PortMuxMidiIn::Emit(int port, const uint8_t* p, int c, MidiTimestamp t)
+	{
+		if(port != lastPort)
+		{
+			const uint8_t sel[2] = { PortSelectStatus, (uint8_t)(port + 1) };
+			selectCount.Add();
+			if(OnMidiInReceived) OnMidiInReceived(sel, 2, t);
+			lastPort = port;
+		}
+		if(OnMidiInReceived) OnMidiInReceived(p, c, t);
+		MidiMessage m = ClassifyMidiMessage(p, c);
+		if(m.kind == MidiMessageKind::SysEx)			sysexPort = (m.sysexFlags & SysExEnd) ? -1 : port;
+		else if(m.kind != MidiMessageKind::RealTime)	{ if(sysexPort == port) sysexPort = -1; }
+	}
+	void PortMuxMidiIn::ReleaseHeldMessages()
+	{
+		// a port's messages keep their order, the ports among themselves need not, so a blocked port does not stop the others.
+		// the end of a released SysEx may free what was passed over, hence the passes
+		bool released = true;
+		while(released && !heldMessages.empty())
+		{
+			released = false;
+			uint32_t blocked = 0;
+			size_t rd = 0;
+			size_t wr = 0;
+			size_t n = 0;
+			for(size_t i = 0; i < heldMessages.size(); ++i)
+			{
+				HeldMessage h = heldMessages[i];
+				if(!(blocked & (1u << h.port)) && ((sysexPort < 0) || (sysexPort == h.port)))
+				{
+					Emit(h.port, heldBytes.data() + rd, (int)h.length, h.timestamp);
+					released = true;
+				}
+				else
+				{
+					blocked |= 1u << h.port;
+					memmove(heldBytes.data() + wr, heldBytes.data() + rd, h.length);
+					heldMessages[n++] = h;
+					wr += h.length;
+				}
+				rd += h.length;
+			}
+			heldMessages.resize(n);
+			heldBytes.resize(wr);
+			heldPorts = blocked;
+		}
+	}
+	void PortMuxMidiIn::OnPortReceived(int port, const uint8_t* p, int c, MidiTimestamp t)
+	{
+		if(c <= 0) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		if(((sysexPort >= 0) && (sysexPort != port)) || (heldPorts & (1u << port)))
+		{
+			// real-time may land in the middle of a SysEx, it goes out without a select not to end it
+			if((c == 1) && MidiFramer::IsRealTime(p[0]))
+			{
+				if(OnMidiInReceived) OnMidiInReceived(p, c, t);
+				return;
+			}
+			if(heldBytes.size() + (size_t)c > MaxHeldBytes) { droppedBytes.Add((uint64_t)c); return; }
+			heldBytes.insert(heldBytes.end(), p, p + c);
+			heldMessages.push_back({ port, (size_t)c, t });
+			heldPorts |= 1u << port;
+			return;
+		}
+		Emit(port, p, c, t);
+		if((sysexPort < 0) && !heldMessages.empty()) ReleaseHeldMessages();
+	}
+	int PortMuxMidiIn::GetPortCount() const
+	{
+		return (int)ports.size();
+	}
+	void PortMuxMidiIn::SetPort(int index, IMidiInPort* p)
+	{
+		if(ports[index]) ports[index]->OnMidiInReceived = nullptr;
+		ports[index] = p;
+		if(p) p->OnMidiInReceived = [this, index](const uint8_t* d, int c, MidiTimestamp t) { OnPortReceived(index, d, c, t); };
+	}
+	IMidiInPort* PortMuxMidiIn::GetPort(int index) const
+	{
+		return ports[index];
+	}
+	uint64_t PortMuxMidiIn::GetSelectCount() const
+	{
+		return selectCount.Get();
+	}
+	uint64_t PortMuxMidiIn::GetDroppedBytes() const
+	{
+		return droppedBytes.Get();
+	}
+	size_t PortMuxMidiIn::GetHeldBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return heldBytes.size();
+	}
+	void PortMuxMidiIn::ResetCounters()
+	{
+		selectCount.Reset();
+		droppedBytes.Reset();
+	}
+	bool PortMuxMidiIn::IsDeviceOpen() const
+	{
+		return std::any_of(ports.begin(), ports.end(), [](IMidiInPort* port) { return port && port->IsDeviceOpen(); });
+	}
+	ResultCode PortMuxMidiIn::StartDevice()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			lastPort = -1;
+			sysexPort = -1;
+			heldBytes.clear();
+			heldMessages.clear();
+			heldPorts = 0;
+		}
+		// the lock is not held here, a driver may call back before its start returns
+		for(size_t i = 0; i < ports.size(); ++i)
+		{
+			if(!ports[i] || !ports[i]->IsDeviceOpen()) continue;
+			ResultCode r = ports[i]->StartDevice();
+			if(ResultIsError(r))
+			{
+				for(size_t j = 0; j < i; ++j) { if(ports[j] && ports[j]->IsDeviceOpen()) ports[j]->StopDevice(); }
+				return r;
+			}
+		}
+		return ResultOk;
+	}
+	ResultCode PortMuxMidiIn::StopDevice()
+	{
+		ResultCode r = ResultOk;
+		for(IMidiInPort* port : ports)
+		{
+			if(!port || !port->IsDeviceOpen()) continue;
+			ResultCode rp = port->StopDevice();
+			if(!ResultIsError(r)) r = rp;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		lastPort = -1;
+		sysexPort = -1;
+		heldBytes.clear();
+		heldMessages.clear();
+		heldPorts = 0;
+		return r;
+	}
+}
@@ -0,0 +1,115 @@
+//
+//  PortSelect.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiPort.h"
+#include "Statistics.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// several MIDI ports over one serial line, the way the multi-port serial interfaces address them (MOTU, Midiman, Roland):
+	// the host sends F5 nn to select the port the following messages belong to, nn = 1 is the first port and nn = 0 all of them.
+	// the selection stays until the next F5, a line that never selects talks to the first port
+	//
+
+	// an output port that demultiplexes the guest's stream to several devices, attach it where a single device would go.
+	// a SysEx left open by a switch is closed with EOX on the port it was going to, a select beyond the ports drops the messages
+	class PortDemuxMidiOut : public IMidiOutPort
+	{
+	public:
+		static constexpr uint8_t PortSelectStatus = 0xf5;
+		static constexpr int MaxPorts = 16;
+		static constexpr int AllPorts = -1;
+		static constexpr int NoPort = -2;
+	private:
+		std::vector<IMidiOutPort*> ports;
+		std::atomic<int> activePort{ 0 };
+		bool sysexOpen = false;
+		RelaxedCounter selectCount;
+		RelaxedCounter unroutedCount;
+		ResultCode Select(uint8_t nn);
+		template<typename Fn> ResultCode ForEachTarget(int target, Fn&& fn);
+	public:
+		PortDemuxMidiOut(int numports);
+		int GetPortCount() const;
+		// set while no engine sends through the demux, null or a closed device swallows its messages
+		void SetPort(int index, IMidiOutPort* p);
+		IMidiOutPort* GetPort(int index) const;
+		// the index of the selected port, AllPorts or NoPort
+		int GetActivePort() const;
+		// back to the first port, for a new session
+		void Reset();
+		uint64_t GetSelectCount() const;
+		// messages that went to a port that does not exist or is not open
+		uint64_t GetUnroutedCount() const;
+		void ResetCounters();
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		virtual ResultCode SendShortMessage(uint32_t msg) override;
+		virtual bool IsShortMessageConcurrent() const override;
+		virtual void SetSendCancelled(bool v) override;
+		virtual int64_t GetBufferLowWater() const override;
+	};
+
+	// an input port that multiplexes several devices into one stream for the guest, attach it where a single device would go.
+	// the drivers call in on their own threads, the calls are serialized and a message from another port than the last one
+	// is prefixed with F5 nn. a SysEx is never split: while one port is in the middle of a SysEx the other ports' messages
+	// are held back (real-time messages excepted, they pass at once) and follow it when it ends, each port's in its order
+	class PortMuxMidiIn : public IMidiInPort
+	{
+	public:
+		static constexpr uint8_t PortSelectStatus = PortDemuxMidiOut::PortSelectStatus;
+		static constexpr int MaxPorts = PortDemuxMidiOut::MaxPorts;
+		static constexpr size_t MaxHeldBytes = 4096;
+	private:
+		struct HeldMessage
+		{
+			int port;
+			size_t length;
+			MidiTimestamp timestamp;
+		};
+		mutable std::mutex mutex;
+		std::vector<IMidiInPort*> ports;
+		int lastPort = -1;
+		int sysexPort = -1;
+		std::vector<uint8_t> heldBytes;
+		std::vector<HeldMessage> heldMessages;
+		// a bit for each port with held messages, its next ones queue up behind them
+		uint32_t heldPorts = 0;
+		RelaxedCounter selectCount;
+		RelaxedCounter droppedBytes;
+		void OnPortReceived(int port, const uint8_t* p, int c, MidiTimestamp t);
+		void Emit(int port, const uint8_t* p, int c, MidiTimestamp t);
+		void ReleaseHeldMessages();
+	public:
+		PortMuxMidiIn(int numports);
+		virtual ~PortMuxMidiIn() override;
+		int GetPortCount() const;
+		// set while the mux is stopped, takes over the port's OnMidiInReceived
+		void SetPort(int index, IMidiInPort* p);
+		IMidiInPort* GetPort(int index) const;
+		// F5 prefixes sent to the guest
+		uint64_t GetSelectCount() const;
+		// the held messages that did not fit in MaxHeldBytes
+		uint64_t GetDroppedBytes() const;
+		// what waits for another port's SysEx to end right now
+		size_t GetHeldBytes() const;
+		void ResetCounters();
+		// open while any of the devices is open
+		virtual bool IsDeviceOpen() const override;
+		// starts every open device, stops them all again when one fails
+		virtual ResultCode StartDevice() override;
+		// stops every device and forgets the held messages
+		virtual ResultCode StopDevice() override;
+	};
+}
@@ -0,0 +1,130 @@
+//
+//  PosixTransport.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if !defined(_WIN32)
+
+#include "PosixTransport.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// PollEvent
+
+	PollEvent::PollEvent()
+	{
+		if(pipe(fds) != 0) { fds[0] = fds[1] = -1; return; }
+		for(int fd : fds) SetNonBlocking(fd);
+	}
+	PollEvent::~PollEvent()
+	{
+		for(int fd : fds) if(fd >= 0) close(fd);
+	}
+	void PollEvent::Set()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(signaled) return;
+		signaled = true;
+		const uint8_t b = 1;
+		if(write(fds[1], &b, 1) < 0) {}
+	}
+	void PollEvent::Reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!signaled) return;
+		signaled = false;
+		uint8_t b[16];
+		while(read(fds[0], b, sizeof(b)) > 0) {}
+	}
+	int PollEvent::GetFd() const
+	{
+		return fds[0];
+	}
+
+	// ================================================================================
+	// PollTransport
+
+	PollTransport::PollTransport(bool socket) : isSocket(socket)
+	{
+	}
+	ResultCode PollTransport::WaitForFd(short events, PollEvent& cancel, const std::atomic<bool>& cancelled)
+	{
+		pollfd pfds[] = { { fd, events, 0 }, { cancel.GetFd(), POLLIN, 0 } };
+		if((poll(pfds, 2, -1) < 0) && (errno != EINTR)) return errno;
+		if(cancelled) return ResultCancelled;
+		return ResultOk;
+	}
+	int PollTransport::GetFd() const
+	{
+		return fd;
+	}
+	void PollTransport::SetFd(int v)
+	{
+		fd = v;
+	}
+	ResultCode PollTransport::Read(uint8_t* p, int c, int* cr)
+	{
+		*cr = 0;
+		while(1)
+		{
+			if(readCancelled) return ResultCancelled;
+			ssize_t n = isSocket ? recv(fd, p, (size_t)c, 0) : read(fd, p, (size_t)c);
+			if(n > 0) { *cr = (int)n; return ResultOk; }
+			if(n == 0) return ResultBrokenPipe;
+			if(errno == EINTR) continue;
+			if((errno != EAGAIN) && (errno != EWOULDBLOCK)) return errno;
+			ResultCode r = WaitForFd(POLLIN, readCancelEvent, readCancelled);
+			if(ResultIsError(r)) return r;
+		}
+	}
+	ResultCode PollTransport::Write(const uint8_t* p, int c, int* cw)
+	{
+		*cw = 0;
+		int i = 0; while(i < c)
+		{
+			if(writeCancelled) return ResultCancelled;
+			ssize_t n = isSocket ? send(fd, p + i, (size_t)(c - i), MSG_NOSIGNAL) : write(fd, p + i, (size_t)(c - i));
+			if(n >= 0) { i += (int)n; *cw = i; continue; }
+			if(errno == EINTR) continue;
+			if((errno != EAGAIN) && (errno != EWOULDBLOCK)) return errno;
+			ResultCode r = WaitForFd(POLLOUT, writeCancelEvent, writeCancelled);
+			if(ResultIsError(r)) return r;
+		}
+		return ResultOk;
+	}
+	void PollTransport::SetReadCancelled(bool v)
+	{
+		readCancelled = v;
+		if(v)	readCancelEvent.Set();
+		else	readCancelEvent.Reset();
+	}
+	void PollTransport::SetWriteCancelled(bool v)
+	{
+		writeCancelled = v;
+		if(v)	writeCancelEvent.Set();
+		else	writeCancelEvent.Reset();
+	}
+	bool PollTransport::IsBrokenPipe(ResultCode r) const
+	{
+		return (r == ResultBrokenPipe) || (r == ECONNRESET) || (r == ECONNABORTED) || (!isSocket && (r == EIO));
+	}
+
+	// ================================================================================
+	// helpers
+
+	void SetNonBlocking(int fd)
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+}
+
+#endif // !_WIN32
@@ -0,0 +1,68 @@
+//
+//  PosixTransport.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "Transport.h"
+#include <atomic>
+#include <mutex>
+
+#if !defined(_WIN32)
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// manual-reset event that poll() can wait on, a self-pipe holding one byte while set
+
+	class PollEvent
+	{
+	private:
+		int fds[2] = { -1, -1 };
+		std::mutex mutex;
+		bool signaled = false;
+	public:
+		PollEvent();
+		~PollEvent();
+		PollEvent(const PollEvent&) = delete;
+		PollEvent& operator=(const PollEvent&) = delete;
+		void Set();
+		void Reset();
+		int GetFd() const;
+	};
+
+	// ================================================================================
+	// ITransport over a non-blocking file descriptor, the blocking calls wait in poll() together with the cancel events.
+	// a socket is served with recv()/send() so a closed peer does not raise SIGPIPE, anything else (a pty master) with read()/write().
+	// the descriptor is owned by the caller and must not change while the transport is attached to an engine.
+
+	class PollTransport : public ITransport
+	{
+	private:
+		int fd = -1;
+		bool isSocket;
+		PollEvent readCancelEvent;
+		PollEvent writeCancelEvent;
+		std::atomic<bool> readCancelled{ false };
+		std::atomic<bool> writeCancelled{ false };
+		ResultCode WaitForFd(short events, PollEvent& cancel, const std::atomic<bool>& cancelled);
+	public:
+		PollTransport(bool socket);
+		int GetFd() const;
+		void SetFd(int v);
+		virtual ResultCode Read(uint8_t* p, int c, int* cr) override;
+		virtual ResultCode Write(const uint8_t* p, int c, int* cw) override;
+		virtual void SetReadCancelled(bool v) override;
+		virtual void SetWriteCancelled(bool v) override;
+		// EOF, a reset connection and the EIO of a pty whose other side is gone
+		virtual bool IsBrokenPipe(ResultCode r) const override;
+	};
+
+	// O_NONBLOCK and FD_CLOEXEC
+	void SetNonBlocking(int fd);
+}
+
+#endif
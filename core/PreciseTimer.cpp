@@ -0,0 +1,54 @@
+//
+//  PreciseTimer.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "PreciseTimer.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <thread>
+#endif
+
+#if defined(_WIN32) && !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Windows 10 1803 and later
+#endif
+
+namespace MidiBridgeCore
+{
+#if defined(_WIN32)
+	PreciseTimer::PreciseTimer()
+	{
+		hTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		// older systems reject the flag, fall back to an ordinary timer
+		if(!hTimer) hTimer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	}
+	PreciseTimer::~PreciseTimer()
+	{
+		if(hTimer) CloseHandle(hTimer);
+	}
+	void PreciseTimer::SleepUntil(std::chrono::steady_clock::time_point t)
+	{
+		std::chrono::steady_clock::duration dt = t - std::chrono::steady_clock::now();
+		if(dt.count() <= 0) return;
+		// relative due time in 100 nsec units
+		LARGE_INTEGER due;
+		due.QuadPart = -(std::max<LONGLONG>)(1, (LONGLONG)(std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count() / 100));
+		if(hTimer && SetWaitableTimer(hTimer, &due, 0, nullptr, nullptr, FALSE)) WaitForSingleObject(hTimer, INFINITE);
+		else Sleep(0);
+	}
+#else
+	PreciseTimer::PreciseTimer()
+	{
+	}
+	PreciseTimer::~PreciseTimer()
+	{
+	}
+	void PreciseTimer::SleepUntil(std::chrono::steady_clock::time_point t)
+	{
+		std::this_thread::sleep_until(t);
+	}
+#endif
+}
@@ -0,0 +1,29 @@
+//
+//  PreciseTimer.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <chrono>
+
+namespace MidiBridgeCore
+{
+	//
+	// sub-millisecond sleep for pacing, the default Windows timer resolution is far coarser than one MIDI byte (320 usec).
+	// on Windows this is a high resolution waitable timer, elsewhere the standard sleep is already precise enough.
+	//
+	class PreciseTimer
+	{
+	private:
+		void* hTimer = nullptr;
+	public:
+		PreciseTimer();
+		~PreciseTimer();
+		PreciseTimer(const PreciseTimer&) = delete;
+		PreciseTimer& operator=(const PreciseTimer&) = delete;
+		void SleepUntil(std::chrono::steady_clock::time_point t);
+	};
+}
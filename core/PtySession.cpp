@@ -0,0 +1,137 @@
+//
+//  PtySession.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if !defined(_WIN32)
+
+#include "PtySession.h"
+#include "CoreDebugPrint.h"
+#include "PosixTransport.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// pty session class
+
+	class PtySession : public IPtySession
+	{
+	private:
+		PipeInMidiOut& pipeInMidiOut;
+		MidiInPipeOut& midiInPipeOut;
+		std::string linkPath;
+		std::string slavePath;
+		int masterFd = -1;
+		int slaveFd = -1;
+		PollTransport transport{ false };
+		ResultCode sessionError = ResultOk;
+		ResultCode OpenPty()
+		{
+			// posix_openpt() is what openpty() does underneath, without the libutil dependency
+			masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+			if(masterFd < 0) return errno;
+			if((grantpt(masterFd) != 0) || (unlockpt(masterFd) != 0)) return errno;
+			const char* name = ptsname(masterFd);
+			if(!name) return errno;
+			slavePath = name;
+			slaveFd = open(name, O_RDWR | O_NOCTTY);
+			if(slaveFd < 0) return errno;
+			// no echo, no CR/LF translation, no signal characters and no XON/XOFF, the line carries MIDI bytes
+			termios tio;
+			if(tcgetattr(slaveFd, &tio) != 0) return errno;
+			cfmakeraw(&tio);
+			tio.c_cflag |= CLOCAL | CREAD;
+			tio.c_cc[VMIN] = 1;
+			tio.c_cc[VTIME] = 0;
+			if(tcsetattr(slaveFd, TCSANOW, &tio) != 0) return errno;
+			SetNonBlocking(masterFd);
+			fcntl(slaveFd, F_SETFD, FD_CLOEXEC);
+			if(!linkPath.empty())
+			{
+				// replace a link left behind by a previous run, never a regular file
+				struct stat st;
+				if((lstat(linkPath.c_str(), &st) == 0) && S_ISLNK(st.st_mode)) unlink(linkPath.c_str());
+				if(symlink(slavePath.c_str(), linkPath.c_str()) != 0) return errno;
+			}
+			return ResultOk;
+		}
+		void ClosePty()
+		{
+			if(!linkPath.empty() && !slavePath.empty())
+			{
+				char target[256];
+				ssize_t n = readlink(linkPath.c_str(), target, sizeof(target) - 1);
+				if((n > 0) && (slavePath == std::string(target, (size_t)n))) unlink(linkPath.c_str());
+			}
+			if(slaveFd >= 0) close(slaveFd);
+			if(masterFd >= 0) close(masterFd);
+			slaveFd = masterFd = -1;
+			slavePath.clear();
+		}
+	public:
+		PtySession(PipeInMidiOut& p2m, MidiInPipeOut& m2p, const std::string& link)
+			: pipeInMidiOut(p2m)
+			, midiInPipeOut(m2p)
+			, linkPath(link)
+		{
+		}
+		virtual ~PtySession() override
+		{
+			StopSession();
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = OpenPty();
+			if(ResultIsError(sessionError))
+			{
+				ClosePty();
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[PtySession] failed to open the pty\n");
+				return false;
+			}
+			transport.SetFd(masterFd);
+			pipeInMidiOut.SetTransport(&transport, true);
+			midiInPipeOut.SetTransport(&transport, true);
+			return true;
+		}
+		virtual void StopSession() override
+		{
+			if(masterFd < 0) return;
+			pipeInMidiOut.SetTransport(nullptr, false);
+			midiInPipeOut.SetTransport(nullptr, false);
+			transport.SetFd(-1);
+			ClosePty();
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return masterFd >= 0;
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+		virtual std::string GetSlavePath() const override
+		{
+			return slavePath;
+		}
+	};
+
+	// ================================================================================
+	// factory
+
+	std::unique_ptr<IPtySession> CreatePtySession(PipeInMidiOut& p2m, MidiInPipeOut& m2p, const std::string& linkpath)
+	{
+		return std::make_unique<PtySession>(p2m, m2p, linkpath);
+	}
+}
+
+#endif // !_WIN32
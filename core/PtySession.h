@@ -0,0 +1,34 @@
+//
+//  PtySession.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "PipeSession.h"
+#include "TransferEngine.h"
+#include <memory>
+#include <string>
+
+#if !defined(_WIN32)
+
+namespace MidiBridgeCore
+{
+	//
+	// pseudo-terminal session for emulators that attach their COM port to a host tty (DOSBox-X, 86Box, MAME), result codes are errno values.
+	// the engines run over the master side, the emulator opens the slave, which is put into raw mode so every byte passes unchanged.
+	// the session holds the slave open itself, so the tty survives the emulator closing and reopening it,
+	// what the MIDI in sends while nobody reads stays in the tty buffer and then in the engine's queue until it overruns.
+	//
+	struct IPtySession : public IPipeSession
+	{
+		// the slave device, e.g. /dev/pts/3, empty while the session is stopped
+		virtual std::string GetSlavePath() const = 0;
+	};
+	// a non-empty linkpath gets a symbolic link to the slave while the session runs, a stable name for the emulator's configuration
+	std::unique_ptr<IPtySession> CreatePtySession(PipeInMidiOut& p2m, MidiInPipeOut& m2p, const std::string& linkpath = std::string());
+}
+
+#endif
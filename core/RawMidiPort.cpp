@@ -0,0 +1,147 @@
+//
+//  RawMidiPort.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if !defined(_WIN32)
+
+#include "RawMidiPort.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// RawMidiOutPort
+
+	RawMidiOutPort::RawMidiOutPort()
+	{
+	}
+	RawMidiOutPort::~RawMidiOutPort()
+	{
+		CloseDevice();
+	}
+	ResultCode RawMidiOutPort::OpenDevice(const std::string& path)
+	{
+		CloseDevice();
+		fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+		return (fd < 0) ? errno : ResultOk;
+	}
+	void RawMidiOutPort::CloseDevice()
+	{
+		if(fd >= 0) close(fd);
+		fd = -1;
+	}
+	bool RawMidiOutPort::IsDeviceOpen() const
+	{
+		return fd >= 0;
+	}
+	ResultCode RawMidiOutPort::Send(const uint8_t* p, int c)
+	{
+		if(fd < 0) return EBADF;
+		while(c > 0)
+		{
+			if(sendCancelled) return ResultCancelled;
+			ssize_t n = write(fd, p, (size_t)c);
+			if(n > 0) { p += n; c -= (int)n; continue; }
+			if((n < 0) && (errno == EINTR)) continue;
+			if((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) return errno;
+			pollfd pfds[] = { { fd, POLLOUT, 0 }, { cancelEvent.GetFd(), POLLIN, 0 } };
+			if((poll(pfds, 2, -1) < 0) && (errno != EINTR)) return errno;
+		}
+		return ResultOk;
+	}
+	bool RawMidiOutPort::IsShortMessageConcurrent() const
+	{
+		return true;
+	}
+	void RawMidiOutPort::SetSendCancelled(bool v)
+	{
+		sendCancelled = v;
+		if(v) cancelEvent.Set();
+		else cancelEvent.Reset();
+	}
+
+	// ================================================================================
+	// RawMidiInPort
+
+	RawMidiInPort::RawMidiInPort() : WorkerThread("RawMidiInPort")
+	{
+	}
+	RawMidiInPort::~RawMidiInPort()
+	{
+		CloseDevice();
+	}
+	ResultCode RawMidiInPort::OpenDevice(const std::string& path)
+	{
+		CloseDevice();
+		fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+		return (fd < 0) ? errno : ResultOk;
+	}
+	void RawMidiInPort::CloseDevice()
+	{
+		StopDevice();
+		if(fd >= 0) close(fd);
+		fd = -1;
+	}
+	ResultCode RawMidiInPort::GetReadError() const
+	{
+		return readError;
+	}
+	bool RawMidiInPort::IsDeviceOpen() const
+	{
+		return fd >= 0;
+	}
+	ResultCode RawMidiInPort::StartDevice()
+	{
+		if(fd < 0) return EBADF;
+		if(IsThreadRunning()) return ResultOk;
+		quitPollEvent.Reset();
+		framer.Reset();
+		readError = ResultOk;
+		return StartThread() ? ResultOk : EAGAIN;
+	}
+	ResultCode RawMidiInPort::StopDevice()
+	{
+		StopThread();
+		return ResultOk;
+	}
+	void RawMidiInPort::RequestToQuitThread()
+	{
+		WorkerThread::RequestToQuitThread();
+		quitPollEvent.Set();
+	}
+	unsigned int RawMidiInPort::Run()
+	{
+		uint8_t buffer[256];
+		while(!quitFlag)
+		{
+			pollfd pfds[] = { { fd, POLLIN, 0 }, { quitPollEvent.GetFd(), POLLIN, 0 } };
+			if(poll(pfds, 2, -1) < 0)
+			{
+				if(errno == EINTR) continue;
+				readError = errno;
+				break;
+			}
+			if(quitFlag) break;
+			ssize_t n = read(fd, buffer, sizeof(buffer));
+			if(n < 0)
+			{
+				if((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) continue;
+				readError = errno;
+				break;
+			}
+			if(n == 0) { readError = EIO; break; }
+			MidiTimestamp t = std::chrono::steady_clock::now();
+			if(!OnMidiInReceived) continue;
+			framer.Process(buffer, (int)n, [this, t](const MidiMessage& m) { if(m.length > 0) OnMidiInReceived(m.data, m.length, t); });
+		}
+		return 0;
+	}
+}
+
+#endif
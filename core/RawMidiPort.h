@@ -0,0 +1,69 @@
+//
+//  RawMidiPort.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "MidiPort.h"
+#include "MidiFramer.h"
+#include "PosixTransport.h"
+#include "WorkerThread.h"
+#include <atomic>
+#include <string>
+
+#if !defined(_WIN32)
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// MIDI ports over a raw MIDI character device (ALSA /dev/snd/midiC1D0, OSS /dev/midi1) or any byte stream, result codes are errno values.
+	// the device is opened non-blocking, the waits are polls together with a cancel event.
+
+	class RawMidiOutPort : public IMidiOutPort
+	{
+	private:
+		int fd = -1;
+		PollEvent cancelEvent;
+		std::atomic<bool> sendCancelled{ false };
+	public:
+		RawMidiOutPort();
+		virtual ~RawMidiOutPort() override;
+		RawMidiOutPort(const RawMidiOutPort&) = delete;
+		RawMidiOutPort& operator=(const RawMidiOutPort&) = delete;
+		ResultCode OpenDevice(const std::string& path);
+		void CloseDevice();
+		virtual bool IsDeviceOpen() const override;
+		// writes all of it, waiting while the device buffer is full
+		virtual ResultCode Send(const uint8_t* p, int c) override;
+		// each write() is one call into the driver, a real-time byte may land between the chunks of a long message
+		virtual bool IsShortMessageConcurrent() const override;
+		virtual void SetSendCancelled(bool v) override;
+	};
+
+	// the reader thread frames the bytes and calls OnMidiInReceived once per message or SysEx segment, stamped with the read time
+	class RawMidiInPort : public IMidiInPort, private WorkerThread
+	{
+	private:
+		int fd = -1;
+		PollEvent quitPollEvent;
+		MidiFramer framer;
+		std::atomic<ResultCode> readError{ ResultOk };
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+	public:
+		RawMidiInPort();
+		virtual ~RawMidiInPort() override;
+		ResultCode OpenDevice(const std::string& path);
+		void CloseDevice();
+		// the error that ended the reader, e.g. EIO when a USB device was unplugged
+		ResultCode GetReadError() const;
+		virtual bool IsDeviceOpen() const override;
+		virtual ResultCode StartDevice() override;
+		virtual ResultCode StopDevice() override;
+	};
+}
+
+#endif
@@ -0,0 +1,170 @@
+//
+//  Reactor.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if defined(__linux__)
+
+#include "Reactor.h"
+#include "CoreDebugPrint.h"
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	Reactor::Reactor() : WorkerThread("Reactor")
+	{
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if((epollFd >= 0) && (wakeFd >= 0))
+		{
+			epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.fd = wakeFd;
+			epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+		}
+	}
+	Reactor::~Reactor()
+	{
+		Stop();
+		if(wakeFd >= 0) close(wakeFd);
+		if(epollFd >= 0) close(epollFd);
+	}
+	void Reactor::RunTasks()
+	{
+		std::vector<std::function<void()> > v;
+		{
+			std::lock_guard<std::mutex> lock(taskMutex);
+			v.swap(tasks);
+		}
+		for(auto&& f : v) f();
+	}
+	unsigned int Reactor::Run()
+	{
+		CoreDebugPrint(L"[Reactor] thread begin\n");
+		reactorThreadId = std::this_thread::get_id();
+		const int MaxEvents = 64;
+		epoll_event events[MaxEvents];
+		while(1)
+		{
+			RunTasks();
+			if(quitFlag) break;
+			int n = epoll_wait(epollFd, events, MaxEvents, -1);
+			if(n < 0)
+			{
+				if(errno == EINTR) continue;
+				CoreDebugPrint(L"[Reactor] failed epoll_wait()\n");
+				break;
+			}
+			wakeCount.fetch_add(1, std::memory_order_relaxed);
+			for(int i = 0; i < n; ++i)
+			{
+				int fd = events[i].data.fd;
+				if(fd == wakeFd)
+				{
+					uint64_t v;
+					if(read(wakeFd, &v, sizeof(v)) < 0) {}
+					continue;
+				}
+				// an earlier handler of this batch may have removed the descriptor, the copy keeps a handler alive that removes itself
+				auto it = handlers.find(fd);
+				if(it == handlers.end()) continue;
+				std::shared_ptr<Handler> h = it->second;
+				eventCount.fetch_add(1, std::memory_order_relaxed);
+				(*h)(events[i].events);
+			}
+		}
+		reactorThreadId = std::thread::id();
+		CoreDebugPrint(L"[Reactor] thread end\n");
+		return 0;
+	}
+	void Reactor::RequestToQuitThread()
+	{
+		WorkerThread::RequestToQuitThread();
+		const uint64_t v = 1;
+		if(write(wakeFd, &v, sizeof(v)) < 0) {}
+	}
+	bool Reactor::Start()
+	{
+		if(IsThreadRunning()) return true;
+		if((epollFd < 0) || (wakeFd < 0)) return false;
+		return StartThread();
+	}
+	void Reactor::Stop()
+	{
+		StopThread();
+		// what was posted after the last round still runs, nobody waits forever in Invoke()
+		RunTasks();
+	}
+	bool Reactor::IsRunning() const
+	{
+		return IsThreadRunning();
+	}
+	bool Reactor::IsReactorThread() const
+	{
+		return reactorThreadId.load() == std::this_thread::get_id();
+	}
+	ResultCode Reactor::Add(int fd, uint32_t events, Handler h)
+	{
+		ResultCode r = ResultOk;
+		Invoke([&]()
+		{
+			epoll_event ev = {};
+			ev.events = events;
+			ev.data.fd = fd;
+			if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) { r = errno; return; }
+			handlers[fd] = std::make_shared<Handler>(std::move(h));
+		});
+		return r;
+	}
+	ResultCode Reactor::Modify(int fd, uint32_t events)
+	{
+		ResultCode r = ResultOk;
+		Invoke([&]()
+		{
+			epoll_event ev = {};
+			ev.events = events;
+			ev.data.fd = fd;
+			if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) r = errno;
+		});
+		return r;
+	}
+	void Reactor::Remove(int fd)
+	{
+		Invoke([&]()
+		{
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+			handlers.erase(fd);
+		});
+	}
+	void Reactor::Post(std::function<void()> f)
+	{
+		{
+			std::lock_guard<std::mutex> lock(taskMutex);
+			tasks.push_back(std::move(f));
+		}
+		const uint64_t v = 1;
+		if(write(wakeFd, &v, sizeof(v)) < 0) {}
+	}
+	void Reactor::Invoke(const std::function<void()>& f)
+	{
+		if(IsReactorThread() || !IsThreadRunning()) { f(); return; }
+		SignalEvent done;
+		Post([&]() { f(); done.Set(); });
+		done.Wait();
+	}
+	uint64_t Reactor::GetWakeCount() const
+	{
+		return wakeCount.load(std::memory_order_relaxed);
+	}
+	uint64_t Reactor::GetEventCount() const
+	{
+		return eventCount.load(std::memory_order_relaxed);
+	}
+}
+
+#endif // __linux__
@@ -0,0 +1,66 @@
+//
+//  Reactor.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "WorkerThread.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+
+namespace MidiBridgeCore
+{
+	//
+	// single-threaded event loop over epoll, the handlers of any number of descriptors run one after another on the reactor thread.
+	// the registration calls may come from any thread, they are carried out on the reactor thread and return when done,
+	// so once Remove() has returned the handler is not called again. handlers are level-triggered.
+	//
+	class Reactor : private WorkerThread
+	{
+	public:
+		using Handler = std::function<void(uint32_t events)>;
+	private:
+		int epollFd = -1;
+		int wakeFd = -1;
+		std::unordered_map<int, std::shared_ptr<Handler> > handlers;
+		std::mutex taskMutex;
+		std::vector<std::function<void()> > tasks;
+		std::atomic<std::thread::id> reactorThreadId;
+		std::atomic<uint64_t> wakeCount{ 0 };
+		std::atomic<uint64_t> eventCount{ 0 };
+		void RunTasks();
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+	public:
+		Reactor();
+		virtual ~Reactor() override;
+		bool Start();
+		// the registrations stay, a restarted reactor serves them again
+		void Stop();
+		bool IsRunning() const;
+		bool IsReactorThread() const;
+		// events are EPOLLIN, EPOLLOUT, ..., the handler also sees EPOLLERR and EPOLLHUP
+		ResultCode Add(int fd, uint32_t events, Handler h);
+		ResultCode Modify(int fd, uint32_t events);
+		void Remove(int fd);
+		// queue f to the reactor thread
+		void Post(std::function<void()> f);
+		// run f on the reactor thread and wait for it, directly when called from there or while the reactor is stopped
+		void Invoke(const std::function<void()>& f);
+		// epoll_wait() returns and dispatched events since construction
+		uint64_t GetWakeCount() const;
+		uint64_t GetEventCount() const;
+	};
+}
+
+#endif
@@ -0,0 +1,380 @@
+//
+//  ReactorBridge.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if defined(__linux__)
+
+#include "ReactorBridge.h"
+#include "CoreDebugPrint.h"
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	ReactorBridge::ReactorBridge(Reactor& r) : reactor(r), readBuffer(ReadBufferSize), writeBuffer(WriteBufferSize), stagingRing(StagingBufferSize)
+	{
+		wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(wakeFd >= 0) reactor.Add(wakeFd, EPOLLIN, [this](uint32_t) { OnWake(); });
+	}
+	ReactorBridge::~ReactorBridge()
+	{
+		reactor.Invoke([this]() { Detach(); });
+		if(midiInPort) midiInPort->OnMidiInReceived = nullptr;
+		if(wakeFd >= 0)
+		{
+			reactor.Remove(wakeFd);
+			close(wakeFd);
+		}
+	}
+	void ReactorBridge::OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t)
+	{
+		if(!isAccepting.load(std::memory_order_relaxed)) return;
+		const uint8_t* in = p;
+		int cin = c;
+		uint8_t w[3];
+		FlightRecorder* recorder = flightRecorder.load(std::memory_order_relaxed);
+		if(IMessageFilter* filter = midiToPipeFilter.load(std::memory_order_relaxed); filter && (c > 0))
+		{
+			MidiMessage fm;
+			if(!ApplyMessageFilter(*filter, ClassifyMidiMessage(p, c), fm, w))
+			{
+				if(recorder) recorder->Record(FlightDirection::MidiToPipe, in, cin, t);
+				midiFilteredMessages.Add();
+				return;
+			}
+			p = fm.data;
+			c = fm.length;
+		}
+		if(!stagingRing.PushRange(p, (size_t)c))
+		{
+			overrunBytes += (uint64_t)c;
+			return;
+		}
+		if(recorder) recorder->Record(FlightDirection::MidiToPipe, in, cin, t);
+		midiInMessages.Add();
+		// pairs with the fence in DrainStaging(), either the reactor sees the bytes or we see it idle
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if(wakeArmed.load(std::memory_order_relaxed) && wakeArmed.exchange(false))
+		{
+			const uint64_t v = 1;
+			if(write(wakeFd, &v, sizeof(v)) < 0) {}
+		}
+	}
+	void ReactorBridge::OnConnectionEvent(uint32_t events)
+	{
+		if((events & EPOLLOUT) && !DrainStaging()) return;
+		if(interest & EPOLLIN)
+		{
+			// a hangup is seen as the end of the data, what the peer sent before it is still delivered
+			if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) ReadConnection();
+			return;
+		}
+		if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) Fail(ResultBrokenPipe, false);
+	}
+	void ReactorBridge::OnWake()
+	{
+		uint64_t v;
+		if(read(wakeFd, &v, sizeof(v)) < 0) {}
+		wakeCount.Add();
+		if(isAttached) DrainStaging();
+	}
+	bool ReactorBridge::ReadConnection()
+	{
+		ssize_t n = read(connection, readBuffer.data(), readBuffer.size());
+		if(n < 0)
+		{
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return true;
+			Fail((errno == ECONNRESET) ? ResultBrokenPipe : errno, false);
+			return false;
+		}
+		if(n == 0)
+		{
+			Fail(ResultBrokenPipe, false);
+			return false;
+		}
+		std::chrono::steady_clock::time_point readtime = std::chrono::steady_clock::now();
+		pipeReadCalls.Add();
+		pipeReadBytes.Add((uint64_t)n);
+		ResultCode r = ResultOk;
+		FlightRecorder* recorder = flightRecorder.load(std::memory_order_relaxed);
+		IMessageFilter* filter = pipeToMidiFilter.load(std::memory_order_relaxed);
+		uint64_t discarded = framer.GetDiscardedBytes();
+		framer.Process(readBuffer.data(), (int)n, [&](const MidiMessage& m)
+		{
+			pipeMessages.Add();
+			if(recorder) recorder->Record(FlightDirection::PipeToMidi, m.data, m.length, readtime);
+			if(ResultIsError(r)) return;
+			if(!filter) { r = dispatcher.Dispatch(m); return; }
+			MidiMessage fm;
+			uint8_t w[3];
+			if(ApplyMessageFilter(*filter, m, fm, w))	r = dispatcher.Dispatch(fm);
+			else										pipeFilteredMessages.Add();
+		});
+		if(!ResultIsError(r)) r = dispatcher.Flush();
+		discardedBytes.Add(framer.GetDiscardedBytes() - discarded);
+		if(ResultIsError(r))
+		{
+			Fail(r, true);
+			return false;
+		}
+		readToSendLatency.Record(std::chrono::steady_clock::now() - readtime);
+		return true;
+	}
+	bool ReactorBridge::DrainStaging()
+	{
+		while(1)
+		{
+			if(writeOffset == writeLength)
+			{
+				writeOffset = 0;
+				writeLength = stagingRing.PopRange(writeBuffer.data(), writeBuffer.size());
+				if(writeLength == 0)
+				{
+					if(interest & EPOLLOUT) { interest &= ~(uint32_t)EPOLLOUT; UpdateInterest(); }
+					wakeArmed.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if(stagingRing.IsEmpty()) return true;
+					// a callback that saw us busy has left its bytes, unless it has just claimed the wake-up itself
+					if(!wakeArmed.exchange(false)) return true;
+					continue;
+				}
+			}
+			ssize_t n = isSocket
+				? send(connection, writeBuffer.data() + writeOffset, writeLength - writeOffset, MSG_NOSIGNAL)
+				: write(connection, writeBuffer.data() + writeOffset, writeLength - writeOffset);
+			if(n >= 0)
+			{
+				pipeWriteCalls.Add();
+				writtenBytes.Add((uint64_t)n);
+				writeOffset += (size_t)n;
+				continue;
+			}
+			if(errno == EINTR) continue;
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				if(!(interest & EPOLLOUT)) { interest |= EPOLLOUT; UpdateInterest(); }
+				return true;
+			}
+			Fail(((errno == EPIPE) || (errno == ECONNRESET) || (errno == EIO)) ? ResultBrokenPipe : errno, false);
+			return false;
+		}
+	}
+	void ReactorBridge::UpdateInterest()
+	{
+		if(isAttached) reactor.Modify(connection, interest);
+	}
+	void ReactorBridge::Attach()
+	{
+		if(isAttached || (connection < 0)) return;
+		deviceError = ResultOk;
+		pipeError = ResultOk;
+		framer.Reset();
+		bool out = midiOutPort && midiOutPort->IsDeviceOpen();
+		dispatcher.SetMidiOutPort(out ? midiOutPort : nullptr);
+		// the device is stopped, so the leftovers of the previous connection can be discarded from this side
+		uint8_t discard[256];
+		while(stagingRing.PopRange(discard, sizeof(discard)) > 0) {}
+		writeOffset = writeLength = 0;
+		wakeArmed = true;
+		interest = EPOLLRDHUP | (out ? (uint32_t)EPOLLIN : 0);
+		ResultCode r = reactor.Add(connection, interest, [this](uint32_t events) { OnConnectionEvent(events); });
+		if(ResultIsError(r))
+		{
+			pipeError = r;
+			if(OnPipeError) OnPipeError(r);
+			return;
+		}
+		isAttached = true;
+		if(midiInPort && midiInPort->IsDeviceOpen())
+		{
+			isAccepting = true;
+			r = midiInPort->StartDevice();
+			if(ResultIsError(r)) { isAccepting = false; Fail(r, true); return; }
+			isDeviceStarted = true;
+		}
+	}
+	void ReactorBridge::Detach()
+	{
+		if(isDeviceStarted) midiInPort->StopDevice();
+		isDeviceStarted = false;
+		isAccepting = false;
+		if(isAttached) reactor.Remove(connection);
+		isAttached = false;
+	}
+	void ReactorBridge::Fail(ResultCode r, bool device)
+	{
+		Detach();
+		if(device)
+		{
+			deviceError = r;
+			if(OnDeviceError) OnDeviceError(r);
+		}
+		else
+		{
+			pipeError = r;
+			if(!(isServer && (r == ResultBrokenPipe)) && OnPipeError) OnPipeError(r);
+		}
+		if(OnStopped) OnStopped();
+	}
+	Reactor& ReactorBridge::GetReactor() const
+	{
+		return reactor;
+	}
+	int ReactorBridge::GetConnection() const
+	{
+		return connection;
+	}
+	void ReactorBridge::SetConnection(int fd, bool server)
+	{
+		reactor.Invoke([&]()
+		{
+			Detach();
+			connection = fd;
+			isServer = server;
+			int type = 0;
+			socklen_t len = sizeof(type);
+			isSocket = (fd >= 0) && (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0);
+			if(fd >= 0) connectCount.Add();
+			Attach();
+		});
+	}
+	IMidiOutPort* ReactorBridge::GetMidiOutPort() const
+	{
+		return midiOutPort;
+	}
+	void ReactorBridge::SetMidiOutPort(IMidiOutPort* p)
+	{
+		reactor.Invoke([&]()
+		{
+			Detach();
+			midiOutPort = p;
+			Attach();
+		});
+	}
+	IMidiInPort* ReactorBridge::GetMidiInPort() const
+	{
+		return midiInPort;
+	}
+	void ReactorBridge::SetMidiInPort(IMidiInPort* p)
+	{
+		reactor.Invoke([&]()
+		{
+			Detach();
+			if(midiInPort) midiInPort->OnMidiInReceived = nullptr;
+			midiInPort = p;
+			if(midiInPort) midiInPort->OnMidiInReceived = [this](const uint8_t* data, int c, MidiTimestamp t) { OnMidiMessageReceived(data, c, t); };
+			Attach();
+		});
+	}
+	FlightRecorder* ReactorBridge::GetFlightRecorder() const
+	{
+		return flightRecorder;
+	}
+	void ReactorBridge::SetFlightRecorder(FlightRecorder* p)
+	{
+		// the device is stopped while detached, so no callback is left holding the old recorder
+		reactor.Invoke([&]()
+		{
+			Detach();
+			flightRecorder = p;
+			Attach();
+		});
+	}
+	IMessageFilter* ReactorBridge::GetPipeToMidiFilter() const
+	{
+		return pipeToMidiFilter;
+	}
+	IMessageFilter* ReactorBridge::GetMidiToPipeFilter() const
+	{
+		return midiToPipeFilter;
+	}
+	void ReactorBridge::SetPipeToMidiFilter(IMessageFilter* p)
+	{
+		reactor.Invoke([&]()
+		{
+			Detach();
+			pipeToMidiFilter = p;
+			Attach();
+		});
+	}
+	void ReactorBridge::SetMidiToPipeFilter(IMessageFilter* p)
+	{
+		// the device is stopped while detached, so no callback is left holding the old filter
+		reactor.Invoke([&]()
+		{
+			Detach();
+			midiToPipeFilter = p;
+			Attach();
+		});
+	}
+	bool ReactorBridge::IsRunning() const
+	{
+		return isAttached;
+	}
+	ResultCode ReactorBridge::GetDeviceError() const
+	{
+		return deviceError;
+	}
+	ResultCode ReactorBridge::GetPipeError() const
+	{
+		return pipeError;
+	}
+	uint64_t ReactorBridge::GetOverrunBytes() const
+	{
+		return overrunBytes;
+	}
+	uint64_t ReactorBridge::GetWakeCount() const
+	{
+		return wakeCount.Get();
+	}
+	BridgeStatistics ReactorBridge::GetStatistics() const
+	{
+		BridgeStatistics st;
+		PipeInMidiOutStatistics& p = st.pipeToMidi;
+		p.pipeReadCalls = pipeReadCalls.Get();
+		p.pipeReadBytes = pipeReadBytes.Get();
+		p.messages = pipeMessages.Get();
+		p.shortSends = dispatcher.GetShortSendCount();
+		p.longSends = dispatcher.GetLongSendCount();
+		p.discardedBytes = discardedBytes.Get();
+		p.filteredMessages = pipeFilteredMessages.Get();
+		p.connects = connectCount.Get();
+		p.reconnects = (p.connects > 0) ? p.connects - 1 : 0;
+		IMidiOutPort* port = midiOutPort;
+		p.bufferLowWater = port ? port->GetBufferLowWater() : -1;
+		p.readToSendLatency = readToSendLatency.GetSnapshot();
+		MidiInPipeOutStatistics& m = st.midiToPipe;
+		m.messages = midiInMessages.Get();
+		m.bytes = writtenBytes.Get();
+		m.pipeWriteCalls = pipeWriteCalls.Get();
+		m.droppedBytes = overrunBytes;
+		m.filteredMessages = midiFilteredMessages.Get();
+		m.connects = p.connects;
+		m.reconnects = p.reconnects;
+		return st;
+	}
+	void ReactorBridge::ResetStatistics()
+	{
+		pipeReadCalls.Reset();
+		pipeReadBytes.Reset();
+		pipeMessages.Reset();
+		pipeFilteredMessages.Reset();
+		midiFilteredMessages.Reset();
+		discardedBytes.Reset();
+		dispatcher.ResetCounters();
+		midiInMessages.Reset();
+		writtenBytes.Reset();
+		pipeWriteCalls.Reset();
+		wakeCount.Reset();
+		connectCount.Reset();
+		readToSendLatency.Reset();
+	}
+}
+
+#endif // __linux__
@@ -0,0 +1,125 @@
+//
+//  ReactorBridge.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "MidiPort.h"
+#include "MidiFramer.h"
+#include "MidiOutDispatcher.h"
+#include "Reactor.h"
+#include "SpscRing.h"
+#include "Statistics.h"
+#include "FlightRecorder.h"
+#include "MessageFilter.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#if defined(__linux__)
+
+namespace MidiBridgeCore
+{
+	//
+	// both directions of one connection as handlers on a Reactor, the threadless counterpart of PipeInMidiOut + MidiInPipeOut:
+	// - a readable connection is framed and dispatched to the MIDI out on the reactor thread, so the port's Send() should not block for long
+	// - the MIDI in callback stages its bytes and wakes the reactor through an eventfd only when it is idle,
+	//   what arrives while a write is in progress goes out with the next write, so a burst costs one wake-up
+	// - there is no coalescing delay and no serial pacing, a connection that needs them stays on the threaded engines
+	// the connection is a connected non-blocking socket or tty owned by the caller. the callbacks run on the reactor thread.
+	//
+	class ReactorBridge
+	{
+	private:
+		static constexpr int ReadBufferSize = 1024;
+		static constexpr int WriteBufferSize = 4096;
+		static constexpr size_t StagingBufferSize = 64 * 1024;
+		Reactor& reactor;
+		IMidiOutPort* midiOutPort = nullptr;
+		IMidiInPort* midiInPort = nullptr;
+		std::atomic<FlightRecorder*> flightRecorder{ nullptr };
+		std::atomic<IMessageFilter*> pipeToMidiFilter{ nullptr };
+		std::atomic<IMessageFilter*> midiToPipeFilter{ nullptr };
+		int connection = -1;
+		bool isSocket = false;
+		bool isServer = false;
+		bool isAttached = false;
+		bool isDeviceStarted = false;
+		uint32_t interest = 0;
+		int wakeFd = -1;
+		MidiFramer framer;
+		MidiOutDispatcher dispatcher;
+		std::vector<uint8_t> readBuffer;
+		std::vector<uint8_t> writeBuffer;
+		size_t writeOffset = 0;
+		size_t writeLength = 0;
+		SpscRing<uint8_t> stagingRing;
+		// set while the reactor has nothing left to write, the callback that clears it owes the wake-up
+		std::atomic<bool> wakeArmed{ true };
+		std::atomic<bool> isAccepting{ false };
+		std::atomic<ResultCode> deviceError{ ResultOk };
+		std::atomic<ResultCode> pipeError{ ResultOk };
+		std::atomic<uint64_t> overrunBytes{ 0 };
+		RelaxedCounter pipeReadCalls;
+		RelaxedCounter pipeReadBytes;
+		RelaxedCounter pipeMessages;
+		RelaxedCounter discardedBytes;
+		RelaxedCounter pipeFilteredMessages;
+		RelaxedCounter midiFilteredMessages;
+		RelaxedCounter midiInMessages;
+		RelaxedCounter writtenBytes;
+		RelaxedCounter pipeWriteCalls;
+		RelaxedCounter wakeCount;
+		RelaxedCounter connectCount;
+		LatencyHistogram readToSendLatency;
+		void OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t);
+		void OnConnectionEvent(uint32_t events);
+		void OnWake();
+		bool ReadConnection();
+		bool DrainStaging();
+		void UpdateInterest();
+		void Attach();
+		void Detach();
+		void Fail(ResultCode r, bool device);
+	public:
+		std::function<void(ResultCode)> OnDeviceError;
+		std::function<void(ResultCode)> OnPipeError;
+		// the connection has failed and is detached, the owner closes it
+		std::function<void()> OnStopped;
+		ReactorBridge(Reactor& r);
+		~ReactorBridge();
+		ReactorBridge(const ReactorBridge&) = delete;
+		ReactorBridge& operator=(const ReactorBridge&) = delete;
+		Reactor& GetReactor() const;
+		int GetConnection() const;
+		// -1 detaches, server has the same meaning as for PipeInMidiOut::SetTransport()
+		void SetConnection(int fd, bool server);
+		IMidiOutPort* GetMidiOutPort() const;
+		void SetMidiOutPort(IMidiOutPort* p);
+		IMidiInPort* GetMidiInPort() const;
+		void SetMidiInPort(IMidiInPort* p);
+		FlightRecorder* GetFlightRecorder() const;
+		// captures both directions, the recorder stays open while it is attached, the connection is detached and attached again
+		void SetFlightRecorder(FlightRecorder* p);
+		IMessageFilter* GetPipeToMidiFilter() const;
+		IMessageFilter* GetMidiToPipeFilter() const;
+		// the same as PipeInMidiOut::SetMessageFilter() and MidiInPipeOut::SetMessageFilter(), the connection is detached and attached again
+		void SetPipeToMidiFilter(IMessageFilter* p);
+		void SetMidiToPipeFilter(IMessageFilter* p);
+		bool IsRunning() const;
+		ResultCode GetDeviceError() const;
+		ResultCode GetPipeError() const;
+		uint64_t GetOverrunBytes() const;
+		// reactor wake-ups caused by the MIDI in callback
+		uint64_t GetWakeCount() const;
+		// the latency of the MIDI in direction is not recorded in this mode
+		BridgeStatistics GetStatistics() const;
+		void ResetStatistics();
+	};
+}
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  SharedBlockPool.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace MidiBridgeCore
+{
+	// a captured message (or a piece of a long one), shared by every consumer that was handed a reference
+	struct SharedMidiBlock
+	{
+		static constexpr int Capacity = 256;
+		SharedMidiBlock* next = nullptr;	// free list link
+		std::atomic<int> refCount{ 0 };
+		int length = 0;
+		uint8_t data[Capacity];
+	};
+
+	//
+	// fixed set of refcounted blocks: the producer fills a block once and hands a reference to each consumer,
+	// the last Release() puts it back, so fanning a message out costs one copy however many consumers there are.
+	//
+	// NOTE:
+	// Acquire() must only be called from one thread (the driver callback), Release() from any thread.
+	// The free list is an intrusive stack, with a single popper the head cannot be recycled between the load and the CAS, so there is no ABA.
+	//
+	class SharedBlockPool
+	{
+	private:
+		std::unique_ptr<SharedMidiBlock[]> blocks;
+		size_t blockCount = 0;
+		std::atomic<SharedMidiBlock*> freeHead{ nullptr };
+		std::atomic<size_t> freeCount{ 0 };
+		void Push(SharedMidiBlock* b)
+		{
+			freeCount.fetch_add(1, std::memory_order_relaxed);
+			SharedMidiBlock* h = freeHead.load(std::memory_order_relaxed);
+			do { b->next = h; } while(!freeHead.compare_exchange_weak(h, b, std::memory_order_release, std::memory_order_relaxed));
+		}
+	public:
+		SharedBlockPool(size_t count = 0)
+		{
+			Reset(count);
+		}
+		SharedBlockPool(const SharedBlockPool&) = delete;
+		SharedBlockPool& operator=(const SharedBlockPool&) = delete;
+		// not thread safe, every block must be back in the pool
+		void Reset(size_t count)
+		{
+			blocks = std::make_unique<SharedMidiBlock[]>(count);
+			blockCount = count;
+			freeHead.store(nullptr, std::memory_order_relaxed);
+			freeCount.store(0, std::memory_order_relaxed);
+			for(size_t i = 0; i < count; ++i) Push(&blocks[i]);
+		}
+		size_t GetCapacity() const
+		{
+			return blockCount;
+		}
+		// approximate while blocks are being released
+		size_t GetFreeCount() const
+		{
+			return freeCount.load(std::memory_order_relaxed);
+		}
+		// the block comes with one reference held by the caller, nullptr when the pool is exhausted
+		SharedMidiBlock* Acquire()
+		{
+			SharedMidiBlock* h = freeHead.load(std::memory_order_acquire);
+			while(h && !freeHead.compare_exchange_weak(h, h->next, std::memory_order_acquire, std::memory_order_acquire)) {}
+			if(!h) return nullptr;
+			freeCount.fetch_sub(1, std::memory_order_relaxed);
+			h->refCount.store(1, std::memory_order_relaxed);
+			h->length = 0;
+			return h;
+		}
+		static void AddRef(SharedMidiBlock* b)
+		{
+			b->refCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		void Release(SharedMidiBlock* b)
+		{
+			if(b->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) Push(b);
+		}
+	};
+}
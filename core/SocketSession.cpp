@@ -0,0 +1,541 @@
+//
+//  SocketSession.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#if !defined(_WIN32)
+
+#include "SocketSession.h"
+#include "CoreDebugPrint.h"
+#include "PosixTransport.h"
+#include "WorkerThread.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// primitive classes
+
+	struct SocketAddress
+	{
+		sockaddr_storage addr = {};
+		socklen_t length = 0;
+		bool isTcp = false;
+		std::string unixPath;
+	};
+
+	static ResultCode ResolveSocketAddress(const std::string& address, bool passive, SocketAddress* sa)
+	{
+		*sa = SocketAddress();
+		if(address.compare(0, 4, "tcp:") == 0)
+		{
+			std::string hostport = address.substr(4);
+			size_t pos = hostport.rfind(':');
+			if(pos == std::string::npos) return EINVAL;
+			std::string host = hostport.substr(0, pos);
+			std::string port = hostport.substr(pos + 1);
+			if((host.size() >= 2) && (host.front() == '[') && (host.back() == ']')) host = host.substr(1, host.size() - 2);
+			if(host.empty()) host = "127.0.0.1";
+			addrinfo hints = {};
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = passive ? AI_PASSIVE : 0;
+			addrinfo* ai = nullptr;
+			if(getaddrinfo(host.c_str(), port.c_str(), &hints, &ai) != 0 || !ai) return EADDRNOTAVAIL;
+			memcpy(&sa->addr, ai->ai_addr, ai->ai_addrlen);
+			sa->length = (socklen_t)ai->ai_addrlen;
+			sa->isTcp = true;
+			freeaddrinfo(ai);
+			return ResultOk;
+		}
+		std::string path = (address.compare(0, 5, "unix:") == 0) ? address.substr(5) : address;
+		sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&sa->addr);
+		if(path.empty() || (sizeof(un->sun_path) <= path.size())) return ENAMETOOLONG;
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, path.c_str(), path.size() + 1);
+		sa->length = (socklen_t)sizeof(sockaddr_un);
+		sa->unixPath = path;
+		return ResultOk;
+	}
+
+	static void PrepareStreamSocket(int fd, bool tcp)
+	{
+		SetNonBlocking(fd);
+		// a MIDI message is a few bytes, Nagle would hold it back for an ACK
+		if(tcp) { int v = 1; setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v)); }
+	}
+
+	static ResultCode OpenListenSocket(const SocketAddress& sa, int* pfd)
+	{
+		*pfd = -1;
+		int fd = socket(sa.addr.ss_family, SOCK_STREAM, 0);
+		if(fd < 0) return errno;
+		if(sa.isTcp) { int v = 1; setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &v, sizeof(v)); }
+		// a socket file left behind by a previous run would make bind() fail, anything else is not ours to remove
+		struct stat st;
+		if(!sa.unixPath.empty() && (stat(sa.unixPath.c_str(), &st) == 0) && S_ISSOCK(st.st_mode)) unlink(sa.unixPath.c_str());
+		if((bind(fd, reinterpret_cast<const sockaddr*>(&sa.addr), sa.length) != 0) || (listen(fd, 4) != 0))
+		{
+			ResultCode r = errno;
+			close(fd);
+			return r;
+		}
+		SetNonBlocking(fd);
+		*pfd = fd;
+		return ResultOk;
+	}
+
+	static void CloseListenSocket(int& fd, const SocketAddress& sa)
+	{
+		if(fd < 0) return;
+		close(fd);
+		fd = -1;
+		if(!sa.unixPath.empty()) unlink(sa.unixPath.c_str());
+	}
+
+	// waits until a connection arrives or the cancel event is set, ResultCancelled in the latter case
+	static ResultCode AcceptSocket(int lfd, bool tcp, PollEvent& cancel, int* pfd)
+	{
+		*pfd = -1;
+		while(1)
+		{
+			int fd = accept(lfd, nullptr, nullptr);
+			if(fd >= 0)
+			{
+				PrepareStreamSocket(fd, tcp);
+				*pfd = fd;
+				return ResultOk;
+			}
+			if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) && (errno != ECONNABORTED)) return errno;
+			pollfd pfds[] = { { lfd, POLLIN, 0 }, { cancel.GetFd(), POLLIN, 0 } };
+			if((poll(pfds, 2, -1) < 0) && (errno != EINTR)) return errno;
+			if(pfds[1].revents) return ResultCancelled;
+		}
+	}
+
+	static void CloseStreamSocket(int fd)
+	{
+		if(fd < 0) return;
+		shutdown(fd, SHUT_RDWR);
+		close(fd);
+	}
+
+	// ================================================================================
+	// socket connection session classes
+
+	class SocketServer : public IPipeSession, private WorkerThread
+	{
+	private:
+		std::string address;
+		PipeInMidiOut& pipeInMidiOut;
+		MidiInPipeOut& midiInPipeOut;
+		SocketAddress socketAddress;
+		int listenSocket = -1;
+		PollEvent acceptCancelEvent;
+		SignalEvent stateEvent;
+		PollTransport transport{ true };
+		std::atomic<ResultCode> sessionError{ ResultOk };
+		virtual unsigned int Run() override
+		{
+			CoreDebugPrint(L"[SocketServer] thread begin\n");
+			while(1)
+			{
+				if(quitFlag) break;
+				int fd = -1;
+				ResultCode r = AcceptSocket(listenSocket, socketAddress.isTcp, acceptCancelEvent, &fd);
+				if(ResultIsError(r))
+				{
+					if(!quitFlag)
+					{
+						CoreDebugPrint(L"[SocketServer] failed accept()\n");
+						sessionError = r;
+						if(OnSessionError) OnSessionError(r);
+					}
+					break;
+				}
+				CoreDebugPrint(L"[SocketServer] connected\n");
+				stateEvent.Reset();
+				transport.SetFd(fd);
+				pipeInMidiOut.SetTransport(&transport, true);
+				midiInPipeOut.SetTransport(&transport, true);
+				while(1)
+				{
+					stateEvent.Wait();
+					stateEvent.Reset();
+					if( ResultIsError(pipeInMidiOut.GetDeviceError()) ||
+						ResultIsError(pipeInMidiOut.GetPipeError()) ||
+						ResultIsError(midiInPipeOut.GetDeviceError()) ||
+						ResultIsError(midiInPipeOut.GetPipeError()) ||
+						quitFlag) break;
+				}
+				shutdown(fd, SHUT_RDWR);
+				pipeInMidiOut.SetTransport(nullptr, false);
+				midiInPipeOut.SetTransport(nullptr, false);
+				close(fd);
+				transport.SetFd(-1);
+				CoreDebugPrint(L"[SocketServer] disconnected\n");
+			}
+			CoreDebugPrint(L"[SocketServer] thread end\n");
+			return 0;
+		}
+		virtual void RequestToQuitThread() override
+		{
+			quitFlag = true;
+			acceptCancelEvent.Set();
+			stateEvent.Set();
+			WorkerThread::RequestToQuitThread();
+		}
+	public:
+		SocketServer(const std::string& addr, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+			: WorkerThread("SocketServer")
+			, address(addr)
+			, pipeInMidiOut(p2m)
+			, midiInPipeOut(m2p)
+		{
+			pipeInMidiOut.OnStopped = [this]() { stateEvent.Set(); };
+			midiInPipeOut.OnStopped = [this]() { stateEvent.Set(); };
+		}
+		virtual ~SocketServer() override
+		{
+			StopSession();
+			pipeInMidiOut.OnStopped = nullptr;
+			midiInPipeOut.OnStopped = nullptr;
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			ResultCode r = ResolveSocketAddress(address, true, &socketAddress);
+			if(!ResultIsError(r)) r = OpenListenSocket(socketAddress, &listenSocket);
+			if(ResultIsError(r))
+			{
+				sessionError = r;
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[SocketServer] failed to listen\n");
+				return false;
+			}
+			acceptCancelEvent.Reset();
+			return StartThread();
+		}
+		virtual void StopSession() override
+		{
+			StopThread();
+			CloseListenSocket(listenSocket, socketAddress);
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return IsThreadRunning();
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+	// accepts a connection into each free ClientHub slot, the same thread detaches the clients whose transfer has ended
+	class SocketHubServer : public IPipeSession, private WorkerThread
+	{
+	private:
+		struct Slot
+		{
+			PollTransport transport{ true };
+			std::atomic<bool> stopped{ false };
+		};
+		std::string address;
+		ClientHub& clientHub;
+		std::vector<std::unique_ptr<Slot> > slots;
+		SocketAddress socketAddress;
+		int listenSocket = -1;
+		PollEvent wakeEvent;
+		std::atomic<ResultCode> sessionError{ ResultOk };
+		void DetachSlot(int i)
+		{
+			Slot& s = *slots[i];
+			int fd = s.transport.GetFd();
+			if(fd < 0) return;
+			shutdown(fd, SHUT_RDWR);
+			clientHub.SetClientTransport(i, nullptr, false);
+			close(fd);
+			s.transport.SetFd(-1);
+			s.stopped = false;
+		}
+		virtual unsigned int Run() override
+		{
+			CoreDebugPrint(L"[SocketHubServer] thread begin\n");
+			while(1)
+			{
+				wakeEvent.Reset();
+				if(quitFlag) break;
+				for(int i = 0; i < (int)slots.size(); ++i) { if(slots[i]->stopped) DetachSlot(i); }
+				int fd = -1;
+				ResultCode r = AcceptSocket(listenSocket, socketAddress.isTcp, wakeEvent, &fd);
+				if(r == ResultCancelled) continue;
+				if(ResultIsError(r))
+				{
+					CoreDebugPrint(L"[SocketHubServer] failed accept()\n");
+					sessionError = r;
+					if(OnSessionError) OnSessionError(r);
+					break;
+				}
+				int slot = -1;
+				for(int i = 0; (i < (int)slots.size()) && (slot < 0); ++i) { if(slots[i]->transport.GetFd() < 0) slot = i; }
+				if(slot < 0)
+				{
+					CoreDebugPrint(L"[SocketHubServer] no free slot\n");
+					CloseStreamSocket(fd);
+					continue;
+				}
+				CoreDebugPrint(L"[SocketHubServer] connected\n");
+				slots[slot]->transport.SetFd(fd);
+				clientHub.SetClientTransport(slot, &slots[slot]->transport, true);
+			}
+			for(int i = 0; i < (int)slots.size(); ++i) DetachSlot(i);
+			CoreDebugPrint(L"[SocketHubServer] thread end\n");
+			return 0;
+		}
+		virtual void RequestToQuitThread() override
+		{
+			quitFlag = true;
+			wakeEvent.Set();
+			WorkerThread::RequestToQuitThread();
+		}
+	public:
+		SocketHubServer(const std::string& addr, ClientHub& hub) : WorkerThread("SocketHubServer"), address(addr), clientHub(hub)
+		{
+			for(int i = 0; i < clientHub.GetMaxClients(); ++i) slots.push_back(std::make_unique<Slot>());
+			clientHub.OnClientStopped = [this](int slot) { slots[slot]->stopped = true; wakeEvent.Set(); };
+		}
+		virtual ~SocketHubServer() override
+		{
+			StopSession();
+			clientHub.OnClientStopped = nullptr;
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			ResultCode r = ResolveSocketAddress(address, true, &socketAddress);
+			if(!ResultIsError(r)) r = OpenListenSocket(socketAddress, &listenSocket);
+			if(ResultIsError(r))
+			{
+				sessionError = r;
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[SocketHubServer] failed to listen\n");
+				return false;
+			}
+			return StartThread();
+		}
+		virtual void StopSession() override
+		{
+			StopThread();
+			CloseListenSocket(listenSocket, socketAddress);
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return IsThreadRunning();
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+	class SocketClient : public IPipeSession
+	{
+	private:
+		std::string address;
+		PipeInMidiOut& pipeInMidiOut;
+		MidiInPipeOut& midiInPipeOut;
+		int clientSocket = -1;
+		PollTransport transport{ true };
+		ResultCode sessionError = ResultOk;
+	public:
+		SocketClient(const std::string& addr, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+			: address(addr)
+			, pipeInMidiOut(p2m)
+			, midiInPipeOut(m2p)
+		{
+		}
+		virtual ~SocketClient() override
+		{
+			StopSession();
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			SocketAddress sa;
+			ResultCode r = ResolveSocketAddress(address, false, &sa);
+			int fd = -1;
+			if(!ResultIsError(r))
+			{
+				fd = socket(sa.addr.ss_family, SOCK_STREAM, 0);
+				if(fd < 0) r = errno;
+			}
+			// the peer is local, a blocking connect() returns at once
+			if(!ResultIsError(r) && (connect(fd, reinterpret_cast<const sockaddr*>(&sa.addr), sa.length) != 0)) r = errno;
+			if(ResultIsError(r))
+			{
+				if(fd >= 0) close(fd);
+				sessionError = r;
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[SocketClient] failed connect()\n");
+				return false;
+			}
+			PrepareStreamSocket(fd, sa.isTcp);
+			clientSocket = fd;
+			transport.SetFd(fd);
+			pipeInMidiOut.SetTransport(&transport, false);
+			midiInPipeOut.SetTransport(&transport, false);
+			return true;
+		}
+		virtual void StopSession() override
+		{
+			if(clientSocket >= 0) shutdown(clientSocket, SHUT_RDWR);
+			pipeInMidiOut.SetTransport(nullptr, false);
+			midiInPipeOut.SetTransport(nullptr, false);
+			if(clientSocket >= 0) close(clientSocket);
+			clientSocket = -1;
+			transport.SetFd(-1);
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return clientSocket >= 0;
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+
+#if defined(__linux__)
+	// the accept and the disconnect are handled on the reactor thread, next to the bridge's own handlers
+	class ReactorSocketServer : public IPipeSession
+	{
+	private:
+		std::string address;
+		ReactorBridge& bridge;
+		Reactor& reactor;
+		SocketAddress socketAddress;
+		int listenSocket = -1;
+		int connectionSocket = -1;
+		std::atomic<ResultCode> sessionError{ ResultOk };
+		void OnAccept()
+		{
+			int fd = accept(listenSocket, nullptr, nullptr);
+			if(fd < 0)
+			{
+				if((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR) || (errno == ECONNABORTED)) return;
+				CoreDebugPrint(L"[ReactorSocketServer] failed accept()\n");
+				sessionError = errno;
+				reactor.Remove(listenSocket);
+				if(OnSessionError) OnSessionError(sessionError);
+				return;
+			}
+			if(connectionSocket >= 0)
+			{
+				CoreDebugPrint(L"[ReactorSocketServer] busy\n");
+				close(fd);
+				return;
+			}
+			CoreDebugPrint(L"[ReactorSocketServer] connected\n");
+			PrepareStreamSocket(fd, socketAddress.isTcp);
+			connectionSocket = fd;
+			bridge.SetConnection(fd, true);
+		}
+		void Disconnect()
+		{
+			if(connectionSocket < 0) return;
+			bridge.SetConnection(-1, false);
+			CloseStreamSocket(connectionSocket);
+			connectionSocket = -1;
+			CoreDebugPrint(L"[ReactorSocketServer] disconnected\n");
+		}
+	public:
+		ReactorSocketServer(const std::string& addr, ReactorBridge& b) : address(addr), bridge(b), reactor(b.GetReactor())
+		{
+			bridge.OnStopped = [this]() { Disconnect(); };
+		}
+		virtual ~ReactorSocketServer() override
+		{
+			StopSession();
+			bridge.OnStopped = nullptr;
+		}
+		virtual bool StartSession() override
+		{
+			StopSession();
+			sessionError = ResultOk;
+			ResultCode r = ResolveSocketAddress(address, true, &socketAddress);
+			if(!ResultIsError(r)) r = OpenListenSocket(socketAddress, &listenSocket);
+			if(!ResultIsError(r)) r = reactor.Add(listenSocket, EPOLLIN, [this](uint32_t) { OnAccept(); });
+			if(ResultIsError(r))
+			{
+				CloseListenSocket(listenSocket, socketAddress);
+				sessionError = r;
+				if(OnSessionError) OnSessionError(sessionError);
+				CoreDebugPrint(L"[ReactorSocketServer] failed to listen\n");
+				return false;
+			}
+			return true;
+		}
+		virtual void StopSession() override
+		{
+			if(listenSocket < 0) return;
+			reactor.Invoke([this]()
+			{
+				reactor.Remove(listenSocket);
+				Disconnect();
+			});
+			CloseListenSocket(listenSocket, socketAddress);
+		}
+		virtual bool IsSessionRunning() const override
+		{
+			return listenSocket >= 0;
+		}
+		virtual ResultCode GetSessionError() const override
+		{
+			return sessionError;
+		}
+	};
+#endif
+
+	// ================================================================================
+	// factories
+
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+	{
+		return std::make_unique<SocketServer>(address, p2m, m2p);
+	}
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, ClientHub& hub)
+	{
+		return std::make_unique<SocketHubServer>(address, hub);
+	}
+	std::unique_ptr<IPipeSession> CreateSocketClient(const std::string& address, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
+	{
+		return std::make_unique<SocketClient>(address, p2m, m2p);
+	}
+#if defined(__linux__)
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, ReactorBridge& bridge)
+	{
+		return std::make_unique<ReactorSocketServer>(address, bridge);
+	}
+#endif
+}
+
+#endif // !_WIN32
@@ -0,0 +1,36 @@
+//
+//  SocketSession.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "PipeSession.h"
+#include "TransferEngine.h"
+#include "ClientHub.h"
+#include "ReactorBridge.h"
+#include <memory>
+#include <string>
+
+#if !defined(_WIN32)
+
+namespace MidiBridgeCore
+{
+	//
+	// stream socket sessions for VMs whose serial port is a Unix socket or a TCP chardev (QEMU, VirtualBox, Bochs), result codes are errno values.
+	// the address is "unix:/path/to/socket" or "tcp:host:port", a bare path is taken as a Unix socket and an empty host as the loopback.
+	// the sockets are non-blocking and waited on with poll(), TCP connections run with TCP_NODELAY.
+	//
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, PipeInMidiOut& p2m, MidiInPipeOut& m2p);
+	// accepts up to hub.GetMaxClients() connections at once, a connection beyond that is closed right away
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, ClientHub& hub);
+	std::unique_ptr<IPipeSession> CreateSocketClient(const std::string& address, PipeInMidiOut& p2m, MidiInPipeOut& m2p);
+#if defined(__linux__)
+	// accepts on the bridge's reactor without a thread of its own, one connection at a time, a second one is closed right away
+	std::unique_ptr<IPipeSession> CreateSocketServer(const std::string& address, ReactorBridge& bridge);
+#endif
+}
+
+#endif
@@ -0,0 +1,105 @@
+//
+//  SpscRing.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	//
+	// fixed-capacity single-producer/single-consumer ring, wait-free and allocation-free after Reset().
+	// Push() must only be called from one thread and Pop() from one other thread, e.g. a driver callback and a worker.
+	//
+	template<typename T> class SpscRing
+	{
+	private:
+		std::vector<T> slots;
+		size_t mask = 0;
+		alignas(64) std::atomic<size_t> head{ 0 };	// written by the consumer
+		alignas(64) std::atomic<size_t> tail{ 0 };	// written by the producer
+	public:
+		SpscRing(size_t capacity = 0)
+		{
+			Reset(capacity);
+		}
+		SpscRing(const SpscRing&) = delete;
+		SpscRing& operator=(const SpscRing&) = delete;
+		// not thread safe, call while neither side is active, the capacity is rounded up to a power of two
+		void Reset(size_t capacity)
+		{
+			size_t n = 1; while(n < capacity) n <<= 1;
+			slots.assign(n, T{});
+			mask = n - 1;
+			head.store(0, std::memory_order_relaxed);
+			tail.store(0, std::memory_order_relaxed);
+		}
+		size_t GetCapacity() const
+		{
+			return slots.size();
+		}
+		bool Push(const T& v)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if(t - head.load(std::memory_order_acquire) >= slots.size()) return false;
+			slots[t & mask] = v;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+		bool Pop(T* v)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if(h == tail.load(std::memory_order_acquire)) return false;
+			*v = slots[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+		// consumer side, reads the oldest element without removing it
+		bool Peek(T* v) const
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if(h == tail.load(std::memory_order_acquire)) return false;
+			*v = slots[h & mask];
+			return true;
+		}
+		// all or nothing, so a variable-length record is never split
+		bool PushRange(const T* p, size_t c)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if(slots.size() - (t - head.load(std::memory_order_acquire)) < c) return false;
+			size_t i0 = t & mask;
+			size_t lseg = std::min(c, slots.size() - i0);
+			std::copy(p, p + lseg, slots.data() + i0);
+			std::copy(p + lseg, p + c, slots.data());
+			tail.store(t + c, std::memory_order_release);
+			return true;
+		}
+		// pops as many as are available up to c
+		size_t PopRange(T* p, size_t c)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t n = std::min(c, tail.load(std::memory_order_acquire) - h);
+			size_t i0 = h & mask;
+			size_t lseg = std::min(n, slots.size() - i0);
+			std::copy(slots.data() + i0, slots.data() + i0 + lseg, p);
+			std::copy(slots.data(), slots.data() + (n - lseg), p + lseg);
+			head.store(h + n, std::memory_order_release);
+			return n;
+		}
+		bool IsEmpty() const
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+		size_t GetCount() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+	};
+}
@@ -0,0 +1,87 @@
+//
+//  Statistics.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "Statistics.h"
+#include <algorithm>
+#include <bit>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// LatencyHistogramSnapshot
+
+	double LatencyHistogramSnapshot::GetMeanNs() const
+	{
+		return count ? (double)sumNs / (double)count : 0.0;
+	}
+	uint64_t LatencyHistogramSnapshot::GetPercentileNs(double p) const
+	{
+		if(!count) return 0;
+		uint64_t target = (uint64_t)((p / 100.0) * (double)count + 0.5);
+		if(target < 1) target = 1;
+		uint64_t acc = 0;
+		for(size_t i = 0; i < counts.size(); ++i)
+		{
+			acc += counts[i];
+			if(acc >= target) return std::min(LatencyHistogram::GetBucketUpperBound((int)i), maxNs);
+		}
+		return maxNs;
+	}
+
+	// ================================================================================
+	// LatencyHistogram
+
+	int LatencyHistogram::GetBucketIndex(uint64_t ns)
+	{
+		if(ns < (uint64_t)SubBucketCount) return (int)ns;
+		int m = (int)std::bit_width(ns) - 1;
+		int shift = m - SubBucketBits;
+		int sub = (int)(ns >> shift) - SubBucketCount;
+		return (shift + 1) * SubBucketCount + sub;
+	}
+	uint64_t LatencyHistogram::GetBucketLowerBound(int index)
+	{
+		if(index < SubBucketCount) return (uint64_t)index;
+		int group = index / SubBucketCount;
+		int sub = index % SubBucketCount;
+		return (uint64_t)(SubBucketCount + sub) << (group - 1);
+	}
+	uint64_t LatencyHistogram::GetBucketUpperBound(int index)
+	{
+		return (index + 1 < BucketCount) ? GetBucketLowerBound(index + 1) - 1 : UINT64_MAX;
+	}
+	void LatencyHistogram::Record(std::chrono::nanoseconds d)
+	{
+		uint64_t ns = (d.count() > 0) ? (uint64_t)d.count() : 0;
+		counts[GetBucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+		sumNs.fetch_add(ns, std::memory_order_relaxed);
+		// single writer, so a plain compare and store is enough
+		if(ns < minNs.load(std::memory_order_relaxed)) minNs.store(ns, std::memory_order_relaxed);
+		if(ns > maxNs.load(std::memory_order_relaxed)) maxNs.store(ns, std::memory_order_relaxed);
+	}
+	LatencyHistogramSnapshot LatencyHistogram::GetSnapshot() const
+	{
+		LatencyHistogramSnapshot s;
+		// trim the empty tail so a snapshot stays small
+		int last = -1;
+		for(int i = 0; i < BucketCount; ++i) { if(counts[i].load(std::memory_order_relaxed)) last = i; }
+		s.counts.resize((size_t)(last + 1));
+		for(int i = 0; i <= last; ++i) s.counts[i] = counts[i].load(std::memory_order_relaxed);
+		for(uint64_t v : s.counts) s.count += v;
+		s.sumNs = sumNs.load(std::memory_order_relaxed);
+		s.maxNs = maxNs.load(std::memory_order_relaxed);
+		s.minNs = s.count ? minNs.load(std::memory_order_relaxed) : 0;
+		return s;
+	}
+	void LatencyHistogram::Reset()
+	{
+		for(auto& v : counts) v.store(0, std::memory_order_relaxed);
+		minNs.store(UINT64_MAX, std::memory_order_relaxed);
+		maxNs.store(0, std::memory_order_relaxed);
+		sumNs.store(0, std::memory_order_relaxed);
+	}
+}
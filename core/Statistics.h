@@ -0,0 +1,117 @@
+//
+//  Statistics.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// hot path primitives, recording is a relaxed atomic operation, reading is safe from any thread
+
+	class RelaxedCounter
+	{
+	private:
+		std::atomic<uint64_t> value{ 0 };
+	public:
+		void Add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+		void Set(uint64_t n) { value.store(n, std::memory_order_relaxed); }
+		uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+		void Reset() { Set(0); }
+	};
+
+	struct LatencyHistogramSnapshot
+	{
+		std::vector<uint64_t> counts;
+		uint64_t count = 0;
+		uint64_t minNs = 0;
+		uint64_t maxNs = 0;
+		uint64_t sumNs = 0;
+		double GetMeanNs() const;
+		// the upper bound of the bucket holding the given percentile (0..100)
+		uint64_t GetPercentileNs(double p) const;
+	};
+
+	//
+	// log-linear histogram in the spirit of HdrHistogram: each power of two is split into 16 sub-buckets,
+	// so a value is resolved to within 1/16 of itself from nanoseconds up to minutes with a fixed table.
+	// there must be only one recording thread, snapshots may be taken from anywhere.
+	//
+	class LatencyHistogram
+	{
+	public:
+		static constexpr int SubBucketBits = 4;
+		static constexpr int SubBucketCount = 1 << SubBucketBits;
+		static constexpr int BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+		static int GetBucketIndex(uint64_t ns);
+		static uint64_t GetBucketLowerBound(int index);
+		static uint64_t GetBucketUpperBound(int index);
+	private:
+		std::atomic<uint64_t> counts[BucketCount] = {};
+		std::atomic<uint64_t> minNs{ UINT64_MAX };
+		std::atomic<uint64_t> maxNs{ 0 };
+		std::atomic<uint64_t> sumNs{ 0 };
+	public:
+		void Record(std::chrono::nanoseconds d);
+		LatencyHistogramSnapshot GetSnapshot() const;
+		void Reset();
+	};
+
+	// ================================================================================
+	// snapshots
+
+	struct PipeInMidiOutStatistics
+	{
+		uint64_t pipeReadCalls = 0;
+		uint64_t pipeReadBytes = 0;
+		uint64_t messages = 0;
+		uint64_t shortSends = 0;
+		uint64_t longSends = 0;
+		// long sends read straight into a device buffer, included in longSends
+		uint64_t inPlaceSends = 0;
+		// bytes the framer could not place in a message
+		uint64_t discardedBytes = 0;
+		// messages dropped by the message filter, included in messages
+		uint64_t filteredMessages = 0;
+		// real-time messages sent ahead by the real-time lane, included in messages and shortSends
+		uint64_t laneSends = 0;
+		uint64_t connects = 0;
+		uint64_t reconnects = 0;
+		// the fewest free output buffers seen, -1 when the port has no buffer pool
+		int64_t bufferLowWater = -1;
+		// pipe read completion to the return of the last send for that read
+		LatencyHistogramSnapshot readToSendLatency;
+		// pipe read completion to the return of a real-time lane send
+		LatencyHistogramSnapshot laneLatency;
+	};
+
+	struct MidiInPipeOutStatistics
+	{
+		uint64_t messages = 0;
+		uint64_t bytes = 0;
+		uint64_t pipeWriteCalls = 0;
+		// bytes lost because the staging ring was full
+		uint64_t droppedBytes = 0;
+		// messages dropped by the message filter, not included in messages
+		uint64_t filteredMessages = 0;
+		uint64_t connects = 0;
+		uint64_t reconnects = 0;
+		// driver callback to the completion of the pipe write that carried the message
+		LatencyHistogramSnapshot callbackToWriteLatency;
+	};
+
+	struct BridgeStatistics
+	{
+		PipeInMidiOutStatistics pipeToMidi;
+		MidiInPipeOutStatistics midiToPipe;
+	};
+}
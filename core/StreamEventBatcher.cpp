@@ -0,0 +1,200 @@
+//
+//  StreamEventBatcher.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "StreamEventBatcher.h"
+#include "MidiFramer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MidiBridgeCore
+{
+	StreamEventBatcher::StreamEventBatcher()
+	{
+		SetTiming(StreamTiming());
+	}
+	void StreamEventBatcher::SetTiming(const StreamTiming& v)
+	{
+		timing = v;
+		timing.tick = std::max(timing.tick, std::chrono::microseconds(1));
+		// a burst is timed when it is over, and its first message may be spread back by the smoothing:
+		// the latency has to leave room for both before the lead
+		timing.latency = std::max(timing.latency, timing.smoothing + timing.lead + std::chrono::duration_cast<std::chrono::microseconds>(BurstWindow));
+		// a batch holds at least one short event and a long one of a few bytes
+		timing.batchBytes = std::max(timing.batchBytes, (EventHeaderWords + 4) * sizeof(uint32_t));
+		byteTime = (timing.bytesPerSecond > 0) ? std::chrono::ceil<Duration>(std::chrono::duration<double>(1 / timing.bytesPerSecond)) : Duration(0);
+	}
+	const StreamTiming& StreamEventBatcher::GetTiming() const
+	{
+		return timing;
+	}
+	void StreamEventBatcher::Reset(TimePoint t0)
+	{
+		origin = t0;
+		burst.clear();
+		burstBytes.clear();
+		hasPreviousBurst = false;
+		lastDue = t0;
+		lineFree = t0;
+		lastTick = 0;
+		batches.clear();
+		pendingBytes = 0;
+	}
+	int64_t StreamEventBatcher::ToTick(TimePoint t) const
+	{
+		Duration d = t - origin;
+		Duration tk = timing.tick;
+		return (d.count() <= 0) ? 0 : (int64_t)((d + tk / 2) / tk);
+	}
+	StreamEventBatcher::TimePoint StreamEventBatcher::FromTick(int64_t tick) const
+	{
+		return origin + tick * std::chrono::duration_cast<Duration>(timing.tick);
+	}
+	void StreamEventBatcher::AppendWords(TimePoint due, const uint32_t* w, size_t n)
+	{
+		size_t capacity = timing.batchBytes / sizeof(uint32_t);
+		if(batches.empty() || (batches.back().words.size() + n > capacity))
+		{
+			batches.emplace_back();
+			batches.back().words.reserve(capacity);
+			batches.back().firstDue = due;
+		}
+		batches.back().words.insert(batches.back().words.end(), w, w + n);
+		pendingBytes += n * sizeof(uint32_t);
+	}
+	void StreamEventBatcher::AppendEvent(TimePoint due, uint32_t event, const uint8_t* data, size_t n)
+	{
+		int64_t tick = std::max(ToTick(due), lastTick);
+		int64_t delta = tick - lastTick;
+		lastTick = tick;
+		// the delta is 32 bits, a longer pause is bridged with no-op events
+		for(; delta > (int64_t)UINT32_MAX; delta -= UINT32_MAX)
+		{
+			const uint32_t nop[EventHeaderWords] = { UINT32_MAX, 0, EventNop };
+			AppendWords(due, nop, EventHeaderWords);
+		}
+		uint32_t w[EventHeaderWords + 64] = { (uint32_t)delta, 0, event };
+		size_t nw = EventHeaderWords + (n + 3) / 4;
+		if(n) std::memcpy(w + EventHeaderWords, data, n);
+		AppendWords(due, w, nw);
+		++eventCount;
+	}
+	void StreamEventBatcher::Schedule(const Message& m, TimePoint due)
+	{
+		if(m.length == 0)
+		{
+			AppendEvent(due, EventShortMessage | (m.shortMessage & EventParamMask), nullptr, 0);
+			return;
+		}
+		// what fits in one event of an empty batch, and in the stack buffer of AppendEvent()
+		size_t maxpiece = std::min<size_t>(timing.batchBytes / sizeof(uint32_t) - EventHeaderWords, 64) * sizeof(uint32_t);
+		for(size_t i = 0; i < m.length; )
+		{
+			size_t n = std::min(maxpiece, m.length - i);
+			AppendEvent(due, EventLongMessage | (uint32_t)n, burstBytes.data() + m.offset + i, n);
+			i += n;
+		}
+	}
+	void StreamEventBatcher::CloseBurst()
+	{
+		if(burst.empty()) return;
+		TimePoint last = burst.back().arrival;
+		// the span the burst is spread back over: the smoothing, no more than the pause before it
+		Duration span{ 0 };
+		if(hasPreviousBurst) span = std::min<Duration>(last - previousBurst, timing.smoothing);
+		size_t k = burst.size();
+		for(size_t j = 0; j < k; ++j)
+		{
+			const Message& m = burst[j];
+			TimePoint sent = (span.count() > 0) ? last - span + span * (Duration::rep)(j + 1) / (Duration::rep)k : m.arrival;
+			TimePoint due = sent + timing.latency;
+			bool realtime = (m.length == 0) && MidiFramer::IsRealTime((uint8_t)m.shortMessage);
+			if(!realtime) due = std::max(due, lineFree);
+			due = std::max(due, lastDue);
+			TimePoint cap = m.arrival + 2 * timing.latency;
+			if(due > cap)
+			{
+				due = std::max(cap, lastDue);
+				++cappedCount;
+			}
+			Schedule(m, due);
+			lastDue = due;
+			if(!realtime)
+			{
+				size_t n = m.length ? m.length : (size_t)MidiFramer::GetShortMessageLength((uint8_t)m.shortMessage);
+				lineFree = due + (Duration::rep)n * byteTime;
+			}
+		}
+		previousBurst = last;
+		hasPreviousBurst = true;
+		pendingBytes -= burstBytes.size();
+		burst.clear();
+		burstBytes.clear();
+	}
+	void StreamEventBatcher::AddMessage(const Message& m, const uint8_t* data)
+	{
+		if(!burst.empty() && (m.arrival >= burst.front().arrival + BurstWindow)) CloseBurst();
+		burst.push_back(m);
+		if(m.length)
+		{
+			burst.back().offset = burstBytes.size();
+			burstBytes.insert(burstBytes.end(), data, data + m.length);
+			pendingBytes += m.length;
+		}
+	}
+	void StreamEventBatcher::AddShortMessage(uint32_t msg, TimePoint arrival)
+	{
+		AddMessage({ arrival, msg, 0, 0 }, nullptr);
+	}
+	void StreamEventBatcher::AddLongMessage(const uint8_t* p, int c, TimePoint arrival)
+	{
+		if(c <= 0) return;
+		AddMessage({ arrival, 0, 0, (size_t)c }, p);
+	}
+	StreamEventBatcher::TimePoint StreamEventBatcher::GetNextTakeTime() const
+	{
+		TimePoint t = TimePoint::max();
+		if(batches.size() > 1) return TimePoint::min();
+		if(!batches.empty()) t = batches.front().firstDue - timing.lead;
+		// the open burst is timed once it is over
+		if(!burst.empty()) t = std::min(t, burst.front().arrival + BurstWindow);
+		return t;
+	}
+	bool StreamEventBatcher::TakeBatch(TimePoint now, std::vector<uint32_t>* words)
+	{
+		if(!burst.empty() && (now >= burst.front().arrival + BurstWindow)) CloseBurst();
+		if(batches.empty()) return false;
+		Batch& b = batches.front();
+		if((batches.size() == 1) && (now < b.firstDue - timing.lead)) return false;
+		// a batch that is not the last one is full, it goes at once
+		if(now > b.firstDue) ++lateBatchCount;
+		words->swap(b.words);
+		pendingBytes -= words->size() * sizeof(uint32_t);
+		batches.pop_front();
+		++batchCount;
+		return true;
+	}
+	size_t StreamEventBatcher::GetPendingBytes() const
+	{
+		return pendingBytes;
+	}
+	uint64_t StreamEventBatcher::GetEventCount() const
+	{
+		return eventCount;
+	}
+	uint64_t StreamEventBatcher::GetBatchCount() const
+	{
+		return batchCount;
+	}
+	uint64_t StreamEventBatcher::GetLateBatchCount() const
+	{
+		return lateBatchCount;
+	}
+	uint64_t StreamEventBatcher::GetCappedCount() const
+	{
+		return cappedCount;
+	}
+}
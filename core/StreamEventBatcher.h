@@ -0,0 +1,116 @@
+//
+//  StreamEventBatcher.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	struct StreamTiming
+	{
+		// how long after its arrival a message is due, the room the schedule has to absorb the pipe's burstiness.
+		// no less than the smoothing and the lead plus a millisecond
+		std::chrono::microseconds latency{ 20000 };
+		// a burst that came after a pause is spread back over up to this long, the way the guest sent it before the host
+		// coalesced its timer ticks. a chord is spread as well, 0 leaves every message at its arrival
+		std::chrono::microseconds smoothing{ 0 };
+		// the stream's time base, the driver is set to the same
+		std::chrono::microseconds tick{ 100 };
+		// how long before its first event is due a batch goes to the driver
+		std::chrono::microseconds lead{ 5000 };
+		// messages other than real-time follow each other no closer than at this line rate, 0 lets them pile up
+		double bytesPerSecond = 3125;
+		// the size of the driver's stream buffers
+		size_t batchBytes = 4096;
+	};
+
+	//
+	// turns messages with their arrival times into batches of timestamped stream events for a driver that plays them at
+	// their ticks (midiStreamOut). each message is given a due time, its arrival plus the latency, kept in order and apart
+	// at the line rate and never more than twice the latency late; the delta of each event is counted from the one before
+	// it in the whole stream, across batches, on a time line whose tick 0 is when the stream was started.
+	// the batcher never reads a clock, the caller passes the time in, so it runs the same against a virtual clock.
+	// the batches are laid out like MIDIEVENTs: delta ticks, stream id, event with the type in the high byte, then the
+	// bytes of a long message padded to a whole word
+	//
+	class StreamEventBatcher
+	{
+	public:
+		using TimePoint = std::chrono::steady_clock::time_point;
+		using Duration = std::chrono::steady_clock::duration;
+		// MEVT_SHORTMSG, MEVT_NOP and MEVT_LONGMSG in the high byte of the event word
+		static constexpr uint32_t EventShortMessage = 0x00000000;
+		static constexpr uint32_t EventNop = 0x02000000;
+		static constexpr uint32_t EventLongMessage = 0x80000000;
+		static constexpr uint32_t EventParamMask = 0x00ffffff;
+		static constexpr size_t EventHeaderWords = 3;
+		// messages that arrive within this of the first one of a burst belong to it
+		static constexpr std::chrono::microseconds BurstWindow{ 1000 };
+	private:
+		struct Message
+		{
+			TimePoint arrival;
+			uint32_t shortMessage;
+			size_t offset;
+			size_t length; // 0 for a short message
+		};
+		struct Batch
+		{
+			std::vector<uint32_t> words;
+			TimePoint firstDue;
+		};
+		StreamTiming timing;
+		Duration byteTime{ 0 };
+		TimePoint origin{};
+		std::vector<Message> burst;
+		std::vector<uint8_t> burstBytes;
+		TimePoint previousBurst{};
+		bool hasPreviousBurst = false;
+		TimePoint lastDue{};
+		TimePoint lineFree{};
+		int64_t lastTick = 0;
+		std::deque<Batch> batches;
+		size_t pendingBytes = 0;
+		uint64_t eventCount = 0;
+		uint64_t batchCount = 0;
+		uint64_t lateBatchCount = 0;
+		uint64_t cappedCount = 0;
+		void CloseBurst();
+		void Schedule(const Message& m, TimePoint due);
+		void AppendEvent(TimePoint due, uint32_t event, const uint8_t* data, size_t n);
+		void AppendWords(TimePoint due, const uint32_t* w, size_t n);
+		void AddMessage(const Message& m, const uint8_t* data);
+	public:
+		StreamEventBatcher();
+		void SetTiming(const StreamTiming& v);
+		const StreamTiming& GetTiming() const;
+		// the stream was started at t0, its tick 0. drops everything pending
+		void Reset(TimePoint t0);
+		void AddShortMessage(uint32_t msg, TimePoint arrival);
+		// a SysEx or a segment of one, split into several events when it is longer than a batch holds
+		void AddLongMessage(const uint8_t* p, int c, TimePoint arrival);
+		// when TakeBatch() has something next, TimePoint::max() while nothing is pending
+		TimePoint GetNextTakeTime() const;
+		// the next batch once it is full or its first event is within the lead, false while there is none
+		bool TakeBatch(TimePoint now, std::vector<uint32_t>* words);
+		// held by the batcher, in bytes of stream events and of messages yet to be timed
+		size_t GetPendingBytes() const;
+		int64_t ToTick(TimePoint t) const;
+		TimePoint FromTick(int64_t tick) const;
+		uint64_t GetEventCount() const;
+		uint64_t GetBatchCount() const;
+		// batches taken after their first event was due, the driver plays them late
+		uint64_t GetLateBatchCount() const;
+		// messages held back to twice the latency, the line rate could not keep up
+		uint64_t GetCappedCount() const;
+	};
+}
@@ -0,0 +1,804 @@
+//
+//  TransferEngine.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "TransferEngine.h"
+#include "CoreDebugPrint.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// PipeInMidiOut
+
+	PipeInMidiOut::ReadAheadThread::ReadAheadThread(PipeInMidiOut& o) : WorkerThread("PipeInMidiOut.ReadAhead"), owner(o)
+	{
+	}
+	PipeInMidiOut::ReadAheadThread::~ReadAheadThread()
+	{
+		StopThread();
+	}
+	unsigned int PipeInMidiOut::ReadAheadThread::Run()
+	{
+		return owner.RunReadAhead();
+	}
+	void PipeInMidiOut::ReadAheadThread::RequestToQuitThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(owner.readMutex);
+			owner.readQuit = true;
+		}
+		owner.readCond.notify_all();
+		if(owner.transport) owner.transport->SetReadCancelled(true);
+		WorkerThread::RequestToQuitThread();
+	}
+	PipeInMidiOut::PipeInMidiOut() : WorkerThread("PipeInMidiOut"), readAheadThread(*this)
+	{
+	}
+	PipeInMidiOut::~PipeInMidiOut()
+	{
+		InternalStop();
+	}
+	bool PipeInMidiOut::NeedToReportPipeError(ResultCode r) const
+	{
+		if(!ResultIsError(r)) return false;
+		if(isServer && transport && transport->IsBrokenPipe(r)) return false;
+		return true;
+	}
+	bool PipeInMidiOut::ProcessRead(const uint8_t* p, int c, ResultCode r, std::chrono::steady_clock::time_point readtime)
+	{
+		if(ResultIsError(r))
+		{
+			if(!quitFlag)
+			{
+				pipeError = r;
+				if(NeedToReportPipeError(r)) { if(OnPipeError) OnPipeError(r); }
+			}
+			return false;
+		}
+		pipeReadCalls.Add();
+		pipeReadBytes.Add((uint64_t)c);
+		// the framer's count never goes back, what this read added is counted so the statistic can be reset
+		uint64_t discarded = framer.GetDiscardedBytes();
+		framer.Process(p, c, [&](const MidiMessage& m)
+		{
+			messageCount.Add();
+			if(flightRecorder) flightRecorder->Record(FlightDirection::PipeToMidi, m.data, m.length, readtime);
+			if(ResultIsError(r)) return;
+			if(!messageFilter) { r = dispatcher.Dispatch(m); return; }
+			MidiMessage fm;
+			uint8_t w[3];
+			if(ApplyMessageFilter(*messageFilter, m, fm, w))	r = dispatcher.Dispatch(fm);
+			else												filteredMessages.Add();
+		});
+		if(!ResultIsError(r)) r = dispatcher.Flush();
+		discardedBytes.Add(framer.GetDiscardedBytes() - discarded);
+		if(!ResultIsError(r)) readToSendLatency.Record(std::chrono::steady_clock::now() - readtime);
+		if(ResultIsError(r))
+		{
+			deviceError = r;
+			if(OnDeviceError) OnDeviceError(r);
+			return false;
+		}
+		return true;
+	}
+	bool PipeInMidiOut::IsWholeSysExSegment(const uint8_t* p, int c) const
+	{
+		if(c <= 0) return false;
+		if(!framer.IsInSysEx() && (p[0] != 0xf0)) return false;
+		if(framer.IsInSysEx() && (p[0] >= 0x80)) return false;
+		for(int i = 1; i < c - 1; ++i) { if(p[i] >= 0x80) return false; }
+		return (c == 1) || (p[c - 1] < 0x80) || (p[c - 1] == 0xf7);
+	}
+	bool PipeInMidiOut::ReadIntoSendBuffer(std::vector<uint8_t>& buffer)
+	{
+		uint8_t* lent = nullptr;
+		int capacity = 0;
+		ResultCode r = midiOutPort->AcquireSendBuffer(&lent, &capacity);
+		if(r == ResultNotSupported)
+		{
+			zeroCopyActive = false;
+			return true;
+		}
+		if(ResultIsError(r))
+		{
+			if(quitFlag) return false;
+			deviceError = r;
+			if(OnDeviceError) OnDeviceError(r);
+			return false;
+		}
+		int cr = 0;
+		r = transport->Read(lent, std::min(capacity, ReadBufferSize), &cr);
+		std::chrono::steady_clock::time_point readtime = std::chrono::steady_clock::now();
+		if(ResultIsError(r) || !IsWholeSysExSegment(lent, cr))
+		{
+			// give the buffer back before framing, the dispatcher may need every buffer of the port
+			memcpy(buffer.data(), lent, (size_t)cr);
+			midiOutPort->ReturnSendBuffer(lent);
+			return ProcessRead(buffer.data(), cr, r, readtime);
+		}
+		pipeReadCalls.Add();
+		pipeReadBytes.Add((uint64_t)cr);
+		// the framer only follows along, its one segment is the whole buffer
+		bool pass = true;
+		framer.Process(lent, cr, [&](const MidiMessage& m)
+		{
+			messageCount.Add();
+			MidiMessage fm = m;
+			if(messageFilter && !messageFilter->Process(fm, nullptr)) pass = false;
+		});
+		if(flightRecorder) flightRecorder->Record(FlightDirection::PipeToMidi, lent, cr, readtime);
+		if(!pass)
+		{
+			filteredMessages.Add();
+			midiOutPort->ReturnSendBuffer(lent);
+			return true;
+		}
+		r = dispatcher.SendInPlace(lent, cr);
+		if(ResultIsError(r))
+		{
+			deviceError = r;
+			if(OnDeviceError) OnDeviceError(r);
+			return false;
+		}
+		readToSendLatency.Record(std::chrono::steady_clock::now() - readtime);
+		return true;
+	}
+	bool PipeInMidiOut::TrackLaneSysEx(uint8_t b)
+	{
+		if(b == 0xf0) { laneInSysEx = true; return true; }
+		if(laneInSysEx && ((b < 0x80) || (b == 0xf7))) { laneInSysEx = b != 0xf7; return true; }
+		laneInSysEx = false;
+		return false;
+	}
+	int PipeInMidiOut::SendRealTimeAhead(ReadSlot& slot, bool orderedpending)
+	{
+		uint8_t* p = slot.data.data();
+		int c = slot.length;
+		int wr = 0;
+		int i = 0;
+		bool ordered = false;
+		if(!orderedpending)
+		{
+			for(; i < c; ++i)
+			{
+				uint8_t b = p[i];
+				if(!MidiFramer::IsRealTime(b))
+				{
+					// a real-time byte may cut into a SysEx, not overtake a channel message or an F5 nn that moves what follows
+					if(!TrackLaneSysEx(b)) { ordered = true; break; }
+					p[wr++] = b;
+					continue;
+				}
+				messageCount.Add();
+				if(flightRecorder) flightRecorder->Record(FlightDirection::PipeToMidi, &b, 1, slot.readTime);
+				MidiMessage m;
+				m.data = &b;
+				m.length = 1;
+				m.kind = MidiMessageKind::RealTime;
+				MidiMessage fm = m;
+				uint8_t w[3];
+				if(messageFilter && !ApplyMessageFilter(*messageFilter, m, fm, w)) { filteredMessages.Add(); continue; }
+				laneSends.Add();
+				slot.laneResult = midiOutPort->SendShortMessage(MidiOutDispatcher::PackShortMessage(fm));
+				if(ResultIsError(slot.laneResult)) { ++i; break; }
+				laneLatency.Record(std::chrono::steady_clock::now() - slot.readTime);
+			}
+		}
+		// the rest stays in place, followed for the next read
+		for(int j = ordered ? i + 1 : i; j < c; ++j)
+		{
+			if(!MidiFramer::IsRealTime(p[j]) && !TrackLaneSysEx(p[j])) ordered = true;
+		}
+		slot.ordered = ordered;
+		if(wr < i) memmove(p + wr, p + i, (size_t)(c - i));
+		pipeReadBytes.Add((uint64_t)(i - wr));
+		return wr + c - i;
+	}
+	unsigned int PipeInMidiOut::RunReadAhead()
+	{
+		while(1)
+		{
+			ReadSlot* slot = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(readMutex);
+				readCond.wait(lock, [this]() { return readQuit || (readFilled < readSlots.size()); });
+				if(readQuit) break;
+				slot = &readSlots[(readHead + readFilled) % readSlots.size()];
+			}
+			int cr = 0;
+			slot->result = transport->Read(slot->data.data(), (int)slot->data.size(), &cr);
+			slot->length = cr;
+			slot->readTime = std::chrono::steady_clock::now();
+			slot->laneResult = ResultOk;
+			slot->ordered = false;
+			if(laneActive && !ResultIsError(slot->result))
+			{
+				bool orderedpending = false;
+				{
+					std::lock_guard<std::mutex> lock(readMutex);
+					orderedpending = pendingOrdered > 0;
+				}
+				slot->length = SendRealTimeAhead(*slot, orderedpending);
+			}
+			{
+				std::lock_guard<std::mutex> lock(readMutex);
+				if(slot->ordered) ++pendingOrdered;
+				++readFilled;
+			}
+			readCond.notify_all();
+			if(ResultIsError(slot->result) || ResultIsError(slot->laneResult)) break;
+		}
+		return 0;
+	}
+	unsigned int PipeInMidiOut::Run()
+	{
+		CoreDebugPrint(L"[PipeInMidiOut] thread begin\n");
+		framer.Reset();
+		dispatcher.SetMidiOutPort(midiOutPort);
+		if(readAhead <= 1)
+		{
+			zeroCopyActive = zeroCopyRead;
+			std::vector<uint8_t> buffer(ReadBufferSize);
+			while(1)
+			{
+				if(quitFlag) break;
+				if(zeroCopyActive)
+				{
+					if(!ReadIntoSendBuffer(buffer)) break;
+					if(zeroCopyActive) continue;
+				}
+				int cr = 0;
+				ResultCode r = transport->Read(buffer.data(), (int)buffer.size(), &cr);
+				if(!ProcessRead(buffer.data(), cr, r, std::chrono::steady_clock::now())) break;
+			}
+		}
+		else
+		{
+			{
+				std::lock_guard<std::mutex> lock(readMutex);
+				readHead = 0;
+				readFilled = 0;
+				readQuit = false;
+				pendingOrdered = 0;
+			}
+			laneInSysEx = false;
+			laneActive = realTimeLane && midiOutPort->IsShortMessageConcurrent();
+			readAheadThread.StartThread();
+			// the completed reads are taken in order, the slot stays owned by this thread until it has been sent
+			while(1)
+			{
+				ReadSlot* slot = nullptr;
+				{
+					std::unique_lock<std::mutex> lock(readMutex);
+					readCond.wait(lock, [this]() { return quitFlag || (readFilled > 0); });
+					if(quitFlag) break;
+					slot = &readSlots[readHead % readSlots.size()];
+				}
+				bool ok = ProcessRead(slot->data.data(), slot->length, slot->result, slot->readTime);
+				if(ok && ResultIsError(slot->laneResult))
+				{
+					if(!quitFlag)
+					{
+						deviceError = slot->laneResult;
+						if(OnDeviceError) OnDeviceError(slot->laneResult);
+					}
+					ok = false;
+				}
+				{
+					std::lock_guard<std::mutex> lock(readMutex);
+					if(slot->ordered) --pendingOrdered;
+					++readHead;
+					--readFilled;
+				}
+				readCond.notify_all();
+				if(!ok) break;
+			}
+			// cancels the read the reader may be blocked in, InternalStart() re-arms the transport
+			readAheadThread.StopThread();
+		}
+		CoreDebugPrint(L"[PipeInMidiOut] thread end\n");
+		if(OnStopped) OnStopped();
+		return 0;
+	}
+	void PipeInMidiOut::RequestToQuitThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(readMutex);
+			quitFlag = true;
+		}
+		readCond.notify_all();
+		if(transport) transport->SetReadCancelled(true);
+		if(midiOutPort) midiOutPort->SetSendCancelled(true);
+		WorkerThread::RequestToQuitThread();
+	}
+	void PipeInMidiOut::InternalStart()
+	{
+		std::lock_guard<std::mutex> lock(reentrantMutex);
+		if(IsThreadRunning()) return;
+		if(!transport || !midiOutPort || !midiOutPort->IsDeviceOpen()) return;
+		StopThread(); // join the finished thread before re-arming the transport
+		deviceError = ResultOk;
+		pipeError = ResultOk;
+		transport->SetReadCancelled(false);
+		midiOutPort->SetSendCancelled(false);
+		StartThread();
+	}
+	void PipeInMidiOut::InternalStop()
+	{
+		std::lock_guard<std::mutex> lock(reentrantMutex);
+		StopThread();
+	}
+	ITransport* PipeInMidiOut::GetTransport() const
+	{
+		return transport;
+	}
+	void PipeInMidiOut::SetTransport(ITransport* t, bool server)
+	{
+		InternalStop();
+		pipeError = ResultOk;
+		if(t) connectCount.Add();
+		transport = t;
+		isServer = server;
+		InternalStart();
+	}
+	IMidiOutPort* PipeInMidiOut::GetMidiOutPort() const
+	{
+		return midiOutPort;
+	}
+	void PipeInMidiOut::SetMidiOutPort(IMidiOutPort* p)
+	{
+		InternalStop();
+		deviceError = ResultOk;
+		midiOutPort = p;
+		InternalStart();
+	}
+	int PipeInMidiOut::GetReadAhead() const
+	{
+		return readAhead;
+	}
+	void PipeInMidiOut::SetReadAhead(int v)
+	{
+		InternalStop();
+		readAhead = std::clamp(v, 1, MaxReadAhead);
+		readSlots.resize((size_t)readAhead);
+		for(auto&& slot : readSlots) slot.data.resize(ReadBufferSize);
+		InternalStart();
+	}
+	bool PipeInMidiOut::GetZeroCopyRead() const
+	{
+		return zeroCopyRead;
+	}
+	void PipeInMidiOut::SetZeroCopyRead(bool v)
+	{
+		InternalStop();
+		zeroCopyRead = v;
+		InternalStart();
+	}
+	FlightRecorder* PipeInMidiOut::GetFlightRecorder() const
+	{
+		return flightRecorder;
+	}
+	void PipeInMidiOut::SetFlightRecorder(FlightRecorder* p)
+	{
+		InternalStop();
+		flightRecorder = p;
+		InternalStart();
+	}
+	IMessageFilter* PipeInMidiOut::GetMessageFilter() const
+	{
+		return messageFilter;
+	}
+	void PipeInMidiOut::SetMessageFilter(IMessageFilter* p)
+	{
+		InternalStop();
+		messageFilter = p;
+		InternalStart();
+	}
+	bool PipeInMidiOut::GetRealTimeLane() const
+	{
+		return realTimeLane;
+	}
+	void PipeInMidiOut::SetRealTimeLane(bool v)
+	{
+		InternalStop();
+		realTimeLane = v;
+		InternalStart();
+	}
+	bool PipeInMidiOut::IsRunning() const
+	{
+		return IsThreadRunning();
+	}
+	ResultCode PipeInMidiOut::GetDeviceError() const
+	{
+		return deviceError;
+	}
+	ResultCode PipeInMidiOut::GetPipeError() const
+	{
+		return pipeError;
+	}
+	uint64_t PipeInMidiOut::GetDiscardedBytes() const
+	{
+		return discardedBytes.Get();
+	}
+	uint64_t PipeInMidiOut::GetShortSendCount() const
+	{
+		return dispatcher.GetShortSendCount() + laneSends.Get();
+	}
+	uint64_t PipeInMidiOut::GetLongSendCount() const
+	{
+		return dispatcher.GetLongSendCount();
+	}
+	PipeInMidiOutStatistics PipeInMidiOut::GetStatistics() const
+	{
+		PipeInMidiOutStatistics st;
+		st.pipeReadCalls = pipeReadCalls.Get();
+		st.pipeReadBytes = pipeReadBytes.Get();
+		st.messages = messageCount.Get();
+		st.laneSends = laneSends.Get();
+		st.shortSends = dispatcher.GetShortSendCount() + st.laneSends;
+		st.longSends = dispatcher.GetLongSendCount();
+		st.inPlaceSends = dispatcher.GetInPlaceSendCount();
+		st.discardedBytes = discardedBytes.Get();
+		st.filteredMessages = filteredMessages.Get();
+		st.connects = connectCount.Get();
+		st.reconnects = (st.connects > 0) ? st.connects - 1 : 0;
+		IMidiOutPort* port = midiOutPort;
+		st.bufferLowWater = port ? port->GetBufferLowWater() : -1;
+		st.readToSendLatency = readToSendLatency.GetSnapshot();
+		st.laneLatency = laneLatency.GetSnapshot();
+		return st;
+	}
+	void PipeInMidiOut::ResetStatistics()
+	{
+		pipeReadCalls.Reset();
+		pipeReadBytes.Reset();
+		messageCount.Reset();
+		filteredMessages.Reset();
+		laneSends.Reset();
+		discardedBytes.Reset();
+		dispatcher.ResetCounters();
+		connectCount.Reset();
+		readToSendLatency.Reset();
+		laneLatency.Reset();
+	}
+
+	// ================================================================================
+	// MidiInPipeOut
+
+	MidiInPipeOut::MidiInPipeOut() : WorkerThread("MidiInPipeOut"), stagingRing(StagingBufferSize), messageRing(StagedMessageCount)
+	{
+	}
+	MidiInPipeOut::~MidiInPipeOut()
+	{
+		InternalStop();
+		if(midiInPort) midiInPort->OnMidiInReceived = nullptr;
+	}
+	bool MidiInPipeOut::NeedToReportPipeError(ResultCode r) const
+	{
+		if(!ResultIsError(r)) return false;
+		if(isServer && transport && transport->IsBrokenPipe(r)) return false;
+		return true;
+	}
+	void MidiInPipeOut::OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t)
+	{
+		if(quitFlag || ResultIsError(pipeError)) return;
+		const uint8_t* in = p;
+		int cin = c;
+		uint8_t w[3];
+		if(messageFilter && (c > 0))
+		{
+			MidiMessage fm;
+			if(!ApplyMessageFilter(*messageFilter, ClassifyMidiMessage(p, c), fm, w))
+			{
+				if(flightRecorder) flightRecorder->Record(FlightDirection::MidiToPipe, in, cin, t);
+				filteredMessages.Add();
+				return;
+			}
+			p = fm.data;
+			c = fm.length;
+		}
+		if(!stagingRing.PushRange(p, (size_t)c))
+		{
+			overrunBytes += (uint64_t)c;
+			return;
+		}
+		if(flightRecorder) flightRecorder->Record(FlightDirection::MidiToPipe, in, cin, t);
+		// a message whose timestamp does not fit is still delivered, it just goes untimed
+		stagedEnd += (uint64_t)c;
+		messageCount.Add();
+		messageRing.Push({ stagedEnd, t, std::chrono::steady_clock::now() });
+		if(coalescePolicy.flushOnRealTime && (c > 0) && MidiFramer::IsRealTime(p[0])) realTimeStaged = true;
+		// pairs with the fence in WaitForStagedBytes(), either the writer sees the bytes or we see the writer sleeping
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int wait = writerWait.load(std::memory_order_relaxed);
+		if((wait != WriterBusy) && IsWriterReady(wait))
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			wakeCond.notify_one();
+		}
+	}
+	bool MidiInPipeOut::IsWriterReady(int wait) const
+	{
+		if(wait == WriterIdle) return !stagingRing.IsEmpty();
+		return realTimeStaged || (stagingRing.GetCount() >= (size_t)coalescePolicy.flushBytes);
+	}
+	void MidiInPipeOut::WaitForStagedBytes(int wait, std::chrono::steady_clock::time_point deadline)
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		writerWait.store(wait, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto ready = [this, wait]() { return quitFlag || IsWriterReady(wait); };
+		if(wait == WriterIdle)	wakeCond.wait(lock, ready);
+		else					wakeCond.wait_until(lock, deadline, ready);
+		writerWait.store(WriterBusy, std::memory_order_relaxed);
+	}
+	void MidiInPipeOut::RecordFlush(size_t n)
+	{
+		int bucket = 0; while((bucket + 1 < CoalesceStatistics::NumSizeBuckets) && ((size_t)2 << bucket) <= n) ++bucket;
+		flushCount.fetch_add(1, std::memory_order_relaxed);
+		flushedBytes.fetch_add(n, std::memory_order_relaxed);
+		sizeHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+		if(maxFlushBytes.load(std::memory_order_relaxed) < n) maxFlushBytes.store(n, std::memory_order_relaxed);
+	}
+	void MidiInPipeOut::RecordMessageLatency(std::chrono::steady_clock::time_point now)
+	{
+		StagedMessage m;
+		while(messageRing.Peek(&m) && (m.endOffset <= writtenEnd))
+		{
+			messageRing.Pop(&m);
+			callbackToWriteLatency.Record(now - m.callbackTime);
+			int64_t ns = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(now - m.timestamp).count());
+			int bin = (int)std::min<int64_t>(ns / std::chrono::duration_cast<std::chrono::nanoseconds>(SourceLatencyStatistics::BinWidth).count(), SourceLatencyStatistics::NumBins - 1);
+			latencyHistogram[bin].fetch_add(1, std::memory_order_relaxed);
+			latencyCount.fetch_add(1, std::memory_order_relaxed);
+			latencySum.fetch_add(ns, std::memory_order_relaxed);
+			if(ns < latencyMin.load(std::memory_order_relaxed)) latencyMin.store(ns, std::memory_order_relaxed);
+			if(ns > latencyMax.load(std::memory_order_relaxed)) latencyMax.store(ns, std::memory_order_relaxed);
+		}
+	}
+	unsigned int MidiInPipeOut::Run()
+	{
+		CoreDebugPrint(L"[MidiInPipeOut] thread begin\n");
+		std::vector<uint8_t> buffer(WriteBufferSize);
+		pacer.SetRate(serialPacing.bitRate, serialPacing.fifoBytes);
+		pacer.Reset(std::chrono::steady_clock::now());
+		while(1)
+		{
+			if(quitFlag) break;
+			if(stagingRing.IsEmpty())
+			{
+				WaitForStagedBytes(WriterIdle, {});
+				continue;
+			}
+			size_t c = buffer.size();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if(pacer.IsEnabled())
+			{
+				// the pacer already batches what piles up while the line is busy, so there is no coalescing wait
+				c = std::min(c, pacer.GetAllowance(now));
+				if(c == 0)
+				{
+					// short naps keep the quit request responsive
+					pacingTimer.SleepUntil(std::min(pacer.GetNextSendTime(), now + std::chrono::milliseconds(2)));
+					continue;
+				}
+			}
+			else if((coalescePolicy.flushDelay.count() > 0) && !IsWriterReady(WriterBatching))
+			{
+				// hold the first bytes back for a moment so a burst goes out in one write
+				WaitForStagedBytes(WriterBatching, now + coalescePolicy.flushDelay);
+				if(quitFlag) break;
+			}
+			realTimeStaged = false;
+			size_t n = stagingRing.PopRange(buffer.data(), c);
+			pacer.Consume(n, now);
+			int cw = 0;
+			ResultCode r = transport->Write(buffer.data(), (int)n, &cw);
+			if(ResultIsError(r))
+			{
+				if(quitFlag) break;
+				pipeError = r;
+				if(NeedToReportPipeError(r)) { if(OnPipeError) OnPipeError(r); }
+				if(OnStopped) OnStopped();
+				break;
+			}
+			RecordFlush(n);
+			writtenBytes.Add(n);
+			writtenEnd += n;
+			RecordMessageLatency(std::chrono::steady_clock::now());
+		}
+		CoreDebugPrint(L"[MidiInPipeOut] thread end\n");
+		return 0;
+	}
+	void MidiInPipeOut::RequestToQuitThread()
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		quitFlag = true;
+		if(transport) transport->SetWriteCancelled(true);
+		WorkerThread::RequestToQuitThread();
+		wakeCond.notify_all();
+	}
+	void MidiInPipeOut::InternalStart()
+	{
+		std::lock_guard<std::mutex> lock(reentrantMutex);
+		if(isStarted) return;
+		if(!transport || !midiInPort || !midiInPort->IsDeviceOpen()) return;
+		StopThread(); // join a writer that has failed on its own
+		deviceError = ResultOk;
+		pipeError = ResultOk;
+		transport->SetWriteCancelled(false);
+		// the device is stopped, so the leftovers of the previous session can be discarded from this side
+		uint8_t discard[256];
+		while(stagingRing.PopRange(discard, sizeof(discard)) > 0) {}
+		StagedMessage m;
+		while(messageRing.Pop(&m)) {}
+		stagedEnd = 0;
+		writtenEnd = 0;
+		StartThread();
+		ResultCode r = midiInPort->StartDevice();
+		if(ResultIsError(r))
+		{
+			StopThread();
+			deviceError = r;
+			if(OnDeviceError) OnDeviceError(r);
+			if(OnStopped) OnStopped();
+			return;
+		}
+		isStarted = true;
+	}
+	void MidiInPipeOut::InternalStop()
+	{
+		std::lock_guard<std::mutex> lock(reentrantMutex);
+		if(midiInPort && isStarted) midiInPort->StopDevice();
+		StopThread();
+		isStarted = false;
+	}
+	ITransport* MidiInPipeOut::GetTransport() const
+	{
+		return transport;
+	}
+	void MidiInPipeOut::SetTransport(ITransport* t, bool server)
+	{
+		InternalStop();
+		pipeError = ResultOk;
+		if(t) connectCount.Add();
+		transport = t;
+		isServer = server;
+		InternalStart();
+	}
+	IMidiInPort* MidiInPipeOut::GetMidiInPort() const
+	{
+		return midiInPort;
+	}
+	void MidiInPipeOut::SetMidiInPort(IMidiInPort* p)
+	{
+		InternalStop();
+		if(midiInPort) midiInPort->OnMidiInReceived = nullptr;
+		deviceError = ResultOk;
+		midiInPort = p;
+		if(midiInPort) midiInPort->OnMidiInReceived = [this](const uint8_t* data, int c, MidiTimestamp t) { OnMidiMessageReceived(data, c, t); };
+		InternalStart();
+	}
+	bool MidiInPipeOut::IsRunning() const
+	{
+		return isStarted && IsThreadRunning();
+	}
+	ResultCode MidiInPipeOut::GetDeviceError() const
+	{
+		return deviceError;
+	}
+	ResultCode MidiInPipeOut::GetPipeError() const
+	{
+		return pipeError;
+	}
+	uint64_t MidiInPipeOut::GetOverrunBytes() const
+	{
+		return overrunBytes;
+	}
+	CoalescePolicy MidiInPipeOut::GetCoalescePolicy() const
+	{
+		return coalescePolicy;
+	}
+	void MidiInPipeOut::SetCoalescePolicy(const CoalescePolicy& v)
+	{
+		InternalStop();
+		coalescePolicy = v;
+		coalescePolicy.flushBytes = std::clamp(coalescePolicy.flushBytes, 1, WriteBufferSize);
+		InternalStart();
+	}
+	SerialPacing MidiInPipeOut::GetSerialPacing() const
+	{
+		return serialPacing;
+	}
+	void MidiInPipeOut::SetSerialPacing(const SerialPacing& v)
+	{
+		InternalStop();
+		serialPacing = v;
+		InternalStart();
+	}
+	FlightRecorder* MidiInPipeOut::GetFlightRecorder() const
+	{
+		return flightRecorder;
+	}
+	void MidiInPipeOut::SetFlightRecorder(FlightRecorder* p)
+	{
+		InternalStop();
+		flightRecorder = p;
+		InternalStart();
+	}
+	IMessageFilter* MidiInPipeOut::GetMessageFilter() const
+	{
+		return messageFilter;
+	}
+	void MidiInPipeOut::SetMessageFilter(IMessageFilter* p)
+	{
+		InternalStop();
+		messageFilter = p;
+		InternalStart();
+	}
+	CoalesceStatistics MidiInPipeOut::GetCoalesceStatistics() const
+	{
+		CoalesceStatistics st;
+		st.flushCount = flushCount;
+		st.flushedBytes = flushedBytes;
+		st.maxFlushBytes = maxFlushBytes;
+		for(int i = 0; i < CoalesceStatistics::NumSizeBuckets; ++i) st.sizeHistogram[i] = sizeHistogram[i];
+		return st;
+	}
+	void MidiInPipeOut::ResetCoalesceStatistics()
+	{
+		flushCount = 0;
+		flushedBytes = 0;
+		maxFlushBytes = 0;
+		for(auto& v : sizeHistogram) v = 0;
+	}
+	SourceLatencyStatistics MidiInPipeOut::GetSourceLatencyStatistics() const
+	{
+		SourceLatencyStatistics st;
+		st.count = latencyCount;
+		if(st.count)
+		{
+			st.minDelay = std::chrono::nanoseconds(latencyMin.load());
+			st.maxDelay = std::chrono::nanoseconds(latencyMax.load());
+			st.sumDelay = std::chrono::nanoseconds(latencySum.load());
+		}
+		for(int i = 0; i < SourceLatencyStatistics::NumBins; ++i) st.histogram[i] = latencyHistogram[i];
+		return st;
+	}
+	void MidiInPipeOut::ResetSourceLatencyStatistics()
+	{
+		latencyCount = 0;
+		latencyMin = INT64_MAX;
+		latencyMax = 0;
+		latencySum = 0;
+		for(auto& v : latencyHistogram) v = 0;
+	}
+	MidiInPipeOutStatistics MidiInPipeOut::GetStatistics() const
+	{
+		MidiInPipeOutStatistics st;
+		st.messages = messageCount.Get();
+		st.bytes = writtenBytes.Get();
+		st.pipeWriteCalls = flushCount;
+		st.droppedBytes = overrunBytes;
+		st.filteredMessages = filteredMessages.Get();
+		st.connects = connectCount.Get();
+		st.reconnects = (st.connects > 0) ? st.connects - 1 : 0;
+		st.callbackToWriteLatency = callbackToWriteLatency.GetSnapshot();
+		return st;
+	}
+	void MidiInPipeOut::ResetStatistics()
+	{
+		messageCount.Reset();
+		writtenBytes.Reset();
+		filteredMessages.Reset();
+		overrunBytes = 0;
+		connectCount.Reset();
+		callbackToWriteLatency.Reset();
+		ResetCoalesceStatistics();
+	}
+}
@@ -0,0 +1,319 @@
+//
+//  TransferEngine.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "Transport.h"
+#include "MidiPort.h"
+#include "MidiFramer.h"
+#include "MidiOutDispatcher.h"
+#include "SpscRing.h"
+#include "BytePacer.h"
+#include "PreciseTimer.h"
+#include "Statistics.h"
+#include "FlightRecorder.h"
+#include "MessageFilter.h"
+#include "WorkerThread.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// pipe -> MIDI out
+
+	class PipeInMidiOut : private WorkerThread
+	{
+	public:
+		static constexpr int MaxReadAhead = 256;
+	private:
+		static constexpr int ReadBufferSize = 256;
+		// one completed (or failed) read waiting in the read-ahead ring
+		struct ReadSlot
+		{
+			std::vector<uint8_t> data;
+			int length = 0;
+			ResultCode result = ResultOk;
+			std::chrono::steady_clock::time_point readTime;
+			// a real-time lane send that failed, the worker reports it in turn
+			ResultCode laneResult = ResultOk;
+			// holds bytes outside a SysEx, a channel message or a port select, the lane may not pass them until the worker has sent them
+			bool ordered = false;
+		};
+		// keeps reads queued on the transport while the worker sends, the counterpart of several overlapped reads in flight
+		class ReadAheadThread : public WorkerThread
+		{
+		private:
+			PipeInMidiOut& owner;
+			virtual unsigned int Run() override;
+			virtual void RequestToQuitThread() override;
+		public:
+			ReadAheadThread(PipeInMidiOut& o);
+			virtual ~ReadAheadThread() override;
+		};
+		ITransport* transport = nullptr;
+		IMidiOutPort* midiOutPort = nullptr;
+		MidiFramer framer;
+		MidiOutDispatcher dispatcher;
+		std::mutex reentrantMutex;
+		std::atomic<ResultCode> deviceError{ ResultOk };
+		std::atomic<ResultCode> pipeError{ ResultOk };
+		bool isServer = false;
+		RelaxedCounter pipeReadCalls;
+		RelaxedCounter pipeReadBytes;
+		RelaxedCounter messageCount;
+		RelaxedCounter discardedBytes;
+		RelaxedCounter connectCount;
+		LatencyHistogram readToSendLatency;
+		int readAhead = 1;
+		bool zeroCopyRead = false;
+		FlightRecorder* flightRecorder = nullptr;
+		IMessageFilter* messageFilter = nullptr;
+		RelaxedCounter filteredMessages;
+		bool realTimeLane = false;
+		// set for the run when the lane can work: read-ahead and a port that takes short messages beside a long send
+		bool laneActive = false;
+		RelaxedCounter laneSends;
+		LatencyHistogram laneLatency;
+		// cleared for the run when the port turns out to lend no buffers
+		bool zeroCopyActive = false;
+		std::vector<ReadSlot> readSlots;
+		// slots [readHead, readHead + readFilled) hold completed reads in order, the reader fills the one after them
+		std::mutex readMutex;
+		std::condition_variable readCond;
+		size_t readHead = 0;
+		size_t readFilled = 0;
+		bool readQuit = false;
+		// the slots in the ring holding bytes the lane may not pass
+		int pendingOrdered = 0;
+		// whether the bytes the reader has seen so far end inside a SysEx, the reader's own
+		bool laneInSysEx = false;
+		ReadAheadThread readAheadThread;
+		bool NeedToReportPipeError(ResultCode r) const;
+		// false ends the transfer
+		bool ProcessRead(const uint8_t* p, int c, ResultCode r, std::chrono::steady_clock::time_point readtime);
+		// true when the framer will see the chunk as a single SysEx segment covering all of it
+		bool IsWholeSysExSegment(const uint8_t* p, int c) const;
+		// reads into a buffer lent by the MIDI out port, false ends the transfer
+		bool ReadIntoSendBuffer(std::vector<uint8_t>& buffer);
+		// follows the SysEx the reader is in, true when the byte belongs to a SysEx the lane may pass
+		bool TrackLaneSysEx(uint8_t b);
+		// sends the real-time bytes of a completed read ahead of the ring and packs the rest together, returns what is left.
+		// only SysEx is passed: stops at the first other byte, or at once when the ring still holds one
+		int SendRealTimeAhead(ReadSlot& slot, bool orderedpending);
+		unsigned int RunReadAhead();
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+		void InternalStart();
+		void InternalStop();
+	public:
+		std::function<void(ResultCode)> OnDeviceError;
+		std::function<void(ResultCode)> OnPipeError;
+		// called on the worker thread when the transfer loop has ended
+		std::function<void()> OnStopped;
+		PipeInMidiOut();
+		virtual ~PipeInMidiOut() override;
+		ITransport* GetTransport() const;
+		void SetTransport(ITransport* t, bool server);
+		IMidiOutPort* GetMidiOutPort() const;
+		void SetMidiOutPort(IMidiOutPort* p);
+		int GetReadAhead() const;
+		// how many pipe reads may complete ahead of the MIDI out, 1 reads and sends in turn on a single thread,
+		// more adds a reader thread that fills a ring of that many buffers while the worker sends. restarts the transfer when it is running
+		void SetReadAhead(int v);
+		bool GetZeroCopyRead() const;
+		// read the pipe straight into the MIDI out port's buffers, a read that is all SysEx data goes to the device without a copy,
+		// anything else is copied out and framed as usual. needs a port with AcquireSendBuffer() and a read-ahead of 1, ignored otherwise.
+		// restarts the transfer when it is running
+		void SetZeroCopyRead(bool v);
+		FlightRecorder* GetFlightRecorder() const;
+		// every message read from the pipe is captured with the read completion time, nullptr stops the capture.
+		// the recorder stays open while it is attached, restarts the transfer when it is running
+		void SetFlightRecorder(FlightRecorder* p);
+		IMessageFilter* GetMessageFilter() const;
+		// every framed message passes the filter on its way to the MIDI out, nullptr passes them unchanged.
+		// the flight recorder still sees them as read. the filter stays alive while it is attached, restarts the transfer when it is running
+		void SetMessageFilter(IMessageFilter* p);
+		bool GetRealTimeLane() const;
+		// real-time bytes (F8-FF) skip the queue: the reader thread sends them as soon as a read completes,
+		// ahead of the SysEx that waits in the read-ahead ring or for the device. MIDI 1.0 lets them cut into a SysEx.
+		// only SysEx is passed, a real-time byte after a channel message that is still queued stays behind it.
+		// while the waiting SysEx fits in the ring (read-ahead x 256 bytes) a clock byte waits one pipe read, not the dump.
+		// needs a read-ahead of 2 or more and a port with IsShortMessageConcurrent(), ignored otherwise.
+		// real-time after a port select waits for the select the same way. restarts the transfer when it is running
+		void SetRealTimeLane(bool v);
+		bool IsRunning() const;
+		ResultCode GetDeviceError() const;
+		ResultCode GetPipeError() const;
+		// bytes dropped by the framer (data without status, stray EOX, truncated messages)
+		uint64_t GetDiscardedBytes() const;
+		uint64_t GetShortSendCount() const;
+		uint64_t GetLongSendCount() const;
+		// counters and latency since construction or the last reset, safe to call while running
+		PipeInMidiOutStatistics GetStatistics() const;
+		void ResetStatistics();
+	};
+
+	// ================================================================================
+	// MIDI in -> pipe write coalescing
+
+	struct CoalescePolicy
+	{
+		// flush as soon as this many bytes are staged
+		int flushBytes = 256;
+		// otherwise hold the first staged byte back at most this long, 0 writes whatever is staged right away.
+		// the default is below the 320 usec a single byte takes on a MIDI 1.0 wire
+		std::chrono::microseconds flushDelay{ 250 };
+		// a clock or other real-time byte ends the wait
+		bool flushOnRealTime = true;
+	};
+
+	struct CoalesceStatistics
+	{
+		// sizeHistogram[i] counts the writes of [2^i, 2^(i+1)) bytes
+		static constexpr int NumSizeBuckets = 13;
+		uint64_t flushCount = 0;
+		uint64_t flushedBytes = 0;
+		uint64_t maxFlushBytes = 0;
+		uint64_t sizeHistogram[NumSizeBuckets] = {};
+	};
+
+	// delay from the driver's source timestamp to the completion of the pipe write that carried the message
+	struct SourceLatencyStatistics
+	{
+		// histogram[i] counts the delays of [i, i+1) * BinWidth, the last bin also takes everything beyond
+		static constexpr std::chrono::microseconds BinWidth{ 250 };
+		static constexpr int NumBins = 64;
+		uint64_t count = 0;
+		std::chrono::nanoseconds minDelay{ 0 };
+		std::chrono::nanoseconds maxDelay{ 0 };
+		std::chrono::nanoseconds sumDelay{ 0 };
+		uint64_t histogram[NumBins] = {};
+		// peak-to-peak jitter
+		std::chrono::nanoseconds GetJitter() const { return maxDelay - minDelay; }
+		std::chrono::nanoseconds GetMeanDelay() const { return count ? sumDelay / (int64_t)count : std::chrono::nanoseconds(0); }
+	};
+
+	// serial line emulation toward the guest, trades latency for a UART that is never overrun
+	struct SerialPacing
+	{
+		// 0 disables pacing, 31250 matches a MIDI wire, 38400 the classic serial MIDI drivers
+		double bitRate = 0;
+		// how many bytes may run ahead of the line, the headroom of the guest's receive FIFO
+		int fifoBytes = 1;
+	};
+
+	// ================================================================================
+	// MIDI in -> pipe
+	// the driver callback only copies the message into a staging ring, a writer thread drains it to the pipe
+	// so a stalled guest never blocks the driver
+
+	class MidiInPipeOut : private WorkerThread
+	{
+	private:
+		static constexpr size_t StagingBufferSize = 64 * 1024;
+		static constexpr int WriteBufferSize = 4096;
+		static constexpr size_t StagedMessageCount = 32 * 1024;
+		struct StagedMessage
+		{
+			uint64_t endOffset;
+			MidiTimestamp timestamp;
+			std::chrono::steady_clock::time_point callbackTime;
+		};
+		ITransport* transport = nullptr;
+		IMidiInPort* midiInPort = nullptr;
+		SpscRing<uint8_t> stagingRing;
+		// the source timestamp of each staged message, keyed by where the message ends in the byte stream
+		SpscRing<StagedMessage> messageRing;
+		uint64_t stagedEnd = 0;		// callback side
+		uint64_t writtenEnd = 0;	// writer side
+		std::mutex wakeMutex;
+		std::condition_variable wakeCond;
+		enum WriterWait { WriterBusy, WriterIdle, WriterBatching };
+		std::atomic<int> writerWait{ WriterBusy };
+		std::atomic<bool> realTimeStaged{ false };
+		std::atomic<uint64_t> overrunBytes{ 0 };
+		CoalescePolicy coalescePolicy;
+		SerialPacing serialPacing;
+		FlightRecorder* flightRecorder = nullptr;
+		IMessageFilter* messageFilter = nullptr;
+		RelaxedCounter filteredMessages;
+		BytePacer pacer;
+		PreciseTimer pacingTimer;
+		std::atomic<uint64_t> flushCount{ 0 };
+		std::atomic<uint64_t> flushedBytes{ 0 };
+		std::atomic<uint64_t> maxFlushBytes{ 0 };
+		std::atomic<uint64_t> sizeHistogram[CoalesceStatistics::NumSizeBuckets] = {};
+		std::atomic<uint64_t> latencyCount{ 0 };
+		std::atomic<int64_t> latencyMin{ INT64_MAX };
+		std::atomic<int64_t> latencyMax{ 0 };
+		std::atomic<int64_t> latencySum{ 0 };
+		std::atomic<uint64_t> latencyHistogram[SourceLatencyStatistics::NumBins] = {};
+		RelaxedCounter messageCount;
+		RelaxedCounter writtenBytes;
+		RelaxedCounter connectCount;
+		LatencyHistogram callbackToWriteLatency;
+		std::mutex reentrantMutex;
+		std::atomic<ResultCode> deviceError{ ResultOk };
+		std::atomic<ResultCode> pipeError{ ResultOk };
+		bool isServer = false;
+		bool isStarted = false;
+		bool NeedToReportPipeError(ResultCode r) const;
+		void OnMidiMessageReceived(const uint8_t* p, int c, MidiTimestamp t);
+		bool IsWriterReady(int wait) const;
+		void WaitForStagedBytes(int wait, std::chrono::steady_clock::time_point deadline);
+		void RecordFlush(size_t n);
+		void RecordMessageLatency(std::chrono::steady_clock::time_point now);
+		virtual unsigned int Run() override;
+		virtual void RequestToQuitThread() override;
+		void InternalStart();
+		void InternalStop();
+	public:
+		std::function<void(ResultCode)> OnDeviceError;
+		std::function<void(ResultCode)> OnPipeError;
+		// called on the writer thread (or the caller of a failed start) when the transfer has failed
+		std::function<void()> OnStopped;
+		MidiInPipeOut();
+		virtual ~MidiInPipeOut() override;
+		ITransport* GetTransport() const;
+		void SetTransport(ITransport* t, bool server);
+		IMidiInPort* GetMidiInPort() const;
+		void SetMidiInPort(IMidiInPort* p);
+		bool IsRunning() const;
+		ResultCode GetDeviceError() const;
+		ResultCode GetPipeError() const;
+		// bytes dropped because the staging ring was full, the guest has not been reading
+		uint64_t GetOverrunBytes() const;
+		CoalescePolicy GetCoalescePolicy() const;
+		// restarts the transfer when it is running
+		void SetCoalescePolicy(const CoalescePolicy& v);
+		SerialPacing GetSerialPacing() const;
+		// restarts the transfer when it is running
+		void SetSerialPacing(const SerialPacing& v);
+		FlightRecorder* GetFlightRecorder() const;
+		// every MIDI in message is captured with the driver's source timestamp, nullptr stops the capture.
+		// the recorder stays open while it is attached, restarts the transfer when it is running
+		void SetFlightRecorder(FlightRecorder* p);
+		IMessageFilter* GetMessageFilter() const;
+		// every MIDI in message passes the filter before it is staged for the pipe, nullptr passes them unchanged.
+		// the flight recorder still sees them as received. the filter stays alive while it is attached, restarts the transfer when it is running
+		void SetMessageFilter(IMessageFilter* p);
+		CoalesceStatistics GetCoalesceStatistics() const;
+		void ResetCoalesceStatistics();
+		SourceLatencyStatistics GetSourceLatencyStatistics() const;
+		void ResetSourceLatencyStatistics();
+		// counters and latency since construction or the last reset, safe to call while running
+		MidiInPipeOutStatistics GetStatistics() const;
+		void ResetStatistics();
+	};
+}
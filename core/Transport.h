@@ -0,0 +1,29 @@
+//
+//  Transport.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include "CoreTypes.h"
+
+namespace MidiBridgeCore
+{
+	//
+	// a connected full-duplex byte stream (named pipe, in-memory pipe, ...)
+	// - Read() blocks until at least one byte is available, Write() blocks until all bytes are accepted
+	// - reads and writes are issued from different threads, but never two reads or two writes at once
+	// - SetReadCancelled(true) aborts a blocking Read() and makes following reads fail with ResultCancelled until re-armed, the same for writes
+	//
+	struct ITransport
+	{
+		virtual ~ITransport() {}
+		virtual ResultCode Read(uint8_t* p, int c, int* cr) = 0;
+		virtual ResultCode Write(const uint8_t* p, int c, int* cw) = 0;
+		virtual void SetReadCancelled(bool v) = 0;
+		virtual void SetWriteCancelled(bool v) = 0;
+		virtual bool IsBrokenPipe(ResultCode r) const = 0;
+	};
+}
@@ -0,0 +1,98 @@
+//
+//  WorkerThread.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "WorkerThread.h"
+#include "CoreDebugPrint.h"
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// SignalEvent
+
+	void SignalEvent::Set()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		signaled = true;
+		cond.notify_all();
+	}
+	void SignalEvent::Reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		signaled = false;
+	}
+	bool SignalEvent::IsSet() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return signaled;
+	}
+	void SignalEvent::Wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this]() { return signaled; });
+	}
+	bool SignalEvent::WaitFor(std::chrono::nanoseconds t)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		return cond.wait_for(lock, t, [this]() { return signaled; });
+	}
+
+	// ================================================================================
+	// WorkerThread
+
+	WorkerThread::WorkerThread(const std::string& name) : threadName(name)
+	{
+	}
+	WorkerThread::~WorkerThread()
+	{
+		// NOTE: derived classes must stop the thread in their own destructor, Run() is already gone here
+		StopThread();
+	}
+	void WorkerThread::ThreadProc()
+	{
+		try
+		{
+			Run();
+		}
+		catch(...)
+		{
+			CoreDebugPrint(L"[WorkerThread] exception: unknown\n");
+		}
+		running = false;
+	}
+	bool WorkerThread::StartThread()
+	{
+		StopThread();
+		quitEvent.Reset();
+		quitFlag = false;
+		running = true;
+		try
+		{
+			thread = std::thread([this]() { ThreadProc(); });
+		}
+		catch(...)
+		{
+			running = false;
+			return false;
+		}
+		return true;
+	}
+	void WorkerThread::StopThread()
+	{
+		if(!thread.joinable()) return;
+		RequestToQuitThread();
+		thread.join();
+	}
+	bool WorkerThread::IsThreadRunning() const
+	{
+		return running;
+	}
+	void WorkerThread::RequestToQuitThread()
+	{
+		quitFlag = true;
+		quitEvent.Set();
+	}
+}
@@ -0,0 +1,59 @@
+//
+//  WorkerThread.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace MidiBridgeCore
+{
+	// ================================================================================
+	// manual-reset event
+
+	class SignalEvent
+	{
+	private:
+		mutable std::mutex mutex;
+		std::condition_variable cond;
+		bool signaled = false;
+	public:
+		void Set();
+		void Reset();
+		bool IsSet() const;
+		void Wait();
+		bool WaitFor(std::chrono::nanoseconds t);
+	};
+
+	// ================================================================================
+	// a thread with a cooperative quit request
+
+	class WorkerThread
+	{
+	protected:
+		std::string threadName;
+		std::thread thread;
+		std::atomic<bool> running{ false };
+		SignalEvent quitEvent;
+		std::atomic<bool> quitFlag{ false };
+		void ThreadProc();
+	public:
+		WorkerThread(const std::string& name);
+		virtual ~WorkerThread();
+		WorkerThread(const WorkerThread&) = delete;
+		WorkerThread& operator=(const WorkerThread&) = delete;
+		bool StartThread();
+		void StopThread();
+		bool IsThreadRunning() const;
+		virtual void RequestToQuitThread();
+		virtual unsigned int Run() = 0;
+	};
+}
@@ -0,0 +1,97 @@
+//
+//  BenchBackPressure.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// back-to-back SysEx dumps like a patch librarian sends
+	static std::vector<uint8_t> MakeSysExStream(size_t n, size_t dumpsize)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(n);
+		while(v.size() < n)
+		{
+			size_t c = std::min(dumpsize, n - v.size());
+			if(c < 2) { v.push_back(0xf8); continue; }
+			v.push_back(0xf0);
+			for(size_t i = 1; i + 1 < c; ++i) v.push_back((uint8_t)((v.size() * 7) & 0x7f));
+			v.push_back(0xf7);
+		}
+		return v;
+	}
+
+	struct SlowSinkResult
+	{
+		uint64_t bytes = 0;
+		uint64_t waits = 0;
+		uint64_t sends = 0;
+		ResultCode deviceError = ResultOk;
+		double sec = 0;
+		bool matched = false;
+	};
+
+	static SlowSinkResult RunSlowSink(const std::vector<uint8_t>& stream, double rate, std::chrono::milliseconds timeout)
+	{
+		SlowSinkResult result;
+		MemoryPipe pipe(64 * 1024);
+		FakeQueuedMidiOutPort midiout(16, 256);
+		midiout.SetBytesPerSecond(rate);
+		midiout.SetSendTimeout(timeout);
+		midiout.OpenDevice();
+		PipeInMidiOut p2m;
+		p2m.SetMidiOutPort(&midiout);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		Clock::time_point t0 = Clock::now();
+		std::thread writer([&]()
+		{
+			int cw = 0;
+			pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+		});
+		// give up early when the engine has failed, the remaining bytes would never arrive
+		while(!midiout.WaitForBytes(stream.size(), std::chrono::milliseconds(100)))
+		{
+			if(!p2m.IsRunning() || (SecondsSince(t0) > 120)) break;
+		}
+		result.sec = SecondsSince(t0);
+		pipe.Close();
+		writer.join();
+		p2m.SetTransport(nullptr, false);
+		result.deviceError = p2m.GetDeviceError();
+		result.sends = p2m.GetLongSendCount();
+		p2m.SetMidiOutPort(nullptr);
+		result.waits = midiout.GetWaitCount();
+		midiout.CloseDevice();
+		std::vector<uint8_t> received = midiout.GetReceivedData();
+		result.bytes = received.size();
+		result.matched = received == stream;
+		return result;
+	}
+
+	int RunBackPressure(const BenchArgs& args)
+	{
+		size_t total = (size_t)args.GetInt("bytes", 1024 * 1024);
+		size_t dumpsize = (size_t)args.GetInt("dump", 32 * 1024);
+		double rate = args.GetDouble("rate", 4e6);
+		std::chrono::milliseconds timeout(args.GetInt("timeout", 2000));
+		std::vector<uint8_t> stream = MakeSysExStream(total, dumpsize);
+		// the pre-back-pressure behavior for reference: the stream dies as soon as the 16 buffers are in flight
+		SlowSinkResult failfast = RunSlowSink(std::vector<uint8_t>(stream.begin(), stream.begin() + std::min<size_t>(stream.size(), 64 * 1024)), rate, std::chrono::milliseconds(0));
+		std::printf("fail-fast: %llu bytes delivered, device error %d\n", (unsigned long long)failfast.bytes, (int)failfast.deviceError);
+		SlowSinkResult r = RunSlowSink(stream, rate, timeout);
+		PrintRate("sysex slow sink", r.bytes, r.sends, r.sec);
+		std::printf("blocked %llu times, sink rate %.0f bytes/s\n", (unsigned long long)r.waits, rate);
+		if(ResultIsError(r.deviceError)) { std::printf("backpressure: device error %d\n", (int)r.deviceError); return 1; }
+		if(!r.matched) { std::printf("backpressure: lost or corrupted data, %llu of %zu bytes\n", (unsigned long long)r.bytes, stream.size()); return 1; }
+		return 0;
+	}
+}
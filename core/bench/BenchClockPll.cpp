@@ -0,0 +1,320 @@
+//
+//  BenchClockPll.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "ClockRegenerator.h"
+#include "PortSelect.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	using PllTimePoint = MidiClockPll::TimePoint;
+
+	// a clock status as the guest's sequencer meant it and as the pipe delivered it
+	struct ClockCaseEvent
+	{
+		uint8_t status;
+		PllTimePoint intended;
+		PllTimePoint arrival;
+	};
+
+	// a sequencer playing at bpm from t for length, 24 clocks to the quarter note, after a start or continue when there is one
+	static void AppendClockRun(std::vector<ClockCaseEvent>* v, uint8_t start, PllTimePoint t, std::chrono::microseconds length, double bpm, double bpm2)
+	{
+		if(start) v->push_back({ start, t, {} });
+		PllTimePoint end = t + length;
+		for(PllTimePoint c = t; c < end; )
+		{
+			v->push_back({ 0xf8, c, {} });
+			// the second tempo from the middle on
+			double b = (c < t + length / 2) ? bpm : bpm2;
+			c += std::chrono::duration_cast<PllTimePoint::duration>(std::chrono::duration<double>(60.0 / b / 24));
+		}
+	}
+
+	// the host delivers each status up to jitter late, or at the end of its timer quantum, never out of order
+	static void DeliverClockCase(std::vector<ClockCaseEvent>* v, std::chrono::microseconds jitter, std::chrono::microseconds quantum, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int64_t> noise(0, std::max<int64_t>(jitter.count(), 0));
+		PllTimePoint last{};
+		for(auto& e : *v)
+		{
+			PllTimePoint t = e.intended + std::chrono::microseconds(noise(rng));
+			if(quantum.count() > 0)
+			{
+				auto q = std::chrono::duration_cast<PllTimePoint::duration>(quantum);
+				t = PllTimePoint((e.intended.time_since_epoch() + q - PllTimePoint::duration(1)) / q * q) + std::chrono::microseconds(noise(rng) / 8);
+			}
+			e.arrival = std::max(t, last);
+			last = e.arrival;
+		}
+	}
+
+	static double PeakToPeakMs(const std::vector<double>& v)
+	{
+		return v.empty() ? 0 : *std::max_element(v.begin(), v.end()) - *std::min_element(v.begin(), v.end());
+	}
+
+	static double RmsMs(const std::vector<double>& v)
+	{
+		double m = 0, s = 0;
+		for(double x : v) m += x;
+		m /= std::max<size_t>(v.size(), 1);
+		for(double x : v) s += (x - m) * (x - m);
+		return std::sqrt(s / std::max<size_t>(v.size(), 1));
+	}
+
+	// runs the case through the loop the way the regenerator does, waking at each arrival and at each due time, an FA, FB
+	// or FC played as it comes after the clocks it released.
+	// the output's jitter must come down to maxrms of the input's and its peaks to maxpp, 0 leaves them unchecked. a clock
+	// released early by a stop is not jitter and is not counted. the loop must end up at the period of endbpm
+	static int CheckClockCase(const char* label, const std::vector<ClockCaseEvent>& input, const ClockPllSettings& settings, double maxrms, double maxpp, double endbpm)
+	{
+		MidiClockPll pll;
+		pll.SetSettings(settings);
+		struct Played { uint8_t status; PllTimePoint time; bool locked; bool released; };
+		std::vector<Played> played;
+		PllTimePoint now = input.empty() ? PllTimePoint() : input.front().arrival;
+		PllTimePoint firstlock = PllTimePoint::max();
+		for(size_t i = 0; ; )
+		{
+			PllTimePoint t = pll.GetNextTime();
+			if(i < input.size()) t = std::min(t, input[i].arrival);
+			if(t == PllTimePoint::max()) break;
+			now = std::max(now, t);
+			for(; (i < input.size()) && (input[i].arrival <= now); ++i)
+			{
+				pll.Push(input[i].status, input[i].arrival);
+				if(pll.IsLocked() && (firstlock == PllTimePoint::max())) firstlock = input[i].arrival;
+				if(input[i].status == 0xf8) continue;
+				while(pll.TakeDue(now)) played.push_back({ 0xf8, now, pll.IsLocked(), true });
+				played.push_back({ input[i].status, now, pll.IsLocked(), false });
+			}
+			while(pll.TakeDue(now)) played.push_back({ 0xf8, now, pll.IsLocked(), false });
+		}
+		int r = 0;
+		bool sameorder = played.size() == input.size();
+		for(size_t j = 0; sameorder && (j < played.size()); ++j) sameorder = played[j].status == input[j].status;
+		if(!sameorder) { std::printf("clockpll: %s, %zu statuses played of %zu or out of order\n", label, played.size(), input.size()); return 1; }
+		std::vector<double> in, out;
+		double rmsin = 0, rmsout = 0;
+		double holdbackms = std::chrono::duration<double, std::milli>(settings.holdback).count();
+		bool bounded = true;
+		for(size_t j = 0; j < played.size(); ++j)
+		{
+			double wait = std::chrono::duration<double, std::milli>(played[j].time - input[j].arrival).count();
+			if((wait < 0) || (wait > 2 * holdbackms + 1e-6)) bounded = false;
+			if((input[j].status != 0xf8) || !played[j].locked || played[j].released) continue;
+			in.push_back(std::chrono::duration<double, std::milli>(input[j].arrival - input[j].intended).count());
+			out.push_back(std::chrono::duration<double, std::milli>(played[j].time - input[j].intended).count());
+		}
+		rmsin = RmsMs(in);
+		rmsout = RmsMs(out);
+		double lockms = (firstlock == PllTimePoint::max()) ? -1 : std::chrono::duration<double, std::milli>(firstlock - input.front().arrival).count();
+		std::printf("%-22s %5zu clocks locked, jitter in %6.2f ms p-p %5.2f rms, out %6.2f ms p-p %5.2f rms, lock after %7.1f ms, %llu relocks\n", label,
+			out.size(), PeakToPeakMs(in), rmsin, PeakToPeakMs(out), rmsout, lockms, (unsigned long long)pll.GetRelockCount());
+		if(!bounded) { std::printf("clockpll: %s, a status played before it arrived or more than twice the holdback after\n", label); r = 1; }
+		if(lockms < 0) { std::printf("clockpll: %s, the loop never locked\n", label); r = 1; }
+		if(rmsout > maxrms * rmsin) { std::printf("clockpll: %s, the jitter went from %.2f to %.2f ms rms\n", label, rmsin, rmsout); r = 1; }
+		if((maxpp > 0) && (PeakToPeakMs(out) > maxpp * PeakToPeakMs(in))) { std::printf("clockpll: %s, the jitter went from %.2f to %.2f ms p-p\n", label, PeakToPeakMs(in), PeakToPeakMs(out)); r = 1; }
+		double periodms = std::chrono::duration<double, std::milli>(pll.GetPeriod()).count();
+		double endperiodms = 60000 / (endbpm * 24);
+		if(std::abs(periodms - endperiodms) > 0.01 * endperiodms) { std::printf("clockpll: %s, the period ended at %.3f ms instead of %.3f ms\n", label, periodms, endperiodms); r = 1; }
+		return r;
+	}
+
+	// a device that notes when each short message arrives
+	struct ClockProbePort : public IMidiOutPort
+	{
+		std::mutex mutex;
+		std::vector<std::pair<uint8_t, Clock::time_point> > arrivals;
+		// the next short message fails with this instead of arriving
+		ResultCode failNext = ResultOk;
+		virtual bool IsDeviceOpen() const override { return true; }
+		virtual ResultCode Send(const uint8_t*, int) override { return ResultOk; }
+		virtual ResultCode SendShortMessage(uint32_t msg) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ResultCode r = failNext;
+			failNext = ResultOk;
+			if(r == ResultOk) arrivals.push_back({ (uint8_t)msg, Clock::now() });
+			return r;
+		}
+		virtual bool IsShortMessageConcurrent() const override { return true; }
+	};
+
+	// the regenerator on the real clock: a jittered clock played into it by a thread, out of it by its own.
+	// the output's jitter must come down as in the virtual cases, give or take how late the host wakes a thread (hostms);
+	// *smooth is false when only that fails, a host that stalls a thread for longer can make it fail now and then
+	static int CheckClockRegenSession(const ClockPllSettings& settings, double bpm, std::chrono::microseconds length, std::chrono::microseconds jitter, uint32_t seed, double maxrms, double maxpp, double hostms, bool* smooth)
+	{
+		*smooth = true;
+		std::vector<ClockCaseEvent> input;
+		Clock::time_point t0 = Clock::now() + std::chrono::milliseconds(5);
+		AppendClockRun(&input, 0xfa, t0, length, bpm, bpm);
+		input.push_back({ 0xfc, input.back().intended + std::chrono::milliseconds(1), {} });
+		// a note on right behind the start and a note off right behind the stop must reach the device after them
+		input.insert(input.begin() + 1, { 0x90, t0, {} });
+		input.push_back({ 0x80, input.back().intended, {} });
+		DeliverClockCase(&input, jitter, std::chrono::microseconds(0), seed);
+		ClockProbePort device;
+		ClockRegenMidiOut regen;
+		regen.SetMidiOutPort(&device);
+		regen.SetSettings(settings);
+		regen.Start();
+		std::vector<Clock::time_point> sent;
+		for(const auto& e : input)
+		{
+			std::this_thread::sleep_until(e.arrival);
+			sent.push_back(Clock::now());
+			regen.SendShortMessage((e.status < 0xf0) ? (uint32_t)e.status | 0x403c00 : e.status);
+		}
+		bool flushed = regen.Flush(std::chrono::seconds(2));
+		bool locked = regen.IsLocked();
+		double periodms = std::chrono::duration<double, std::milli>(regen.GetPeriod()).count();
+		regen.Stop();
+		std::lock_guard<std::mutex> lock(device.mutex);
+		int r = 0;
+		bool sameorder = flushed && (device.arrivals.size() == input.size());
+		for(size_t j = 0; sameorder && (j < input.size()); ++j) sameorder = device.arrivals[j].first == input[j].status;
+		if(!sameorder) { std::printf("clockpll: real clock, %zu statuses played of %zu or out of order\n", device.arrivals.size(), input.size()); return 1; }
+		// the clocks in the second half, the loop has locked by then, but not the last one: the stop right behind it
+		// releases it early
+		std::vector<double> in, out;
+		for(size_t j = input.size() / 2; j < input.size(); ++j)
+		{
+			if((input[j].status != 0xf8) || ((j + 1 < input.size()) && (input[j + 1].status != 0xf8))) continue;
+			in.push_back(std::chrono::duration<double, std::milli>(sent[j] - input[j].intended).count());
+			out.push_back(std::chrono::duration<double, std::milli>(device.arrivals[j].second - input[j].intended).count());
+		}
+		double rmsin = RmsMs(in), rmsout = RmsMs(out);
+		std::printf("%-22s %5zu clocks, jitter in %6.2f ms p-p %5.2f rms, out %6.2f ms p-p %5.2f rms, period %.3f ms, %s\n", "real clock", in.size(),
+			PeakToPeakMs(in), rmsin, PeakToPeakMs(out), rmsout, periodms, locked ? "locked" : "not locked");
+		if(!locked) { std::printf("clockpll: real clock, the loop did not lock\n"); r = 1; }
+		*smooth = (rmsout <= maxrms * rmsin + hostms / 4) && (PeakToPeakMs(out) <= maxpp * PeakToPeakMs(in) + hostms);
+		if(regen.GetClockCount() != (uint64_t)std::count_if(input.begin(), input.end(), [](const ClockCaseEvent& e) { return e.status == 0xf8; })) { std::printf("clockpll: real clock, the clock count is off\n"); r = 1; }
+		return r;
+	}
+
+	// a regenerator for each port behind a demux: a clock still held when the guest selects another port stays on its own
+	static int CheckClockBehindDemux(const ClockPllSettings& settings)
+	{
+		ClockProbePort devices[2];
+		ClockRegenMidiOut regens[2];
+		PortDemuxMidiOut demux(2);
+		for(int i = 0; i < 2; ++i)
+		{
+			regens[i].SetMidiOutPort(&devices[i]);
+			regens[i].SetSettings(settings);
+			regens[i].Start();
+			demux.SetPort(i, &regens[i]);
+		}
+		demux.SendShortMessage(0x01f5);
+		demux.SendShortMessage(0xf8);
+		demux.SendShortMessage(0x02f5);
+		demux.SendShortMessage(0x403c90);
+		bool flushed = regens[0].Flush(std::chrono::seconds(1)) && regens[1].Flush(std::chrono::seconds(1));
+		for(auto& regen : regens) regen.Stop();
+		bool routed = flushed && (devices[0].arrivals.size() == 1) && (devices[0].arrivals[0].first == 0xf8) && (devices[1].arrivals.size() == 1) && (devices[1].arrivals[0].first == 0x90);
+		std::printf("%-22s clock on port %s\n", "behind a demux", routed ? "1 as selected" : "2 or lost");
+		if(!routed) { std::printf("clockpll: behind a demux, the clock did not stay on the port it was sent to\n"); return 1; }
+		return 0;
+	}
+
+	// a clock the device failed is reported to the next one, re-arming the port for the next session lets the device try again
+	static int CheckClockRegenRecover(const ClockPllSettings& settings)
+	{
+		ClockProbePort device;
+		device.failNext = ResultTimedOut;
+		ClockRegenMidiOut regen;
+		regen.SetMidiOutPort(&device);
+		regen.SetSettings(settings);
+		regen.Start();
+		regen.SendShortMessage(0xf8);
+		regen.Flush(std::chrono::seconds(1));
+		ResultCode failed = regen.SendShortMessage(0xf8);
+		regen.SetSendCancelled(true);
+		regen.SetSendCancelled(false);
+		ResultCode rearmed = regen.SendShortMessage(0xfa);
+		regen.Flush(std::chrono::seconds(1));
+		regen.Stop();
+		std::lock_guard<std::mutex> lock(device.mutex);
+		bool delivered = (device.arrivals.size() == 1) && (device.arrivals[0].first == 0xfa);
+		std::printf("%-22s %s, after re-arming %s\n", "device error", (failed == ResultTimedOut) ? "reported" : "lost",
+			((rearmed == ResultOk) && delivered) ? "sent" : "still failing");
+		if(failed != ResultTimedOut) { std::printf("clockpll: the device error was not reported, %d\n", failed); return 1; }
+		if((rearmed != ResultOk) || !delivered) { std::printf("clockpll: the regenerator did not recover when re-armed, %d\n", rearmed); return 1; }
+		return 0;
+	}
+
+	int RunClockPll(const BenchArgs& args)
+	{
+		double bpm = args.GetDouble("bpm", 120);
+		std::chrono::microseconds jitter = std::chrono::microseconds(args.GetInt("jitter", 6000));
+		std::chrono::microseconds length = std::chrono::milliseconds(args.GetInt("length", 20000));
+		uint32_t seed = (uint32_t)args.GetInt("seed", 1);
+		ClockPllSettings settings;
+		settings.holdback = std::chrono::microseconds(args.GetInt("holdback", 8000));
+		std::printf("%.1f BPM, up to %lld us of jitter, holdback %lld us\n", bpm, (long long)jitter.count(), (long long)settings.holdback.count());
+		PllTimePoint t0 = PllTimePoint() + std::chrono::hours(1);
+		int r = 0;
+		{
+			std::vector<ClockCaseEvent> v;
+			AppendClockRun(&v, 0xfa, t0, length, bpm, bpm);
+			DeliverClockCase(&v, jitter, std::chrono::microseconds(0), seed);
+			r |= CheckClockCase("steady", v, settings, 0.4, 0.6, bpm);
+		}
+		{
+			// a tempo change is a jump the loop acquires again, the first clocks of the new tempo look like jitter until it
+			// notices, so its peaks may only be no worse than the input's
+			std::vector<ClockCaseEvent> v;
+			AppendClockRun(&v, 0xfa, t0, length, bpm, bpm * 1.25);
+			DeliverClockCase(&v, jitter, std::chrono::microseconds(0), seed);
+			r |= CheckClockCase("tempo step", v, settings, 0.6, 1.0, bpm * 1.25);
+		}
+		{
+			// stopped for two seconds, restarted off the old grid
+			std::vector<ClockCaseEvent> v;
+			AppendClockRun(&v, 0xfa, t0, length / 2, bpm, bpm);
+			PllTimePoint stop = v.back().intended + std::chrono::milliseconds(3);
+			v.push_back({ 0xfc, stop, {} });
+			AppendClockRun(&v, 0xfa, stop + std::chrono::milliseconds(2007), length / 2, bpm, bpm);
+			DeliverClockCase(&v, jitter, std::chrono::microseconds(0), seed);
+			r |= CheckClockCase("stop and start", v, settings, 0.4, 0.6, bpm);
+		}
+		{
+			// a host that wakes on the default Windows timer, a holdback longer than its quantum
+			std::vector<ClockCaseEvent> v;
+			AppendClockRun(&v, 0xfa, t0, length, bpm, bpm);
+			DeliverClockCase(&v, jitter, std::chrono::microseconds(15625), seed);
+			ClockPllSettings s = settings;
+			s.holdback = std::max(settings.holdback, std::chrono::microseconds(16000));
+			r |= CheckClockCase("15.6 ms timer", v, s, 0.4, 0.6, bpm);
+		}
+		{
+			// the same bounds as the virtual cases, a session the host disturbed is played again
+			int attempts = (int)args.GetInt("attempts", 3);
+			bool smooth = false;
+			for(int k = 0; (k < attempts) && !smooth; ++k)
+			{
+				r |= CheckClockRegenSession(settings, bpm, std::chrono::milliseconds(args.GetInt("reallength", 3000)), jitter, seed, 0.4, 0.6, args.GetDouble("hostms", 2), &smooth);
+				if(!smooth) std::printf("clockpll: real clock, the output jitter is outside the bounds%s\n", (k + 1 < attempts) ? ", once more" : "");
+			}
+			if(!smooth) r = 1;
+		}
+		r |= CheckClockBehindDemux(settings);
+		r |= CheckClockRegenRecover(settings);
+		return r;
+	}
+}
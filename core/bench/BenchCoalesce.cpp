@@ -0,0 +1,155 @@
+//
+//  BenchCoalesce.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// records every write with its completion time, each write costs a fixed time like an overlapped WriteFile round trip
+	class RecordingTransport : public ITransport
+	{
+	public:
+		struct WriteRecord
+		{
+			uint64_t endOffset;
+			Clock::time_point time;
+		};
+	private:
+		std::mutex mutex;
+		std::vector<uint8_t> data;
+		std::vector<WriteRecord> writes;
+		std::chrono::microseconds writeCost;
+	public:
+		RecordingTransport(std::chrono::microseconds cost) : writeCost(cost)
+		{
+		}
+		virtual ResultCode Read(uint8_t*, int, int* cr) override { *cr = 0; return ResultCancelled; }
+		virtual ResultCode Write(const uint8_t* p, int c, int* cw) override
+		{
+			Clock::time_point due = Clock::now() + writeCost;
+			while(Clock::now() < due) std::this_thread::yield();
+			std::lock_guard<std::mutex> lock(mutex);
+			data.insert(data.end(), p, p + c);
+			writes.push_back({ data.size(), Clock::now() });
+			*cw = c;
+			return ResultOk;
+		}
+		virtual void SetReadCancelled(bool) override {}
+		virtual void SetWriteCancelled(bool) override {}
+		virtual bool IsBrokenPipe(ResultCode r) const override { return r == ResultBrokenPipe; }
+		size_t GetByteCount()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return data.size();
+		}
+		std::vector<uint8_t> GetData()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return data;
+		}
+		std::vector<WriteRecord> GetWrites()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return writes;
+		}
+	};
+
+	struct BurstEvent
+	{
+		uint8_t msg[3];
+		int length;
+	};
+
+	// controller sweeps with a clock tick every 8 events and active sensing now and then
+	static std::vector<BurstEvent> MakeBurst(int n)
+	{
+		std::vector<BurstEvent> v;
+		for(int i = 0; i < n; ++i)
+		{
+			if((i % 8) == 0)		v.push_back({ { 0xf8 }, 1 });
+			else if((i % 61) == 0)	v.push_back({ { 0xfe }, 1 });
+			else					v.push_back({ { (uint8_t)(0xb0 | (i & 0x0f)), 0x01, (uint8_t)(i & 0x7f) }, 3 });
+		}
+		return v;
+	}
+
+	static int RunBurst(const char* label, const CoalescePolicy& policy, const std::vector<BurstEvent>& burst, std::chrono::microseconds spacing, std::chrono::microseconds writecost)
+	{
+		RecordingTransport transport(writecost);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		MidiInPipeOut m2p;
+		m2p.SetCoalescePolicy(policy);
+		m2p.SetMidiInPort(&midiin);
+		m2p.SetTransport(&transport, false);
+		std::vector<uint8_t> sent;
+		std::vector<std::pair<uint64_t, Clock::time_point> > realtime;
+		Clock::time_point due = Clock::now();
+		for(const auto& e : burst)
+		{
+			while(Clock::now() < due) std::this_thread::yield();
+			due += spacing;
+			if(MidiFramer::IsRealTime(e.msg[0])) realtime.push_back({ sent.size(), Clock::now() });
+			sent.insert(sent.end(), e.msg, e.msg + e.length);
+			midiin.Inject(e.msg, e.length);
+		}
+		for(Clock::time_point t0 = Clock::now(); (transport.GetByteCount() < sent.size()) && (SecondsSince(t0) < 5); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		m2p.SetTransport(nullptr, false);
+		CoalesceStatistics st = m2p.GetCoalesceStatistics();
+		// latency of a real-time byte: from the injection to the completion of the write that carried it
+		std::vector<RecordingTransport::WriteRecord> writes = transport.GetWrites();
+		double maxrtlatency = 0;
+		for(const auto& rt : realtime)
+		{
+			auto it = std::upper_bound(writes.begin(), writes.end(), rt.first, [](uint64_t o, const RecordingTransport::WriteRecord& w) { return o < w.endOffset; });
+			if(it != writes.end()) maxrtlatency = std::max(maxrtlatency, std::chrono::duration<double, std::micro>(it->time - rt.second).count());
+		}
+		std::printf("%-28s %5zu events %5llu writes %7.1f bytes/write max %4llu, real-time latency max %7.1f usec\n",
+			label, burst.size(), (unsigned long long)st.flushCount,
+			st.flushCount ? (double)st.flushedBytes / (double)st.flushCount : 0.0,
+			(unsigned long long)st.maxFlushBytes, maxrtlatency);
+		std::printf("%-28s", "  bytes/write histogram");
+		for(int i = 0; i < CoalesceStatistics::NumSizeBuckets; ++i) { if(st.sizeHistogram[i]) std::printf(" %d+:%llu", 1 << i, (unsigned long long)st.sizeHistogram[i]); }
+		std::printf("\n");
+		if(transport.GetData() != sent) { std::printf("%s: lost or reordered bytes\n", label); return 1; }
+		return 0;
+	}
+
+	int RunCoalesce(const BenchArgs& args)
+	{
+		int events = (int)args.GetInt("events", 500);
+		std::chrono::microseconds spacing(args.GetInt("spacing", 20));
+		std::chrono::microseconds writecost(args.GetInt("writecost", 20));
+		std::vector<BurstEvent> burst = MakeBurst(events);
+		int r = 0;
+		if(args.Has("delay"))
+		{
+			CoalescePolicy policy;
+			policy.flushBytes = (int)args.GetInt("flush", policy.flushBytes);
+			policy.flushDelay = std::chrono::microseconds(args.GetInt("delay", 0));
+			policy.flushOnRealTime = args.GetInt("rt", 1) != 0;
+			return RunBurst("custom", policy, burst, spacing, writecost);
+		}
+		CoalescePolicy policy;
+		policy.flushDelay = std::chrono::microseconds(0);
+		r |= RunBurst("no delay", policy, burst, spacing, writecost);
+		policy.flushDelay = std::chrono::microseconds(250);
+		r |= RunBurst("250 usec, real-time flush", policy, burst, spacing, writecost);
+		policy.flushDelay = std::chrono::microseconds(1000);
+		r |= RunBurst("1 msec, real-time flush", policy, burst, spacing, writecost);
+		policy.flushOnRealTime = false;
+		r |= RunBurst("1 msec", policy, burst, spacing, writecost);
+		return r;
+	}
+}
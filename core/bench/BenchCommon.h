@@ -0,0 +1,114 @@
+//
+//  BenchCommon.h
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace BridgeBench
+{
+	using Clock = std::chrono::steady_clock;
+
+	static inline double SecondsSince(Clock::time_point t0)
+	{
+		return std::chrono::duration<double>(Clock::now() - t0).count();
+	}
+
+	// options are given as key=value pairs, the same style as the app's command line
+	class BenchArgs
+	{
+	private:
+		std::map<std::string, std::string> values;
+	public:
+		BenchArgs(int argc, char** argv)
+		{
+			for(int i = 0; i < argc; ++i)
+			{
+				std::string arg = argv[i];
+				size_t pos = arg.find('=');
+				if(pos == std::string::npos)	values[arg] = std::string("1");
+				else							values[arg.substr(0, pos)] = arg.substr(pos + 1);
+			}
+		}
+		bool Has(const std::string& key) const
+		{
+			return values.find(key) != values.end();
+		}
+		int64_t GetInt(const std::string& key, int64_t defval) const
+		{
+			auto it = values.find(key);
+			return (it != values.end()) ? std::strtoll(it->second.c_str(), nullptr, 0) : defval;
+		}
+		double GetDouble(const std::string& key, double defval) const
+		{
+			auto it = values.find(key);
+			return (it != values.end()) ? std::strtod(it->second.c_str(), nullptr) : defval;
+		}
+		std::string GetString(const std::string& key, const std::string& defval) const
+		{
+			auto it = values.find(key);
+			return (it != values.end()) ? it->second : defval;
+		}
+	};
+
+	// a repeating stream of complete channel voice messages
+	static inline std::vector<uint8_t> MakeChannelMessageStream(size_t n)
+	{
+		std::vector<uint8_t> v(n);
+		size_t i = 0; for(uint8_t k = 0; i < n; ++k)
+		{
+			const uint8_t msg[] = { (uint8_t)(0x90 | (k & 0x0f)), (uint8_t)(k & 0x7f), (uint8_t)((k * 5) & 0x7f) };
+			for(int j = 0; (j < 3) && (i < n); ++j) v[i++] = msg[j];
+		}
+		return v;
+	}
+
+	static inline void PrintRate(const char* label, uint64_t bytes, uint64_t messages, double sec)
+	{
+		std::printf("%-24s %12llu bytes %10llu msgs %9.3f s %10.2f MB/s %12.0f msg/s\n",
+			label, (unsigned long long)bytes, (unsigned long long)messages, sec,
+			(sec > 0) ? (double)bytes / sec / 1e6 : 0.0,
+			(sec > 0) ? (double)messages / sec : 0.0);
+	}
+
+	struct BenchEntry
+	{
+		const char* name;
+		const char* description;
+		int (*run)(const BenchArgs& args);
+	};
+
+	int RunThroughput(const BenchArgs& args);
+	int RunFramer(const BenchArgs& args);
+	int RunDispatch(const BenchArgs& args);
+	int RunBackPressure(const BenchArgs& args);
+	int RunHeaderPool(const BenchArgs& args);
+	int RunCoalesce(const BenchArgs& args);
+	int RunPacing(const BenchArgs& args);
+	int RunTimestamp(const BenchArgs& args);
+	int RunStatistics(const BenchArgs& args);
+	int RunHub(const BenchArgs& args);
+	int RunSocket(const BenchArgs& args);
+	int RunPty(const BenchArgs& args);
+	int RunReactor(const BenchArgs& args);
+	int RunReadAhead(const BenchArgs& args);
+	int RunZeroCopy(const BenchArgs& args);
+	int RunFlightRecorder(const BenchArgs& args);
+	int RunReplay(const BenchArgs& args);
+	int RunFilter(const BenchArgs& args);
+	int RunPortSelect(const BenchArgs& args);
+	int RunRealTimeLane(const BenchArgs& args);
+	int RunOutputPacing(const BenchArgs& args);
+	int RunStreamOut(const BenchArgs& args);
+	int RunClockPll(const BenchArgs& args);
+}
@@ -0,0 +1,104 @@
+//
+//  BenchDispatch.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "MidiFramer.h"
+#include "MidiOutDispatcher.h"
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// counts what reaches the device without any locking, the dispatcher is single-threaded
+	struct CountingMidiOutPort : public IMidiOutPort
+	{
+		uint64_t shortSends = 0;
+		uint64_t longSends = 0;
+		uint64_t bytes = 0;
+		virtual bool IsDeviceOpen() const override { return true; }
+		virtual ResultCode Send(const uint8_t*, int c) override { ++longSends; bytes += (uint64_t)c; return ResultOk; }
+		virtual ResultCode SendShortMessage(uint32_t msg) override { ++shortSends; bytes += (uint64_t)MidiFramer::GetShortMessageLength((uint8_t)msg); return ResultOk; }
+	};
+
+	// keeps what reaches the device in order, a short message as its bytes
+	struct RecordingMidiOutPort : public IMidiOutPort
+	{
+		std::vector<uint8_t> bytes;
+		virtual bool IsDeviceOpen() const override { return true; }
+		virtual ResultCode Send(const uint8_t* p, int c) override { bytes.insert(bytes.end(), p, p + c); return ResultOk; }
+		virtual ResultCode SendShortMessage(uint32_t msg) override { for(int i = 0; i < MidiFramer::GetShortMessageLength((uint8_t)msg); ++i) bytes.push_back((uint8_t)(msg >> (i * 8))); return ResultOk; }
+	};
+
+	// a SysEx cut off by a note, split at each position between the chunks, must reach the device closed with an F7
+	static int CheckCutOffSysEx()
+	{
+		static const uint8_t stream[] = { 0xf0, 0x41, 0x10, 0x42, 0x90, 0x3c, 0x40 };
+		static const uint8_t expected[] = { 0xf0, 0x41, 0x10, 0x42, 0xf7, 0x90, 0x3c, 0x40 };
+		for(int split = 0; split <= (int)sizeof(stream); ++split)
+		{
+			RecordingMidiOutPort port;
+			MidiFramer framer;
+			MidiOutDispatcher dispatcher;
+			dispatcher.SetMidiOutPort(&port);
+			for(int i = 0, c = split; i < (int)sizeof(stream); i += c, c = (int)sizeof(stream) - i)
+			{
+				framer.Process(stream + i, c, [&](const MidiMessage& m) { dispatcher.Dispatch(m); });
+				dispatcher.Flush();
+			}
+			if((port.bytes != std::vector<uint8_t>(expected, expected + sizeof(expected))) || (dispatcher.GetClosedSysExCount() != 1))
+			{
+				std::printf("dispatch: a SysEx cut off by a status byte split at %d reached the device unterminated\n", split);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	int RunDispatch(const BenchArgs& args)
+	{
+		uint64_t total = (uint64_t)args.GetInt("bytes", 64 * 1024 * 1024);
+		int sysexsize = (int)args.GetInt("sysex", 1024);
+		// a dense controller sweep with running status, clock, and a SysEx dump every 4096 events
+		std::vector<uint8_t> stream;
+		for(int i = 0; i < 16 * 1024; ++i)
+		{
+			if((i % 64) == 0) stream.push_back((uint8_t)(0xb0 | ((i / 64) & 0x0f)));
+			stream.push_back(0x07);
+			stream.push_back((uint8_t)(i & 0x7f));
+			if((i % 24) == 0) stream.push_back(0xf8);
+			if((i % 4096) == 4095)
+			{
+				stream.push_back(0xf0);
+				for(int j = 0; j < sysexsize; ++j) stream.push_back((uint8_t)(j & 0x7f));
+				stream.push_back(0xf7);
+				stream.push_back((uint8_t)(0xb0 | ((i / 64) & 0x0f)));
+				stream.push_back(0x07);
+				stream.push_back(0x00);
+			}
+		}
+		CountingMidiOutPort port;
+		MidiFramer framer;
+		MidiOutDispatcher dispatcher;
+		dispatcher.SetMidiOutPort(&port);
+		uint64_t bytes = 0, messages = 0;
+		Clock::time_point t0 = Clock::now();
+		while(bytes < total)
+		{
+			for(size_t i = 0; i < stream.size(); i += 256)
+			{
+				int c = (int)std::min<size_t>(256, stream.size() - i);
+				framer.Process(stream.data() + i, c, [&](const MidiMessage& m) { ++messages; dispatcher.Dispatch(m); });
+				dispatcher.Flush();
+				bytes += (uint64_t)c;
+			}
+		}
+		double sec = SecondsSince(t0);
+		PrintRate("frame+dispatch", bytes, messages, sec);
+		std::printf("short sends %llu, long sends %llu, %.1f ns/message\n", (unsigned long long)port.shortSends, (unsigned long long)port.longSends, (messages > 0) ? sec * 1e9 / (double)messages : 0.0);
+		return CheckCutOffSysEx();
+	}
+}
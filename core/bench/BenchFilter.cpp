@@ -0,0 +1,307 @@
+//
+//  BenchFilter.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "MessageFilter.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// what an old sequencer sends: notes on several channels under a steady clock, active sensing and a SysEx now and then
+	static std::vector<uint8_t> MakeSequencerStream(size_t messages)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(messages * 3);
+		for(size_t i = 0; i < messages; ++i)
+		{
+			if((i % 6) == 0)			v.push_back(0xf8);
+			else if((i % 50) == 1)		v.push_back(0xfe);
+			else if((i % 500) == 2)		{ v.push_back(0xf0); for(int k = 0; k < 16; ++k) v.push_back((uint8_t)((i + k) & 0x7f)); v.push_back(0xf7); }
+			else						{ v.push_back((uint8_t)(((i & 1) ? 0x90 : 0x80) | (i % 12))); v.push_back((uint8_t)(24 + (i % 80))); v.push_back((uint8_t)(i & 0x7f)); }
+		}
+		return v;
+	}
+
+	static RemapChannels MakeSwap(int a, int b)
+	{
+		RemapChannels s;
+		s.map[a] = (uint8_t)b;
+		s.map[b] = (uint8_t)a;
+		return s;
+	}
+	static KeepChannels MakeKeep(uint16_t mask) { KeepChannels s; s.mask = mask; return s; }
+	static ClampVelocity MakeClamp(uint8_t lo, uint8_t hi) { ClampVelocity s; s.lo = lo; s.hi = hi; return s; }
+	static Transpose MakeTranspose(int n) { Transpose s; s.semitones = n; return s; }
+	// chains of 0, 1, 3, 4 and 8 stages, each one a prefix of the next, and the specs that parse into the same
+	static const char* const SpecByStages[] = { "", "droprt", "droprt;channels:1-10;remap:10>16,16>10", "droprt;channels:1-10;remap:10>16,16>10;velocity:10-110", "droprt;channels:1-10;remap:10>16,16>10;velocity:10-110;transpose:12;dropsysex;remap:1>2,2>1;transpose:-12" };
+
+	using Static0 = StaticMessageFilter<>;
+	using Static1 = StaticMessageFilter<DropRealTime>;
+	using Static3 = StaticMessageFilter<DropRealTime, KeepChannels, RemapChannels>;
+	using Static4 = StaticMessageFilter<DropRealTime, KeepChannels, RemapChannels, ClampVelocity>;
+	using Static8 = StaticMessageFilter<DropRealTime, KeepChannels, RemapChannels, ClampVelocity, Transpose, DropSysEx, RemapChannels, Transpose>;
+
+	static Static3 MakeStatic3() { return Static3(DropRealTime(), MakeKeep(0x03ff), MakeSwap(9, 15)); }
+	static Static4 MakeStatic4() { return Static4(DropRealTime(), MakeKeep(0x03ff), MakeSwap(9, 15), MakeClamp(10, 110)); }
+	static Static8 MakeStatic8() { return Static8(DropRealTime(), MakeKeep(0x03ff), MakeSwap(9, 15), MakeClamp(10, 110), MakeTranspose(12), DropSysEx(), MakeSwap(0, 1), MakeTranspose(-12)); }
+
+	struct FilterResult
+	{
+		uint64_t passed = 0;
+		uint64_t hash = 1469598103934665603ull;
+		double nsPerMessage = 0;
+	};
+
+	// the stream framed once up front, SysEx segments point into the stream, short messages into their own copy
+	struct FramedStream
+	{
+		std::vector<uint8_t> stream;
+		std::vector<MidiMessage> messages;
+		std::vector<uint8_t> shortBytes;
+		FramedStream(std::vector<uint8_t> s) : stream(std::move(s))
+		{
+			std::vector<size_t> offsets;
+			MidiFramer framer;
+			framer.Process(stream.data(), (int)stream.size(), [&](const MidiMessage& m)
+			{
+				if(m.kind != MidiMessageKind::SysEx) { offsets.push_back(shortBytes.size()); shortBytes.insert(shortBytes.end(), m.data, m.data + m.length); }
+				else offsets.push_back(SIZE_MAX);
+				messages.push_back(m);
+			});
+			for(size_t i = 0; i < messages.size(); ++i) { if(offsets[i] != SIZE_MAX) messages[i].data = shortBytes.data() + offsets[i]; }
+		}
+	};
+
+	// only the filter is timed, the sink folds the output into a hash so nothing is optimized away
+	template<typename Filter> static FilterResult RunFilter(Filter& filter, const FramedStream& framed, int passes)
+	{
+		FilterResult best;
+		best.nsPerMessage = 1e30;
+		for(int pass = 0; pass < passes; ++pass)
+		{
+			FilterResult fr;
+			Clock::time_point t0 = Clock::now();
+			for(const MidiMessage& m : framed.messages)
+			{
+				MidiMessage fm;
+				uint8_t w[3];
+				if(!ApplyMessageFilter(filter, m, fm, w)) continue;
+				++fr.passed;
+				fr.hash = (fr.hash ^ ((uint64_t)fm.data[0] | ((uint64_t)fm.data[fm.length - 1] << 8) | ((uint64_t)fm.length << 16))) * 1099511628211ull;
+			}
+			fr.nsPerMessage = SecondsSince(t0) * 1e9 / (double)framed.messages.size();
+			if(fr.nsPerMessage < best.nsPerMessage) best = fr;
+		}
+		return best;
+	}
+
+	static std::unique_ptr<IMessageFilter> ParseOrDie(const char* spec)
+	{
+		std::unique_ptr<IMessageFilter> f;
+		if(ResultIsError(ParseMessageFilter(spec, &f))) std::printf("filter: cannot parse \"%s\"\n", spec);
+		return f;
+	}
+
+	static void PrintFilterRow(const char* label, const FilterResult& fr, double baseline, size_t messages)
+	{
+		std::printf("%-24s %8.2f ns/msg %+8.2f ns over 0 stages %10llu of %zu passed\n", label, fr.nsPerMessage, fr.nsPerMessage - baseline, (unsigned long long)fr.passed, messages);
+	}
+
+	// a few messages through the 4-stage chain with known results
+	static int CheckStages()
+	{
+		Static4 f = MakeStatic4();
+		struct { std::vector<uint8_t> in; std::vector<uint8_t> out; } cases[] =
+		{
+			{ { 0xf8 }, {} },
+			{ { 0xfa }, { 0xfa } },
+			{ { 0x9a, 60, 100 }, {} },					// channel 11 is not kept
+			{ { 0x99, 60, 127 }, { 0x9f, 60, 110 } },	// channel 10 goes to 16, velocity clamped
+			{ { 0x90, 60, 0 }, { 0x90, 60, 0 } },		// note off by velocity 0 stays
+			{ { 0x90, 60, 3 }, { 0x90, 60, 10 } },
+			{ { 0xf0, 1, 2, 0xf7 }, { 0xf0, 1, 2, 0xf7 } },
+		};
+		int r = 0;
+		for(auto&& c : cases)
+		{
+			std::vector<uint8_t> out;
+			MidiFramer framer;
+			framer.Process(c.in.data(), (int)c.in.size(), [&](const MidiMessage& m)
+			{
+				MidiMessage fm;
+				uint8_t w[3];
+				if(ApplyMessageFilter(f, m, fm, w)) out.insert(out.end(), fm.data, fm.data + fm.length);
+			});
+			if(out != c.out) { std::printf("stages: %02x %02x gave the wrong result\n", c.in[0], (c.in.size() > 1) ? c.in[1] : 0); r = 1; }
+		}
+		const char* bad[] = { "droprt:f7", "channels:0", "channels:3-1", "remap:1", "velocity:0-10", "transpose:x", "frobnicate" };
+		for(const char* spec : bad)
+		{
+			std::unique_ptr<IMessageFilter> pf;
+			if(ParseMessageFilter(spec, &pf) != EINVAL) { std::printf("stages: \"%s\" was accepted\n", spec); r = 1; }
+		}
+		return r;
+	}
+
+	// a driver callback's message is classified as the framer frames it, a SysEx cut after any byte included, so a
+	// lone F7 that ends one is a SysEx segment and dropsysex drops it
+	static int CheckClassify()
+	{
+		const std::vector<uint8_t> stream = { 0x90, 60, 100, 0xf0, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7f, 0x00, 0x41, 0xf7, 0xf8, 0xf2, 0x10, 0x20, 0xc1, 5 };
+		int r = 0;
+		for(size_t cut = 1; cut < stream.size(); ++cut)
+		{
+			MidiFramer framer;
+			auto check = [&](const MidiMessage& m)
+			{
+				if(m.length <= 0) return;
+				MidiMessage c = ClassifyMidiMessage(m.data, m.length);
+				if((c.kind != m.kind) || ((m.kind == MidiMessageKind::SysEx) && (c.sysexFlags != m.sysexFlags)))
+				{
+					std::printf("classify: %02x, %d bytes, cut at %zu, is not what the framer made of it\n", m.data[0], m.length, cut);
+					r = 1;
+				}
+			};
+			framer.Process(stream.data(), (int)cut, check);
+			framer.Process(stream.data() + cut, (int)(stream.size() - cut), check);
+		}
+		static const uint8_t eox = 0xf7;
+		std::unique_ptr<IMessageFilter> f = ParseOrDie("dropsysex");
+		MidiMessage fm;
+		uint8_t w[3];
+		if(!f || ApplyMessageFilter(*f, ClassifyMidiMessage(&eox, 1), fm, w)) { std::printf("classify: dropsysex passed a lone F7\n"); r = 1; }
+		std::printf("classify: a lone F7 is %s\n", r ? "misread" : "the end of a SysEx");
+		return r;
+	}
+
+	// the engines apply the filter in both directions, compared with the same filter run offline
+	static int CheckEngines(size_t messages)
+	{
+		std::vector<uint8_t> stream = MakeSequencerStream(messages);
+		std::unique_ptr<IMessageFilter> filter = ParseOrDie(SpecByStages[3]);
+		std::vector<uint8_t> expected;
+		MidiFramer framer;
+		framer.Process(stream.data(), (int)stream.size(), [&](const MidiMessage& m)
+		{
+			MidiMessage fm;
+			uint8_t w[3];
+			if(ApplyMessageFilter(*filter, m, fm, w)) expected.insert(expected.end(), fm.data, fm.data + fm.length);
+		});
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetMessageFilter(filter.get());
+		m2p.SetMessageFilter(filter.get());
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> received;
+		std::thread guest([&]()
+		{
+			int cw = 0;
+			pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+			std::vector<uint8_t> buffer(4096);
+			while(received.size() < expected.size())
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				received.insert(received.end(), buffer.begin(), buffer.begin() + cr);
+			}
+		});
+		// the device delivers whole messages, SysEx in one piece
+		MidiFramer injector;
+		std::vector<uint8_t> sysex;
+		uint64_t staged = 0;
+		injector.Process(stream.data(), (int)stream.size(), [&](const MidiMessage& m)
+		{
+			const uint8_t* p = m.data;
+			int c = m.length;
+			if(m.kind == MidiMessageKind::SysEx)
+			{
+				sysex.insert(sysex.end(), m.data, m.data + m.length);
+				if(!(m.sysexFlags & SysExEnd)) return;
+				p = sysex.data();
+				c = (int)sysex.size();
+			}
+			// keep the staging ring from overrunning, the guest drains it at its own pace
+			MidiMessage fm;
+			uint8_t w[3];
+			if(ApplyMessageFilter(*filter, ClassifyMidiMessage(p, c), fm, w)) staged += (uint64_t)fm.length;
+			while(staged > m2p.GetStatistics().bytes + 16 * 1024) std::this_thread::yield();
+			while(!midiin.Inject(p, c)) std::this_thread::yield();
+			sysex.clear();
+		});
+		midiout.WaitForBytes(expected.size(), std::chrono::seconds(30));
+		for(Clock::time_point t0 = Clock::now(); (received.size() < expected.size()) && (SecondsSince(t0) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		pipe.Close();
+		guest.join();
+		p2m.SetTransport(nullptr, false);
+		m2p.SetTransport(nullptr, false);
+		bool p2mok = midiout.GetReceivedData() == expected;
+		bool m2pok = received == expected;
+		std::printf("engines: %zu of %zu bytes pipe->midi%s, %zu bytes midi->pipe%s, %llu + %llu messages filtered\n",
+			midiout.GetReceivedData().size(), stream.size(), p2mok ? "" : " MISMATCH", received.size(), m2pok ? "" : " MISMATCH",
+			(unsigned long long)p2m.GetStatistics().filteredMessages, (unsigned long long)m2p.GetStatistics().filteredMessages);
+		return (p2mok && m2pok) ? 0 : 1;
+	}
+
+	int RunFilter(const BenchArgs& args)
+	{
+		size_t messages = (size_t)args.GetInt("messages", 1000000);
+		int passes = (int)args.GetInt("passes", 5);
+		int r = CheckStages();
+		r |= CheckClassify();
+		FramedStream framed(MakeSequencerStream(messages));
+		messages = framed.messages.size();
+		Static0 s0;
+		Static1 s1;
+		Static3 s3 = MakeStatic3();
+		Static4 s4 = MakeStatic4();
+		Static8 s8 = MakeStatic8();
+		FilterResult statics[] = { RunFilter(s0, framed, passes), RunFilter(s1, framed, passes), RunFilter(s3, framed, passes), RunFilter(s4, framed, passes), RunFilter(s8, framed, passes) };
+		const int stagecounts[] = { 0, 1, 3, 4, 8 };
+		double baseline = statics[0].nsPerMessage;
+		for(int i = 0; i < 5; ++i)
+		{
+			char label[64];
+			std::snprintf(label, sizeof(label), "static %d stages", stagecounts[i]);
+			PrintFilterRow(label, statics[i], baseline, messages);
+		}
+		// the same chains behind the engines' interface: one virtual call for a static chain, one per three stages for a parsed one
+		IMessageFilter* virtuals[] = { &s0, &s1, &s3, &s4, &s8 };
+		for(int i = 0; i < 5; ++i)
+		{
+			char label[64];
+			std::snprintf(label, sizeof(label), "virtual %d stages", stagecounts[i]);
+			FilterResult fr = RunFilter(*virtuals[i], framed, passes);
+			PrintFilterRow(label, fr, baseline, messages);
+			if(fr.hash != statics[i].hash) { std::printf("%s: different output\n", label); r = 1; }
+		}
+		for(int i = 1; i < 5; ++i)
+		{
+			char label[64];
+			std::snprintf(label, sizeof(label), "parsed %d stages", stagecounts[i]);
+			std::unique_ptr<IMessageFilter> f = ParseOrDie(SpecByStages[i]);
+			if(!f) return 1;
+			FilterResult fr = RunFilter(*f, framed, passes);
+			PrintFilterRow(label, fr, baseline, messages);
+			if(fr.hash != statics[i].hash) { std::printf("%s: different output\n", label); r = 1; }
+		}
+		r |= CheckEngines((size_t)args.GetInt("enginemessages", 30000));
+		return r;
+	}
+}
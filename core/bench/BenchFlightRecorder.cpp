@@ -0,0 +1,233 @@
+//
+//  BenchFlightRecorder.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "FlightRecorder.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// the best of several passes, the cost of the record itself rather than of the scheduler
+	static double MeasureRecordNs(FlightRecorder& recorder, int threads, int count, int length)
+	{
+		std::vector<uint8_t> msg((size_t)length, 0x40);
+		msg[0] = 0x90;
+		double best = 1e30;
+		for(int pass = 0; pass < 5; ++pass)
+		{
+			std::atomic<int> ready{ 0 };
+			std::vector<std::thread> workers;
+			Clock::time_point t0;
+			std::atomic<bool> go{ false };
+			for(int t = 0; t < threads; ++t)
+			{
+				workers.emplace_back([&]()
+				{
+					++ready;
+					while(!go) std::this_thread::yield();
+					Clock::time_point ts = Clock::now();
+					for(int i = 0; i < count; ++i) recorder.Record(FlightDirection::PipeToMidi, msg.data(), length, ts);
+				});
+			}
+			while(ready < threads) std::this_thread::yield();
+			t0 = Clock::now();
+			go = true;
+			for(auto&& w : workers) w.join();
+			best = std::min(best, SecondsSince(t0) * 1e9 / ((double)count * threads));
+		}
+		return best;
+	}
+
+	// two writers over many laps of a small ring: what is left must be the newest records, intact and in order
+	static int CheckWrapAround(const std::filesystem::path& path)
+	{
+		FlightRecorder recorder;
+		if(ResultIsError(recorder.Open(path, FlightRecorder::MinCapacity))) { std::printf("wrap: cannot open %s\n", path.string().c_str()); return 1; }
+		const int count = 20000;
+		std::vector<std::thread> workers;
+		for(int t = 0; t < 2; ++t)
+		{
+			workers.emplace_back([&recorder, t]()
+			{
+				for(int i = 0; i < count; ++i)
+				{
+					// the sequence number in the payload, a varying length so the records straddle the end of the ring at every offset
+					uint8_t msg[40];
+					int c = 4 + (i % 37);
+					for(int k = 0; k < c; ++k) msg[k] = (uint8_t)((i >> ((k % 3) * 7)) & 0x7f);
+					recorder.Record((t == 0) ? FlightDirection::PipeToMidi : FlightDirection::MidiToPipe, msg, c, Clock::time_point(std::chrono::nanoseconds(i)), (uint16_t)t);
+				}
+			});
+		}
+		for(auto&& w : workers) w.join();
+		recorder.Close();
+		FlightLogReader reader;
+		if(ResultIsError(reader.Open(path))) { std::printf("wrap: cannot read back\n"); return 1; }
+		int last[2] = { -1, -1 };
+		uint64_t records = 0;
+		bool ok = true;
+		reader.ForEach([&](const FlightRecordView& v)
+		{
+			int t = v.source;
+			int i = (int)v.timestamp;
+			bool intact = (t < 2) && (v.data.size() == (size_t)(4 + (i % 37)));
+			for(size_t k = 0; intact && (k < v.data.size()); ++k) intact = v.data[k] == (uint8_t)((i >> ((k % 3) * 7)) & 0x7f);
+			// once a writer's records start they must follow one another without a gap
+			if(!intact || ((last[t] >= 0) && (i != last[t] + 1))) ok = false;
+			last[t] = i;
+			++records;
+		});
+		std::printf("wrap: %llu of %d records kept in a %llu byte ring, %llu bytes skipped at the oldest end\n",
+			(unsigned long long)records, 2 * count, (unsigned long long)reader.GetHeader().capacity, (unsigned long long)reader.GetSkippedBytes());
+		// a writer that finished a lap earlier may be gone entirely, one that is still there ends with its last record
+		for(int t = 0; t < 2; ++t) { if((last[t] != -1) && (last[t] != count - 1)) ok = false; }
+		if(!ok || (std::max(last[0], last[1]) != count - 1)) { std::printf("wrap: records lost, torn or out of order\n"); return 1; }
+		// a torn record in the middle is passed over and the walk picks up at the next one
+		std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+		uint64_t middle = 0;
+		uint64_t seen = 0;
+		reader.ForEach([&](const FlightRecordView& v) { if(++seen == records / 2) middle = v.position; });
+		uint64_t garbage = ~(uint64_t)0;
+		fs.seekp((std::streamoff)(sizeof(FlightLogHeader) + (middle & (reader.GetHeader().capacity - 1))));
+		fs.write(reinterpret_cast<const char*>(&garbage), sizeof(garbage));
+		fs.close();
+		FlightLogReader torn;
+		torn.Open(path);
+		uint64_t after = 0;
+		torn.ForEach([&](const FlightRecordView&) { ++after; });
+		std::printf("wrap: one torn record, %llu records read back\n", (unsigned long long)after);
+		if(after != records - 1) { std::printf("wrap: the walk did not resynchronize\n"); return 1; }
+		return 0;
+	}
+
+#if !defined(_WIN32)
+	// a process that dies without closing or flushing the log leaves it to the kernel, every committed record is still there
+	static int CheckCrash(const std::filesystem::path& path)
+	{
+		std::filesystem::remove(path);
+		const int count = 1000;
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			FlightRecorder recorder;
+			if(ResultIsError(recorder.Open(path, FlightRecorder::MinCapacity))) _exit(1);
+			for(int i = 0; i < count; ++i)
+			{
+				uint8_t msg[3] = { 0x90, (uint8_t)(i & 0x7f), 0x40 };
+				recorder.Record(FlightDirection::MidiToPipe, msg, 3, Clock::now());
+			}
+			abort();
+		}
+		int status = 0;
+		waitpid(pid, &status, 0);
+		FlightLogReader reader;
+		if(ResultIsError(reader.Open(path))) { std::printf("crash: the log was not left behind\n"); return 1; }
+		int n = 0;
+		bool ok = true;
+		reader.ForEach([&](const FlightRecordView& v) { if((v.data.size() != 3) || (v.data[1] != (uint8_t)(n & 0x7f))) ok = false; ++n; });
+		std::printf("crash: child %s, %d of %d records recovered\n", WIFSIGNALED(status) ? "aborted" : "exited", n, count);
+		return (ok && (n == count)) ? 0 : 1;
+	}
+#endif
+
+	// both engines attached to one recorder, the capture must be exactly the traffic
+	static int CheckEngines(const std::filesystem::path& path, size_t total)
+	{
+		FlightRecorder recorder;
+		if(ResultIsError(recorder.Open(path, 16 * total + FlightRecorder::MinCapacity))) { std::printf("engines: cannot open %s\n", path.string().c_str()); return 1; }
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetFlightRecorder(&recorder);
+		m2p.SetFlightRecorder(&recorder);
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> stream = MakeChannelMessageStream(total);
+		std::vector<uint8_t> received;
+		std::thread guest([&]()
+		{
+			int cw = 0;
+			pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+			std::vector<uint8_t> buffer(4096);
+			while(received.size() < stream.size())
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				received.insert(received.end(), buffer.begin(), buffer.begin() + cr);
+			}
+		});
+		for(size_t i = 0; i < stream.size(); i += 3)
+		{
+			while(!midiin.Inject(stream.data() + i, 3)) std::this_thread::yield();
+			if((i % 3072) == 0) std::this_thread::yield();
+		}
+		midiout.WaitForBytes(stream.size(), std::chrono::seconds(30));
+		for(Clock::time_point t0 = Clock::now(); (received.size() < stream.size()) && (SecondsSince(t0) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		pipe.Close();
+		guest.join();
+		p2m.SetTransport(nullptr, false);
+		m2p.SetTransport(nullptr, false);
+		recorder.Close();
+		FlightLogReader reader;
+		reader.Open(path);
+		std::vector<uint8_t> captured[2];
+		reader.ForEach([&](const FlightRecordView& v) { captured[(int)v.direction].insert(captured[(int)v.direction].end(), v.data.begin(), v.data.end()); });
+		bool p2mok = captured[0] == stream;
+		bool m2pok = captured[1] == received;
+		std::printf("engines: %zu bytes pipe->midi captured%s, %zu bytes midi->pipe captured%s\n", captured[0].size(), p2mok ? "" : " MISMATCH", captured[1].size(), m2pok ? "" : " MISMATCH");
+		return (p2mok && m2pok) ? 0 : 1;
+	}
+
+	int RunFlightRecorder(const BenchArgs& args)
+	{
+		int r = 0;
+		std::filesystem::path path = args.GetString("path", (std::filesystem::temp_directory_path() / "bridgebench-flight.log").string());
+		int count = (int)args.GetInt("count", 1000000);
+		double limit = args.GetDouble("limitns", 50);
+		{
+			FlightRecorder recorder;
+			ResultCode rc = recorder.Open(path, FlightRecorder::DefaultCapacity);
+			if(ResultIsError(rc)) { std::printf("cannot open %s (%d)\n", path.string().c_str(), rc); return 1; }
+			// touch every page first, the steady state of an always-on log is a mapping that is already resident
+			MeasureRecordNs(recorder, 1, (int)(FlightRecorder::DefaultCapacity / 32), 3);
+			double ns3 = MeasureRecordNs(recorder, 1, count, 3);
+			double ns32 = MeasureRecordNs(recorder, 1, count, 32);
+			double ns3x2 = MeasureRecordNs(recorder, 2, count / 2, 3);
+			std::printf("record: %6.1f ns per 3 byte message, %6.1f ns per 32 byte message, %6.1f ns per 3 byte message from 2 threads\n", ns3, ns32, ns3x2);
+#if defined(__linux__)
+			if(ns3 > limit) { std::printf("record: above the %.0f ns budget\n", limit); r = 1; }
+#else
+			(void)limit;
+#endif
+		}
+		r |= CheckWrapAround(path);
+#if !defined(_WIN32)
+		r |= CheckCrash(path);
+#endif
+		r |= CheckEngines(path, (size_t)args.GetInt("bytes", 96 * 1024));
+		std::filesystem::remove(path);
+		return r;
+	}
+}
@@ -0,0 +1,114 @@
+//
+//  BenchFramer.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "MidiFramer.h"
+#include <random>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// framed output normalized so that it does not depend on the chunking: SysEx segments are joined into one message
+	struct NormalizedFrames
+	{
+		std::vector<std::vector<uint8_t> > messages;
+		std::vector<uint8_t> sysex;
+		bool broken = false;
+		void operator()(const MidiMessage& m)
+		{
+			if(m.kind == MidiMessageKind::SysEx)
+			{
+				if((m.sysexFlags & SysExBegin) && !sysex.empty()) broken = true;
+				sysex.insert(sysex.end(), m.data, m.data + m.length);
+				if(m.sysexFlags & SysExEnd) { messages.push_back(sysex); sysex.clear(); }
+				return;
+			}
+			if(m.length != MidiFramer::GetShortMessageLength(m.data[0])) broken = true;
+			for(int i = 1; i < m.length; ++i) { if(m.data[i] & 0x80) broken = true; }
+			messages.emplace_back(m.data, m.data + m.length);
+		}
+	};
+
+	static std::vector<uint8_t> MakeRandomMidiStream(std::mt19937& rng, size_t n)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(n + 64);
+		std::uniform_int_distribution<int> pick(0, 99);
+		std::uniform_int_distribution<int> byte(0, 255);
+		std::uniform_int_distribution<int> data(0, 127);
+		while(v.size() < n)
+		{
+			int k = pick(rng);
+			if(k < 50)		{ uint8_t st = (uint8_t)(0x80 | (byte(rng) & 0x70) | (byte(rng) & 0x0f)); v.push_back(st); for(int c = MidiFramer::GetShortMessageLength(st), i = 1; i < c; ++i) v.push_back((uint8_t)data(rng)); }
+			else if(k < 65)	{ v.push_back((uint8_t)data(rng)); v.push_back((uint8_t)data(rng)); } // running status
+			else if(k < 75)	{ v.push_back((uint8_t)(0xf8 + (byte(rng) & 7))); }
+			else if(k < 82)	{ v.push_back(0xf0); for(int c = data(rng) * 4, i = 0; i < c; ++i) { v.push_back((k == 81) && (i == c / 2) ? (uint8_t)0xf8 : (uint8_t)data(rng)); } v.push_back(0xf7); }
+			else if(k < 90)	{ v.push_back((uint8_t)(0xf1 + (byte(rng) % 6))); v.push_back((uint8_t)data(rng)); v.push_back((uint8_t)data(rng)); }
+			else			{ v.push_back((uint8_t)byte(rng)); } // garbage
+		}
+		return v;
+	}
+
+	static NormalizedFrames FrameInChunks(const std::vector<uint8_t>& stream, std::mt19937* rng, int maxchunk)
+	{
+		NormalizedFrames frames;
+		MidiFramer framer;
+		std::uniform_int_distribution<int> chunk(1, maxchunk);
+		size_t i = 0; while(i < stream.size())
+		{
+			int c = rng ? chunk(*rng) : 1;
+			c = (int)std::min<size_t>((size_t)c, stream.size() - i);
+			framer.Process(stream.data() + i, c, frames);
+			i += (size_t)c;
+		}
+		return frames;
+	}
+
+	int RunFramer(const BenchArgs& args)
+	{
+		int iterations = (int)args.GetInt("iterations", 200);
+		uint64_t seed = (uint64_t)args.GetInt("seed", 1);
+		// fuzz: the framed result must not depend on how the stream is chunked
+		std::mt19937 rng((unsigned int)seed);
+		for(int it = 0; it < iterations; ++it)
+		{
+			std::vector<uint8_t> stream = MakeRandomMidiStream(rng, 4096);
+			NormalizedFrames reference = FrameInChunks(stream, nullptr, 1);
+			NormalizedFrames chunked = FrameInChunks(stream, &rng, 300);
+			if(reference.broken || chunked.broken || (reference.messages != chunked.messages))
+			{
+				std::printf("framer: mismatch at iteration %d (seed=%llu)\n", it, (unsigned long long)seed);
+				return 1;
+			}
+		}
+		std::printf("framer fuzz: %d streams ok\n", iterations);
+		// throughput over channel messages with running status and interleaved clock
+		std::vector<uint8_t> stream;
+		for(int i = 0; i < 64 * 1024; ++i)
+		{
+			stream.push_back((i % 16) ? (uint8_t)(i & 0x3f) : (uint8_t)0xb0);
+			stream.push_back((uint8_t)(i & 0x7f));
+			if((i % 24) == 0) stream.push_back(0xf8);
+		}
+		uint64_t total = (uint64_t)args.GetInt("bytes", 64 * 1024 * 1024);
+		MidiFramer framer;
+		uint64_t messages = 0, bytes = 0;
+		Clock::time_point t0 = Clock::now();
+		while(bytes < total)
+		{
+			for(size_t i = 0; i < stream.size(); i += 256)
+			{
+				int c = (int)std::min<size_t>(256, stream.size() - i);
+				framer.Process(stream.data() + i, c, [&messages](const MidiMessage&) { ++messages; });
+				bytes += (uint64_t)c;
+			}
+		}
+		PrintRate("framer", bytes, messages, SecondsSince(t0));
+		return 0;
+	}
+}
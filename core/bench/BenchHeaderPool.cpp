@@ -0,0 +1,155 @@
+//
+//  BenchHeaderPool.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "HeaderPool.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	struct FakeHeader
+	{
+		uint64_t sequence = 0;
+	};
+
+	// the free list MidiOutPort used before, kept here as the baseline
+	class ListHeaderPool
+	{
+	private:
+		std::list<FakeHeader*> freeList;
+		std::recursive_mutex lock;
+	public:
+		void Release(FakeHeader* p)
+		{
+			std::lock_guard<std::recursive_mutex> al(lock);
+			freeList.push_back(p);
+		}
+		bool TryAcquire(FakeHeader** pp)
+		{
+			std::lock_guard<std::recursive_mutex> al(lock);
+			if(freeList.empty()) return false;
+			*pp = freeList.front();
+			freeList.pop_front();
+			return true;
+		}
+	};
+
+	class RingHeaderPool
+	{
+	private:
+		HeaderPool<FakeHeader> pool;
+	public:
+		RingHeaderPool(size_t capacity) : pool(capacity)
+		{
+		}
+		void Release(FakeHeader* p)
+		{
+			pool.Release(p);
+		}
+		bool TryAcquire(FakeHeader** pp)
+		{
+			return !ResultIsError(pool.Acquire(pp, std::chrono::milliseconds(0)));
+		}
+	};
+
+	//
+	// the pipe thread acquires a header and submits it, a synthetic driver callback thread completes it and releases it back,
+	// both sides spin on an empty queue so the cost measured is the free list itself
+	//
+	template<typename Pool> static double MeasureRoundTrip(Pool& pool, int numheaders, uint64_t count, bool* ok)
+	{
+		std::vector<FakeHeader> headers(numheaders);
+		for(auto& hdr : headers) pool.Release(&hdr);
+		SpscRing<FakeHeader*> submitted(numheaders);
+		std::atomic<bool> done{ false };
+		uint64_t completed = 0;
+		bool inorder = true;
+		std::thread driver([&]()
+		{
+			uint64_t expected = 0;
+			while(!done || !submitted.IsEmpty())
+			{
+				FakeHeader* hdr = nullptr;
+				if(!submitted.Pop(&hdr)) { std::this_thread::yield(); continue; }
+				if(hdr->sequence != expected++) inorder = false;
+				++completed;
+				pool.Release(hdr);
+			}
+		});
+		Clock::time_point t0 = Clock::now();
+		for(uint64_t i = 0; i < count; ++i)
+		{
+			FakeHeader* hdr = nullptr;
+			while(!pool.TryAcquire(&hdr)) std::this_thread::yield();
+			hdr->sequence = i;
+			while(!submitted.Push(hdr)) std::this_thread::yield();
+		}
+		done = true;
+		driver.join();
+		double sec = SecondsSince(t0);
+		*ok = inorder && (completed == count);
+		return sec;
+	}
+
+	int RunHeaderPool(const BenchArgs& args)
+	{
+		uint64_t count = (uint64_t)args.GetInt("count", 2000000);
+		int numheaders = (int)args.GetInt("headers", 16);
+		int r = 0;
+		{
+			ListHeaderPool pool;
+			bool ok = false;
+			double sec = MeasureRoundTrip(pool, numheaders, count, &ok);
+			std::printf("%-24s %12llu headers %9.3f s %8.1f ns/header\n", "list+mutex", (unsigned long long)count, sec, sec * 1e9 / (double)count);
+			if(!ok) { std::printf("list+mutex: lost or reordered headers\n"); r = 1; }
+		}
+		{
+			RingHeaderPool pool((size_t)numheaders);
+			bool ok = false;
+			double sec = MeasureRoundTrip(pool, numheaders, count, &ok);
+			std::printf("%-24s %12llu headers %9.3f s %8.1f ns/header\n", "spsc ring", (unsigned long long)count, sec, sec * 1e9 / (double)count);
+			if(!ok) { std::printf("spsc ring: lost or reordered headers\n"); r = 1; }
+		}
+		// the blocking path, the pipe thread sleeps on the pool instead of spinning
+		{
+			HeaderPool<FakeHeader> pool((size_t)numheaders);
+			std::vector<FakeHeader> headers(numheaders);
+			for(auto& hdr : headers) pool.Release(&hdr);
+			SpscRing<FakeHeader*> submitted(numheaders);
+			std::atomic<bool> done{ false };
+			std::thread driver([&]()
+			{
+				while(!done || !submitted.IsEmpty())
+				{
+					FakeHeader* hdr = nullptr;
+					if(!submitted.Pop(&hdr)) { std::this_thread::yield(); continue; }
+					pool.Release(hdr);
+				}
+			});
+			Clock::time_point t0 = Clock::now();
+			uint64_t acquired = 0;
+			for(uint64_t i = 0; i < count; ++i)
+			{
+				FakeHeader* hdr = nullptr;
+				if(ResultIsError(pool.Acquire(&hdr, std::chrono::milliseconds(1000)))) break;
+				++acquired;
+				while(!submitted.Push(hdr)) std::this_thread::yield();
+			}
+			done = true;
+			driver.join();
+			double sec = SecondsSince(t0);
+			std::printf("%-24s %12llu headers %9.3f s %8.1f ns/header, waited %llu times\n", "spsc ring (blocking)", (unsigned long long)acquired, sec, sec * 1e9 / (double)count, (unsigned long long)pool.GetWaitCount());
+			if(acquired != count) { std::printf("spsc ring (blocking): timed out\n"); r = 1; }
+		}
+		return r;
+	}
+}
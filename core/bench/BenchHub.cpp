@@ -0,0 +1,373 @@
+//
+//  BenchHub.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "ClientHub.h"
+#include "FakePorts.h"
+#include "MidiOutMerger.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// a guest that never writes and reads everything instantly, isolates the cost of the fan-out itself
+	class NullTransport : public ITransport
+	{
+	private:
+		std::mutex mutex;
+		std::condition_variable cond;
+		bool readCancelled = false;
+	public:
+		virtual ResultCode Read(uint8_t*, int, int* cr) override
+		{
+			*cr = 0;
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this]() { return readCancelled; });
+			return ResultCancelled;
+		}
+		virtual ResultCode Write(const uint8_t*, int c, int* cw) override { *cw = c; return ResultOk; }
+		virtual void SetReadCancelled(bool v) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			readCancelled = v;
+			cond.notify_all();
+		}
+		virtual void SetWriteCancelled(bool) override {}
+		virtual bool IsBrokenPipe(ResultCode r) const override { return r == ResultBrokenPipe; }
+	};
+
+	static const uint8_t GuestSysExId = 0x7d;
+	static const int GuestSysExBody = 40;
+
+	// what guest i plays: notes on its own channel, a clock tick every 8 notes and a SysEx every 64
+	static std::vector<uint8_t> MakeGuestStream(int guest, int notes)
+	{
+		std::vector<uint8_t> v;
+		for(int k = 0; k < notes; ++k)
+		{
+			if((k % 8) == 0) v.push_back(0xf8);
+			if((k % 64) == 32)
+			{
+				v.insert(v.end(), { 0xf0, GuestSysExId, (uint8_t)guest, (uint8_t)(k & 0x7f) });
+				for(int j = 0; j < GuestSysExBody; ++j) v.push_back((uint8_t)((guest * 16 + j) & 0x7f));
+				v.push_back(0xf7);
+			}
+			v.insert(v.end(), { (uint8_t)(0x90 | guest), (uint8_t)(k & 0x7f), 0x40 });
+		}
+		return v;
+	}
+
+	// the merged stream must hold every guest's messages in order, with nothing but real-time bytes inside a SysEx
+	static bool VerifyMergedStream(const std::vector<uint8_t>& v, int guests, int notes)
+	{
+		std::vector<int> nextnote(guests, 0);
+		std::vector<int> sysexcount(guests, 0);
+		uint64_t clocks = 0;
+		std::vector<uint8_t> sysex;
+		bool insysex = false;
+		for(size_t i = 0; i < v.size(); ++i)
+		{
+			uint8_t b = v[i];
+			if(MidiFramer::IsRealTime(b)) { ++clocks; continue; }
+			if(insysex)
+			{
+				if(b < 0x80) { sysex.push_back(b); continue; }
+				if(b != 0xf7) { std::printf("hub: status %02x inside a SysEx at %zu\n", b, i); return false; }
+				insysex = false;
+				int g = (sysex.size() > 2) ? sysex[1] : -1;
+				bool ok = (sysex.size() == (size_t)(3 + GuestSysExBody)) && (sysex[0] == GuestSysExId) && (0 <= g) && (g < guests);
+				for(int j = 0; ok && (j < GuestSysExBody); ++j) ok = sysex[3 + j] == (uint8_t)((g * 16 + j) & 0x7f);
+				if(!ok) { std::printf("hub: torn SysEx ending at %zu\n", i); return false; }
+				++sysexcount[g];
+				continue;
+			}
+			if(b == 0xf0) { insysex = true; sysex.clear(); continue; }
+			int g = b & 0x0f;
+			if(((b & 0xf0) != 0x90) || (g >= guests) || (i + 2 >= v.size()) || (v[i + 1] != (uint8_t)(nextnote[g] & 0x7f)))
+			{
+				std::printf("hub: unexpected message %02x at %zu\n", b, i);
+				return false;
+			}
+			++nextnote[g];
+			i += 2;
+		}
+		for(int g = 0; g < guests; ++g)
+		{
+			if((nextnote[g] != notes) || (sysexcount[g] != (notes + 31) / 64)) { std::printf("hub: guest %d lost messages\n", g); return false; }
+		}
+		if(clocks != (uint64_t)guests * (uint64_t)((notes + 7) / 8)) { std::printf("hub: lost clock ticks\n"); return false; }
+		return true;
+	}
+
+	// what the MIDI in device plays: note and controller traffic with a 600 byte SysEx now and then, which spans several shared blocks
+	static std::vector<std::vector<uint8_t> > MakeDeviceMessages(int n)
+	{
+		std::vector<std::vector<uint8_t> > v;
+		for(int i = 0; i < n; ++i)
+		{
+			if((i % 500) == 250)
+			{
+				std::vector<uint8_t> sx(600);
+				sx.front() = 0xf0;
+				for(size_t j = 1; j + 1 < sx.size(); ++j) sx[j] = (uint8_t)((i + j) & 0x7f);
+				sx.back() = 0xf7;
+				v.push_back(sx);
+			}
+			else
+			{
+				v.push_back({ (uint8_t)(0xb0 | (i & 0x0f)), (uint8_t)(i & 0x7f), (uint8_t)((i >> 7) & 0x7f) });
+			}
+		}
+		return v;
+	}
+
+	static double MeasureFanOutCost(int clients, int events)
+	{
+		ClientHub hub(clients);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		std::vector<std::unique_ptr<NullTransport> > transports;
+		for(int i = 0; i < clients; ++i)
+		{
+			transports.push_back(std::make_unique<NullTransport>());
+			hub.SetClientTransport(i, transports.back().get(), false);
+		}
+		hub.SetMidiInPort(&midiin);
+		const uint8_t msg[3] = { 0x90, 0x3c, 0x40 };
+		const int batch = 128;
+		double sec = 0;
+		for(int i = 0; i < events; i += batch)
+		{
+			int n = std::min(batch, events - i);
+			Clock::time_point t0 = Clock::now();
+			for(int k = 0; k < n; ++k) midiin.Inject(msg, 3);
+			sec += SecondsSince(t0);
+			// keep the queues shallow so nothing is dropped
+			uint64_t expected = (uint64_t)(i + n) * 3 * (uint64_t)clients;
+			for(Clock::time_point t1 = Clock::now(); (hub.GetStatistics().midiToPipe.bytes < expected) && (SecondsSince(t1) < 5); ) std::this_thread::yield();
+		}
+		hub.SetMidiInPort(nullptr);
+		for(int i = 0; i < clients; ++i) hub.SetClientTransport(i, nullptr, false);
+		return sec * 1e9 / (double)events;
+	}
+
+	// a SysEx send blocked by the device's back-pressure must not hold up another guest's real-time message
+	static int CheckRealTimeBesideBlockedSend()
+	{
+		MidiOutMerger merger(2);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		std::mutex mutex;
+		std::condition_variable cond;
+		bool blocked = false, released = false;
+		midiout.OnSend = [&](const uint8_t* p, int) -> ResultCode
+		{
+			if(p[0] != 0xf0) return ResultOk;
+			std::unique_lock<std::mutex> lock(mutex);
+			blocked = true;
+			cond.notify_all();
+			cond.wait_for(lock, std::chrono::seconds(2), [&]() { return released; });
+			return ResultOk;
+		};
+		merger.SetMidiOutPort(&midiout);
+		static const uint8_t sysex[] = { 0xf0, GuestSysExId, 0x01, 0xf7 };
+		static const uint8_t clock = 0xf8;
+		std::thread sender([&]()
+		{
+			MidiMessage m;
+			m.data = sysex;
+			m.length = sizeof(sysex);
+			m.kind = MidiMessageKind::SysEx;
+			m.sysexFlags = SysExBegin | SysExEnd;
+			merger.Dispatch(0, m);
+		});
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait_for(lock, std::chrono::seconds(2), [&]() { return blocked; });
+		}
+		MidiMessage m;
+		m.data = &clock;
+		m.length = 1;
+		m.kind = MidiMessageKind::RealTime;
+		Clock::time_point t0 = Clock::now();
+		merger.Dispatch(1, m);
+		double ms = SecondsSince(t0) * 1000;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			released = true;
+			cond.notify_all();
+		}
+		sender.join();
+		merger.SetMidiOutPort(nullptr);
+		bool ok = (ms < 100) && (midiout.GetReceivedData() == std::vector<uint8_t>{ 0xf8, 0xf0, GuestSysExId, 0x01, 0xf7 });
+		std::printf("real-time beside a blocked SysEx send: %s (%.2f ms)\n", ok ? "went ahead" : "FAILED", ms);
+		return ok ? 0 : 1;
+	}
+
+	int RunHub(const BenchArgs& args)
+	{
+		int r = 0;
+		int guests = std::clamp((int)args.GetInt("clients", 4), 1, 15);
+		int notes = (int)args.GetInt("notes", 4000);
+		int events = (int)args.GetInt("events", 5000);
+		uint32_t seed = (uint32_t)args.GetInt("seed", 1);
+		// the driver callback pays one copy per message, plus a queue push per client
+		for(int n : { 1, 2, 4, 8 })
+		{
+			std::printf("fan-out to %d client(s): %.0f ns per callback\n", n, MeasureFanOutCost(n, events));
+		}
+		// every guest plays into the merge while the device fans out to all of them
+		ClientHub hub(guests);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		hub.SetMidiOutPort(&midiout);
+		hub.SetMidiInPort(&midiin);
+		std::vector<std::unique_ptr<MemoryPipe> > pipes;
+		for(int i = 0; i < guests; ++i)
+		{
+			pipes.push_back(std::make_unique<MemoryPipe>(16 * 1024));
+			hub.SetClientTransport(i, &pipes[i]->HostEnd(), true);
+		}
+		std::vector<std::vector<uint8_t> > devmsgs = MakeDeviceMessages(events);
+		std::vector<uint8_t> devstream;
+		for(auto&& m : devmsgs) devstream.insert(devstream.end(), m.begin(), m.end());
+		uint64_t merged = 0;
+		std::vector<std::thread> threads;
+		std::vector<std::atomic<uint64_t> > received(guests);
+		std::atomic<int> fanoutmismatch{ 0 };
+		for(int i = 0; i < guests; ++i)
+		{
+			std::vector<uint8_t> stream = MakeGuestStream(i, notes);
+			merged += stream.size();
+			threads.emplace_back([&, i, stream]()
+			{
+				// odd chunk sizes split the SysEx across reads, the yields let the guests race each other
+				std::mt19937 rng(seed + (uint32_t)i);
+				std::uniform_int_distribution<int> chunkdist(1, 24);
+				for(size_t j = 0; j < stream.size(); )
+				{
+					int c = (int)std::min<size_t>((size_t)chunkdist(rng), stream.size() - j);
+					int cw = 0;
+					if(ResultIsError(pipes[i]->GuestEnd().Write(stream.data() + j, c, &cw))) break;
+					j += (size_t)c;
+					std::this_thread::yield();
+				}
+			});
+			threads.emplace_back([&, i]()
+			{
+				std::vector<uint8_t> buffer(4096);
+				while(received[i] < devstream.size())
+				{
+					int cr = 0;
+					if(ResultIsError(pipes[i]->GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+					if(memcmp(buffer.data(), devstream.data() + received[i], cr) != 0) ++fanoutmismatch;
+					received[i] += (uint64_t)cr;
+				}
+			});
+		}
+		Clock::time_point t0 = Clock::now();
+		size_t injected = 0;
+		for(size_t i = 0; i < devmsgs.size(); ++i)
+		{
+			midiin.Inject(devmsgs[i].data(), (int)devmsgs[i].size());
+			injected += devmsgs[i].size();
+			if((i % 64) != 63) continue;
+			// bound what is in flight, so the clients' queues never overrun
+			for(int g = 0; g < guests; ++g)
+			{
+				for(Clock::time_point t1 = Clock::now(); (received[g] < injected) && (SecondsSince(t1) < 5); ) std::this_thread::yield();
+			}
+		}
+		midiout.WaitForBytes(merged, std::chrono::seconds(20));
+		for(int g = 0; g < guests; ++g)
+		{
+			for(Clock::time_point t1 = Clock::now(); (received[g] < devstream.size()) && (SecondsSince(t1) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		double sec = SecondsSince(t0);
+		for(auto&& p : pipes) p->Close();
+		for(auto&& t : threads) t.join();
+		BridgeStatistics st = hub.GetStatistics();
+		PrintRate("merge (all guests)", midiout.GetByteCount(), st.pipeToMidi.messages, sec);
+		PrintRate("fan-out (per guest)", devstream.size(), devmsgs.size(), sec);
+		std::printf("merge: %llu short / %llu long sends, fan-out: %llu writes for %d guests, %llu dropped\n",
+			(unsigned long long)st.pipeToMidi.shortSends, (unsigned long long)st.pipeToMidi.longSends,
+			(unsigned long long)st.midiToPipe.pipeWriteCalls, guests, (unsigned long long)st.midiToPipe.droppedBytes);
+		if(!VerifyMergedStream(midiout.GetReceivedData(), guests, notes)) r = 1;
+		for(int g = 0; g < guests; ++g)
+		{
+			if(received[g] != devstream.size()) { std::printf("hub: guest %d received %llu of %zu fan-out bytes\n", g, (unsigned long long)received[g].load(), devstream.size()); r = 1; }
+		}
+		if(fanoutmismatch) { std::printf("hub: fan-out data mismatch\n"); r = 1; }
+		if(st.midiToPipe.droppedBytes) { std::printf("hub: fan-out dropped bytes\n"); r = 1; }
+		// a guest that leaves in the middle of a SysEx must not hold the port, its SysEx is closed with EOX
+		if(guests >= 2)
+		{
+			for(int i = 0; i < 2; ++i)
+			{
+				pipes[i]->Reset();
+				hub.SetClientTransport(i, &pipes[i]->HostEnd(), true);
+			}
+			midiout.Clear();
+			const uint8_t partial[] = { 0xf0, GuestSysExId, 0x00, 0x01, 0x02 };
+			const uint8_t note[] = { 0x91, 0x10, 0x20 };
+			int cw = 0;
+			pipes[0]->GuestEnd().Write(partial, sizeof(partial), &cw);
+			midiout.WaitForBytes(sizeof(partial), std::chrono::seconds(5));
+			pipes[1]->GuestEnd().Write(note, sizeof(note), &cw);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			bool held = midiout.GetByteCount() == sizeof(partial);
+			hub.SetClientTransport(0, nullptr, true);
+			midiout.WaitForBytes(sizeof(partial) + 1 + sizeof(note), std::chrono::seconds(5));
+			const std::vector<uint8_t> expected = { 0xf0, GuestSysExId, 0x00, 0x01, 0x02, 0xf7, 0x91, 0x10, 0x20 };
+			bool ok = held && (midiout.GetReceivedData() == expected);
+			std::printf("disconnect inside a SysEx: %s\n", ok ? "closed with EOX, the next guest proceeds" : "FAILED");
+			if(!ok) r = 1;
+		}
+		// a guest that stays connected but stops inside a SysEx loses the port after the owner timeout, the rest of its SysEx
+		// is dropped when it comes and its next message goes out
+		if(guests >= 2)
+		{
+			pipes[0]->Reset();
+			hub.SetClientTransport(0, &pipes[0]->HostEnd(), true);
+			midiout.Clear();
+			const std::chrono::milliseconds timeout(50);
+			hub.SetSysExOwnerTimeout(timeout);
+			const uint8_t partial[] = { 0xf0, GuestSysExId, 0x00, 0x01, 0x02 };
+			const uint8_t rest[] = { 0x03, 0x04, 0xf7, 0x90, 0x11, 0x22 };
+			const uint8_t note[] = { 0x91, 0x10, 0x20 };
+			int cw = 0;
+			pipes[0]->GuestEnd().Write(partial, sizeof(partial), &cw);
+			midiout.WaitForBytes(sizeof(partial), std::chrono::seconds(5));
+			Clock::time_point waited = Clock::now();
+			pipes[1]->GuestEnd().Write(note, sizeof(note), &cw);
+			midiout.WaitForBytes(sizeof(partial) + 1 + sizeof(note), std::chrono::seconds(5));
+			double ms = SecondsSince(waited) * 1000;
+			pipes[0]->GuestEnd().Write(rest, sizeof(rest), &cw);
+			midiout.WaitForBytes(sizeof(partial) + 1 + sizeof(note) + 3, std::chrono::seconds(5));
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			hub.SetSysExOwnerTimeout(MidiOutMerger::DefaultSysExOwnerTimeout);
+			const std::vector<uint8_t> expected = { 0xf0, GuestSysExId, 0x00, 0x01, 0x02, 0xf7, 0x91, 0x10, 0x20, 0x90, 0x11, 0x22 };
+			bool ok = (ms >= (double)timeout.count() * 0.9) && (ms < 1000) && (midiout.GetReceivedData() == expected);
+			std::printf("stall inside a SysEx: %s after %.1f ms\n", ok ? "closed with EOX, the next guest proceeds" : "FAILED", ms);
+			if(!ok) r = 1;
+		}
+		hub.SetMidiInPort(nullptr);
+		for(int i = 0; i < guests; ++i) hub.SetClientTransport(i, nullptr, false);
+		r |= CheckRealTimeBesideBlockedSend();
+		return r;
+	}
+}
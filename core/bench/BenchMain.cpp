@@ -0,0 +1,65 @@
+//
+//  BenchMain.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+//  usage: bridgebench <scenario> [key=value ...]
+//  a scenario returns non-zero when it detects data loss or corruption, so it can gate CI
+//
+
+#include "BenchCommon.h"
+#include <cstring>
+
+using namespace BridgeBench;
+
+static const BenchEntry Entries[] =
+{
+	{ "throughput", "pipe->MIDI and MIDI->pipe throughput over in-memory fake ports [bytes=N]", RunThroughput },
+	{ "framer", "MIDI byte-stream framer chunking fuzz and throughput [iterations=N seed=N bytes=N]", RunFramer },
+	{ "dispatch", "short/long message classification of a controller sweep with SysEx [bytes=N sysex=N]", RunDispatch },
+	{ "backpressure", "SysEx through a device with 16 x 256 byte buffers and a slow drain, asserts zero loss [bytes=N dump=N rate=N timeout=ms]", RunBackPressure },
+	{ "headerpool", "header recycling, list+mutex against the lock-free ring with a synthetic driver callback thread [count=N headers=N]", RunHeaderPool },
+	{ "coalesce", "MIDI in burst through the write coalescer under several policies [events=N spacing=usec writecost=usec delay=usec flush=N rt=0|1]", RunCoalesce },
+	{ "pacing", "serial line pacing of a SysEx restore against a virtual UART, then on the real clock [bytes=N bitrate=N uartfifo=N realbytes=N]", RunPacing },
+	{ "timestamp", "source timestamp to pipe write delay and jitter histogram with a jittery driver callback [events=N spacing=usec jitter=usec seed=N]", RunTimestamp },
+	{ "statistics", "cost of the hot path counters and histograms, then a two-way session checked against its statistics snapshot [count=N bytes=N]", RunStatistics },
+	{ "hub", "fan-out cost for 1..8 clients, then several guests merged into one MIDI out and fed from one MIDI in, checked message by message [clients=N notes=N events=N seed=N]", RunHub },
+	{ "socket", "Unix socket and TCP loopback sessions: both directions at once, then a note echoed through the devices back to the guest [bytes=N count=N path=P port=N]", RunSocket },
+	{ "pty", "pseudo-terminal session: every byte through the raw tty both ways, a reopened slave, then serial pacing on the tty [messages=N seed=N pacedbytes=N link=P]", RunPty },
+	{ "reactor", "threaded engines against the epoll reactor: round trip latency and context switches, many bridges on one thread, accept on the reactor [count=N bridges=N bytes=N path=P]", RunReactor },
+	{ "readahead", "pipe reads kept in flight ahead of the MIDI out for K = 1, 2, 4, 8: bytes/s and read-to-send latency [bytes=N readlatency=usec sendcost=usec]", RunReadAhead },
+	{ "zerocopy", "pipe reads landing straight in the MIDI out buffers vs copied out: bytes/s, in-place sends and output equality [bytes=N dumpsize=N mixedbytes=N]", RunZeroCopy },
+	{ "flight", "flight recorder: cost per message, many laps of a small ring from two writers, a torn record, a crashed writer, then both engines captured [count=N bytes=N limitns=N path=P]", RunFlightRecorder },
+	{ "replay", "a captured session replayed into both sides with its original timing, scaled or at full speed: per-message latency and loss [log=P|smf=P smfdir=p2m|m2p speed=X allowloss=0|1]", RunReplay },
+	{ "filter", "per-message cost of a static filter chain of 0, 1, 4 and 8 stages, behind a virtual call and parsed at run time, and the engines filtering both directions [messages=N passes=N]", RunFilter },
+	{ "portselect", "F5 port-select demux of one guest stream to several MIDI outs and mux of several MIDI ins, checked end to end, and the per-message cost of the demux [messages=N passes=N]", RunPortSelect },
+	{ "rtlane", "delay of MIDI clock bytes played beside a bulk SysEx with and without the real-time lane, and the lane across port selects [bytes=N rate=bytes/s interval=usec readahead=N bound=usec passes=N]", RunRealTimeLane },
+	{ "outpacing", "SysEx paced to a slow receiver by a device profile: rate, the gap after each EOX and clock bytes passing the held messages, then the built-in profile lookup [profile=spec passes=N sysex=N bound=usec]", RunOutputPacing },
+	{ "streamout", "timestamped stream batches on a virtual clock: a guest's notes, clock and dumps coalesced by the host, played back byte-exact within the latency, note jitter with and without smoothing [length=ms quantum=usec latency=usec sysex=N seed=N]", RunStreamOut },
+	{ "clockpll", "MIDI clock regenerated by a PLL on a virtual clock: jitter in and out, lock time across a tempo step, a stop and start and a coarse host timer, then on the real clock [bpm=N jitter=usec holdback=usec length=ms reallength=ms seed=N]", RunClockPll },
+};
+
+static void PrintUsage()
+{
+	std::printf("usage: bridgebench <scenario>|all [key=value ...]\n");
+	for(const auto& e : Entries) std::printf("  %-16s %s\n", e.name, e.description);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2) { PrintUsage(); return 2; }
+	BenchArgs args(argc - 2, argv + 2);
+	bool all = std::strcmp(argv[1], "all") == 0;
+	int r = 0;
+	bool found = false;
+	for(const auto& e : Entries)
+	{
+		if(!all && (std::strcmp(argv[1], e.name) != 0)) continue;
+		found = true;
+		std::printf("== %s\n", e.name);
+		if(int rs = e.run(args)) { std::printf("!! %s failed (%d)\n", e.name, rs); r = 1; }
+	}
+	if(!found) { PrintUsage(); return 2; }
+	return r;
+}
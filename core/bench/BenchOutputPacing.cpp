@@ -0,0 +1,216 @@
+//
+//  BenchOutputPacing.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "PacedMidiOut.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// a device that notes when each piece arrives, with or without short messages beside a long one
+	struct PacingProbePort : public IMidiOutPort
+	{
+		struct Arrival
+		{
+			Clock::time_point time;
+			std::vector<uint8_t> bytes;
+		};
+		bool concurrent = true;
+		mutable std::mutex mutex;
+		std::vector<Arrival> arrivals;
+		// the next call fails with this instead of taking the bytes
+		ResultCode failNext = ResultOk;
+		ResultCode Record(const uint8_t* p, int c)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ResultCode r = failNext;
+			failNext = ResultOk;
+			if(r == ResultOk) arrivals.push_back({ Clock::now(), std::vector<uint8_t>(p, p + c) });
+			return r;
+		}
+		virtual bool IsDeviceOpen() const override { return true; }
+		virtual ResultCode Send(const uint8_t* p, int c) override { return Record(p, c); }
+		virtual ResultCode SendShortMessage(uint32_t msg) override
+		{
+			const uint8_t b[3] = { (uint8_t)msg, (uint8_t)(msg >> 8), (uint8_t)(msg >> 16) };
+			return Record(b, MidiFramer::GetShortMessageLength(b[0]));
+		}
+		virtual bool IsShortMessageConcurrent() const override { return concurrent; }
+	};
+
+	static bool CheckProfileLookup()
+	{
+		struct { const char* spec; const char* device; const char* expected; ResultCode result; } cases[] =
+		{
+			{ "auto", "Roland MT-32", "mt32", ResultOk },
+			{ "", "UM-ONE (CM-64)", "mt32", ResultOk },
+			{ "auto", "YAMAHA TX81Z", "tx81z", ResultOk },
+			{ "auto", "fb-01 via USB", "fb01", ResultOk },
+			{ "auto", "Microsoft GS Wavetable Synth", "", ResultOk },
+			{ "off", "Roland MT-32", "", ResultOk },
+			{ "wire", "Microsoft GS Wavetable Synth", "wire", ResultOk },
+			{ "rate:3125;gap:40", "", "custom", ResultOk },
+			{ "rate:fast", "", "", EINVAL },
+			{ "tempo:3", "", "", EINVAL },
+		};
+		bool ok = true;
+		for(const auto& c : cases)
+		{
+			MidiOutPacingProfile profile;
+			ResultCode r = ParsePacingProfile(c.spec, c.device, &profile);
+			if((r != c.result) || ((r == ResultOk) && (profile.name != c.expected)))
+			{
+				std::printf("outpacing: \"%s\" for \"%s\" gave \"%s\" (%d), expected \"%s\" (%d)\n", c.spec, c.device, profile.name.c_str(), r, c.expected, c.result);
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+	// a guest restoring patches: each pass writes a SysEx and the notes that audition it, then a clock byte while the device
+	// is still in the gap. the bytes must come out whole, no faster than the profile's rate, with the gap after each EOX,
+	// and the clock must not wait for the gap
+	static int CheckPacedSession(const MidiOutPacingProfile& profile, bool concurrent, int passes, int sysexbytes, double bound)
+	{
+		MemoryPipe pipe(64 * 1024);
+		PacingProbePort device;
+		device.concurrent = concurrent;
+		PacedMidiOut paced;
+		paced.SetMidiOutPort(&device);
+		paced.SetProfile(profile);
+		paced.Start();
+		PipeInMidiOut p2m;
+		p2m.SetMidiOutPort(&paced);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> expected;
+		std::vector<Clock::time_point> clocksent;
+		// an unlimited rate is spaced as if on the MIDI wire
+		double linerate = (profile.bytesPerSecond > 0) ? profile.bytesPerSecond : 3125;
+		std::chrono::milliseconds period = std::chrono::milliseconds(20) + 2 * profile.sysexGap + std::chrono::milliseconds((int64_t)(sysexbytes * 1000 / linerate));
+		Clock::time_point next = Clock::now();
+		for(int k = 0; k < passes; ++k)
+		{
+			std::vector<uint8_t> msg = { 0xf0, 0x41, 0x10, 0x16, 0x12 };
+			for(int j = 0; j < sysexbytes; ++j) msg.push_back((uint8_t)((k * 3 + j) & 0x7f));
+			msg.insert(msg.end(), { 0xf7, 0x90, 0x3c, 0x40, 0x80, 0x3c, 0x00 });
+			expected.insert(expected.end(), msg.begin(), msg.end());
+			int cw = 0;
+			pipe.GuestEnd().Write(msg.data(), (int)msg.size(), &cw);
+			// past the SysEx on the line, into the gap
+			std::this_thread::sleep_for(std::chrono::microseconds((profile.bytesPerSecond > 0) ? (int64_t)(msg.size() * 1e6 / profile.bytesPerSecond) : 0) + profile.sysexGap / 4);
+			const uint8_t f8 = 0xf8;
+			clocksent.push_back(Clock::now());
+			pipe.GuestEnd().Write(&f8, 1, &cw);
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+		paced.Flush(std::chrono::seconds(10));
+		pipe.Close();
+		p2m.SetTransport(nullptr, false);
+		paced.Stop();
+		std::lock_guard<std::mutex> lock(device.mutex);
+		std::vector<uint8_t> received;
+		std::vector<Clock::time_point> clockarrived;
+		double mingapms = 1e9;
+		double maxclockms = 0;
+		uint64_t clocksbehindheld = 0;
+		bool rateok = true;
+		Clock::time_point t0 = device.arrivals.empty() ? Clock::now() : device.arrivals.front().time;
+		Clock::time_point eox{};
+		bool ingap = false;
+		bool clockingap = false;
+		for(const auto& a : device.arrivals)
+		{
+			if((a.bytes.size() == 1) && MidiFramer::IsRealTime(a.bytes[0]))
+			{
+				clockarrived.push_back(a.time);
+				if(ingap) clockingap = true;
+				continue;
+			}
+			if(ingap)
+			{
+				mingapms = std::min(mingapms, std::chrono::duration<double, std::milli>(a.time - eox).count());
+				if(!clockingap) ++clocksbehindheld;
+				ingap = false;
+			}
+			received.insert(received.end(), a.bytes.begin(), a.bytes.end());
+			if(profile.bytesPerSecond > 0)
+			{
+				// what the line could have carried since the first byte, plus what the interface may hold ahead of it
+				double allowed = std::max(profile.maxOutstandingBytes, 3) + profile.bytesPerSecond * std::chrono::duration<double>(a.time - t0).count() + 1;
+				if((double)received.size() > allowed) rateok = false;
+			}
+			if(a.bytes.back() == 0xf7) { eox = a.time; ingap = true; clockingap = false; }
+		}
+		for(size_t i = 0; i < std::min(clocksent.size(), clockarrived.size()); ++i) maxclockms = std::max(maxclockms, std::chrono::duration<double, std::milli>(clockarrived[i] - clocksent[i]).count());
+		double sec = std::chrono::duration<double>((device.arrivals.empty() ? t0 : device.arrivals.back().time) - t0).count();
+		std::printf("%-10s device %-13s %6zu bytes %7.0f bytes/s, %llu gaps, shortest %6.2f ms, clock delay max %6.3f ms\n", profile.name.c_str(),
+			concurrent ? "concurrent" : "serialized", received.size(), (sec > 0) ? (double)received.size() / sec : 0.0,
+			(unsigned long long)paced.GetGapCount(), (mingapms < 1e9) ? mingapms : 0.0, maxclockms);
+		int r = 0;
+		if(received != expected) { std::printf("outpacing: data mismatch, %zu bytes received of %zu\n", received.size(), expected.size()); r = 1; }
+		if(clockarrived.size() != clocksent.size()) { std::printf("outpacing: %zu clocks arrived of %zu\n", clockarrived.size(), clocksent.size()); r = 1; }
+		if(!rateok) { std::printf("outpacing: the device was fed faster than %.0f bytes/s\n", profile.bytesPerSecond); r = 1; }
+		// the first EOX is measured from when the device got it, the line may still be carrying it, so the gap only grows
+		if((profile.sysexGap.count() > 0) && (mingapms < (double)profile.sysexGap.count() - 0.2)) { std::printf("outpacing: a gap of %.2f ms, the profile asks for %lld\n", mingapms, (long long)profile.sysexGap.count()); r = 1; }
+		if(maxclockms > bound / 1e3) { std::printf("outpacing: a clock byte waited %.3f ms\n", maxclockms); r = 1; }
+		if((profile.sysexGap.count() > 0) && clocksbehindheld) { std::printf("outpacing: %llu clocks came after the message held behind the gap\n", (unsigned long long)clocksbehindheld); r = 1; }
+		return r;
+	}
+
+	// a device call that times out is reported to the sends after it, and re-arming the port for the next session lets
+	// the device try again
+	static int CheckRecoverAfterDeviceError(const MidiOutPacingProfile& profile)
+	{
+		PacingProbePort device;
+		device.failNext = ResultTimedOut;
+		PacedMidiOut paced;
+		paced.SetMidiOutPort(&device);
+		paced.SetProfile(profile);
+		paced.Start();
+		const uint8_t noteon[3] = { 0x90, 0x3c, 0x40 };
+		const uint8_t noteoff[3] = { 0x80, 0x3c, 0x00 };
+		paced.Send(noteon, 3);
+		paced.Flush(std::chrono::seconds(1));
+		ResultCode failed = paced.Send(noteon, 3);
+		paced.SetSendCancelled(true);
+		paced.SetSendCancelled(false);
+		ResultCode rearmed = paced.Send(noteoff, 3);
+		paced.Flush(std::chrono::seconds(1));
+		paced.Stop();
+		std::lock_guard<std::mutex> lock(device.mutex);
+		bool delivered = (device.arrivals.size() == 1) && (device.arrivals[0].bytes == std::vector<uint8_t>(noteoff, noteoff + 3));
+		std::printf("%-10s device error %s, after re-arming %s\n", profile.name.c_str(), (failed == ResultTimedOut) ? "reported" : "lost",
+			((rearmed == ResultOk) && delivered) ? "sent" : "still failing");
+		if(failed != ResultTimedOut) { std::printf("outpacing: the device error was not reported, %d\n", failed); return 1; }
+		if((rearmed != ResultOk) || !delivered) { std::printf("outpacing: the port did not recover when re-armed, %d\n", rearmed); return 1; }
+		return 0;
+	}
+
+	int RunOutputPacing(const BenchArgs& args)
+	{
+		int r = 0;
+		if(!CheckProfileLookup()) r = 1;
+		MidiOutPacingProfile profile;
+		std::string spec = args.GetString("profile", "rate:31250;gap:20;outstanding:16");
+		if(ParsePacingProfile(spec, "", &profile) != ResultOk) { std::printf("outpacing: bad profile \"%s\"\n", spec.c_str()); return 1; }
+		int passes = (int)args.GetInt("passes", 8);
+		int sysexbytes = (int)args.GetInt("sysex", 256);
+		double bound = args.GetDouble("bound", 5000);
+		std::printf("%d passes of a %d byte SysEx, rate %.0f bytes/s, gap %lld ms, %d outstanding\n", passes, sysexbytes,
+			profile.bytesPerSecond, (long long)profile.sysexGap.count(), profile.maxOutstandingBytes);
+		for(bool concurrent : { true, false }) r |= CheckPacedSession(profile, concurrent, passes, sysexbytes, bound);
+		r |= CheckRecoverAfterDeviceError(profile);
+		return r;
+	}
+}
@@ -0,0 +1,150 @@
+//
+//  BenchPacing.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "BytePacer.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// the guest's receive FIFO, emptied at the line rate, counts the bytes that arrive to a full FIFO
+	struct UartModel
+	{
+		double bytesPerSecond;
+		double fifoSize;
+		double occupancy = 0;
+		double lastTime = 0;
+		uint64_t overrunBytes = 0;
+		double maxOccupancy = 0;
+		UartModel(double bitrate, int fifosize) : bytesPerSecond(bitrate / BytePacer::BitsPerByte), fifoSize(fifosize)
+		{
+		}
+		void Arrive(double t, size_t n)
+		{
+			occupancy = std::max(0.0, occupancy - (t - lastTime) * bytesPerSecond);
+			lastTime = t;
+			// a whole byte has to have left before the next one fits, allow for the rounding of the drain
+			double room = std::floor(fifoSize - occupancy + 1e-6);
+			if((double)n > room) { overrunBytes += (uint64_t)((double)n - std::max(room, 0.0)); occupancy = fifoSize; }
+			else occupancy += (double)n;
+			maxOccupancy = std::max(maxOccupancy, occupancy);
+		}
+	};
+
+	struct VirtualRun
+	{
+		uint64_t writes = 0;
+		uint64_t overrunBytes = 0;
+		double maxOccupancy = 0;
+		double lastDelivery = 0;
+	};
+
+	// drives the pacer exactly like MidiInPipeOut::Run() does, but on a virtual clock: the whole dump is staged at t=0
+	static VirtualRun RunVirtual(size_t total, double bitrate, int fifobytes, int uartfifo, bool paced)
+	{
+		using TimePoint = BytePacer::TimePoint;
+		VirtualRun result;
+		BytePacer pacer;
+		pacer.SetRate(paced ? bitrate : 0, fifobytes);
+		TimePoint origin{};
+		TimePoint vt = origin;
+		pacer.Reset(vt);
+		UartModel uart(bitrate, uartfifo);
+		size_t staged = total;
+		while(staged > 0)
+		{
+			size_t c = std::min<size_t>(staged, 4096);
+			c = std::min(c, pacer.GetAllowance(vt));
+			if(c == 0) { vt = pacer.GetNextSendTime(); continue; }
+			staged -= c;
+			pacer.Consume(c, vt);
+			double t = std::chrono::duration<double>(vt - origin).count();
+			uart.Arrive(t, c);
+			++result.writes;
+			result.lastDelivery = t;
+		}
+		result.overrunBytes = uart.overrunBytes;
+		result.maxOccupancy = uart.maxOccupancy;
+		return result;
+	}
+
+	// the real engine on the real clock, checks the achieved rate against the line rate
+	static int RunRealClock(size_t total, double bitrate, int fifobytes)
+	{
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		MidiInPipeOut m2p;
+		SerialPacing pacing;
+		pacing.bitRate = bitrate;
+		pacing.fifoBytes = fifobytes;
+		m2p.SetSerialPacing(pacing);
+		m2p.SetMidiInPort(&midiin);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> dump(total, 0x55);
+		dump.front() = 0xf0;
+		dump.back() = 0xf7;
+		std::atomic<uint64_t> received{ 0 };
+		std::thread reader([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(received < total)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				received += (uint64_t)cr;
+			}
+		});
+		Clock::time_point t0 = Clock::now();
+		for(size_t i = 0; i < total; i += 256) midiin.Inject(dump.data() + i, (int)std::min<size_t>(256, total - i));
+		double expected = (double)total * BytePacer::BitsPerByte / bitrate;
+		while((received < total) && (SecondsSince(t0) < expected * 2 + 1)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		double sec = SecondsSince(t0);
+		pipe.Close();
+		reader.join();
+		m2p.SetTransport(nullptr, false);
+		CoalesceStatistics st = m2p.GetCoalesceStatistics();
+		double rate = (sec > 0) ? (double)received * BytePacer::BitsPerByte / sec : 0;
+		std::printf("%-24s %8zu bytes %9.3f s (line %.3f s) %8.0f bps %6llu writes\n", "real clock", total, sec, expected, rate, (unsigned long long)st.flushCount);
+		if(received != total) { std::printf("pacing: %llu of %zu bytes\n", (unsigned long long)received.load(), total); return 1; }
+		// the pacer may finish early by at most its FIFO headroom, never faster than the line beyond that
+		double earliest = (double)(total - (size_t)fifobytes) * BytePacer::BitsPerByte / bitrate;
+		if(sec < earliest) { std::printf("pacing: faster than the line rate\n"); return 1; }
+		return 0;
+	}
+
+	int RunPacing(const BenchArgs& args)
+	{
+		size_t total = (size_t)args.GetInt("bytes", 64 * 1024);
+		double bitrate = args.GetDouble("bitrate", 31250);
+		int uartfifo = (int)args.GetInt("uartfifo", 16);
+		int r = 0;
+		struct { const char* label; bool paced; int fifobytes; } cases[] =
+		{
+			{ "unpaced", false, 1 },
+			{ "paced, 1 byte ahead", true, 1 },
+			{ "paced, FIFO ahead", true, uartfifo },
+		};
+		for(const auto& c : cases)
+		{
+			VirtualRun v = RunVirtual(total, bitrate, c.fifobytes, uartfifo, c.paced);
+			std::printf("%-24s %8zu bytes %8llu writes, last byte at %8.3f s, FIFO peak %5.1f, overrun %llu bytes\n",
+				c.label, total, (unsigned long long)v.writes, v.lastDelivery, v.maxOccupancy, (unsigned long long)v.overrunBytes);
+			if(c.paced && v.overrunBytes) { std::printf("pacing: %s overran the UART\n", c.label); r = 1; }
+		}
+		size_t realtotal = (size_t)args.GetInt("realbytes", 4096);
+		if(realtotal > 0) r |= RunRealClock(realtotal, bitrate, uartfifo);
+		return r;
+	}
+}
@@ -0,0 +1,287 @@
+//
+//  BenchPortSelect.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "MidiOutDispatcher.h"
+#include "PortSelect.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static constexpr int DemuxPorts = 4;	// the last one has no device behind it
+	static constexpr int OpenPorts = 3;
+
+	struct DemuxCase
+	{
+		std::vector<uint8_t> stream;
+		std::vector<std::vector<uint8_t> > expected;
+		size_t messages = 0;
+	};
+
+	// a guest that selects ports now and then, all of them, the unconnected one and one beyond the interface,
+	// and sometimes switches in the middle of a SysEx. what each device should get is written down as it goes
+	static DemuxCase MakeDemuxCase(size_t messages, uint32_t seed)
+	{
+		DemuxCase dc;
+		dc.expected.resize(OpenPorts);
+		std::mt19937 rng(seed);
+		uint8_t nn = 1;
+		auto targets = [](uint8_t v) { std::vector<int> t; if(v == 0) { for(int i = 0; i < OpenPorts; ++i) t.push_back(i); } else if(v <= OpenPorts) t.push_back(v - 1); return t; };
+		auto emit = [&](std::initializer_list<uint8_t> b)
+		{
+			dc.stream.insert(dc.stream.end(), b);
+			for(int t : targets(nn)) dc.expected[t].insert(dc.expected[t].end(), b);
+		};
+		auto pick = [&]() { const uint8_t choices[] = { 1, 1, 2, 2, 3, 3, 0, 4, 7 }; return choices[rng() % 9]; };
+		for(size_t i = 0; i < messages; ++i)
+		{
+			uint32_t k = rng() % 100;
+			if(k < 8)
+			{
+				nn = pick();
+				dc.stream.insert(dc.stream.end(), { 0xf5, nn });
+			}
+			else if(k < 10)
+			{
+				emit({ 0xf0, 0x41, 0x10 });
+				for(int j = 0; j < 20; ++j) emit({ (uint8_t)((i + j) & 0x7f) });
+				// cut short by a select to another port, whose device must not be left inside the SysEx
+				uint8_t next; do next = pick(); while(next == nn);
+				for(int t : targets(nn)) dc.expected[t].push_back(0xf7);
+				nn = next;
+				dc.stream.insert(dc.stream.end(), { 0xf5, nn });
+			}
+			else if(k < 14)
+			{
+				// longer than the dispatcher's buffer, so it reaches the device in several sends
+				emit({ 0xf0, 0x7e });
+				for(int j = 0; j < 300; ++j) emit({ (uint8_t)((i * 3 + j) & 0x7f) });
+				emit({ 0xf7 });
+			}
+			else if(k < 24)	emit({ 0xf8 });
+			else			emit({ (uint8_t)(0x90 | (i % 16)), (uint8_t)(i & 0x7f), (uint8_t)(1 + (i % 127)) });
+			++dc.messages;
+		}
+		return dc;
+	}
+
+	static int CheckDemux(size_t messages, bool zerocopy)
+	{
+		DemuxCase dc = MakeDemuxCase(messages, 2024);
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiOutPort midiouts[OpenPorts];
+		PortDemuxMidiOut demux(DemuxPorts);
+		for(int i = 0; i < OpenPorts; ++i) { midiouts[i].OpenDevice(); demux.SetPort(i, &midiouts[i]); }
+		PipeInMidiOut p2m;
+		// the demux lends no buffers, a zero-copy request falls back to copying
+		p2m.SetZeroCopyRead(zerocopy);
+		p2m.SetMidiOutPort(&demux);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		Clock::time_point t0 = Clock::now();
+		int cw = 0;
+		pipe.GuestEnd().Write(dc.stream.data(), (int)dc.stream.size(), &cw);
+		for(int i = 0; i < OpenPorts; ++i) midiouts[i].WaitForBytes(dc.expected[i].size(), std::chrono::seconds(20));
+		double sec = SecondsSince(t0);
+		p2m.SetTransport(nullptr, false);
+		p2m.SetMidiOutPort(nullptr);
+		bool ok = true;
+		uint64_t bytes = 0;
+		for(int i = 0; i < OpenPorts; ++i)
+		{
+			bytes += midiouts[i].GetByteCount();
+			if(midiouts[i].GetReceivedData() != dc.expected[i])
+			{
+				std::printf("demux: port %d got %zu bytes, %zu expected\n", i + 1, midiouts[i].GetReceivedData().size(), dc.expected[i].size());
+				ok = false;
+			}
+		}
+		std::printf("demux%s              %12llu bytes %10zu msgs %9.3f s, %llu selects, %llu messages unrouted%s\n", zerocopy ? " zerocopy" : "         ",
+			(unsigned long long)bytes, dc.messages, sec, (unsigned long long)demux.GetSelectCount(), (unsigned long long)demux.GetUnroutedCount(), ok ? "" : " MISMATCH");
+		return ok ? 0 : 1;
+	}
+
+	// what one device plays in: notes on its own channel, a clock now and then, and a SysEx delivered in three pieces
+	static std::vector<std::vector<uint8_t> > MakeMuxMessages(int port, size_t messages)
+	{
+		std::vector<std::vector<uint8_t> > v;
+		for(size_t i = 0; i < messages; ++i)
+		{
+			if((i % 7) == 0)		v.push_back({ 0xf8 });
+			else if((i % 40) == 3)
+			{
+				std::vector<uint8_t> sx = { 0xf0, 0x43, (uint8_t)(0x10 | port) };
+				for(int j = 0; j < 36; ++j) sx.push_back((uint8_t)((i + j) & 0x7f));
+				sx.push_back(0xf7);
+				v.push_back(std::vector<uint8_t>(sx.begin(), sx.begin() + 14));
+				v.push_back(std::vector<uint8_t>(sx.begin() + 14, sx.begin() + 28));
+				v.push_back(std::vector<uint8_t>(sx.begin() + 28, sx.end()));
+			}
+			else					v.push_back({ (uint8_t)(0x90 | port), (uint8_t)(i & 0x7f), (uint8_t)(1 + (i % 127)) });
+		}
+		return v;
+	}
+
+	static int CheckMux(size_t messages)
+	{
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiInPort midiins[OpenPorts];
+		PortMuxMidiIn mux(OpenPorts);
+		for(int i = 0; i < OpenPorts; ++i) { midiins[i].OpenDevice(); mux.SetPort(i, &midiins[i]); }
+		MidiInPipeOut m2p;
+		m2p.SetMidiInPort(&mux);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<std::vector<uint8_t> > expected(OpenPorts);
+		std::vector<std::vector<std::vector<uint8_t> > > sources(OpenPorts);
+		uint64_t realtime = 0;
+		for(int i = 0; i < OpenPorts; ++i)
+		{
+			sources[i] = MakeMuxMessages(i, messages);
+			for(const auto& m : sources[i])
+			{
+				if(m[0] == 0xf8) ++realtime;
+				else expected[i].insert(expected[i].end(), m.begin(), m.end());
+			}
+		}
+		std::vector<uint8_t> received;
+		std::atomic<uint64_t> receivedBytes{ 0 };
+		std::thread guest([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(1)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				received.insert(received.end(), buffer.begin(), buffer.begin() + cr);
+				receivedBytes += (uint64_t)cr;
+			}
+		});
+		// one thread per device like the drivers' callbacks, kept from overrunning the staging ring and the held messages
+		std::atomic<uint64_t> injected{ 0 };
+		Clock::time_point t0 = Clock::now();
+		std::vector<std::thread> devices;
+		for(int i = 0; i < OpenPorts; ++i)
+		{
+			devices.emplace_back([&, i]()
+			{
+				bool insysex = false;
+				for(const auto& m : sources[i])
+				{
+					if(!insysex)
+					{
+						while(mux.GetHeldBytes() > PortMuxMidiIn::MaxHeldBytes / 2) std::this_thread::yield();
+						while(injected.load() > m2p.GetStatistics().bytes + 16 * 1024) std::this_thread::yield();
+					}
+					while(!midiins[i].Inject(m.data(), (int)m.size())) std::this_thread::yield();
+					injected += m.size() + 2; // with a select, at most
+					std::this_thread::yield();
+					if(m[0] == 0xf0)			insysex = true;
+					else if(m.back() == 0xf7)	insysex = false;
+				}
+			});
+		}
+		for(auto& t : devices) t.join();
+		// every device has finished its SysEx, so nothing is held and the selects are all counted
+		uint64_t total = realtime + mux.GetSelectCount() * 2;
+		for(const auto& e : expected) total += e.size();
+		for(Clock::time_point t1 = Clock::now(); (receivedBytes.load() < total) && (SecondsSince(t1) < 20); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		double sec = SecondsSince(t0);
+		pipe.Close();
+		guest.join();
+		m2p.SetTransport(nullptr, false);
+		m2p.SetMidiInPort(nullptr);
+		// the guest's side: follow the selects, every SysEx must arrive whole
+		std::vector<std::vector<uint8_t> > got(OpenPorts);
+		uint64_t gotrealtime = 0;
+		bool broken = false;
+		int port = -1;
+		MidiFramer framer;
+		framer.Process(received.data(), (int)received.size(), [&](const MidiMessage& m)
+		{
+			if(m.kind == MidiMessageKind::RealTime) { ++gotrealtime; return; }
+			if((m.kind == MidiMessageKind::SystemCommon) && (m.data[0] == PortMuxMidiIn::PortSelectStatus)) { port = m.data[1] - 1; return; }
+			if((m.kind == MidiMessageKind::SysEx) && (m.sysexFlags & SysExEnd) && ((m.length == 0) || (m.data[m.length - 1] != 0xf7))) broken = true;
+			if((port < 0) || (port >= OpenPorts)) { broken = true; return; }
+			got[port].insert(got[port].end(), m.data, m.data + m.length);
+		});
+		bool ok = !broken && (gotrealtime == realtime) && (mux.GetDroppedBytes() == 0);
+		uint64_t bytes = 0;
+		for(int i = 0; i < OpenPorts; ++i)
+		{
+			bytes += expected[i].size();
+			if(got[i] != expected[i]) { std::printf("mux: port %d got %zu bytes, %zu expected\n", i + 1, got[i].size(), expected[i].size()); ok = false; }
+		}
+		std::printf("mux                     %12llu bytes %10zu msgs %9.3f s, %llu selects, %llu held bytes dropped%s%s\n",
+			(unsigned long long)received.size(), messages * OpenPorts, sec, (unsigned long long)mux.GetSelectCount(), (unsigned long long)mux.GetDroppedBytes(), broken ? " BROKEN SYSEX" : "", ok ? "" : " MISMATCH");
+		return ok ? 0 : 1;
+	}
+
+	struct DemuxCountingPort : public IMidiOutPort
+	{
+		uint64_t bytes = 0;
+		virtual bool IsDeviceOpen() const override { return true; }
+		virtual ResultCode Send(const uint8_t*, int c) override { bytes += (uint64_t)c; return ResultOk; }
+		virtual ResultCode SendShortMessage(uint32_t msg) override { bytes += (uint64_t)MidiFramer::GetShortMessageLength((uint8_t)msg); return ResultOk; }
+	};
+
+	// notes with a select every eighth message, a sequencer playing a rack a bar at a time would select far less often
+	static std::vector<uint8_t> MakeSelectingStream(size_t messages)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(messages * 3);
+		for(size_t i = 0; i < messages; ++i)
+		{
+			if((i % 8) == 0)	v.insert(v.end(), { 0xf5, (uint8_t)(1 + (i / 8) % DemuxPorts) });
+			else				v.insert(v.end(), { (uint8_t)(0x90 | (i % 16)), (uint8_t)(i & 0x7f), (uint8_t)(1 + (i % 127)) });
+		}
+		return v;
+	}
+
+	// framer and dispatcher straight into one port, then through the demux into several
+	static double TimeDispatch(IMidiOutPort* port, const std::vector<uint8_t>& stream, int passes)
+	{
+		double best = 1e9;
+		for(int pass = 0; pass < passes; ++pass)
+		{
+			MidiFramer framer;
+			MidiOutDispatcher dispatcher;
+			dispatcher.SetMidiOutPort(port);
+			Clock::time_point t0 = Clock::now();
+			framer.Process(stream.data(), (int)stream.size(), [&](const MidiMessage& m) { dispatcher.Dispatch(m); });
+			dispatcher.Flush();
+			best = std::min(best, SecondsSince(t0));
+		}
+		return best;
+	}
+
+	int RunPortSelect(const BenchArgs& args)
+	{
+		size_t messages = (size_t)args.GetInt("messages", 1000000);
+		int passes = (int)args.GetInt("passes", 5);
+		int r = 0;
+		std::vector<uint8_t> stream = MakeSelectingStream(messages);
+		DemuxCountingPort direct;
+		DemuxCountingPort counters[DemuxPorts];
+		PortDemuxMidiOut demux(DemuxPorts);
+		for(int i = 0; i < DemuxPorts; ++i) demux.SetPort(i, &counters[i]);
+		double directsec = TimeDispatch(&direct, stream, passes);
+		double demuxsec = TimeDispatch(&demux, stream, passes);
+		std::printf("direct                  %8.2f ns/msg\n", directsec * 1e9 / (double)messages);
+		std::printf("demux %d ports           %8.2f ns/msg   %+.2f ns over direct\n", DemuxPorts, demuxsec * 1e9 / (double)messages, (demuxsec - directsec) * 1e9 / (double)messages);
+		size_t enginemessages = (size_t)args.GetInt("enginemessages", 30000);
+		r |= CheckDemux(enginemessages, false);
+		r |= CheckDemux(enginemessages, true);
+		r |= CheckMux(enginemessages / OpenPorts);
+		return r;
+	}
+}
@@ -0,0 +1,180 @@
+//
+//  BenchPty.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+
+#if !defined(_WIN32)
+
+#include "FakePorts.h"
+#include "PtySession.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// channel messages with a SysEx now and then, the SysEx carries every data byte, so CR, LF, ^C, ^D, XON/XOFF and DEL all cross the line
+	static std::vector<std::vector<uint8_t> > MakeTtyMessages(int n)
+	{
+		std::vector<std::vector<uint8_t> > v;
+		for(int i = 0; i < n; ++i)
+		{
+			if((i % 100) == 50)
+			{
+				std::vector<uint8_t> sx = { 0xf0 };
+				for(int j = 0; j < 0x80; ++j) sx.push_back((uint8_t)((i + j) & 0x7f));
+				sx.push_back(0xf7);
+				v.push_back(sx);
+			}
+			else
+			{
+				v.push_back({ (uint8_t)(0x90 | (i & 0x0f)), (uint8_t)(i & 0x7f), (uint8_t)((i * 3) & 0x7f) });
+			}
+		}
+		return v;
+	}
+
+	static int OpenGuestTty(const std::string& path)
+	{
+		return open(path.c_str(), O_RDWR | O_NOCTTY);
+	}
+
+	// the guest plays the stream in random chunks while the device plays it back, both checked byte for byte
+	static int RunPtyTransfer(IPtySession& session, FakeMidiOutPort& midiout, FakeMidiInPort& midiin, MidiInPipeOut& m2p, int messages, uint32_t seed, const char* label)
+	{
+		int r = 0;
+		int guest = OpenGuestTty(session.GetSlavePath());
+		if(guest < 0) { std::printf("pty: failed to open %s\n", session.GetSlavePath().c_str()); return 1; }
+		midiout.Clear();
+		std::vector<std::vector<uint8_t> > msgs = MakeTtyMessages(messages);
+		std::vector<uint8_t> stream;
+		for(auto&& m : msgs) stream.insert(stream.end(), m.begin(), m.end());
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<bool> mismatch{ false };
+		Clock::time_point t0 = Clock::now();
+		std::thread writer([&]()
+		{
+			std::mt19937 rng(seed);
+			std::uniform_int_distribution<int> chunkdist(1, 64);
+			for(size_t i = 0; i < stream.size(); )
+			{
+				ssize_t n = write(guest, stream.data() + i, std::min<size_t>((size_t)chunkdist(rng), stream.size() - i));
+				if(n <= 0) break;
+				i += (size_t)n;
+			}
+		});
+		std::thread reader([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(received < stream.size())
+			{
+				ssize_t n = read(guest, buffer.data(), buffer.size());
+				if(n <= 0) break;
+				if(memcmp(buffer.data(), stream.data() + received, (size_t)n) != 0) mismatch = true;
+				received += (uint64_t)n;
+			}
+		});
+		for(auto&& m : msgs)
+		{
+			uint64_t dropped = m2p.GetOverrunBytes();
+			midiin.Inject(m.data(), (int)m.size());
+			while(m2p.GetOverrunBytes() != dropped) { dropped = m2p.GetOverrunBytes(); std::this_thread::yield(); midiin.Inject(m.data(), (int)m.size()); }
+		}
+		midiout.WaitForBytes(stream.size(), std::chrono::seconds(20));
+		for(Clock::time_point t1 = Clock::now(); (received < stream.size()) && (SecondsSince(t1) < 20); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		double sec = SecondsSince(t0);
+		writer.join();
+		// the session holds the slave open, so the reader is not woken by a hangup; a last byte ends its read
+		if(received < stream.size()) { const uint8_t b = 0xfe; midiin.Inject(&b, 1); }
+		reader.join();
+		close(guest);
+		PrintRate((std::string(label) + " guest->midi").c_str(), midiout.GetByteCount(), msgs.size(), sec);
+		PrintRate((std::string(label) + " midi->guest").c_str(), received, msgs.size(), sec);
+		if(midiout.GetReceivedData() != stream) { std::printf("pty: %s guest->midi data mismatch\n", label); r = 1; }
+		if((received != stream.size()) || mismatch) { std::printf("pty: %s midi->guest data mismatch\n", label); r = 1; }
+		return r;
+	}
+
+	int RunPty(const BenchArgs& args)
+	{
+		int r = 0;
+		int messages = (int)args.GetInt("messages", 20000);
+		uint32_t seed = (uint32_t)args.GetInt("seed", 1);
+		int pacedbytes = (int)args.GetInt("pacedbytes", 600);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		std::string link = args.GetString("link", "/tmp/bridgebench-" + std::to_string(getpid()) + ".tty");
+		std::unique_ptr<IPtySession> session = CreatePtySession(p2m, m2p, link);
+		if(!session->StartSession()) { std::printf("pty: failed to open a pty (%d)\n", session->GetSessionError()); return 1; }
+		char target[256] = {};
+		bool linked = (readlink(link.c_str(), target, sizeof(target) - 1) > 0) && (session->GetSlavePath() == target);
+		std::printf("pty: slave %s, link %s\n", session->GetSlavePath().c_str(), linked ? link.c_str() : "MISSING");
+		if(!linked) r = 1;
+		// raw mode lets every byte through, an emulator that closes and reopens the tty finds it still bridged
+		if(RunPtyTransfer(*session, midiout, midiin, m2p, messages, seed, "pty")) r = 1;
+		if(RunPtyTransfer(*session, midiout, midiin, m2p, messages / 4, seed + 1, "pty reopened")) r = 1;
+		// serial pacing applies to the tty like to a pipe: a 31250 bit/s line takes 320 usec per byte
+		SerialPacing pacing;
+		pacing.bitRate = 31250;
+		m2p.SetSerialPacing(pacing);
+		int guest = OpenGuestTty(session->GetSlavePath());
+		if(guest >= 0)
+		{
+			std::vector<uint8_t> paced = MakeChannelMessageStream((size_t)pacedbytes - (size_t)pacedbytes % 3);
+			Clock::time_point t0 = Clock::now();
+			for(size_t i = 0; i < paced.size(); i += 3) midiin.Inject(paced.data() + i, 3);
+			std::vector<uint8_t> got(paced.size());
+			size_t n = 0;
+			while(n < got.size())
+			{
+				ssize_t c = read(guest, got.data() + n, got.size() - n);
+				if(c <= 0) break;
+				n += (size_t)c;
+			}
+			double sec = SecondsSince(t0);
+			double expected = (double)paced.size() * 10 / pacing.bitRate;
+			bool ok = (got == paced) && (sec >= expected * 0.9);
+			std::printf("pty paced: %zu bytes in %.1f ms, the line needs %.1f ms: %s\n", paced.size(), sec * 1e3, expected * 1e3, ok ? "ok" : "FAILED");
+			if(!ok) r = 1;
+			close(guest);
+		}
+		else
+		{
+			std::printf("pty: failed to reopen the slave\n");
+			r = 1;
+		}
+		session->StopSession();
+		if(access(link.c_str(), F_OK) == 0) { std::printf("pty: the link outlived the session\n"); r = 1; }
+		return r;
+	}
+}
+
+#else
+
+namespace BridgeBench
+{
+	int RunPty(const BenchArgs&)
+	{
+		std::printf("pty: the pty session is not built on Windows\n");
+		return 0;
+	}
+}
+
+#endif
@@ -0,0 +1,301 @@
+//
+//  BenchReactor.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+
+#if defined(__linux__)
+
+#include "FakePorts.h"
+#include "PosixTransport.h"
+#include "ReactorBridge.h"
+#include "SocketSession.h"
+#include "TransferEngine.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static uint64_t GetContextSwitches()
+	{
+		rusage ru = {};
+		getrusage(RUSAGE_SELF, &ru);
+		return (uint64_t)ru.ru_nvcsw + (uint64_t)ru.ru_nivcsw;
+	}
+
+	static bool ReadGuest(int fd, uint8_t* p, size_t c)
+	{
+		for(size_t i = 0; i < c; )
+		{
+			ssize_t n = read(fd, p + i, c - i);
+			if(n <= 0) return false;
+			i += (size_t)n;
+		}
+		return true;
+	}
+
+	struct RoundTripResult
+	{
+		LatencyHistogramSnapshot latency;
+		double switchesPerTrip = 0;
+		bool ok = false;
+	};
+
+	// the guest sends a note, the MIDI out hands it to the MIDI in, and the guest waits for it to come back
+	static RoundTripResult MeasureRoundTrip(int guest, int count)
+	{
+		RoundTripResult result;
+		LatencyHistogram histogram;
+		uint64_t cs0 = GetContextSwitches();
+		bool ok = true;
+		for(int i = 0; ok && (i < count); ++i)
+		{
+			const uint8_t msg[3] = { (uint8_t)(0x90 | (i & 0x0f)), (uint8_t)(i & 0x7f), 0x40 };
+			uint8_t echo[3] = {};
+			Clock::time_point t0 = Clock::now();
+			ok = (write(guest, msg, 3) == 3) && ReadGuest(guest, echo, 3) && (memcmp(msg, echo, 3) == 0);
+			histogram.Record(Clock::now() - t0);
+		}
+		result.switchesPerTrip = (double)(GetContextSwitches() - cs0) / (double)count;
+		result.latency = histogram.GetSnapshot();
+		result.ok = ok;
+		return result;
+	}
+
+	static void PrintRoundTrip(const char* label, const RoundTripResult& r)
+	{
+		std::printf("%-24s p50 %6.1f p99 %6.1f usec, %.2f context switches per round trip\n", label,
+			r.latency.GetPercentileNs(50) / 1e3, r.latency.GetPercentileNs(99) / 1e3, r.switchesPerTrip);
+	}
+
+	static RoundTripResult RunThreadedRoundTrip(int count)
+	{
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return RoundTripResult();
+		SetNonBlocking(sv[0]);
+		PollTransport transport(true);
+		transport.SetFd(sv[0]);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(false);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		midiout.OnSend = [&](const uint8_t* p, int c) { midiin.Inject(p, c); return ResultOk; };
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		CoalescePolicy policy;
+		policy.flushDelay = std::chrono::microseconds(0);
+		m2p.SetCoalescePolicy(policy);
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		p2m.SetTransport(&transport, true);
+		m2p.SetTransport(&transport, true);
+		RoundTripResult r = MeasureRoundTrip(sv[1], count);
+		p2m.SetTransport(nullptr, false);
+		m2p.SetTransport(nullptr, false);
+		close(sv[0]);
+		close(sv[1]);
+		return r;
+	}
+
+	static RoundTripResult RunReactorRoundTrip(Reactor& reactor, int count)
+	{
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return RoundTripResult();
+		SetNonBlocking(sv[0]);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(false);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		midiout.OnSend = [&](const uint8_t* p, int c) { midiin.Inject(p, c); return ResultOk; };
+		ReactorBridge bridge(reactor);
+		bridge.SetMidiOutPort(&midiout);
+		bridge.SetMidiInPort(&midiin);
+		bridge.SetConnection(sv[0], true);
+		RoundTripResult r = MeasureRoundTrip(sv[1], count);
+		bridge.SetConnection(-1, false);
+		close(sv[0]);
+		close(sv[1]);
+		return r;
+	}
+
+	// one guest of many, plays its stream in while the device plays the same stream back
+	struct ReactorGuest
+	{
+		int sv[2] = { -1, -1 };
+		FakeMidiOutPort midiout;
+		FakeMidiInPort midiin;
+		std::unique_ptr<ReactorBridge> bridge;
+		std::vector<uint8_t> stream;
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<bool> mismatch{ false };
+	};
+
+	static int RunManyBridges(Reactor& reactor, int bridges, size_t total)
+	{
+		int r = 0;
+		std::vector<std::unique_ptr<ReactorGuest> > guests;
+		for(int i = 0; i < bridges; ++i)
+		{
+			auto g = std::make_unique<ReactorGuest>();
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, g->sv) != 0) return 1;
+			SetNonBlocking(g->sv[0]);
+			g->midiout.OpenDevice();
+			g->midiin.OpenDevice();
+			g->bridge = std::make_unique<ReactorBridge>(reactor);
+			g->bridge->SetMidiOutPort(&g->midiout);
+			g->bridge->SetMidiInPort(&g->midiin);
+			g->bridge->SetConnection(g->sv[0], true);
+			g->stream = MakeChannelMessageStream(total);
+			for(size_t j = 0; j < g->stream.size(); j += 3) g->stream[j] = (uint8_t)((g->stream[j] & 0xf0) | (i & 0x0f));
+			guests.push_back(std::move(g));
+		}
+		uint64_t wakes0 = reactor.GetWakeCount();
+		Clock::time_point t0 = Clock::now();
+		std::vector<std::thread> threads;
+		for(auto&& g : guests)
+		{
+			ReactorGuest* pg = g.get();
+			threads.emplace_back([pg]()
+			{
+				for(size_t i = 0; i < pg->stream.size(); )
+				{
+					ssize_t n = write(pg->sv[1], pg->stream.data() + i, std::min<size_t>(4096, pg->stream.size() - i));
+					if(n <= 0) break;
+					i += (size_t)n;
+				}
+			});
+			threads.emplace_back([pg]()
+			{
+				std::vector<uint8_t> buffer(4096);
+				while(pg->received < pg->stream.size())
+				{
+					ssize_t n = read(pg->sv[1], buffer.data(), buffer.size());
+					if(n <= 0) break;
+					if(memcmp(buffer.data(), pg->stream.data() + pg->received, (size_t)n) != 0) pg->mismatch = true;
+					pg->received += (uint64_t)n;
+				}
+			});
+		}
+		// the devices play round robin, a full staging ring is retried like the statistics scenario does
+		for(size_t j = 0; j < total; j += 3)
+		{
+			for(auto&& g : guests)
+			{
+				uint64_t dropped = g->bridge->GetOverrunBytes();
+				g->midiin.Inject(g->stream.data() + j, 3);
+				while(g->bridge->GetOverrunBytes() != dropped) { dropped = g->bridge->GetOverrunBytes(); std::this_thread::yield(); g->midiin.Inject(g->stream.data() + j, 3); }
+			}
+		}
+		for(auto&& g : guests)
+		{
+			g->midiout.WaitForBytes(total, std::chrono::seconds(20));
+			for(Clock::time_point t1 = Clock::now(); (g->received < total) && (SecondsSince(t1) < 20); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		double sec = SecondsSince(t0);
+		for(auto&& g : guests) shutdown(g->sv[1], SHUT_RDWR);
+		for(auto&& t : threads) t.join();
+		uint64_t bytes = 0;
+		uint64_t wakes = 0;
+		for(int i = 0; i < bridges; ++i)
+		{
+			ReactorGuest& g = *guests[i];
+			bytes += g.midiout.GetByteCount() + g.received;
+			wakes += g.bridge->GetWakeCount();
+			if(g.midiout.GetReceivedData() != g.stream) { std::printf("reactor: bridge %d guest->midi data mismatch\n", i); r = 1; }
+			if((g.received != total) || g.mismatch) { std::printf("reactor: bridge %d midi->guest data mismatch\n", i); r = 1; }
+			g.bridge->SetConnection(-1, false);
+			close(g.sv[0]);
+			close(g.sv[1]);
+		}
+		char label[64];
+		std::snprintf(label, sizeof(label), "%d bridges, 1 thread", bridges);
+		PrintRate(label, bytes, bytes / 3, sec);
+		std::printf("reactor: %llu epoll wake-ups, %llu of them for %llu MIDI in messages\n",
+			(unsigned long long)(reactor.GetWakeCount() - wakes0), (unsigned long long)wakes, (unsigned long long)(total / 3 * (uint64_t)bridges));
+		return r;
+	}
+
+	// the accept and the disconnect on the reactor, then a second guest on the same listener
+	static int RunReactorServer(Reactor& reactor, const std::string& address)
+	{
+		int r = 0;
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(false);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		midiout.OnSend = [&](const uint8_t* p, int c) { midiin.Inject(p, c); return ResultOk; };
+		ReactorBridge bridge(reactor);
+		bridge.SetMidiOutPort(&midiout);
+		bridge.SetMidiInPort(&midiin);
+		std::unique_ptr<IPipeSession> server = CreateSocketServer(address, bridge);
+		if(!server->StartSession()) { std::printf("reactor: failed to listen on %s (%d)\n", address.c_str(), server->GetSessionError()); return 1; }
+		for(int pass = 0; pass < 2; ++pass)
+		{
+			sockaddr_un un = {};
+			un.sun_family = AF_UNIX;
+			std::string path = address.substr(5);
+			memcpy(un.sun_path, path.c_str(), path.size() + 1);
+			int guest = socket(AF_UNIX, SOCK_STREAM, 0);
+			if((guest < 0) || (connect(guest, reinterpret_cast<const sockaddr*>(&un), sizeof(un)) != 0)) { std::printf("reactor: failed to connect\n"); r = 1; break; }
+			RoundTripResult rt = MeasureRoundTrip(guest, 200);
+			close(guest);
+			if(!rt.ok) { std::printf("reactor: server pass %d lost a message\n", pass); r = 1; }
+			// the server has to see the hangup before the next guest is accepted
+			for(Clock::time_point t0 = Clock::now(); (bridge.GetConnection() >= 0) && (SecondsSince(t0) < 5); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		server->StopSession();
+		BridgeStatistics st = bridge.GetStatistics();
+		std::printf("reactor server: %llu connects, %llu messages echoed: %s\n", (unsigned long long)st.pipeToMidi.connects,
+			(unsigned long long)st.pipeToMidi.messages, ((r == 0) && (st.pipeToMidi.connects == 2)) ? "ok" : "FAILED");
+		if(st.pipeToMidi.connects != 2) r = 1;
+		return r;
+	}
+
+	int RunReactor(const BenchArgs& args)
+	{
+		int r = 0;
+		int count = (int)args.GetInt("count", 5000);
+		int bridges = (int)args.GetInt("bridges", 8);
+		size_t total = (size_t)args.GetInt("bytes", 3 * 20000);
+		total -= total % 3;
+		Reactor reactor;
+		if(!reactor.Start()) { std::printf("reactor: failed to start\n"); return 1; }
+		// two engine threads against the reactor thread, the guest's own switches are in both numbers
+		RoundTripResult threaded = RunThreadedRoundTrip(count);
+		RoundTripResult evented = RunReactorRoundTrip(reactor, count);
+		PrintRoundTrip("threaded engines", threaded);
+		PrintRoundTrip("reactor", evented);
+		if(!threaded.ok || !evented.ok) { std::printf("reactor: round trip lost or changed a message\n"); r = 1; }
+		if(RunManyBridges(reactor, bridges, total)) r = 1;
+		if(RunReactorServer(reactor, "unix:" + args.GetString("path", "/tmp/bridgebench-reactor-" + std::to_string(getpid()) + ".sock"))) r = 1;
+		reactor.Stop();
+		return r;
+	}
+}
+
+#else
+
+namespace BridgeBench
+{
+	int RunReactor(const BenchArgs&)
+	{
+		std::printf("reactor: the epoll reactor is only built on Linux\n");
+		return 0;
+	}
+}
+
+#endif
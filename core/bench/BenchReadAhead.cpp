@@ -0,0 +1,122 @@
+//
+//  BenchReadAhead.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <thread>
+
+#if !defined(_WIN32)
+#include "PosixTransport.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// every read completes only after a delay, the role of the overlapped ReadFile() round trip
+	class LatentTransport : public ITransport
+	{
+	private:
+		ITransport& inner;
+		std::chrono::microseconds latency;
+	public:
+		LatentTransport(ITransport& t, std::chrono::microseconds l) : inner(t), latency(l) {}
+		virtual ResultCode Read(uint8_t* p, int c, int* cr) override
+		{
+			ResultCode r = inner.Read(p, c, cr);
+			if(!ResultIsError(r) && (latency.count() > 0)) std::this_thread::sleep_for(latency);
+			return r;
+		}
+		virtual ResultCode Write(const uint8_t* p, int c, int* cw) override { return inner.Write(p, c, cw); }
+		virtual void SetReadCancelled(bool v) override { inner.SetReadCancelled(v); }
+		virtual void SetWriteCancelled(bool v) override { inner.SetWriteCancelled(v); }
+		virtual bool IsBrokenPipe(ResultCode r) const override { return inner.IsBrokenPipe(r); }
+	};
+
+	// SysEx dumps, so a 256 byte read turns into one or two long sends
+	static std::vector<uint8_t> MakeDumpStream(size_t n)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(n);
+		while(v.size() + 2 <= n)
+		{
+			size_t c = std::min<size_t>(300, n - v.size());
+			v.push_back(0xf0);
+			for(size_t i = 1; i + 1 < c; ++i) v.push_back((uint8_t)((v.size() * 5) & 0x7f));
+			v.push_back(0xf7);
+		}
+		return v;
+	}
+
+	struct ReadAheadResult
+	{
+		double sec = 0;
+		uint64_t bytes = 0;
+		LatencyHistogramSnapshot latency;
+		bool matched = false;
+	};
+
+	static ReadAheadResult RunReadAheadOnce(int k, const std::vector<uint8_t>& stream, std::chrono::microseconds readlatency, std::chrono::microseconds sendcost)
+	{
+		ReadAheadResult result;
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.OnSend = [sendcost](const uint8_t*, int) { if(sendcost.count() > 0) std::this_thread::sleep_for(sendcost); return ResultOk; };
+#if !defined(_WIN32)
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return result;
+		SetNonBlocking(sv[0]);
+		PollTransport host(true);
+		host.SetFd(sv[0]);
+		auto guestwrite = [&]() { for(size_t i = 0; i < stream.size(); ) { ssize_t n = write(sv[1], stream.data() + i, stream.size() - i); if(n <= 0) break; i += (size_t)n; } };
+#else
+		MemoryPipe pipe(64 * 1024);
+		ITransport& host = pipe.HostEnd();
+		auto guestwrite = [&]() { int cw = 0; pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw); };
+#endif
+		LatentTransport transport(host, readlatency);
+		PipeInMidiOut p2m;
+		p2m.SetReadAhead(k);
+		p2m.SetMidiOutPort(&midiout);
+		Clock::time_point t0 = Clock::now();
+		p2m.SetTransport(&transport, false);
+		std::thread writer(guestwrite);
+		midiout.WaitForBytes(stream.size(), std::chrono::seconds(30));
+		result.sec = SecondsSince(t0);
+		writer.join();
+		p2m.SetTransport(nullptr, false);
+#if !defined(_WIN32)
+		close(sv[0]);
+		close(sv[1]);
+#endif
+		result.bytes = midiout.GetByteCount();
+		result.latency = p2m.GetStatistics().readToSendLatency;
+		result.matched = midiout.GetReceivedData() == stream;
+		return result;
+	}
+
+	int RunReadAhead(const BenchArgs& args)
+	{
+		int r = 0;
+		size_t total = (size_t)args.GetInt("bytes", 64 * 1024);
+		std::chrono::microseconds readlatency((int64_t)args.GetInt("readlatency", 50));
+		std::chrono::microseconds sendcost((int64_t)args.GetInt("sendcost", 50));
+		std::vector<uint8_t> stream = MakeDumpStream(total);
+		std::printf("%zu bytes of SysEx, %lld usec per read completion, %lld usec per send\n", stream.size(), (long long)readlatency.count(), (long long)sendcost.count());
+		for(int k : { 1, 2, 4, 8 })
+		{
+			ReadAheadResult rr = RunReadAheadOnce(k, stream, readlatency, sendcost);
+			std::printf("K=%d %12llu bytes %9.3f s %10.3f MB/s, read->send p50 %8.1f p99 %8.1f usec%s\n", k, (unsigned long long)rr.bytes, rr.sec,
+				(rr.sec > 0) ? (double)rr.bytes / rr.sec / 1e6 : 0.0, rr.latency.GetPercentileNs(50) / 1e3, rr.latency.GetPercentileNs(99) / 1e3, rr.matched ? "" : " MISMATCH");
+			if(!rr.matched) r = 1;
+		}
+		return r;
+	}
+}
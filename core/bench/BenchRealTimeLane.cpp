@@ -0,0 +1,277 @@
+//
+//  BenchRealTimeLane.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "PortSelect.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32)
+
+#include "PosixTransport.h"
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static std::vector<uint8_t> MakeBulkDump(size_t n)
+	{
+		std::vector<uint8_t> v(std::max<size_t>(n, 2));
+		v.front() = 0xf0;
+		for(size_t i = 1; i + 1 < v.size(); ++i) v[i] = (uint8_t)((i * 7) & 0x7f);
+		v.back() = 0xf7;
+		return v;
+	}
+
+	struct ClockDelayResult
+	{
+		LatencyHistogramSnapshot delay;
+		uint64_t clocks = 0;
+		uint64_t arrived = 0;
+		uint64_t laneSends = 0;
+		bool dumpIntact = false;
+	};
+
+	// a guest that writes a bulk dump as fast as the pipe takes it and plays a MIDI clock beside it,
+	// the device drains long messages at the given rate. the delay of each clock byte is taken from the guest's write to the device
+	static ClockDelayResult RunClockUnderDump(bool lane, int readahead, const std::vector<uint8_t>& dump, double bytespersecond, std::chrono::microseconds interval)
+	{
+		ClockDelayResult result;
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return result;
+		SetNonBlocking(sv[0]);
+		PollTransport host(true);
+		host.SetFd(sv[0]);
+		std::mutex mutex;
+		std::vector<Clock::time_point> sent;
+		std::vector<Clock::time_point> arrived;
+		std::vector<uint8_t> data;
+		sent.reserve(4096);
+		arrived.reserve(4096);
+		data.reserve(dump.size());
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(false);
+		midiout.OnSend = [&](const uint8_t* p, int c)
+		{
+			if((c == 1) && (p[0] == 0xf8))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				arrived.push_back(Clock::now());
+				return ResultOk;
+			}
+			std::this_thread::sleep_for(std::chrono::duration<double>((double)c / bytespersecond));
+			std::lock_guard<std::mutex> lock(mutex);
+			data.insert(data.end(), p, p + c);
+			return ResultOk;
+		};
+		PipeInMidiOut p2m;
+		p2m.SetReadAhead(readahead);
+		p2m.SetRealTimeLane(lane);
+		p2m.SetMidiOutPort(&midiout);
+		p2m.SetTransport(&host, false);
+		std::atomic<bool> dumpdone{ false };
+		std::thread dumper([&]()
+		{
+			for(size_t i = 0; i < dump.size(); ) { ssize_t n = write(sv[1], dump.data() + i, dump.size() - i); if(n <= 0) break; i += (size_t)n; }
+		});
+		std::thread clock([&]()
+		{
+			const uint8_t f8 = 0xf8;
+			Clock::time_point next = Clock::now();
+			while(!dumpdone)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					sent.push_back(Clock::now());
+				}
+				if(write(sv[1], &f8, 1) != 1) break;
+				next += interval;
+				std::this_thread::sleep_until(next);
+			}
+		});
+		for(Clock::time_point t0 = Clock::now(); SecondsSince(t0) < 60; )
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(data.size() >= dump.size()) break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		dumpdone = true;
+		clock.join();
+		dumper.join();
+		for(Clock::time_point t0 = Clock::now(); SecondsSince(t0) < 10; )
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(arrived.size() >= sent.size()) break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		p2m.SetTransport(nullptr, false);
+		close(sv[0]);
+		close(sv[1]);
+		std::lock_guard<std::mutex> lock(mutex);
+		LatencyHistogram histogram;
+		for(size_t i = 0; i < std::min(sent.size(), arrived.size()); ++i) histogram.Record(arrived[i] - sent[i]);
+		result.delay = histogram.GetSnapshot();
+		result.clocks = sent.size();
+		result.arrived = arrived.size();
+		result.laneSends = p2m.GetStatistics().laneSends;
+		result.dumpIntact = data == dump;
+		return result;
+	}
+
+	// real-time in and around SysEx on two ports: whatever the lane sends ahead, each device must get its own bytes in order
+	// and every real-time byte of its selection, none of them may slip past a select onto the other port
+	static int CheckLaneAcrossPortSelects(int passes)
+	{
+		std::vector<uint8_t> stream;
+		std::vector<uint8_t> expected[2];
+		uint64_t expectedrt[2] = {};
+		for(int k = 0; k < passes; ++k)
+		{
+			int port = k % 2;
+			stream.insert(stream.end(), { 0xf5, (uint8_t)(port + 1), 0xf0, 0x43 });
+			expected[port].insert(expected[port].end(), { 0xf0, 0x43 });
+			for(int j = 0; j < 4000; ++j)
+			{
+				if((j % 100) == 0) { stream.push_back(0xf8); ++expectedrt[port]; }
+				uint8_t b = (uint8_t)((k + j) & 0x7f);
+				stream.push_back(b);
+				expected[port].push_back(b);
+			}
+			stream.insert(stream.end(), { 0xf7, 0x90, (uint8_t)(k & 0x7f), 0x40, 0xf8, 0xfe });
+			expected[port].insert(expected[port].end(), { 0xf7, 0x90, (uint8_t)(k & 0x7f), 0x40 });
+			expectedrt[port] += 2;
+		}
+		MemoryPipe pipe(16 * 1024);
+		FakeMidiOutPort devices[2];
+		std::mutex mutex;
+		std::vector<uint8_t> received[2];
+		uint64_t receivedrt[2] = {};
+		for(int i = 0; i < 2; ++i)
+		{
+			devices[i].OpenDevice();
+			devices[i].SetCaptureEnabled(false);
+			devices[i].OnSend = [&, i](const uint8_t* p, int c)
+			{
+				if(c > 1) std::this_thread::sleep_for(std::chrono::microseconds(20));
+				std::lock_guard<std::mutex> lock(mutex);
+				if((c == 1) && MidiFramer::IsRealTime(p[0]))	++receivedrt[i];
+				else											received[i].insert(received[i].end(), p, p + c);
+				return ResultOk;
+			};
+		}
+		PortDemuxMidiOut demux(2);
+		demux.SetPort(0, &devices[0]);
+		demux.SetPort(1, &devices[1]);
+		PipeInMidiOut p2m;
+		// a ring shorter than a SysEx, so there are stretches with no select waiting in it
+		p2m.SetReadAhead(8);
+		p2m.SetRealTimeLane(true);
+		p2m.SetMidiOutPort(&demux);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		int cw = 0;
+		pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+		uint64_t total = stream.size();
+		for(Clock::time_point t0 = Clock::now(); (p2m.GetStatistics().pipeReadBytes < total) && (SecondsSince(t0) < 30); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		devices[0].WaitForBytes(expected[0].size() + expectedrt[0], std::chrono::seconds(10));
+		devices[1].WaitForBytes(expected[1].size() + expectedrt[1], std::chrono::seconds(10));
+		pipe.Close();
+		p2m.SetTransport(nullptr, false);
+		PipeInMidiOutStatistics st = p2m.GetStatistics();
+		std::printf("lane across selects %10zu bytes, %llu real-time messages, %llu sent ahead\n", stream.size(),
+			(unsigned long long)(expectedrt[0] + expectedrt[1]), (unsigned long long)st.laneSends);
+		std::lock_guard<std::mutex> lock(mutex);
+		int r = 0;
+		for(int i = 0; i < 2; ++i)
+		{
+			if(received[i] != expected[i]) { std::printf("rtlane: port %d data mismatch\n", i + 1); r = 1; }
+			if(receivedrt[i] != expectedrt[i]) { std::printf("rtlane: port %d got %llu real-time messages, expected %llu\n", i + 1, (unsigned long long)receivedrt[i], (unsigned long long)expectedrt[i]); r = 1; }
+		}
+		if(st.laneSends == 0) { std::printf("rtlane: nothing was sent ahead\n"); r = 1; }
+		return r;
+	}
+
+	// without a SysEx in the way nothing is sent ahead: a stop after the note-offs still queued for a slow device stays after them
+	static int CheckLaneBehindChannelMessages(int passes)
+	{
+		std::vector<uint8_t> stream;
+		for(int k = 0; k < passes; ++k)
+		{
+			stream.push_back(0xfa);
+			for(int j = 0; j < 128; ++j) stream.insert(stream.end(), { (uint8_t)(0x80 | (j & 0x0f)), (uint8_t)j, 0x40 });
+			stream.insert(stream.end(), { 0xf8, 0xfc });
+		}
+		MemoryPipe pipe(16 * 1024);
+		FakeMidiOutPort device;
+		device.OpenDevice();
+		device.OnSend = [](const uint8_t*, int c)
+		{
+			if(c > 1) std::this_thread::sleep_for(std::chrono::microseconds(20));
+			return ResultOk;
+		};
+		PipeInMidiOut p2m;
+		p2m.SetReadAhead(8);
+		p2m.SetRealTimeLane(true);
+		p2m.SetMidiOutPort(&device);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		int cw = 0;
+		pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+		device.WaitForBytes(stream.size(), std::chrono::seconds(10));
+		pipe.Close();
+		p2m.SetTransport(nullptr, false);
+		PipeInMidiOutStatistics st = p2m.GetStatistics();
+		bool ok = device.GetReceivedData() == stream;
+		std::printf("lane behind notes  %10zu bytes, %llu sent ahead%s\n", stream.size(), (unsigned long long)st.laneSends, ok ? "" : " OUT OF ORDER");
+		return ok ? 0 : 1;
+	}
+
+	int RunRealTimeLane(const BenchArgs& args)
+	{
+		int r = 0;
+		std::vector<uint8_t> dump = MakeBulkDump((size_t)args.GetInt("bytes", 64 * 1024));
+		double rate = args.GetDouble("rate", 128 * 1024);
+		std::chrono::microseconds interval((int64_t)args.GetInt("interval", 2000));
+		int readahead = (int)args.GetInt("readahead", PipeInMidiOut::MaxReadAhead);
+		double bound = args.GetDouble("bound", 10000);
+		std::printf("%zu byte SysEx drained at %.0f bytes/s, a clock every %lld usec, read-ahead %d\n", dump.size(), rate, (long long)interval.count(), readahead);
+		for(bool lane : { false, true })
+		{
+			ClockDelayResult cr = RunClockUnderDump(lane, readahead, dump, rate, interval);
+			std::printf("lane %-3s  clock delay p50 %9.1f p99 %9.1f max %9.1f usec, %llu/%llu clocks, %llu sent ahead%s\n", lane ? "on" : "off",
+				cr.delay.GetPercentileNs(50) / 1e3, cr.delay.GetPercentileNs(99) / 1e3, cr.delay.maxNs / 1e3,
+				(unsigned long long)cr.arrived, (unsigned long long)cr.clocks, (unsigned long long)cr.laneSends, cr.dumpIntact ? "" : " DUMP MISMATCH");
+			if(!cr.dumpIntact || (cr.arrived != cr.clocks) || (cr.clocks == 0)) r = 1;
+			if(lane && ((double)cr.delay.GetPercentileNs(99) / 1e3 > bound)) { std::printf("rtlane: p99 clock delay over %.0f usec with the lane\n", bound); r = 1; }
+		}
+		if(CheckLaneAcrossPortSelects((int)args.GetInt("passes", 40))) r = 1;
+		if(CheckLaneBehindChannelMessages((int)args.GetInt("passes", 40))) r = 1;
+		return r;
+	}
+}
+
+#else
+
+namespace BridgeBench
+{
+	int RunRealTimeLane(const BenchArgs&)
+	{
+		std::printf("rtlane: the scenario drives a socket pair, it is not built on Windows\n");
+		return 0;
+	}
+}
+
+#endif
@@ -0,0 +1,420 @@
+//
+//  BenchReplay.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "FlightRecorder.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// one message of a trace, the time is relative to the first message
+	struct ReplayEvent
+	{
+		int64_t timeNs = 0;
+		FlightDirection direction = FlightDirection::PipeToMidi;
+		std::vector<uint8_t> data;
+	};
+
+	// ================================================================================
+	// trace sources
+
+	static bool LoadFlightLog(const std::filesystem::path& path, std::vector<ReplayEvent>& events)
+	{
+		FlightLogReader reader;
+		if(ResultIsError(reader.Open(path))) return false;
+		reader.ForEach([&](const FlightRecordView& v)
+		{
+			ReplayEvent e;
+			e.timeNs = v.timestamp;
+			e.direction = v.direction;
+			e.data = v.data;
+			events.push_back(std::move(e));
+		});
+		// the writers of both directions reserve their records independently, so the log is only nearly in time order
+		std::stable_sort(events.begin(), events.end(), [](const ReplayEvent& a, const ReplayEvent& b) { return a.timeNs < b.timeNs; });
+		if(!events.empty()) { int64_t t0 = events.front().timeNs; for(auto&& e : events) e.timeNs -= t0; }
+		return true;
+	}
+
+	static bool ReadVarLen(const uint8_t*& p, const uint8_t* end, uint32_t* v)
+	{
+		*v = 0;
+		for(int i = 0; i < 4; ++i)
+		{
+			if(p >= end) return false;
+			uint8_t b = *p++;
+			*v = (*v << 7) | (b & 0x7f);
+			if(!(b & 0x80)) return true;
+		}
+		return false;
+	}
+
+	static uint32_t ReadBE(const uint8_t* p, int c)
+	{
+		uint32_t v = 0;
+		for(int i = 0; i < c; ++i) v = (v << 8) | p[i];
+		return v;
+	}
+
+	// format 0 and 1, all tracks merged, the tempo map applies to every track, meta events are not replayed
+	static bool LoadStandardMidiFile(const std::filesystem::path& path, FlightDirection direction, std::vector<ReplayEvent>& events)
+	{
+		std::ifstream ifs(path, std::ios::binary);
+		std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		if((file.size() < 14) || (memcmp(file.data(), "MThd", 4) != 0)) return false;
+		uint32_t ntracks = ReadBE(&file[10], 2);
+		uint32_t division = ReadBE(&file[12], 2);
+		struct TickEvent { uint64_t tick; size_t order; std::vector<uint8_t> data; };
+		std::vector<TickEvent> tickevents;
+		std::vector<std::pair<uint64_t, uint32_t> > tempomap; // tick, usec per quarter note
+		size_t pos = 8 + ReadBE(&file[4], 4);
+		for(uint32_t track = 0; (track < ntracks) && (pos + 8 <= file.size()); ++track)
+		{
+			uint32_t length = ReadBE(&file[pos + 4], 4);
+			bool ismtrk = memcmp(&file[pos], "MTrk", 4) == 0;
+			const uint8_t* p = &file[pos + 8];
+			const uint8_t* end = &file[std::min(file.size(), pos + 8 + (size_t)length)];
+			pos += 8 + (size_t)length;
+			if(!ismtrk) continue;
+			uint64_t tick = 0;
+			uint8_t status = 0;
+			while(p < end)
+			{
+				uint32_t delta = 0;
+				if(!ReadVarLen(p, end, &delta) || (p >= end)) break;
+				tick += delta;
+				if(*p >= 0x80) status = *p++;
+				if(status == 0xff)
+				{
+					if(p >= end) break;
+					uint8_t type = *p++;
+					uint32_t c = 0;
+					if(!ReadVarLen(p, end, &c) || (p + c > end)) break;
+					if((type == 0x51) && (c == 3)) tempomap.push_back({ tick, ReadBE(p, 3) });
+					if(type == 0x2f) break;
+					p += c;
+					status = 0;
+				}
+				else if((status == 0xf0) || (status == 0xf7))
+				{
+					// F0 carries a SysEx without its F0, F7 is an escape whose bytes go out as they are
+					uint32_t c = 0;
+					if(!ReadVarLen(p, end, &c) || (p + c > end)) break;
+					TickEvent e{ tick, tickevents.size(), {} };
+					if(status == 0xf0) e.data.push_back(0xf0);
+					e.data.insert(e.data.end(), p, p + c);
+					if(!e.data.empty()) tickevents.push_back(std::move(e));
+					p += c;
+					status = 0;
+				}
+				else if(status >= 0x80)
+				{
+					int c = MidiFramer::GetShortMessageLength(status) - 1;
+					if(p + c > end) break;
+					TickEvent e{ tick, tickevents.size(), { status } };
+					e.data.insert(e.data.end(), p, p + c);
+					tickevents.push_back(std::move(e));
+					p += c;
+				}
+				else break;
+			}
+		}
+		std::stable_sort(tickevents.begin(), tickevents.end(), [](const TickEvent& a, const TickEvent& b) { return a.tick < b.tick; });
+		std::stable_sort(tempomap.begin(), tempomap.end());
+		// ticks to time through the tempo map, an SMPTE division has a fixed tick length
+		bool smpte = (division & 0x8000) != 0;
+		double smptetick = smpte ? 1e9 / ((double)(256 - (division >> 8)) * (double)(division & 0xff)) : 0.0;
+		double ppq = smpte ? 1.0 : (double)std::max<uint32_t>(division, 1);
+		size_t ti = 0;
+		uint64_t lasttick = 0;
+		double lastns = 0;
+		uint32_t tempo = 500000;
+		for(auto&& te : tickevents)
+		{
+			if(smpte) lastns = (double)te.tick * smptetick;
+			else
+			{
+				for(; (ti < tempomap.size()) && (tempomap[ti].first <= te.tick); ++ti)
+				{
+					lastns += (double)(tempomap[ti].first - lasttick) * tempo * 1e3 / ppq;
+					lasttick = tempomap[ti].first;
+					tempo = tempomap[ti].second;
+				}
+				lastns += (double)(te.tick - lasttick) * tempo * 1e3 / ppq;
+				lasttick = te.tick;
+			}
+			ReplayEvent e;
+			e.timeNs = (int64_t)lastns;
+			e.direction = direction;
+			e.data = std::move(te.data);
+			events.push_back(std::move(e));
+		}
+		return true;
+	}
+
+	// ================================================================================
+	// the built-in trace, a half second of a busy session
+
+	static std::vector<ReplayEvent> MakeSessionTrace()
+	{
+		std::vector<ReplayEvent> events;
+		auto add = [&](double msec, FlightDirection d, std::vector<uint8_t> data) { events.push_back({ (int64_t)(msec * 1e6), d, std::move(data) }); };
+		const FlightDirection p2m = FlightDirection::PipeToMidi, m2p = FlightDirection::MidiToPipe;
+		// the guest's sequencer: clock at 120 bpm, four-note chords, a volume sweep, a patch dump
+		for(double t = 0; t < 500; t += 500.0 / 24) add(t, p2m, { 0xf8 });
+		for(int i = 0; i < 10; ++i)
+		{
+			for(int k = 0; k < 4; ++k) add(i * 50.0, p2m, { 0x90, (uint8_t)(48 + i + k * 4), 100 });
+			for(int k = 0; k < 4; ++k) add(i * 50.0 + 40, p2m, { 0x80, (uint8_t)(48 + i + k * 4), 0 });
+		}
+		for(int i = 0; i < 100; ++i) add(i * 5.0, p2m, { 0xb0, 7, (uint8_t)(i & 0x7f) });
+		std::vector<uint8_t> dump = { 0xf0, 0x41, 0x10, 0x42, 0x12 };
+		for(int i = 0; i < 2048; ++i) dump.push_back((uint8_t)(i & 0x7f));
+		dump.push_back(0xf7);
+		add(200, p2m, dump);
+		// the player's keyboard: notes, active sensing, a knob turned fast, a bulk reply
+		for(int i = 0; i < 16; ++i)
+		{
+			add(i * 30.0, m2p, { 0x90, (uint8_t)(60 + i), 80 });
+			add(i * 30.0 + 20, m2p, { 0x80, (uint8_t)(60 + i), 0 });
+		}
+		for(double t = 0; t < 500; t += 300) add(t, m2p, { 0xfe });
+		for(int i = 0; i < 64; ++i) add(300, m2p, { 0xb0, 74, (uint8_t)(i * 2) });
+		std::vector<uint8_t> reply = { 0xf0, 0x7e, 0x00, 0x06, 0x02 };
+		for(int i = 0; i < 1024; ++i) reply.push_back((uint8_t)((i * 7) & 0x7f));
+		reply.push_back(0xf7);
+		add(400, m2p, reply);
+		std::stable_sort(events.begin(), events.end(), [](const ReplayEvent& a, const ReplayEvent& b) { return a.timeNs < b.timeNs; });
+		return events;
+	}
+
+	static void WriteVarLen(std::vector<uint8_t>& v, uint32_t n)
+	{
+		uint8_t b[4];
+		int c = 0;
+		do { b[c++] = (uint8_t)(n & 0x7f); n >>= 7; } while(n && (c < 4));
+		while(c > 0) { --c; v.push_back((uint8_t)(b[c] | (c ? 0x80 : 0))); }
+	}
+
+	// format 1, a tempo track and one event track, 480 ticks per quarter at 120 bpm
+	static void WriteStandardMidiFile(const std::filesystem::path& path, const std::vector<ReplayEvent>& events, FlightDirection direction)
+	{
+		const double ticksperns = 960.0 / 1e9;
+		std::vector<uint8_t> tempo = { 0x00, 0xff, 0x51, 0x03, 0x07, 0xa1, 0x20, 0x00, 0xff, 0x2f, 0x00 };
+		std::vector<uint8_t> track;
+		uint64_t lasttick = 0;
+		for(auto&& e : events)
+		{
+			if(e.direction != direction) continue;
+			uint64_t tick = (uint64_t)((double)e.timeNs * ticksperns + 0.5);
+			WriteVarLen(track, (uint32_t)(tick - lasttick));
+			lasttick = tick;
+			if(e.data[0] == 0xf0)
+			{
+				track.push_back(0xf0);
+				WriteVarLen(track, (uint32_t)e.data.size() - 1);
+				track.insert(track.end(), e.data.begin() + 1, e.data.end());
+			}
+			else if(MidiFramer::IsRealTime(e.data[0]))
+			{
+				track.push_back(0xf7);
+				WriteVarLen(track, (uint32_t)e.data.size());
+				track.insert(track.end(), e.data.begin(), e.data.end());
+			}
+			else track.insert(track.end(), e.data.begin(), e.data.end());
+		}
+		for(uint8_t b : { 0x00, 0xff, 0x2f, 0x00 }) track.push_back(b);
+		std::vector<uint8_t> file = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0x01, 0xe0 };
+		for(const std::vector<uint8_t>* t : { &tempo, &track })
+		{
+			uint32_t c = (uint32_t)t->size();
+			const uint8_t hdr[8] = { 'M', 'T', 'r', 'k', (uint8_t)(c >> 24), (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c };
+			file.insert(file.end(), hdr, hdr + 8);
+			file.insert(file.end(), t->begin(), t->end());
+		}
+		std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+	}
+
+	// ================================================================================
+	// replay
+
+	// the far end of one direction, the bridge keeps the byte order so an event has arrived once the count passes its end
+	struct ReplayLane
+	{
+		std::vector<uint64_t> endOffsets;
+		std::vector<Clock::time_point> sentTimes;
+		uint64_t sentBytes = 0;
+		std::atomic<uint64_t> receivedBytes{ 0 };
+		size_t arrived = 0;
+		LatencyHistogram latency;
+		void OnReceived(int c)
+		{
+			uint64_t total = receivedBytes.fetch_add((uint64_t)c) + (uint64_t)c;
+			Clock::time_point now = Clock::now();
+			for(; (arrived < endOffsets.size()) && (endOffsets[arrived] <= total); ++arrived) latency.Record(now - sentTimes[arrived]);
+		}
+	};
+
+	struct ReplayResult
+	{
+		double sec = 0;
+		uint64_t events[2] = {};
+		uint64_t sentBytes[2] = {};
+		uint64_t receivedBytes[2] = {};
+		uint64_t overrunBytes = 0;
+		LatencyHistogramSnapshot latency[2];
+		LatencyHistogramSnapshot lateness;
+	};
+
+	// speed 0 replays as fast as the bridge takes it
+	static ReplayResult Replay(const std::vector<ReplayEvent>& events, double speed)
+	{
+		ReplayResult result;
+		ReplayLane lanes[2];
+		for(auto&& e : events)
+		{
+			ReplayLane& lane = lanes[(int)e.direction];
+			lane.sentBytes += e.data.size();
+			lane.endOffsets.push_back(lane.sentBytes);
+		}
+		for(auto&& lane : lanes) lane.sentTimes.resize(lane.endOffsets.size());
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.OnSend = [&lanes](const uint8_t*, int c) { lanes[0].OnReceived(c); return ResultOk; };
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::thread guest([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(1)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				lanes[1].OnReceived(cr);
+			}
+		});
+		LatencyHistogram lateness;
+		PreciseTimer timer;
+		size_t index[2] = {};
+		// a little lead so the first events are not already late
+		Clock::time_point t0 = Clock::now() + ((speed > 0) ? std::chrono::milliseconds(10) : std::chrono::milliseconds(0));
+		for(auto&& e : events)
+		{
+			if(speed > 0)
+			{
+				Clock::time_point due = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds((int64_t)((double)e.timeNs / speed)));
+				timer.SleepUntil(due);
+				lateness.Record(Clock::now() - due);
+			}
+			int d = (int)e.direction;
+			lanes[d].sentTimes[index[d]++] = Clock::now();
+			if(e.direction == FlightDirection::PipeToMidi)
+			{
+				int cw = 0;
+				pipe.GuestEnd().Write(e.data.data(), (int)e.data.size(), &cw);
+			}
+			else midiin.Inject(e.data.data(), (int)e.data.size());
+		}
+		// what has not arrived once both directions have been quiet for a while is lost
+		uint64_t seen = ~(uint64_t)0;
+		for(Clock::time_point quiet = Clock::now(); SecondsSince(quiet) < 0.5; std::this_thread::sleep_for(std::chrono::milliseconds(1)))
+		{
+			uint64_t now = lanes[0].receivedBytes + lanes[1].receivedBytes;
+			if(now != seen) { seen = now; quiet = Clock::now(); }
+			if((lanes[0].receivedBytes == lanes[0].sentBytes) && (lanes[1].receivedBytes == lanes[1].sentBytes)) break;
+		}
+		result.sec = SecondsSince(t0);
+		pipe.Close();
+		guest.join();
+		p2m.SetTransport(nullptr, false);
+		m2p.SetTransport(nullptr, false);
+		for(int d = 0; d < 2; ++d)
+		{
+			result.events[d] = lanes[d].endOffsets.size();
+			result.sentBytes[d] = lanes[d].sentBytes;
+			result.receivedBytes[d] = lanes[d].receivedBytes;
+			result.latency[d] = lanes[d].latency.GetSnapshot();
+		}
+		result.overrunBytes = m2p.GetOverrunBytes();
+		result.lateness = lateness.GetSnapshot();
+		return result;
+	}
+
+	static int PrintReplay(const char* label, double speed, const ReplayResult& rr, bool allowloss)
+	{
+		int r = 0;
+		if(speed > 0)	std::printf("%s at %gx:\n", label, speed);
+		else			std::printf("%s at full speed:\n", label);
+		static const char* names[2] = { "pipe->midi", "midi->pipe" };
+		for(int d = 0; d < 2; ++d)
+		{
+			if(rr.events[d] == 0) continue;
+			uint64_t lost = rr.sentBytes[d] - std::min(rr.sentBytes[d], rr.receivedBytes[d]);
+			std::printf("  %s %7llu events %9llu bytes, %6llu lost, latency p50 %8.1f p99 %8.1f max %8.1f usec\n", names[d],
+				(unsigned long long)rr.events[d], (unsigned long long)rr.sentBytes[d], (unsigned long long)lost,
+				rr.latency[d].GetPercentileNs(50) / 1e3, rr.latency[d].GetPercentileNs(99) / 1e3, (double)rr.latency[d].maxNs / 1e3);
+			if((lost > 0) && !allowloss) r = 1;
+		}
+		if(rr.overrunBytes) std::printf("  %llu bytes overran the MIDI in staging ring\n", (unsigned long long)rr.overrunBytes);
+		if(speed > 0) std::printf("  %.3f s, the replay ran behind its schedule by p50 %.1f p99 %.1f usec\n", rr.sec, rr.lateness.GetPercentileNs(50) / 1e3, rr.lateness.GetPercentileNs(99) / 1e3);
+		else std::printf("  %.3f s\n", rr.sec);
+		return r;
+	}
+
+	int RunReplay(const BenchArgs& args)
+	{
+		int r = 0;
+		bool allowloss = args.GetInt("allowloss", 0) != 0;
+		std::vector<ReplayEvent> events;
+		if(args.Has("log") || args.Has("smf"))
+		{
+			bool loaded = args.Has("log")
+				? LoadFlightLog(args.GetString("log", ""), events)
+				: LoadStandardMidiFile(args.GetString("smf", ""), (args.GetString("smfdir", "p2m") == "m2p") ? FlightDirection::MidiToPipe : FlightDirection::PipeToMidi, events);
+			if(!loaded) { std::printf("cannot load the trace\n"); return 1; }
+			double speed = args.GetDouble("speed", 1);
+			return PrintReplay(args.Has("log") ? "flight log" : "standard MIDI file", speed, Replay(events, speed), allowloss);
+		}
+		// the built-in session goes through both file formats first, so the loaders are checked as well
+		std::vector<ReplayEvent> session = MakeSessionTrace();
+		std::filesystem::path dir = std::filesystem::temp_directory_path();
+		std::filesystem::path logpath = dir / "bridgebench-replay.flight";
+		std::filesystem::path smfpath = dir / "bridgebench-replay.mid";
+		{
+			FlightRecorder recorder;
+			recorder.Open(logpath, FlightRecorder::MinCapacity);
+			Clock::time_point base = Clock::now();
+			for(auto&& e : session) recorder.Record(e.direction, e.data.data(), (int)e.data.size(), base + std::chrono::nanoseconds(e.timeNs));
+		}
+		WriteStandardMidiFile(smfpath, session, FlightDirection::PipeToMidi);
+		std::vector<ReplayEvent> fromlog, fromsmf;
+		bool logok = LoadFlightLog(logpath, fromlog) && (fromlog.size() == session.size());
+		bool smfok = LoadStandardMidiFile(smfpath, FlightDirection::PipeToMidi, fromsmf)
+			&& (fromsmf.size() == (size_t)std::count_if(session.begin(), session.end(), [](const ReplayEvent& e) { return e.direction == FlightDirection::PipeToMidi; }));
+		std::filesystem::remove(logpath);
+		std::filesystem::remove(smfpath);
+		std::printf("session trace: %zu events, %zu read back from a flight log, %zu pipe->midi events from a standard MIDI file\n", session.size(), fromlog.size(), fromsmf.size());
+		if(!logok || !smfok) { std::printf("a trace did not survive its file format\n"); r = 1; }
+		for(double speed : { 1.0, 10.0, 0.0 }) r |= PrintReplay("flight log", speed, Replay(fromlog, speed), allowloss);
+		r |= PrintReplay("standard MIDI file", 2.0, Replay(fromsmf, 2.0), allowloss);
+		return r;
+	}
+}
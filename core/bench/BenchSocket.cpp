@@ -0,0 +1,204 @@
+//
+//  BenchSocket.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+
+#if !defined(_WIN32)
+
+#include "FakePorts.h"
+#include "SocketSession.h"
+#include "Statistics.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// the guest side is a plain blocking socket, as a VM's serial backend would be
+	static int ConnectGuest(const std::string& address)
+	{
+		int fd = -1;
+		if(address.compare(0, 4, "tcp:") == 0)
+		{
+			std::string hostport = address.substr(4);
+			size_t pos = hostport.rfind(':');
+			addrinfo hints = {};
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			addrinfo* ai = nullptr;
+			if(getaddrinfo(hostport.substr(0, pos).c_str(), hostport.substr(pos + 1).c_str(), &hints, &ai) != 0) return -1;
+			fd = socket(ai->ai_family, SOCK_STREAM, 0);
+			if((fd >= 0) && (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)) { close(fd); fd = -1; }
+			freeaddrinfo(ai);
+			int v = 1;
+			if(fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v));
+			return fd;
+		}
+		sockaddr_un un = {};
+		un.sun_family = AF_UNIX;
+		std::string path = address.substr(5);
+		memcpy(un.sun_path, path.c_str(), path.size() + 1);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if((fd >= 0) && (connect(fd, reinterpret_cast<const sockaddr*>(&un), sizeof(un)) != 0)) { close(fd); fd = -1; }
+		return fd;
+	}
+
+	static bool ReadFully(int fd, uint8_t* p, size_t c)
+	{
+		for(size_t i = 0; i < c; )
+		{
+			ssize_t n = recv(fd, p + i, c - i, 0);
+			if(n <= 0) return false;
+			i += (size_t)n;
+		}
+		return true;
+	}
+
+	// both directions at once through a SocketServer, every byte is checked on arrival
+	static int RunSocketThroughput(const std::string& address, size_t total)
+	{
+		int r = 0;
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		std::unique_ptr<IPipeSession> server = CreateSocketServer(address, p2m, m2p);
+		if(!server->StartSession()) { std::printf("socket: failed to listen on %s (%d)\n", address.c_str(), server->GetSessionError()); return 1; }
+		int guest = ConnectGuest(address);
+		if(guest < 0) { std::printf("socket: failed to connect to %s\n", address.c_str()); server->StopSession(); return 1; }
+		// the connect returns out of the listen backlog, what the driver delivers before the server has accepted goes nowhere
+		for(Clock::time_point t1 = Clock::now(); !m2p.IsRunning() && (SecondsSince(t1) < 5); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::vector<uint8_t> stream = MakeChannelMessageStream(total);
+		std::atomic<uint64_t> received{ 0 };
+		std::atomic<bool> mismatch{ false };
+		Clock::time_point t0 = Clock::now();
+		std::thread writer([&]()
+		{
+			for(size_t i = 0; i < total; )
+			{
+				ssize_t n = send(guest, stream.data() + i, std::min<size_t>(4096, total - i), MSG_NOSIGNAL);
+				if(n <= 0) break;
+				i += (size_t)n;
+			}
+		});
+		std::thread reader([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(received < total)
+			{
+				ssize_t n = recv(guest, buffer.data(), buffer.size(), 0);
+				if(n <= 0) break;
+				if(memcmp(buffer.data(), stream.data() + received, (size_t)n) != 0) mismatch = true;
+				received += (uint64_t)n;
+			}
+		});
+		// the driver callback must not run ahead of the writer's queue, a full queue is retried like the statistics scenario does
+		for(size_t i = 0; i < total; i += 3)
+		{
+			uint64_t dropped = m2p.GetOverrunBytes();
+			midiin.Inject(stream.data() + i, 3);
+			while(m2p.GetOverrunBytes() != dropped) { dropped = m2p.GetOverrunBytes(); std::this_thread::yield(); midiin.Inject(stream.data() + i, 3); }
+		}
+		midiout.WaitForBytes(total, std::chrono::seconds(20));
+		for(Clock::time_point t1 = Clock::now(); (received < total) && (SecondsSince(t1) < 20); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		double sec = SecondsSince(t0);
+		writer.join();
+		shutdown(guest, SHUT_RDWR);
+		reader.join();
+		close(guest);
+		server->StopSession();
+		std::string label = address.substr(0, address.find(':'));
+		PrintRate((label + " guest->midi").c_str(), midiout.GetByteCount(), midiout.GetByteCount() / 3, sec);
+		PrintRate((label + " midi->guest").c_str(), received, received / 3, sec);
+		if(midiout.GetReceivedData() != stream) { std::printf("socket: %s guest->midi data mismatch\n", label.c_str()); r = 1; }
+		if((received != total) || mismatch) { std::printf("socket: %s midi->guest data mismatch\n", label.c_str()); r = 1; }
+		return r;
+	}
+
+	// a note goes out through the MIDI out, comes back in on the MIDI in and returns to the guest
+	static int RunSocketRoundTrip(const std::string& address, int count)
+	{
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(false);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		midiout.OnSend = [&](const uint8_t* p, int c) { midiin.Inject(p, c); return ResultOk; };
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		CoalescePolicy policy;
+		policy.flushDelay = std::chrono::microseconds(0);
+		m2p.SetCoalescePolicy(policy);
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		std::unique_ptr<IPipeSession> server = CreateSocketServer(address, p2m, m2p);
+		if(!server->StartSession()) { std::printf("socket: failed to listen on %s (%d)\n", address.c_str(), server->GetSessionError()); return 1; }
+		int guest = ConnectGuest(address);
+		if(guest < 0) { std::printf("socket: failed to connect to %s\n", address.c_str()); server->StopSession(); return 1; }
+		LatencyHistogram histogram;
+		bool ok = true;
+		for(int i = 0; ok && (i < count); ++i)
+		{
+			const uint8_t msg[3] = { (uint8_t)(0x90 | (i & 0x0f)), (uint8_t)(i & 0x7f), 0x40 };
+			uint8_t echo[3] = {};
+			Clock::time_point t0 = Clock::now();
+			ok = (send(guest, msg, 3, MSG_NOSIGNAL) == 3) && ReadFully(guest, echo, 3) && (memcmp(msg, echo, 3) == 0);
+			histogram.Record(Clock::now() - t0);
+		}
+		shutdown(guest, SHUT_RDWR);
+		close(guest);
+		server->StopSession();
+		LatencyHistogramSnapshot h = histogram.GetSnapshot();
+		std::printf("%-24s n=%llu p50 %.1f p99 %.1f max %.1f usec\n", (address.substr(0, address.find(':')) + " round trip").c_str(),
+			(unsigned long long)h.count, h.GetPercentileNs(50) / 1e3, h.GetPercentileNs(99) / 1e3, h.maxNs / 1e3);
+		if(!ok) { std::printf("socket: round trip lost or changed a message\n"); return 1; }
+		return 0;
+	}
+
+	int RunSocket(const BenchArgs& args)
+	{
+		int r = 0;
+		size_t total = (size_t)args.GetInt("bytes", 3 * 100000);
+		total -= total % 3;
+		int count = (int)args.GetInt("count", 2000);
+		std::string unixaddr = "unix:" + args.GetString("path", "/tmp/bridgebench-" + std::to_string(getpid()) + ".sock");
+		std::string tcpaddr = "tcp:127.0.0.1:" + std::to_string(args.GetInt("port", 20000 + getpid() % 20000));
+		for(const std::string& address : { unixaddr, tcpaddr })
+		{
+			if(RunSocketThroughput(address, total)) r = 1;
+			if(RunSocketRoundTrip(address, count)) r = 1;
+		}
+		return r;
+	}
+}
+
+#else
+
+namespace BridgeBench
+{
+	int RunSocket(const BenchArgs&)
+	{
+		std::printf("socket: the socket sessions are not built on Windows\n");
+		return 0;
+	}
+}
+
+#endif
@@ -0,0 +1,116 @@
+//
+//  BenchStatistics.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "Statistics.h"
+#include "TransferEngine.h"
+#include <atomic>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static void PrintLatency(const char* label, const LatencyHistogramSnapshot& h)
+	{
+		std::printf("  %-26s n=%llu mean %.1f usec, p50 %.1f p99 %.1f p99.9 %.1f max %.1f usec\n", label, (unsigned long long)h.count,
+			h.GetMeanNs() / 1e3, h.GetPercentileNs(50) / 1e3, h.GetPercentileNs(99) / 1e3, h.GetPercentileNs(99.9) / 1e3, h.maxNs / 1e3);
+	}
+
+	static void PrintStatistics(const BridgeStatistics& st)
+	{
+		const PipeInMidiOutStatistics& p = st.pipeToMidi;
+		std::printf("pipe->midi: %llu reads, %llu bytes, %llu messages, %llu short / %llu long sends, %llu discarded, low water %lld, %llu connects\n",
+			(unsigned long long)p.pipeReadCalls, (unsigned long long)p.pipeReadBytes, (unsigned long long)p.messages,
+			(unsigned long long)p.shortSends, (unsigned long long)p.longSends, (unsigned long long)p.discardedBytes,
+			(long long)p.bufferLowWater, (unsigned long long)p.connects);
+		PrintLatency("read -> send returned", p.readToSendLatency);
+		const MidiInPipeOutStatistics& m = st.midiToPipe;
+		std::printf("midi->pipe: %llu messages, %llu bytes, %llu writes, %llu dropped, %llu connects\n",
+			(unsigned long long)m.messages, (unsigned long long)m.bytes, (unsigned long long)m.pipeWriteCalls,
+			(unsigned long long)m.droppedBytes, (unsigned long long)m.connects);
+		PrintLatency("callback -> write done", m.callbackToWriteLatency);
+	}
+
+	int RunStatistics(const BenchArgs& args)
+	{
+		int r = 0;
+		// what the instrumentation costs on the hot path
+		{
+			uint64_t n = (uint64_t)args.GetInt("count", 10000000);
+			RelaxedCounter counter;
+			Clock::time_point t0 = Clock::now();
+			for(uint64_t i = 0; i < n; ++i) counter.Add();
+			double sec = SecondsSince(t0);
+			LatencyHistogram histogram;
+			Clock::time_point t1 = Clock::now();
+			for(uint64_t i = 0; i < n; ++i) histogram.Record(std::chrono::nanoseconds((i * 2654435761u) & 0xfffff));
+			double sec2 = SecondsSince(t1);
+			std::printf("counter add %.2f ns, histogram record %.2f ns (%llu samples)\n", sec * 1e9 / (double)n, sec2 * 1e9 / (double)n, (unsigned long long)histogram.GetSnapshot().count);
+		}
+		// a session in each direction, the snapshot is taken while traffic flows and again at the end
+		size_t total = (size_t)args.GetInt("bytes", 3 * 100000);
+		total -= total % 3;
+		MemoryPipe pipe(64 * 1024);
+		FakeQueuedMidiOutPort midiout(16, 256);
+		midiout.OpenDevice();
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		PipeInMidiOut p2m;
+		MidiInPipeOut m2p;
+		p2m.SetMidiOutPort(&midiout);
+		m2p.SetMidiInPort(&midiin);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> stream = MakeChannelMessageStream(total);
+		std::atomic<uint64_t> received{ 0 };
+		std::thread guest([&]()
+		{
+			int cw = 0;
+			pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+			std::vector<uint8_t> buffer(4096);
+			while(received < total)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				received += (uint64_t)cr;
+			}
+		});
+		for(size_t i = 0; i < total; i += 3)
+		{
+			uint64_t dropped = m2p.GetOverrunBytes();
+			midiin.Inject(stream.data() + i, 3);
+			while(m2p.GetOverrunBytes() != dropped) { dropped = m2p.GetOverrunBytes(); std::this_thread::yield(); midiin.Inject(stream.data() + i, 3); }
+		}
+		midiout.WaitForBytes(total, std::chrono::seconds(10));
+		for(Clock::time_point t0 = Clock::now(); (received < total) && (SecondsSince(t0) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		BridgeStatistics st;
+		st.pipeToMidi = p2m.GetStatistics();
+		st.midiToPipe = m2p.GetStatistics();
+		// stray EOX bytes are discarded, a reset counts them again from 0
+		static const uint8_t stray[] = { 0xf7, 0xf7, 0xf7 };
+		int cw = 0;
+		pipe.GuestEnd().Write(stray, 2, &cw);
+		for(Clock::time_point t0 = Clock::now(); (p2m.GetDiscardedBytes() < 2) && (SecondsSince(t0) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		p2m.ResetStatistics();
+		pipe.GuestEnd().Write(stray + 2, 1, &cw);
+		for(Clock::time_point t0 = Clock::now(); (p2m.GetDiscardedBytes() < 1) && (SecondsSince(t0) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		if(p2m.GetDiscardedBytes() != 1) { std::printf("statistics: %llu bytes discarded after the reset, 1 expected\n", (unsigned long long)p2m.GetDiscardedBytes()); r = 1; }
+		pipe.Close();
+		guest.join();
+		p2m.SetTransport(nullptr, false);
+		m2p.SetTransport(nullptr, false);
+		PrintStatistics(st);
+		uint64_t messages = total / 3;
+		if(st.pipeToMidi.pipeReadBytes != total || st.pipeToMidi.messages != messages || st.pipeToMidi.shortSends != messages) { std::printf("statistics: pipe->midi counters do not add up\n"); r = 1; }
+		if(st.pipeToMidi.readToSendLatency.count != st.pipeToMidi.pipeReadCalls) { std::printf("statistics: pipe->midi latency samples do not match the reads\n"); r = 1; }
+		if(st.midiToPipe.bytes != total || st.midiToPipe.messages != messages || st.midiToPipe.callbackToWriteLatency.count != messages) { std::printf("statistics: midi->pipe counters do not add up\n"); r = 1; }
+		return r;
+	}
+}
@@ -0,0 +1,225 @@
+//
+//  BenchStreamOut.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "MidiFramer.h"
+#include "StreamEventBatcher.h"
+#include <algorithm>
+#include <random>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	using StreamTimePoint = StreamEventBatcher::TimePoint;
+
+	// a message as the guest meant it and as the pipe delivered it
+	struct StreamCaseMessage
+	{
+		StreamTimePoint intended;
+		StreamTimePoint arrival;
+		std::vector<uint8_t> bytes;
+	};
+
+	// an event as the driver plays it
+	struct PlayedEvent
+	{
+		StreamTimePoint played;
+		std::vector<uint8_t> bytes;
+	};
+
+	// a guest playing notes every 5 ms with a MIDI clock at 120 BPM and a few patch dumps, through a host that wakes every
+	// timer quantum: what the guest sent during a quantum arrives at its end, give or take some scheduling noise
+	static std::vector<StreamCaseMessage> MakeStreamCase(StreamTimePoint t0, std::chrono::microseconds length, std::chrono::microseconds quantum, int sysexbytes, uint32_t seed)
+	{
+		std::vector<StreamCaseMessage> v;
+		for(std::chrono::microseconds t{ 0 }; t < length; t += std::chrono::microseconds(5000))
+		{
+			uint8_t k = (uint8_t)(v.size() & 0x7f);
+			v.push_back({ t0 + t, {}, { 0x90, k, (uint8_t)(((k & 1) ? 0x20 : 0x60)) } });
+		}
+		for(std::chrono::microseconds t{ 0 }; t < length; t += std::chrono::microseconds(20833)) v.push_back({ t0 + t, {}, { 0xf8 } });
+		// the middle one is longer than the latency lets the line carry
+		for(int j = 1; j <= 3; ++j)
+		{
+			std::vector<uint8_t> dump = { 0xf0, 0x43, 0x00, 0x09 };
+			for(int i = 0; i < sysexbytes * ((j == 2) ? 3 : 1); ++i) dump.push_back((uint8_t)((i * j) & 0x7f));
+			dump.push_back(0xf7);
+			v.push_back({ t0 + length * j / 4 + std::chrono::microseconds(2500), {}, dump });
+		}
+		std::stable_sort(v.begin(), v.end(), [](const StreamCaseMessage& a, const StreamCaseMessage& b) { return a.intended < b.intended; });
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> noise(0, 499);
+		StreamTimePoint last = t0;
+		for(auto& m : v)
+		{
+			auto s = m.intended - t0;
+			auto q = std::chrono::duration_cast<StreamTimePoint::duration>(quantum);
+			m.arrival = std::max(last, t0 + (s + q - StreamTimePoint::duration(1)) / q * q + std::chrono::microseconds(noise(rng)));
+			last = m.arrival;
+		}
+		return v;
+	}
+
+	// walks a batch like the driver: each event plays at its tick, or when the batch got there if that is later
+	static bool PlayStreamBatch(const StreamEventBatcher& batcher, const std::vector<uint32_t>& words, StreamTimePoint handed, int64_t* tick, std::vector<PlayedEvent>* played)
+	{
+		for(size_t i = 0; i < words.size(); )
+		{
+			if(i + StreamEventBatcher::EventHeaderWords > words.size()) return false;
+			*tick += words[i];
+			uint32_t event = words[i + 2];
+			i += StreamEventBatcher::EventHeaderWords;
+			StreamTimePoint t = std::max(batcher.FromTick(*tick), handed);
+			if(event & StreamEventBatcher::EventLongMessage)
+			{
+				size_t n = event & StreamEventBatcher::EventParamMask;
+				size_t nw = (n + 3) / 4;
+				if(i + nw > words.size()) return false;
+				const uint8_t* p = (const uint8_t*)(words.data() + i);
+				played->push_back({ t, std::vector<uint8_t>(p, p + n) });
+				i += nw;
+			}
+			else if((event & ~StreamEventBatcher::EventParamMask) == StreamEventBatcher::EventShortMessage)
+			{
+				const uint8_t b[3] = { (uint8_t)event, (uint8_t)(event >> 8), (uint8_t)(event >> 16) };
+				played->push_back({ t, std::vector<uint8_t>(b, b + MidiFramer::GetShortMessageLength(b[0])) });
+			}
+			else if((event & ~StreamEventBatcher::EventParamMask) != StreamEventBatcher::EventNop) return false;
+		}
+		return true;
+	}
+
+	// runs the case through the batcher the way the stream port's thread does, waking at each arrival and at each take time
+	static int CheckStreamSession(const char* label, const std::vector<StreamCaseMessage>& input, const StreamTiming& timing, StreamTimePoint t0, double* jitterms, double boundms)
+	{
+		StreamEventBatcher batcher;
+		batcher.SetTiming(timing);
+		batcher.Reset(t0);
+		std::vector<PlayedEvent> played;
+		std::vector<uint32_t> words;
+		int64_t tick = 0;
+		bool wellformed = true;
+		size_t maxbatch = 0;
+		StreamTimePoint now = t0;
+		for(size_t i = 0; ; )
+		{
+			StreamTimePoint t = batcher.GetNextTakeTime();
+			if(i < input.size()) t = std::min(t, input[i].arrival);
+			if(t == StreamTimePoint::max()) break;
+			now = std::max(now, t);
+			for(; (i < input.size()) && (input[i].arrival <= now); ++i)
+			{
+				const auto& m = input[i];
+				if(m.bytes[0] == 0xf0)	batcher.AddLongMessage(m.bytes.data(), (int)m.bytes.size(), m.arrival);
+				else					batcher.AddShortMessage(m.bytes[0] | ((m.bytes.size() > 1) ? m.bytes[1] << 8 : 0) | ((m.bytes.size() > 2) ? m.bytes[2] << 16 : 0), m.arrival);
+			}
+			while(batcher.TakeBatch(now, &words))
+			{
+				maxbatch = std::max(maxbatch, words.size() * sizeof(uint32_t));
+				if(!PlayStreamBatch(batcher, words, now, &tick, &played)) wellformed = false;
+			}
+		}
+		// the played events put back together into messages, a long one may have been cut into several events
+		std::vector<uint8_t> sent, received;
+		for(const auto& m : input) sent.insert(sent.end(), m.bytes.begin(), m.bytes.end());
+		for(const auto& e : played) received.insert(received.end(), e.bytes.begin(), e.bytes.end());
+		std::vector<StreamTimePoint> messageplayed;
+		bool insysex = false;
+		for(const auto& e : played)
+		{
+			if(!insysex) messageplayed.push_back(e.played);
+			insysex = (e.bytes.back() != 0xf7) && ((e.bytes.front() == 0xf0) || insysex);
+		}
+		double maxdelayms = 0;
+		std::vector<double> offsets;
+		for(size_t j = 0; j < std::min(input.size(), messageplayed.size()); ++j)
+		{
+			maxdelayms = std::max(maxdelayms, std::chrono::duration<double, std::milli>(messageplayed[j] - input[j].arrival).count());
+			// the notes played clear of the dumps, where the line holds them back
+			bool clear = true;
+			for(const auto& m : input) if((m.bytes[0] == 0xf0) && (input[j].intended >= m.intended) && (input[j].intended < m.intended + 3 * timing.latency)) clear = false;
+			if((input[j].bytes[0] == 0x90) && clear) offsets.push_back(std::chrono::duration<double, std::milli>(messageplayed[j] - input[j].intended).count());
+		}
+		*jitterms = offsets.empty() ? 0 : *std::max_element(offsets.begin(), offsets.end()) - *std::min_element(offsets.begin(), offsets.end());
+		std::printf("%-22s %5llu events %4llu batches, largest %5zu bytes, %3llu late, %3llu capped, delay max %6.2f ms, note jitter %6.2f ms p-p\n", label,
+			(unsigned long long)batcher.GetEventCount(), (unsigned long long)batcher.GetBatchCount(), maxbatch, (unsigned long long)batcher.GetLateBatchCount(),
+			(unsigned long long)batcher.GetCappedCount(), maxdelayms, *jitterms);
+		int r = 0;
+		if(!wellformed) { std::printf("streamout: %s, a batch was malformed\n", label); r = 1; }
+		if(received != sent) { std::printf("streamout: %s, data mismatch, %zu bytes played of %zu\n", label, received.size(), sent.size()); r = 1; }
+		if(messageplayed.size() != input.size()) { std::printf("streamout: %s, %zu messages played of %zu\n", label, messageplayed.size(), input.size()); r = 1; }
+		if(!std::is_sorted(messageplayed.begin(), messageplayed.end())) { std::printf("streamout: %s, played out of order\n", label); r = 1; }
+		if(maxbatch > timing.batchBytes) { std::printf("streamout: %s, a batch of %zu bytes\n", label, maxbatch); r = 1; }
+		if(batcher.GetLateBatchCount()) { std::printf("streamout: %s, %llu batches handed over late\n", label, (unsigned long long)batcher.GetLateBatchCount()); r = 1; }
+		if(maxdelayms > boundms) { std::printf("streamout: %s, a message played %.2f ms after its arrival\n", label, maxdelayms); r = 1; }
+		if(batcher.GetPendingBytes()) { std::printf("streamout: %s, %zu bytes left in the batcher\n", label, batcher.GetPendingBytes()); r = 1; }
+		return r;
+	}
+
+	// a pause longer than a 32 bit delta holds is bridged with no-op events and the message still plays on time
+	static int CheckLongPause(StreamTimePoint t0)
+	{
+		StreamTiming timing;
+		timing.tick = std::chrono::microseconds(1);
+		StreamEventBatcher batcher;
+		batcher.SetTiming(timing);
+		batcher.Reset(t0);
+		StreamTimePoint later = t0 + std::chrono::hours(2);
+		batcher.AddShortMessage(0x403c90, t0);
+		batcher.AddShortMessage(0x003c80, later);
+		std::vector<PlayedEvent> played;
+		std::vector<uint32_t> words;
+		int64_t tick = 0;
+		bool wellformed = true;
+		for(StreamTimePoint now : { t0 + timing.latency, later + timing.latency })
+		{
+			while(batcher.TakeBatch(now, &words)) if(!PlayStreamBatch(batcher, words, t0, &tick, &played)) wellformed = false;
+		}
+		StreamTimePoint expected = later + timing.latency;
+		if(!wellformed || (played.size() != 2) || (played.back().played != expected))
+		{
+			std::printf("streamout: a note after two hours played %.3f ms off\n", played.empty() ? 0.0 : std::chrono::duration<double, std::milli>(played.back().played - expected).count());
+			return 1;
+		}
+		return 0;
+	}
+
+	int RunStreamOut(const BenchArgs& args)
+	{
+		std::chrono::microseconds length = std::chrono::milliseconds(args.GetInt("length", 2000));
+		std::chrono::microseconds quantum = std::chrono::microseconds(args.GetInt("quantum", 15625));
+		int sysexbytes = (int)args.GetInt("sysex", 200);
+		uint32_t seed = (uint32_t)args.GetInt("seed", 1);
+		StreamTiming timing;
+		timing.latency = std::chrono::microseconds(args.GetInt("latency", 20000));
+		StreamTimePoint t0 = StreamTimePoint() + std::chrono::hours(1);
+		std::vector<StreamCaseMessage> input = MakeStreamCase(t0, length, quantum, sysexbytes, seed);
+		std::printf("%zu messages over %lld ms, delivered every %lld us, latency %lld us\n", input.size(), (long long)(length.count() / 1000),
+			(long long)quantum.count(), (long long)timing.latency.count());
+		// handed to the device as it arrives, what the port does without the stream
+		std::vector<double> offsets;
+		for(const auto& m : input) if(m.bytes[0] == 0x90) offsets.push_back(std::chrono::duration<double, std::milli>(m.arrival - m.intended).count());
+		double immediate = *std::max_element(offsets.begin(), offsets.end()) - *std::min_element(offsets.begin(), offsets.end());
+		std::printf("handed over on arrival, note jitter %.2f ms p-p\n", immediate);
+		int r = 0;
+		double bound = 2 * std::chrono::duration<double, std::milli>(timing.latency).count() + std::chrono::duration<double, std::milli>(timing.tick).count();
+		double flat = 0, smoothed = 0;
+		r |= CheckStreamSession("stream", input, timing, t0, &flat, bound);
+		StreamTiming smooth = timing;
+		smooth.smoothing = quantum;
+		smooth.latency = std::max(smooth.latency, smooth.smoothing + smooth.lead + std::chrono::milliseconds(1));
+		bound = 2 * std::chrono::duration<double, std::milli>(smooth.latency).count() + std::chrono::duration<double, std::milli>(smooth.tick).count();
+		r |= CheckStreamSession("stream, smoothed", input, smooth, t0, &smoothed, bound);
+		StreamTiming small = timing;
+		small.batchBytes = 256;
+		r |= CheckStreamSession("stream, 256 byte batch", input, small, t0, &flat, 2 * std::chrono::duration<double, std::milli>(small.latency).count() + 0.1);
+		if(smoothed > immediate * 0.6) { std::printf("streamout: smoothing left %.2f ms of jitter, %.2f ms without\n", smoothed, immediate); r = 1; }
+		r |= CheckLongPause(t0);
+		return r;
+	}
+}
@@ -0,0 +1,120 @@
+//
+//  BenchThroughput.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <atomic>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static int RunPipeToMidi(uint64_t total, bool verify)
+	{
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiOutPort midiout;
+		midiout.OpenDevice();
+		midiout.SetCaptureEnabled(verify);
+		PipeInMidiOut p2m;
+		p2m.SetMidiOutPort(&midiout);
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> pattern = MakeChannelMessageStream(3 * 1024);
+		Clock::time_point t0 = Clock::now();
+		std::thread writer([&]()
+		{
+			uint64_t i = 0; while(i < total)
+			{
+				int c = (int)std::min<uint64_t>(pattern.size(), total - i);
+				int cw = 0;
+				if(ResultIsError(pipe.GuestEnd().Write(pattern.data(), c, &cw))) break;
+				i += (uint64_t)cw;
+			}
+		});
+		bool completed = midiout.WaitForBytes(total, std::chrono::seconds(60));
+		double sec = SecondsSince(t0);
+		writer.join();
+		p2m.SetTransport(nullptr, false);
+		PrintRate("pipe->midi", midiout.GetByteCount(), midiout.GetSendCount(), sec);
+		if(!completed) { std::printf("pipe->midi: timed out, %llu of %llu bytes\n", (unsigned long long)midiout.GetByteCount(), (unsigned long long)total); return 1; }
+		if(verify)
+		{
+			std::vector<uint8_t> received = midiout.GetReceivedData();
+			for(size_t i = 0; i < received.size(); ++i)
+			{
+				if(received[i] != pattern[i % pattern.size()]) { std::printf("pipe->midi: mismatch at %zu\n", i); return 1; }
+			}
+		}
+		return 0;
+	}
+
+	static int RunMidiToPipe(uint64_t total, bool verify)
+	{
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		MidiInPipeOut m2p;
+		m2p.SetMidiInPort(&midiin);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> pattern = MakeChannelMessageStream(3 * 1024);
+		std::atomic<uint64_t> received{ 0 };
+		bool matched = true;
+		std::thread reader([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(received < total)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				if(verify)
+				{
+					for(int i = 0; i < cr; ++i) { if(buffer[i] != pattern[(received + i) % pattern.size()]) matched = false; }
+				}
+				received += (uint64_t)cr;
+			}
+		});
+		Clock::time_point t0 = Clock::now();
+		uint64_t messages = 0, retries = 0;
+		for(uint64_t i = 0; i < total; i += 3, ++messages)
+		{
+			// a real port never delivers faster than the wire, here the injector backs off and retries when the staging ring overruns
+			const uint8_t* p = pattern.data() + (i % pattern.size());
+			int c = (int)std::min<uint64_t>(3, total - i);
+			uint64_t overrun = m2p.GetOverrunBytes();
+			midiin.Inject(p, c);
+			while(m2p.GetOverrunBytes() != overrun)
+			{
+				overrun = m2p.GetOverrunBytes();
+				++retries;
+				std::this_thread::yield();
+				midiin.Inject(p, c);
+			}
+		}
+		for(Clock::time_point t1 = Clock::now(); (received < total) && (SecondsSince(t1) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		double sec = SecondsSince(t0);
+		pipe.Close();
+		reader.join();
+		m2p.SetTransport(nullptr, false);
+		PrintRate("midi->pipe", received, messages, sec);
+		if(retries) std::printf("midi->pipe: staging ring overran %llu times\n", (unsigned long long)retries);
+		if(received != total) { std::printf("midi->pipe: %llu of %llu bytes\n", (unsigned long long)received.load(), (unsigned long long)total); return 1; }
+		if(!matched) { std::printf("midi->pipe: data mismatch\n"); return 1; }
+		return 0;
+	}
+
+	int RunThroughput(const BenchArgs& args)
+	{
+		uint64_t total = (uint64_t)args.GetInt("bytes", 16 * 1024 * 1024);
+		total -= total % 3;
+		bool verify = args.GetInt("verify", 1) != 0;
+		int r = 0;
+		r |= RunPipeToMidi(total, verify);
+		r |= RunMidiToPipe(total, verify);
+		return r;
+	}
+}
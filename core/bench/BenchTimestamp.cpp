@@ -0,0 +1,102 @@
+//
+//  BenchTimestamp.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+#include <atomic>
+#include <random>
+#include <thread>
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	static void PrintLatencyHistogram(const SourceLatencyStatistics& st)
+	{
+		uint64_t peak = 1;
+		for(uint64_t v : st.histogram) peak = std::max(peak, v);
+		long long binus = (long long)SourceLatencyStatistics::BinWidth.count();
+		for(int i = 0; i < SourceLatencyStatistics::NumBins; ++i)
+		{
+			if(!st.histogram[i]) continue;
+			bool last = i == SourceLatencyStatistics::NumBins - 1;
+			std::printf("  %6lld%s usec %8llu %s\n", i * binus, last ? "+     " : (" - " + std::to_string((i + 1) * binus)).c_str(), (unsigned long long)st.histogram[i], std::string((size_t)(40 * st.histogram[i] / peak), '#').c_str());
+		}
+	}
+
+	//
+	// the driver stamps each event when it happens and calls back a little later, the delay of the callback is random.
+	// the histogram shows how much of that delay, plus the bridge's own, reaches the pipe
+	//
+	static int RunSourceTimestamps(const char* label, const SerialPacing& pacing, int events, std::chrono::microseconds spacing, std::chrono::microseconds callbackjitter, uint32_t seed)
+	{
+		MemoryPipe pipe(64 * 1024);
+		FakeMidiInPort midiin;
+		midiin.OpenDevice();
+		MidiInPipeOut m2p;
+		m2p.SetSerialPacing(pacing);
+		m2p.SetMidiInPort(&midiin);
+		m2p.SetTransport(&pipe.HostEnd(), false);
+		std::vector<uint8_t> sent;
+		std::atomic<uint64_t> received{ 0 };
+		std::vector<uint8_t> receivedData;
+		std::thread reader([&]()
+		{
+			std::vector<uint8_t> buffer(4096);
+			while(1)
+			{
+				int cr = 0;
+				if(ResultIsError(pipe.GuestEnd().Read(buffer.data(), (int)buffer.size(), &cr))) break;
+				receivedData.insert(receivedData.end(), buffer.begin(), buffer.begin() + cr);
+				received += (uint64_t)cr;
+			}
+		});
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> delay(0, (int)callbackjitter.count());
+		Clock::time_point t0 = Clock::now();
+		Clock::time_point delivered = t0;
+		for(int i = 0; i < events; ++i)
+		{
+			const uint8_t msg[3] = { (uint8_t)(0x90 | (i & 0x0f)), (uint8_t)(i & 0x7f), 0x40 };
+			Clock::time_point happened = t0 + i * spacing;
+			delivered = std::max(delivered, happened + std::chrono::microseconds(delay(rng)));
+			while(Clock::now() < delivered) std::this_thread::yield();
+			midiin.Inject(msg, 3, happened);
+			sent.insert(sent.end(), msg, msg + 3);
+		}
+		for(Clock::time_point t1 = Clock::now(); (received < sent.size()) && (SecondsSince(t1) < 10); ) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		pipe.Close();
+		reader.join();
+		m2p.SetTransport(nullptr, false);
+		SourceLatencyStatistics st = m2p.GetSourceLatencyStatistics();
+		std::printf("%-24s %6llu messages, delay mean %8.1f usec min %8.1f max %8.1f, jitter %8.1f usec\n", label, (unsigned long long)st.count,
+			std::chrono::duration<double, std::micro>(st.GetMeanDelay()).count(),
+			std::chrono::duration<double, std::micro>(st.minDelay).count(),
+			std::chrono::duration<double, std::micro>(st.maxDelay).count(),
+			std::chrono::duration<double, std::micro>(st.GetJitter()).count());
+		PrintLatencyHistogram(st);
+		if(receivedData != sent) { std::printf("%s: lost or reordered bytes\n", label); return 1; }
+		if(st.count != (uint64_t)events) { std::printf("%s: %llu of %d messages timed\n", label, (unsigned long long)st.count, events); return 1; }
+		return 0;
+	}
+
+	int RunTimestamp(const BenchArgs& args)
+	{
+		int events = (int)args.GetInt("events", 2000);
+		std::chrono::microseconds spacing(args.GetInt("spacing", 2000));
+		std::chrono::microseconds jitter(args.GetInt("jitter", 1000));
+		uint32_t seed = (uint32_t)args.GetInt("seed", 1);
+		int r = 0;
+		SerialPacing pacing;
+		r |= RunSourceTimestamps("unpaced", pacing, events, spacing, jitter, seed);
+		pacing.bitRate = 31250;
+		pacing.fifoBytes = 16;
+		r |= RunSourceTimestamps("paced at 31250 bps", pacing, events, spacing, jitter, seed);
+		return r;
+	}
+}
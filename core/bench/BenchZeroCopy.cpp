@@ -0,0 +1,123 @@
+//
+//  BenchZeroCopy.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "BenchCommon.h"
+#include "FakePorts.h"
+#include "TransferEngine.h"
+
+using namespace MidiBridgeCore;
+
+namespace BridgeBench
+{
+	// bulk patch dumps, long enough that nearly every 256 byte read is pure SysEx data
+	static std::vector<uint8_t> MakeBulkDumpStream(size_t n, size_t dumpsize)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(n);
+		while(v.size() + 2 <= n)
+		{
+			size_t c = std::min(dumpsize, n - v.size());
+			v.push_back(0xf0);
+			for(size_t i = 1; i + 1 < c; ++i) v.push_back((uint8_t)((v.size() * 3) & 0x7f));
+			v.push_back(0xf7);
+		}
+		return v;
+	}
+
+	// short dumps with channel messages between them and clock bytes inside them
+	static std::vector<uint8_t> MakeMixedStream(size_t n)
+	{
+		std::vector<uint8_t> v;
+		v.reserve(n + 16);
+		uint32_t seed = 1;
+		auto next = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7fff; };
+		while(v.size() < n)
+		{
+			v.push_back(0xf0);
+			for(size_t c = 100 + next() % 900, i = 0; i < c; ++i)
+			{
+				if(next() % 97 == 0) v.push_back(0xf8);
+				v.push_back((uint8_t)(next() & 0x7f));
+			}
+			v.push_back(0xf7);
+			for(uint32_t c = next() % 8, i = 0; i < c; ++i)
+			{
+				v.push_back((uint8_t)(0x90 | (i & 0x0f)));
+				v.push_back((uint8_t)(next() & 0x7f));
+				v.push_back((uint8_t)(next() & 0x7f));
+			}
+		}
+		return v;
+	}
+
+	struct ZeroCopyResult
+	{
+		double sec = 0;
+		uint64_t bytes = 0;
+		uint64_t longSends = 0;
+		uint64_t inPlaceSends = 0;
+		std::vector<uint8_t> received;
+	};
+
+	// the whole stream is in the pipe before the engine starts, so both paths see the same 256 byte reads
+	static ZeroCopyResult RunZeroCopyOnce(bool zerocopy, const std::vector<uint8_t>& stream)
+	{
+		ZeroCopyResult result;
+		MemoryPipe pipe(stream.size() + 1);
+		int cw = 0;
+		pipe.GuestEnd().Write(stream.data(), (int)stream.size(), &cw);
+		FakeQueuedMidiOutPort midiout(16, 256);
+		midiout.OpenDevice();
+		PipeInMidiOut p2m;
+		p2m.SetZeroCopyRead(zerocopy);
+		p2m.SetMidiOutPort(&midiout);
+		Clock::time_point t0 = Clock::now();
+		p2m.SetTransport(&pipe.HostEnd(), false);
+		midiout.WaitForBytes(stream.size(), std::chrono::seconds(30));
+		result.sec = SecondsSince(t0);
+		p2m.SetTransport(nullptr, false);
+		PipeInMidiOutStatistics st = p2m.GetStatistics();
+		result.bytes = midiout.GetByteCount();
+		result.longSends = st.longSends;
+		result.inPlaceSends = st.inPlaceSends;
+		result.received = midiout.GetReceivedData();
+		return result;
+	}
+
+	int RunZeroCopy(const BenchArgs& args)
+	{
+		int r = 0;
+		size_t total = (size_t)args.GetInt("bytes", 4 * 1024 * 1024);
+		size_t dumpsize = (size_t)args.GetInt("dumpsize", 64 * 1024);
+		std::vector<uint8_t> bulk = MakeBulkDumpStream(total, std::max<size_t>(dumpsize, 2));
+		std::vector<uint8_t> mixed = MakeMixedStream((size_t)args.GetInt("mixedbytes", 256 * 1024));
+		struct { const char* name; const std::vector<uint8_t>* stream; } runs[] = { { "bulk", &bulk }, { "mixed", &mixed } };
+		for(auto&& run : runs)
+		{
+			ZeroCopyResult copy = RunZeroCopyOnce(false, *run.stream);
+			ZeroCopyResult inplace = RunZeroCopyOnce(true, *run.stream);
+			for(const ZeroCopyResult* zr : { &copy, &inplace })
+			{
+				std::printf("%-5s %-8s %12llu bytes %9.3f s %10.3f MB/s, %8llu long sends, %8llu in place\n", run.name, (zr == &copy) ? "copy" : "in-place",
+					(unsigned long long)zr->bytes, zr->sec, (zr->sec > 0) ? (double)zr->bytes / zr->sec / 1e6 : 0.0,
+					(unsigned long long)zr->longSends, (unsigned long long)zr->inPlaceSends);
+			}
+			// the in-place path must deliver exactly what the copying path does
+			if((copy.bytes != run.stream->size()) || (inplace.received != copy.received))
+			{
+				std::printf("%s: MISMATCH, in-place output differs from the copying path\n", run.name);
+				r = 1;
+			}
+			if((copy.inPlaceSends != 0) || (inplace.inPlaceSends == 0))
+			{
+				std::printf("%s: the in-place path was %s\n", run.name, (copy.inPlaceSends != 0) ? "taken with zero-copy off" : "never taken");
+				r = 1;
+			}
+		}
+		return r;
+	}
+}
@@ -0,0 +1,247 @@
+//
+//  DaemonMain.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+//  usage: midipipebridged pipename=<address> [midiin=<device>[|<device>...]] [midiout=<device>[|<device>...]] [server] [instances=N] [sysextimeout=<msec>]
+//                         [readahead=N] [zerocopy=0|1] [rtlane=0|1] [flight=<log>] [flightsize=<bytes>] [p2mfilter=<spec>] [m2pfilter=<spec>]
+//                         [pacing=<spec>[|<spec>...]] [clockregen=<msec>] [runfor=<msec>] [config=<file>]
+//  the bridge without a user interface: parses its options, opens the devices, starts the session and waits for SIGINT or SIGTERM.
+//  the address is "pty:<link>" for a pseudo-terminal with a symbolic link, "unix:/path" or "tcp:host:port" for a socket.
+//  prints one line when the bridge is ready and the transfer counters when it stops.
+//
+
+#include "BridgeOptions.h"
+#include "ClientHub.h"
+#include "ClockRegenerator.h"
+#include "FlightRecorder.h"
+#include "MessageFilter.h"
+#include "PacedMidiOut.h"
+#include "PortSelect.h"
+#include "PtySession.h"
+#include "RawMidiPort.h"
+#include "SocketSession.h"
+#include "TransferEngine.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <csignal>
+#include <pthread.h>
+
+using namespace MidiBridgeCore;
+
+static void PrintError(const char* what, const std::string& name, ResultCode r)
+{
+	std::fprintf(stderr, "midipipebridged: %s %s: %s\n", what, name.c_str(), std::strerror(r));
+}
+
+static void PrintStatistics(const BridgeStatistics& s)
+{
+	std::printf("pipe->midi: %llu bytes read in %llu calls, %llu messages, %llu filtered, %llu real-time ahead, %llu bytes discarded\n",
+		(unsigned long long)s.pipeToMidi.pipeReadBytes, (unsigned long long)s.pipeToMidi.pipeReadCalls, (unsigned long long)s.pipeToMidi.messages, (unsigned long long)s.pipeToMidi.filteredMessages, (unsigned long long)s.pipeToMidi.laneSends, (unsigned long long)s.pipeToMidi.discardedBytes);
+	std::printf("midi->pipe: %llu messages, %llu filtered, %llu bytes written in %llu calls, %llu bytes dropped\n",
+		(unsigned long long)s.midiToPipe.messages, (unsigned long long)s.midiToPipe.filteredMessages, (unsigned long long)s.midiToPipe.bytes, (unsigned long long)s.midiToPipe.pipeWriteCalls, (unsigned long long)s.midiToPipe.droppedBytes);
+}
+
+int main(int argc, char** argv)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	// the signals are taken by sigtimedwait() below, every thread started from here on inherits the mask
+	sigset_t sigs;
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+	BridgeOptions options;
+	ResultCode r = options.ParseCommandLine(argc - 1, argv + 1);
+	if(ResultIsError(r)) { PrintError("cannot read", options.configFile.value(), r); return 1; }
+	for(const auto& arg : options.unknown) std::fprintf(stderr, "midipipebridged: unknown option %s\n", arg.c_str());
+	if(!options.pipeName.has_value() || options.pipeName->empty())
+	{
+		std::fprintf(stderr, "usage: midipipebridged pipename=<pty:link|unix:/path|tcp:host:port> [midiin=<device>[|<device>...]] [midiout=<device>[|<device>...]] [server] [instances=N] [sysextimeout=<msec>] [readahead=N] [zerocopy=0|1] [rtlane=0|1] [flight=<log>] [flightsize=<bytes>] [p2mfilter=<spec>] [m2pfilter=<spec>] [pacing=<spec>[|<spec>...]] [clockregen=<msec>] [runfor=<msec>] [config=<file>]\n");
+		return 2;
+	}
+	// the objects the engines point at are declared first so they outlive them
+	FlightRecorder flightRecorder;
+	std::unique_ptr<IMessageFilter> pipeToMidiFilter;
+	std::unique_ptr<IMessageFilter> midiToPipeFilter;
+	std::vector<std::unique_ptr<RawMidiOutPort> > midiOutPorts;
+	std::vector<std::unique_ptr<RawMidiInPort> > midiInPorts;
+	std::vector<std::unique_ptr<PacedMidiOut> > midiOutPacers;
+	std::vector<std::unique_ptr<ClockRegenMidiOut> > midiOutClockRegens;
+	std::unique_ptr<PortDemuxMidiOut> midiOutDemux;
+	std::unique_ptr<PortMuxMidiIn> midiInMux;
+	if(options.flightLog.has_value() && !options.flightLog->empty())
+	{
+		r = flightRecorder.Open(options.flightLog.value(), options.flightLogSize.value_or(FlightRecorder::DefaultCapacity));
+		if(ResultIsError(r)) { PrintError("cannot open the flight log", options.flightLog.value(), r); return 1; }
+	}
+	r = ParseMessageFilter(options.pipeToMidiFilter.value_or(""), &pipeToMidiFilter);
+	if(ResultIsError(r)) { PrintError("cannot parse the filter", options.pipeToMidiFilter.value(), r); return 1; }
+	r = ParseMessageFilter(options.midiToPipeFilter.value_or(""), &midiToPipeFilter);
+	if(ResultIsError(r)) { PrintError("cannot parse the filter", options.midiToPipeFilter.value(), r); return 1; }
+	// several devices on a side are the ports of a multi-port interface, reached through the F5 port select
+	std::vector<std::string> midioutnames = BridgeOptions::SplitDeviceList(options.midiOutDeviceName.value_or(""));
+	std::vector<std::string> midiinnames = BridgeOptions::SplitDeviceList(options.midiInDeviceName.value_or(""));
+	if((midioutnames.size() > (size_t)PortDemuxMidiOut::MaxPorts) || (midiinnames.size() > (size_t)PortMuxMidiIn::MaxPorts))
+	{
+		std::fprintf(stderr, "midipipebridged: at most %d devices on each side\n", PortDemuxMidiOut::MaxPorts);
+		return 2;
+	}
+	for(const auto& name : midioutnames)
+	{
+		midiOutPorts.push_back(std::make_unique<RawMidiOutPort>());
+		r = midiOutPorts.back()->OpenDevice(name);
+		if(ResultIsError(r)) { PrintError("cannot open", name, r); return 1; }
+	}
+	for(const auto& name : midiinnames)
+	{
+		midiInPorts.push_back(std::make_unique<RawMidiInPort>());
+		r = midiInPorts.back()->OpenDevice(name);
+		if(ResultIsError(r)) { PrintError("cannot open", name, r); return 1; }
+	}
+	// a raw MIDI device has no queue that plays at a time, what arrives is written at once
+	if(options.midiOutLatencyMsec.value_or(0) > 0) std::fprintf(stderr, "midipipebridged: outlatency needs the Windows stream API, ignored\n");
+	// a device with a pacing profile is reached through its own scheduler
+	std::vector<std::string> pacingspecs = BridgeOptions::SplitDeviceList(options.midiOutPacing.value_or(""));
+	std::vector<IMidiOutPort*> midioutdevices;
+	for(size_t i = 0; i < midiOutPorts.size(); ++i)
+	{
+		std::string spec = (pacingspecs.size() == 1) ? pacingspecs[0] : (i < pacingspecs.size()) ? pacingspecs[i] : "";
+		MidiOutPacingProfile profile;
+		r = ParsePacingProfile(spec, midioutnames[i], &profile);
+		if(ResultIsError(r)) { PrintError("cannot parse the pacing", spec, r); return 1; }
+		midioutdevices.push_back(midiOutPorts[i].get());
+		if(!profile.IsEnabled()) continue;
+		midiOutPacers.push_back(std::make_unique<PacedMidiOut>());
+		midiOutPacers.back()->SetMidiOutPort(midiOutPorts[i].get());
+		midiOutPacers.back()->SetProfile(profile);
+		midiOutPacers.back()->Start();
+		midioutdevices.back() = midiOutPacers.back().get();
+	}
+	// the clock is regenerated for each device behind the demux, a clock held back still goes to the port it was sent to
+	if(options.midiClockRegenMsec.value_or(0) > 0)
+	{
+		ClockPllSettings settings;
+		settings.holdback = std::chrono::milliseconds(options.midiClockRegenMsec.value());
+		for(auto& device : midioutdevices)
+		{
+			midiOutClockRegens.push_back(std::make_unique<ClockRegenMidiOut>());
+			midiOutClockRegens.back()->SetMidiOutPort(device);
+			midiOutClockRegens.back()->SetSettings(settings);
+			midiOutClockRegens.back()->Start();
+			device = midiOutClockRegens.back().get();
+		}
+	}
+	IMidiOutPort* midiout = midioutdevices.empty() ? nullptr : midioutdevices[0];
+	IMidiInPort* midiin = midiInPorts.empty() ? nullptr : midiInPorts[0].get();
+	if(midioutdevices.size() > 1)
+	{
+		midiOutDemux = std::make_unique<PortDemuxMidiOut>((int)midioutdevices.size());
+		for(size_t i = 0; i < midioutdevices.size(); ++i) midiOutDemux->SetPort((int)i, midioutdevices[i]);
+		midiout = midiOutDemux.get();
+	}
+	if(midiInPorts.size() > 1)
+	{
+		midiInMux = std::make_unique<PortMuxMidiIn>((int)midiInPorts.size());
+		for(size_t i = 0; i < midiInPorts.size(); ++i) midiInMux->SetPort((int)i, midiInPorts[i].get());
+		midiin = midiInMux.get();
+	}
+	FlightRecorder* recorder = flightRecorder.IsOpen() ? &flightRecorder : nullptr;
+	PipeInMidiOut pipeInMidiOut;
+	MidiInPipeOut midiInPipeOut;
+	std::unique_ptr<ClientHub> clientHub;
+	std::unique_ptr<IPipeSession> session;
+	const std::string& pipename = options.pipeName.value();
+	bool server = options.runAsServer.value_or(false);
+	int instances = std::clamp(options.maxInstances.value_or(1), 1, ClientHub::MaxClients);
+	if(server && (instances > 1))
+	{
+		// the hub reads each guest on its own reader, without a read-ahead ring
+		if(options.readAhead.has_value() || options.zeroCopyRead.has_value() || options.realTimeLane.has_value()) std::fprintf(stderr, "midipipebridged: readahead, zerocopy and rtlane apply to a single guest, ignored with instances=%d\n", instances);
+		clientHub = std::make_unique<ClientHub>(instances);
+		clientHub->SetMidiOutPort(midiout);
+		clientHub->SetMidiInPort(midiin);
+		clientHub->SetFlightRecorder(recorder);
+		clientHub->SetPipeToMidiFilter(pipeToMidiFilter.get());
+		clientHub->SetMidiToPipeFilter(midiToPipeFilter.get());
+		if(options.sysExOwnerTimeoutMsec.has_value()) clientHub->SetSysExOwnerTimeout(std::chrono::milliseconds(std::max(options.sysExOwnerTimeoutMsec.value(), 0)));
+		session = CreateSocketServer(pipename, *clientHub);
+	}
+	else
+	{
+		pipeInMidiOut.SetReadAhead(options.readAhead.value_or(1));
+		pipeInMidiOut.SetZeroCopyRead(options.zeroCopyRead.value_or(false));
+		pipeInMidiOut.SetRealTimeLane(options.realTimeLane.value_or(false));
+		pipeInMidiOut.SetFlightRecorder(recorder);
+		midiInPipeOut.SetFlightRecorder(recorder);
+		pipeInMidiOut.SetMessageFilter(pipeToMidiFilter.get());
+		midiInPipeOut.SetMessageFilter(midiToPipeFilter.get());
+		pipeInMidiOut.SetMidiOutPort(midiout);
+		midiInPipeOut.SetMidiInPort(midiin);
+		if(pipename.compare(0, 4, "pty:") == 0)	session = CreatePtySession(pipeInMidiOut, midiInPipeOut, pipename.substr(4));
+		else if(server)							session = CreateSocketServer(pipename, pipeInMidiOut, midiInPipeOut);
+		else									session = CreateSocketClient(pipename, pipeInMidiOut, midiInPipeOut);
+	}
+	session->OnSessionError = [](ResultCode e) { std::fprintf(stderr, "midipipebridged: session error: %s\n", std::strerror(e)); };
+	if(!session->StartSession())
+	{
+		PrintError("cannot start the session on", pipename, session->GetSessionError());
+		return 1;
+	}
+	double readyms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	if(auto pty = dynamic_cast<IPtySession*>(session.get()))	std::printf("ready in %.2f ms on %s\n", readyms, pty->GetSlavePath().c_str());
+	else														std::printf("ready in %.2f ms on %s\n", readyms, pipename.c_str());
+	std::fflush(stdout);
+	int runfor = options.runForMsec.value_or(0);
+	int sig;
+	if(runfor > 0)
+	{
+		timespec ts = { runfor / 1000, (long)(runfor % 1000) * 1000000 };
+		while(((sig = sigtimedwait(&sigs, nullptr, &ts)) < 0) && (errno == EINTR)) {}
+	}
+	else
+	{
+		while(sigwait(&sigs, &sig) != 0) {}
+	}
+	session->StopSession();
+	BridgeStatistics stats = clientHub ? clientHub->GetStatistics() : BridgeStatistics{ pipeInMidiOut.GetStatistics(), midiInPipeOut.GetStatistics() };
+	if(clientHub)
+	{
+		clientHub->SetMidiOutPort(nullptr);
+		clientHub->SetMidiInPort(nullptr);
+		clientHub->SetFlightRecorder(nullptr);
+	}
+	pipeInMidiOut.SetMidiOutPort(nullptr);
+	midiInPipeOut.SetMidiInPort(nullptr);
+	PrintStatistics(stats);
+	for(size_t i = 0; i < midiOutClockRegens.size(); ++i)
+	{
+		ClockRegenMidiOut* regen = midiOutClockRegens[i].get();
+		regen->Flush(std::chrono::seconds(1));
+		double periodms = std::chrono::duration<double, std::milli>(regen->GetPeriod()).count();
+		std::printf("clock: %s, %llu clocks regenerated, %s at %.2f BPM, %llu relocks\n", midioutnames[i].c_str(), (unsigned long long)regen->GetClockCount(),
+			regen->IsLocked() ? "locked" : "not locked", (periodms > 0) ? 60000 / (periodms * 24) : 0.0, (unsigned long long)regen->GetRelockCount());
+		regen->Stop();
+	}
+	if(midiOutDemux) std::printf("port select: %llu selects from the guest, %llu messages to no device\n", (unsigned long long)midiOutDemux->GetSelectCount(), (unsigned long long)midiOutDemux->GetUnroutedCount());
+	for(const auto& pacer : midiOutPacers)
+	{
+		MidiOutPacingProfile profile = pacer->GetProfile();
+		std::printf("pacing: %s at %.0f bytes/s, %llu gaps of %lld ms held\n", profile.name.c_str(), profile.bytesPerSecond, (unsigned long long)pacer->GetGapCount(), (long long)profile.sysexGap.count());
+		pacer->Stop();
+	}
+	if(midiInMux) std::printf("port select: %llu selects to the guest, %llu held bytes dropped\n", (unsigned long long)midiInMux->GetSelectCount(), (unsigned long long)midiInMux->GetDroppedBytes());
+	for(size_t i = 0; i < midiInPorts.size(); ++i)
+	{
+		if(ResultIsError(midiInPorts[i]->GetReadError())) PrintError("read error on", midiinnames[i], midiInPorts[i]->GetReadError());
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+//
+//  FlightDump.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+//  usage: flightdump <logfile> [dir=p2m|m2p] [last=N] [raw=1]
+//  prints the records of a flight recorder log from the oldest to the newest, one message per line:
+//  the UTC wall time, seconds since the previous record, the direction and client slot, the length, then the bytes in hex
+//
+
+#include "FlightRecorder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+
+using namespace MidiBridgeCore;
+
+static std::string FormatWallTime(int64_t ns)
+{
+	time_t sec = (time_t)(ns / 1000000000);
+	long usec = (long)((ns % 1000000000) / 1000);
+	if(usec < 0) { --sec; usec += 1000000; }
+	struct tm tm = {};
+#if defined(_WIN32)
+	gmtime_s(&tm, &sec);
+#else
+	gmtime_r(&sec, &tm);
+#endif
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d:%02d.%06ld", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, usec);
+	return buf;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		std::printf("usage: flightdump <logfile> [dir=p2m|m2p] [last=N] [raw=1]\n");
+		return 2;
+	}
+	std::string dir;
+	size_t last = 0;
+	bool raw = false;
+	for(int i = 2; i < argc; ++i)
+	{
+		if(strncmp(argv[i], "dir=", 4) == 0)			dir = argv[i] + 4;
+		else if(strncmp(argv[i], "last=", 5) == 0)	last = (size_t)std::strtoull(argv[i] + 5, nullptr, 0);
+		else if(strncmp(argv[i], "raw=", 4) == 0)	raw = std::atoi(argv[i] + 4) != 0;
+	}
+	FlightLogReader reader;
+	ResultCode r = reader.Open(argv[1]);
+	if(ResultIsError(r))
+	{
+		std::fprintf(stderr, "flightdump: cannot read %s as a flight recorder log (%s)\n", argv[1], std::strerror(r));
+		return 1;
+	}
+	const FlightLogHeader& h = reader.GetHeader();
+	// the steady clock is mapped to wall time through the origin the recorder took when it last opened the log
+	auto walltime = [&h](int64_t ts) { return h.systemOrigin + (ts - h.steadyOrigin); };
+	std::deque<FlightRecordView> tail;
+	uint64_t count = 0;
+	int64_t prev = 0;
+	auto print = [&](const FlightRecordView& v)
+	{
+		double dt = (count++ > 0) ? (double)(v.timestamp - prev) / 1e9 : 0.0;
+		prev = v.timestamp;
+		if(raw)	std::printf("%lld", (long long)v.timestamp);
+		else	std::printf("%s", FormatWallTime(walltime(v.timestamp)).c_str());
+		std::printf(" %+10.6f %s", dt, (v.direction == FlightDirection::PipeToMidi) ? "p->m" : "m->p");
+		if(v.source != 0) std::printf("[%u]", v.source);
+		std::printf(" %4zu%s ", v.data.size(), (v.flags & FlightRecordHeader::FlagTruncated) ? "+" : " ");
+		for(uint8_t b : v.data) std::printf(" %02x", b);
+		std::printf("\n");
+	};
+	reader.ForEach([&](const FlightRecordView& v)
+	{
+		if((dir == "p2m") && (v.direction != FlightDirection::PipeToMidi)) return;
+		if((dir == "m2p") && (v.direction != FlightDirection::MidiToPipe)) return;
+		if(last == 0) { print(v); return; }
+		tail.push_back(v);
+		if(tail.size() > last) tail.pop_front();
+	});
+	for(const auto& v : tail) print(v);
+	std::printf("# %llu bytes ring, %llu bytes written, %llu records shown, %llu bytes skipped as overwritten or torn\n",
+		(unsigned long long)h.capacity, (unsigned long long)h.cursor, (unsigned long long)count, (unsigned long long)reader.GetSkippedBytes());
+	return 0;
+}
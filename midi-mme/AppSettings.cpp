@@ -201,6 +201,22 @@ namespace winrt::MidiPipeBridge::implementation
 			isDirty = true;
 			onetimeInvoker->Trigger();
 		}
+		// "MidiOutPacing": { "<device name>": "<spec>", ... }
+		hstring GetMidiOutPacing(const hstring& devicename)
+		{
+			Windows::Data::Json::JsonObject map = jsonObject.GetNamedObject(L"MidiOutPacing", nullptr);
+			return map ? map.GetNamedString(devicename, L"") : hstring();
+		}
+		void SetMidiOutPacing(const hstring& devicename, const hstring& value)
+		{
+			if(GetMidiOutPacing(devicename) == value) return;
+			Windows::Data::Json::JsonObject map = jsonObject.GetNamedObject(L"MidiOutPacing", Windows::Data::Json::JsonObject());
+			if(value.empty())	map.Remove(devicename);
+			else				map.Insert(devicename, Windows::Data::Json::JsonValue::CreateStringValue(value));
+			jsonObject.Insert(L"MidiOutPacing", map);
+			isDirty = true;
+			onetimeInvoker->Trigger();
+		}
 	};
 	AppSettings::AppSettings(Microsoft::UI::Dispatching::DispatcherQueue dispqueue) { impl = std::make_unique<Impl>(this, dispqueue); }
 	AppSettings::~AppSettings() { impl.reset(); }
@@ -218,4 +234,6 @@ namespace winrt::MidiPipeBridge::implementation
 	void AppSettings::MidiInDeviceName(const hstring& value) { impl->MidiInDeviceName(value); }
 	hstring AppSettings::MidiOutDeviceName() { return impl->MidiOutDeviceName(); }
 	void AppSettings::MidiOutDeviceName(const hstring& value) { impl->MidiOutDeviceName(value); }
+	hstring AppSettings::GetMidiOutPacing(const hstring& devicename) { return impl->GetMidiOutPacing(devicename); }
+	void AppSettings::SetMidiOutPacing(const hstring& devicename, const hstring& value) { impl->SetMidiOutPacing(devicename, value); }
 } // winrt::MidiPipeBridge::implementation
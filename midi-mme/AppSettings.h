@@ -34,6 +34,8 @@ namespace winrt::MidiPipeBridge::implementation
 		void MidiInDeviceName(const hstring& value);
 		hstring MidiOutDeviceName();
 		void MidiOutDeviceName(const hstring& value);
+		hstring GetMidiOutPacing(const hstring& devicename);
+		void SetMidiOutPacing(const hstring& devicename, const hstring& value);
 	};
 }
 
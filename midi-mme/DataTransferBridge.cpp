@@ -9,7 +9,19 @@
 #include "DataTransferBridge.h"
 #include <mmeapi.h>
 #pragma comment(lib, "Winmm.lib")
+#include <condition_variable>
 #include <mutex>
+#include "TransferEngine.h"
+#include "NamedPipeSession.h"
+#include "ClientHub.h"
+#include "MessageFilter.h"
+#include "PortSelect.h"
+#include "PacedMidiOut.h"
+#include "StreamEventBatcher.h"
+#include "ClockRegenerator.h"
+#include "PreciseTimer.h"
+#include "WorkerThread.h"
+#include "HeaderPool.h"
 #include "MidiDeviceInfo.h"
 #include "DebugPrint.h"
 
@@ -17,135 +29,17 @@
 #undef max
 
 using namespace winrt;
+using MidiBridgeCore::ResultCode;
 
 namespace winrt::MidiPipeBridge::implementation
 {
 
-	// ================================================================================
-	// primitive classes
-
-	struct ManualEvent
-	{
-		HANDLE hEvent = NULL;
-		ManualEvent()
-		{
-			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-		}
-		~ManualEvent()
-		{
-			if(hEvent) CloseHandle(hEvent);
-		}
-		bool Reset()
-		{
-			return hEvent ? ResetEvent(hEvent) : false;
-		}
-		bool Set()
-		{
-			return hEvent ? SetEvent(hEvent) : false;
-		}
-		operator HANDLE()
-		{
-			return hEvent;
-		}
-	};
-
-	struct Overlapped : public OVERLAPPED
-	{
-		Overlapped()
-		{
-			ZeroMemory(this, sizeof(*this));
-			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-		}
-		~Overlapped()
-		{
-			if(hEvent) CloseHandle(hEvent);
-		}
-		void Reset()
-		{
-			HANDLE hsave = this->hEvent;
-			ZeroMemory(this, sizeof(*this));
-			hEvent = hsave;
-			if(hEvent) ResetEvent(hEvent);
-		}
-	};
-
-	class WinThread
-	{
-	protected:
-		static unsigned int WINAPI threadProc(void* param)
-		{
-			WinThread* pthis = reinterpret_cast<WinThread*>(param);
-			HRESULT r = 0;
-			try
-			{
-				r = pthis->Run();
-			}
-			catch(const winrt::hresult_error& e)
-			{
-				r = e.code();
-				DebugPrint(L"[WinThread ({})] exception: {}\n",  pthis->threadName, e.message());
-			}
-			catch(...)
-			{
-				r = E_FAIL;
-				DebugPrint(L"[WinThread ({})] exception: unknown\n", pthis->threadName);
-			}
-			return r;
-		}
-		std::wstring threadName;
-		HANDLE hThread = NULL;
-		ManualEvent quitEvent;
-		bool quitFlag = false;
-	public:
-		WinThread(const std::wstring& name) : threadName(name)
-		{
-		}
-		virtual ~WinThread()
-		{
-			StopThread();
-		}
-		void StopThread()
-		{
-			if(!hThread) return;
-			RequestToQuitThread();
-			WaitForExitThread(INFINITE);
-			CloseHandle(hThread);
-			hThread = NULL;
-		}
-		bool WaitForExitThread(DWORD t)
-		{
-			if(!hThread) return true;
-			return WaitForSingleObject(hThread, t) == WAIT_OBJECT_0;
-		}
-		bool StartThread()
-		{
-			StopThread();
-			quitEvent.Reset();
-			quitFlag = false;
-			hThread = (HANDLE)_beginthreadex(nullptr, 0, threadProc, this, 0, nullptr);
-			return hThread != NULL;
-		}
-		bool IsThreadRunning() const
-		{
-			return (hThread != NULL) && (WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT);
-		}
-		operator HANDLE()
-		{
-			return hThread;
-		}
-		virtual void RequestToQuitThread()
-		{
-			quitFlag = true;
-			quitEvent.Set();
-		}
-		virtual unsigned int Run() = 0;
-	};
-
 	// ================================================================================
 	// MME midiport wrappers
 
 	static constexpr int NumMidiBuffers = 16;
 	static constexpr int MidiBufferSize = 256;
+	static constexpr uint32_t DefaultMidiOutSendTimeout = 2000; // msec
 
 	static inline bool MMResultIsError(MMRESULT r)
 	{
@@ -163,13 +57,14 @@ namespace winrt::MidiPipeBridge::implementation
 		}
 	};
 
-	class MidiOutPort
+	class MidiOutPort : public MidiBridgeCore::IMidiOutPort
 	{
 	private:
 		HMIDIOUT hMidiOut = NULL;
 		std::vector<std::unique_ptr<MIDIHDREX> > hdrList;
-		std::list<MIDIHDREX*> freeList;
-		std::recursive_mutex lock;
+		MidiBridgeCore::HeaderPool<MIDIHDREX> freePool;
+		std::chrono::milliseconds sendTimeout{ DefaultMidiOutSendTimeout };
+		MIDIHDREX* lentHdr = nullptr;
 		static void CALLBACK MidiOutProc(HMIDIOUT hmo, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2)
 		{
 			reinterpret_cast<MidiOutPort*>(inst)->OnMidiOutCallback(hmo, msg, param1, param2);
@@ -178,10 +73,9 @@ namespace winrt::MidiPipeBridge::implementation
 		{
 			if(msg == MOM_DONE)
 			{
-				std::lock_guard<std::recursive_mutex> al(lock);
 				MIDIHDREX* hdr = reinterpret_cast<MIDIHDREX*>(param1);
 				hdr->dwFlags &= MHDR_PREPARED;
-				freeList.push_back(hdr);
+				freePool.Release(hdr);
 			}
 		}
 	public:
@@ -192,10 +86,17 @@ namespace winrt::MidiPipeBridge::implementation
 		{
 			CloseDevice();
 		}
-		bool IsDeviceOpen() const
+		virtual bool IsDeviceOpen() const override
 		{
 			return hMidiOut != NULL;
 		}
+		// the product name of the open device, what the pacing profiles are matched against
+		std::string GetDeviceName() const
+		{
+			MIDIOUTCAPSW caps = {};
+			if(!hMidiOut || (midiOutGetDevCapsW((UINT_PTR)hMidiOut, &caps, sizeof(caps)) != MMSYSERR_NOERROR)) return std::string();
+			return winrt::to_string(caps.szPname);
+		}
 		void CloseDevice()
 		{
 			if(!hMidiOut) return;
@@ -205,25 +106,27 @@ namespace winrt::MidiPipeBridge::implementation
 				midiOutUnprepareHeader(hMidiOut, hdr.get(), sizeof(MIDIHDR));
 			}
 			hdrList.clear();
-			freeList.clear();
+			freePool.Clear();
+			lentHdr = nullptr;
 			midiOutClose(hMidiOut);
 			hMidiOut = NULL;
 		}
-		MMRESULT OpenDevice(uint32_t devid)
+		MMRESULT OpenDevice(uint32_t devid, int numbuffers = NumMidiBuffers)
 		{
 			CloseDevice();
 			int r = MMSYSERR_NOERROR;
 			try
 			{
+				freePool.SetCapacity((size_t)std::max(numbuffers, 1));
 				r = midiOutOpen(&hMidiOut, devid, (DWORD_PTR)MidiOutProc, (DWORD_PTR)this, CALLBACK_FUNCTION);
 				if(MMResultIsError(r)) throw r;
-				for(int c = NumMidiBuffers, i = 0; i < c; ++i)
+				for(int c = std::max(numbuffers, 1), i = 0; i < c; ++i)
 				{
 					std::unique_ptr<MIDIHDREX> hdr = std::make_unique<MIDIHDREX>();
 					hdr->Initialize();
 					r = midiOutPrepareHeader(hMidiOut, hdr.get(), sizeof(MIDIHDR));
 					if(MMResultIsError(r)) throw r;
-					freeList.push_back(hdr.get());
+					freePool.Release(hdr.get());
 					hdrList.push_back(std::move(hdr));
 				}
 			}
@@ -241,18 +144,20 @@ namespace winrt::MidiPipeBridge::implementation
 		{
 			return MidiBufferSize;
 		}
-		MMRESULT Send(const uint8_t* p, int c)
+		void SetSendTimeout(uint32_t msec)
+		{
+			sendTimeout = std::chrono::milliseconds(msec);
+		}
+		virtual ResultCode Send(const uint8_t* p, int c) override
 		{
 			if(!hMidiOut) return MMSYSERR_INVALHANDLE;
 			int i = 0; while(i < c)
 			{
+				// wait for the driver to hand a buffer back rather than failing the stream
 				MIDIHDREX* hdr = nullptr;
-				{
-					std::lock_guard<std::recursive_mutex> al(lock);
-					if(freeList.empty()) return MMSYSERR_ERROR;
-					hdr = freeList.front();
-					freeList.pop_front();
-				}
+				ResultCode rp = freePool.Acquire(&hdr, sendTimeout);
+				if(rp == MidiBridgeCore::ResultTimedOut) return MIDIERR_NOTREADY;
+				if(MidiBridgeCore::ResultIsError(rp)) return rp;
 				int lseg = std::min((int)sizeof(hdr->exbuffer), c - i);
 				memcpy(hdr->lpData, p + i, lseg);
 				hdr->dwBufferLength = hdr->dwBytesRecorded = lseg;
@@ -262,63 +167,337 @@ namespace winrt::MidiPipeBridge::implementation
 			}
 			return MMSYSERR_NOERROR;
 		}
-		MMRESULT Send(const std::vector<uint8_t>& v)
+		// the prepared header's exbuffer is lent to the pipe reader, which reads SysEx straight into it
+		virtual ResultCode AcquireSendBuffer(uint8_t** pp, int* capacity) override
+		{
+			*pp = nullptr;
+			*capacity = 0;
+			if(!hMidiOut) return MMSYSERR_INVALHANDLE;
+			ResultCode rp = freePool.Acquire(&lentHdr, sendTimeout);
+			if(rp == MidiBridgeCore::ResultTimedOut) return MIDIERR_NOTREADY;
+			if(MidiBridgeCore::ResultIsError(rp)) return rp;
+			*pp = reinterpret_cast<uint8_t*>(lentHdr->exbuffer);
+			*capacity = (int)sizeof(lentHdr->exbuffer);
+			return MMSYSERR_NOERROR;
+		}
+		virtual ResultCode SubmitSendBuffer(uint8_t* p, int c) override
+		{
+			if(!hMidiOut) return MMSYSERR_INVALHANDLE;
+			if(!lentHdr || (p != reinterpret_cast<uint8_t*>(lentHdr->exbuffer))) return MMSYSERR_INVALPARAM;
+			MIDIHDREX* hdr = lentHdr;
+			lentHdr = nullptr;
+			hdr->dwBufferLength = hdr->dwBytesRecorded = (DWORD)std::min(c, (int)sizeof(hdr->exbuffer));
+			MMRESULT r = midiOutLongMsg(hMidiOut, hdr, sizeof(MIDIHDR));
+			if(MMResultIsError(r)) freePool.Return(hdr);
+			return r;
+		}
+		virtual void ReturnSendBuffer(uint8_t* p) override
+		{
+			if(!lentHdr || (p != reinterpret_cast<uint8_t*>(lentHdr->exbuffer))) return;
+			freePool.Return(lentHdr);
+			lentHdr = nullptr;
+		}
+		virtual ResultCode SendShortMessage(uint32_t msg) override
 		{
-			return Send(v.data(), (int)v.size());
+			if(!hMidiOut) return MMSYSERR_INVALHANDLE;
+			return midiOutShortMsg(hMidiOut, msg);
+		}
+		// midiOutShortMsg does not wait for the queued long buffers
+		virtual bool IsShortMessageConcurrent() const override
+		{
+			return true;
+		}
+		virtual void SetSendCancelled(bool v) override
+		{
+			freePool.SetCancelled(v);
+		}
+		virtual int64_t GetBufferLowWater() const override
+		{
+			return hMidiOut ? (int64_t)freePool.GetLowWater() : -1;
 		}
 	};
 
-	class MidiInPort
+	// stream buffers hold a whole batch of timestamped events
+	static constexpr int NumMidiStreamBuffers = 8;
+	static constexpr size_t MidiStreamBufferSize = 4096;
+	// how much the batcher may hold before a sender waits, the latency's worth of a dump at full pipe speed fits
+	static constexpr size_t MaxStreamPendingBytes = 4 * MidiStreamBufferSize;
+
+	struct MIDISTREAMHDREX : public MIDIHDR
+	{
+		uint32_t events[MidiStreamBufferSize / sizeof(uint32_t)];
+		void Initialize()
+		{
+			ZeroMemory(this, sizeof(*this));
+			lpData = reinterpret_cast<LPSTR>(events);
+			dwBufferLength = sizeof(events);
+		}
+	};
+
+	// the MIDI out device opened as a stream. each message is given a time by the batcher, its arrival plus a fixed latency,
+	// and goes to the driver ahead of that time in a batch with tick deltas, so the driver plays it on its own clock rather
+	// than whenever the pipe happened to deliver it. the stream's tick is set to the batcher's by MIDIPROP_TIMEDIV and
+	// MIDIPROP_TEMPO, its tick 0 is midiStreamRestart()
+	class MidiStreamOutPort : public MidiBridgeCore::IMidiOutPort, private MidiBridgeCore::WorkerThread
 	{
 	private:
-		static int GuessShortMessageLength(uint8_t stat)
+		using Clock = std::chrono::steady_clock;
+		HMIDISTRM hMidiStream = NULL;
+		UINT deviceId = 0;
+		std::vector<std::unique_ptr<MIDISTREAMHDREX> > hdrList;
+		MidiBridgeCore::HeaderPool<MIDISTREAMHDREX> freePool;
+		std::chrono::milliseconds sendTimeout{ DefaultMidiOutSendTimeout };
+		mutable std::mutex mutex;
+		std::condition_variable pendingCond;
+		std::condition_variable spaceCond;
+		MidiBridgeCore::StreamEventBatcher batcher;
+		bool sendCancelled = false;
+		ResultCode deviceResult = MMSYSERR_NOERROR;
+		// the thread's own
+		std::vector<uint32_t> batch;
+		MidiBridgeCore::PreciseTimer timer;
+		static void CALLBACK MidiOutProc(HMIDIOUT hmo, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2)
+		{
+			reinterpret_cast<MidiStreamOutPort*>(inst)->OnMidiOutCallback(hmo, msg, param1, param2);
+		}
+		void OnMidiOutCallback(HMIDIOUT, UINT msg, DWORD_PTR param1, DWORD_PTR)
+		{
+			if(msg == MOM_DONE)
+			{
+				MIDISTREAMHDREX* hdr = reinterpret_cast<MIDISTREAMHDREX*>(param1);
+				hdr->dwFlags &= MHDR_PREPARED;
+				freePool.Release(hdr);
+			}
+		}
+		virtual unsigned int Run() override
+		{
+			while(1)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					pendingCond.wait(lock, [this]() { return quitFlag || (batcher.GetNextTakeTime() != Clock::time_point::max()); });
+					if(quitFlag) break;
+					Clock::time_point now = Clock::now();
+					if(!batcher.TakeBatch(now, &batch))
+					{
+						// short naps, a burst that fills a batch meanwhile goes at once
+						Clock::time_point t = batcher.GetNextTakeTime();
+						lock.unlock();
+						timer.SleepUntil(std::min<Clock::time_point>(t, now + std::chrono::milliseconds(1)));
+						continue;
+					}
+					spaceCond.notify_all();
+				}
+				MIDISTREAMHDREX* hdr = nullptr;
+				ResultCode r = freePool.Acquire(&hdr, sendTimeout);
+				if(r == MidiBridgeCore::ResultTimedOut) r = MIDIERR_NOTREADY;
+				if(!MidiBridgeCore::ResultIsError(r))
+				{
+					size_t n = std::min(batch.size() * sizeof(uint32_t), sizeof(hdr->events));
+					memcpy(hdr->events, batch.data(), n);
+					hdr->dwBytesRecorded = (DWORD)n;
+					r = midiStreamOut(hMidiStream, hdr, sizeof(MIDIHDR));
+					if(MMResultIsError(r)) freePool.Return(hdr);
+				}
+				if(r != MMSYSERR_NOERROR)
+				{
+					// sticky, the senders see it and the rest of the schedule is dropped
+					std::lock_guard<std::mutex> lock(mutex);
+					deviceResult = r;
+					batcher.Reset(Clock::now());
+					spaceCond.notify_all();
+				}
+			}
+			return 0;
+		}
+		virtual void RequestToQuitThread() override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			WorkerThread::RequestToQuitThread();
+			freePool.SetCancelled(true);
+			pendingCond.notify_all();
+		}
+		// waits while the batcher holds its fill, the lock is held on return
+		ResultCode WaitForRoom(std::unique_lock<std::mutex>& lock)
+		{
+			if(!hMidiStream || !IsThreadRunning()) return MMSYSERR_INVALHANDLE;
+			if(!spaceCond.wait_for(lock, sendTimeout, [this]() { return sendCancelled || (deviceResult != MMSYSERR_NOERROR) || (batcher.GetPendingBytes() < MaxStreamPendingBytes); })) return MIDIERR_NOTREADY;
+			if(sendCancelled) return MidiBridgeCore::ResultCancelled;
+			return deviceResult;
+		}
+	public:
+		MidiStreamOutPort() : WorkerThread("MidiStreamOutPort")
+		{
+			batch.reserve(MidiStreamBufferSize / sizeof(uint32_t));
+		}
+		~MidiStreamOutPort()
+		{
+			CloseDevice();
+		}
+		virtual bool IsDeviceOpen() const override
+		{
+			return hMidiStream != NULL;
+		}
+		std::string GetDeviceName() const
+		{
+			MIDIOUTCAPSW caps = {};
+			if(!hMidiStream || (midiOutGetDevCapsW(deviceId, &caps, sizeof(caps)) != MMSYSERR_NOERROR)) return std::string();
+			return winrt::to_string(caps.szPname);
+		}
+		void CloseDevice()
+		{
+			StopThread();
+			if(!hMidiStream) return;
+			midiStreamStop(hMidiStream);
+			midiOutReset((HMIDIOUT)hMidiStream);
+			for(auto&& hdr : hdrList)
+			{
+				midiOutUnprepareHeader((HMIDIOUT)hMidiStream, hdr.get(), sizeof(MIDIHDR));
+			}
+			hdrList.clear();
+			freePool.Clear();
+			midiStreamClose(hMidiStream);
+			hMidiStream = NULL;
+			std::lock_guard<std::mutex> lock(mutex);
+			batcher.Reset(Clock::now());
+			deviceResult = MMSYSERR_NOERROR;
+		}
+		MMRESULT OpenDevice(uint32_t devid, const MidiBridgeCore::StreamTiming& timing)
 		{
-			switch(stat & 0xf0)
+			CloseDevice();
+			int r = MMSYSERR_NOERROR;
+			try
 			{
-				case 0x80: // noteoff
-				case 0x90: // noteon
-				case 0xa0: // poly.aftertouch
-				case 0xb0: // control
-				case 0xe0: return 3; // pichbend
-				case 0xc0: // program
-				case 0xd0: return 2; // aftertouch
+				MidiBridgeCore::StreamTiming t = timing;
+				t.batchBytes = MidiStreamBufferSize;
+				batcher.SetTiming(t);
+				freePool.SetCapacity(NumMidiStreamBuffers);
+				freePool.SetCancelled(false);
+				deviceId = devid;
+				r = midiStreamOpen(&hMidiStream, &deviceId, 1, (DWORD_PTR)MidiOutProc, (DWORD_PTR)this, CALLBACK_FUNCTION);
+				if(MMResultIsError(r)) throw r;
+				// a quarter note of 1000 ticks lasting 1000 ticks' worth of microseconds, whatever the tick is
+				MIDIPROPTIMEDIV timediv = { sizeof(MIDIPROPTIMEDIV), 1000 };
+				r = midiStreamProperty(hMidiStream, (LPBYTE)&timediv, MIDIPROP_SET | MIDIPROP_TIMEDIV);
+				if(MMResultIsError(r)) throw r;
+				MIDIPROPTEMPO tempo = { sizeof(MIDIPROPTEMPO), (DWORD)(batcher.GetTiming().tick.count() * 1000) };
+				r = midiStreamProperty(hMidiStream, (LPBYTE)&tempo, MIDIPROP_SET | MIDIPROP_TEMPO);
+				if(MMResultIsError(r)) throw r;
+				for(int i = 0; i < NumMidiStreamBuffers; ++i)
+				{
+					std::unique_ptr<MIDISTREAMHDREX> hdr = std::make_unique<MIDISTREAMHDREX>();
+					hdr->Initialize();
+					r = midiOutPrepareHeader((HMIDIOUT)hMidiStream, hdr.get(), sizeof(MIDIHDR));
+					if(MMResultIsError(r)) throw r;
+					freePool.Release(hdr.get());
+					hdrList.push_back(std::move(hdr));
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					batcher.Reset(Clock::now());
+					r = midiStreamRestart(hMidiStream);
+				}
+				if(MMResultIsError(r)) throw r;
+				if(!StartThread())
+				{
+					r = MMSYSERR_ERROR;
+					throw r;
+				}
 			}
-			switch(stat)
+			catch(...)
 			{
-				case 0xf2: return 3; // SPP
-				case 0xf3: return 2; // SS
+				DebugPrint(L"[MidiStreamOutPort] OpenDevice() failed\n");
 			}
-			return 1;
+			if(MMResultIsError(r))
+			{
+				CloseDevice();
+			}
+			return r;
+		}
+		void SetSendTimeout(uint32_t msec)
+		{
+			sendTimeout = std::chrono::milliseconds(msec);
+		}
+		// batches taken after their first event was due, and messages held back to twice the latency
+		uint64_t GetLateBatchCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return batcher.GetLateBatchCount();
+		}
+		uint64_t GetCappedCount() const
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return batcher.GetCappedCount();
+		}
+		virtual ResultCode Send(const uint8_t* p, int c) override
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ResultCode r = WaitForRoom(lock);
+			if(r != MMSYSERR_NOERROR) return r;
+			batcher.AddLongMessage(p, c, Clock::now());
+			pendingCond.notify_one();
+			return MMSYSERR_NOERROR;
+		}
+		virtual ResultCode SendShortMessage(uint32_t msg) override
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ResultCode r = WaitForRoom(lock);
+			if(r != MMSYSERR_NOERROR) return r;
+			batcher.AddShortMessage(msg, Clock::now());
+			pendingCond.notify_one();
+			return MMSYSERR_NOERROR;
+		}
+		// a short message is timed with the rest, the batcher keeps real-time ones clear of the line spacing
+		virtual bool IsShortMessageConcurrent() const override
+		{
+			return true;
+		}
+		virtual void SetSendCancelled(bool v) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			sendCancelled = v;
+			spaceCond.notify_all();
 		}
+		virtual int64_t GetBufferLowWater() const override
+		{
+			return hMidiStream ? (int64_t)freePool.GetLowWater() : -1;
+		}
+	};
+
+	class MidiInPort : public MidiBridgeCore::IMidiInPort
+	{
+	private:
 		HMIDIIN hMidiIn = NULL;
 		std::vector<std::unique_ptr<MIDIHDREX> > hdrList;
 		bool quitFlag = false;
+		// the driver stamps messages in msec since midiInStart()
+		MidiBridgeCore::MidiTimestamp startTime;
 		static void CALLBACK MidiInProc(HMIDIIN hmi, UINT msg, DWORD_PTR inst, DWORD_PTR param1, DWORD_PTR param2)
 		{
 			reinterpret_cast<MidiInPort*>(inst)->OnMidiInCallback(hmi, msg, param1, param2);
 		}
-		void OnMidiInCallback(HMIDIIN hmi, UINT msg, DWORD_PTR param1, DWORD_PTR)
+		void OnMidiInCallback(HMIDIIN hmi, UINT msg, DWORD_PTR param1, DWORD_PTR param2)
 		{
+			MidiBridgeCore::MidiTimestamp t = startTime + std::chrono::milliseconds(param2);
 			switch(msg)
 			{
 				case MIM_DATA:
 				{
 					const uint8_t* p = reinterpret_cast<const uint8_t*>(&param1);
-					int c = GuessShortMessageLength(p[0]);
-					if(OnMidiInReceived) OnMidiInReceived(p, c);
+					int c = MidiBridgeCore::MidiFramer::GetShortMessageLength(p[0]);
+					if(OnMidiInReceived) OnMidiInReceived(p, c, t);
 					break;
 				}
 				case MIM_LONGDATA:
 				{
 					MIDIHDREX* hdr = reinterpret_cast<MIDIHDREX*>(param1);
-					if(OnMidiInReceived) OnMidiInReceived((const uint8_t*)hdr->lpData, hdr->dwBytesRecorded);
+					if(OnMidiInReceived) OnMidiInReceived((const uint8_t*)hdr->lpData, hdr->dwBytesRecorded, t);
 					if(!quitFlag) midiInAddBuffer(hmi, hdr, sizeof(MIDIHDR));
 					break;
 				}
 			}
 		}
 	public:
-		std::function<void(const uint8_t* p, int c)> OnMidiInReceived;
 		MidiInPort()
 		{
 		}
@@ -326,7 +505,7 @@ namespace winrt::MidiPipeBridge::implementation
 		{
 			CloseDevice();
 		}
-		bool IsDeviceOpen() const
+		virtual bool IsDeviceOpen() const override
 		{
 			return hMidiIn != NULL;
 		}
@@ -378,493 +557,415 @@ namespace winrt::MidiPipeBridge::implementation
 		{
 			return MidiBufferSize;
 		}
-		MMRESULT StopDevice()
+		virtual ResultCode StopDevice() override
 		{
 			if(!hMidiIn) return MMSYSERR_INVALHANDLE;
 			return midiInStop(hMidiIn);
 		}
-		MMRESULT StartDevice()
+		virtual ResultCode StartDevice() override
 		{
 			if(!hMidiIn) return MMSYSERR_INVALHANDLE;
+			startTime = std::chrono::steady_clock::now();
 			return midiInStart(hMidiIn);
 		}
 	};
 
 	// ================================================================================
-	// stream transfer classes
+	// the DataTransferBridge
 
-	class PipeInMidiOut : private WinThread
+	class DataTransferBridge::Impl
 	{
-	private:
-		static bool NeedToReportPipeError(HRESULT r, bool isserver)
-		{
-			if(SUCCEEDED(r)) return false;
-			if(isserver && (HRESULT_CODE(r) == ERROR_BROKEN_PIPE)) return false;
-			return true;
-		}
-		HANDLE hPipe = NULL;
-		Overlapped overlapped;
-		uint32_t midiDeviceId = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
+	public:
+		DataTransferBridge* outer;
+		Microsoft::UI::Dispatching::DispatcherQueue dispatchQueue;
 		MidiOutPort midiOutPort;
-		std::mutex reentrantMutex;
-		MMRESULT deviceError = MMSYSERR_NOERROR;
-		HRESULT pipeError = S_OK;
-		bool isServer = false;
-		bool ReadPipeOverlapped(uint8_t* p, int c, int* cr)
-		{
-			overlapped.Reset();
-			DWORD cb = 0;
-			if(ReadFile(hPipe, p, c, &cb, &overlapped)) { *cr = cb; return true; }
-			DWORD r = GetLastError();
-			if(r != ERROR_IO_PENDING) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(r); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			if(!GetOverlappedResult(hPipe, &overlapped, &cb, FALSE)) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			*cr = cb;
-			return true;
-		}
-		virtual unsigned int Run() override
+		// port 1 opened as a stream instead of midiOutPort while the output is timestamped
+		MidiStreamOutPort midiStreamOutPort;
+		MidiInPort midiInPort;
+		uint32_t midiOutDeviceId = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
+		uint32_t midiInDeviceId = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
+		int midiOutBufferCount = NumMidiBuffers;
+		bool midiOutTimestamped = false;
+		MidiBridgeCore::StreamTiming midiOutStreamTiming;
+		// ports 2 and up of a multi-port serial interface, port 1 is the device above. the demux and the mux go where the
+		// devices would go and are declared after them so they let go of them first
+		std::vector<std::unique_ptr<MidiOutPort> > extraMidiOutPorts;
+		std::vector<std::unique_ptr<MidiInPort> > extraMidiInPorts;
+		// the schedulers of the MIDI out devices that have a pacing profile, one slot for each port
+		std::vector<std::string> midiOutPacingSpecs;
+		std::vector<std::unique_ptr<MidiBridgeCore::PacedMidiOut> > midiOutPacers;
+		// in front of each port, behind the demux, while the clock is regenerated
+		uint32_t midiClockRegenMsec = 0;
+		std::vector<std::unique_ptr<MidiBridgeCore::ClockRegenMidiOut> > midiOutClockRegens;
+		std::unique_ptr<MidiBridgeCore::PortDemuxMidiOut> midiOutDemux;
+		std::unique_ptr<MidiBridgeCore::PortMuxMidiIn> midiInMux;
+		// declared ahead of the engines so they outlive them
+		MidiBridgeCore::FlightRecorder flightRecorder;
+		std::unique_ptr<MidiBridgeCore::IMessageFilter> pipeToMidiFilter;
+		std::unique_ptr<MidiBridgeCore::IMessageFilter> midiToPipeFilter;
+		MidiBridgeCore::PipeInMidiOut pipeInMidiOut;
+		MidiBridgeCore::MidiInPipeOut midiInPipeOut;
+		std::wstring pipeName;
+		bool runAsServer = false;
+		int maxPipeInstances = 1;
+		// owns the ports instead of the single client engines while a multi-instance server runs
+		std::unique_ptr<MidiBridgeCore::ClientHub> clientHub;
+		std::unique_ptr<MidiBridgeCore::IPipeSession> pipeSession;
+		Impl(DataTransferBridge* p, Microsoft::UI::Dispatching::DispatcherQueue dispqueue) : outer(p), dispatchQueue(dispqueue)
 		{
-			DebugPrint(L"[PipeInMidiOut] thread begin\n");
-			std::vector<uint8_t> buffer(midiOutPort.GetBufferSize());
-			while(1)
-			{
-				if(quitFlag || FAILED(pipeError) || MMResultIsError(deviceError)) break;
-				int cr = 0;
-				if(!ReadPipeOverlapped(buffer.data(), (int)buffer.size(), &cr))
-				{
-					if(NeedToReportPipeError(pipeError, isServer)) { if(OnPipeError) OnPipeError(pipeError); }
-					break;
-				}
-				deviceError = midiOutPort.Send(buffer.data(), cr);
-				if(MMResultIsError(deviceError))
-				{
-					if(OnDeviceError) OnDeviceError(deviceError);
-					break;
-				}
-			}
-			DebugPrint(L"[PipeInMidiOut] thread end\n");
-			return 0;
+			pipeInMidiOut.OnDeviceError = [this](ResultCode r) { PostMidiOutError((MMRESULT)r); };
+			pipeInMidiOut.OnPipeError = [this](ResultCode r) { PostPipeError((HRESULT)r); };
+			midiInPipeOut.OnDeviceError = [this](ResultCode r) { PostMidiInError((MMRESULT)r); };
+			midiInPipeOut.OnPipeError = [this](ResultCode r) { PostPipeError((HRESULT)r); };
 		}
-		virtual void RequestToQuitThread() override
+		~Impl()
 		{
-			quitFlag = true;
-			CancelIoEx(hPipe, &overlapped);
-			WinThread::RequestToQuitThread();
+			// prevent async callback
+			pipeInMidiOut.OnDeviceError = nullptr;
+			pipeInMidiOut.OnPipeError = nullptr;
+			midiInPipeOut.OnDeviceError = nullptr;
+			midiInPipeOut.OnPipeError = nullptr;
+			outer->OnPipeError = nullptr;
+			outer->OnMidiInError = nullptr;
+			outer->OnMidiOutError = nullptr;
+			StopSession();
+			// detach the ports before they are closed
+			pipeInMidiOut.SetMidiOutPort(nullptr);
+			midiInPipeOut.SetMidiInPort(nullptr);
+			AttachFlightRecorder(nullptr);
+			AttachMessageFilters(nullptr, nullptr);
 		}
-		void InternalStart()
+		// --------------------------------------------------------------------------------
+		// internals
+		void AttachMidiInPort(MidiBridgeCore::IMidiInPort* p)
 		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			if(IsThreadRunning()) return;
-			if(!hPipe || !midiOutPort.IsDeviceOpen()) return;
-			deviceError = MMSYSERR_NOERROR;
-			pipeError = S_OK;
-			StartThread();
+			if(clientHub)	clientHub->SetMidiInPort(p);
+			else			midiInPipeOut.SetMidiInPort(p);
 		}
-		void InternalStop()
+		MidiBridgeCore::IMidiInPort* GetMidiInTarget()
 		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			StopThread();
+			return midiInMux ? (MidiBridgeCore::IMidiInPort*)midiInMux.get() : &midiInPort;
 		}
-	public:
-		std::function<void(MMRESULT)> OnDeviceError;
-		std::function<void(HRESULT)> OnPipeError;
-		PipeInMidiOut() : WinThread(L"PipeInMidiOut")
+		// the device of a port, or the scheduler in front of it
+		MidiBridgeCore::IMidiOutPort* GetMidiOutDevice(size_t index)
 		{
+			if((index < midiOutPacers.size()) && midiOutPacers[index]) return midiOutPacers[index].get();
+			if(index == 0) return midiOutTimestamped ? (MidiBridgeCore::IMidiOutPort*)&midiStreamOutPort : &midiOutPort;
+			return extraMidiOutPorts[index - 1].get();
 		}
-		HANDLE GetPipeHandle() const
+		// where a port's messages go, its clock regenerator or its device
+		MidiBridgeCore::IMidiOutPort* GetMidiOutPortTarget(size_t index)
 		{
-			return hPipe;
+			if((index < midiOutClockRegens.size()) && midiOutClockRegens[index]) return midiOutClockRegens[index].get();
+			return GetMidiOutDevice(index);
 		}
-		void SetPipeHandle(HANDLE h, bool server)
+		MidiBridgeCore::IMidiOutPort* GetMidiOutTarget()
 		{
-			InternalStop();
-			pipeError = S_OK;
-			hPipe = h;
-			isServer = server;
-			InternalStart();
+			return midiOutDemux ? (MidiBridgeCore::IMidiOutPort*)midiOutDemux.get() : GetMidiOutPortTarget(0);
 		}
-		uint32_t GetMidiDeviceId() const
+		// port 1 as a plain device or as a stream, false when it does not open
+		bool OpenMidiOutDevice()
 		{
-			return midiDeviceId;
+			if(!MidiDeviceInfo::IsValidDeviceId(midiOutDeviceId, true)) return true;
+			MMRESULT r = midiOutTimestamped ? midiStreamOutPort.OpenDevice(midiOutDeviceId, midiOutStreamTiming) : midiOutPort.OpenDevice(midiOutDeviceId, midiOutBufferCount);
+			if(MMResultIsError(r)) PostMidiOutError(r);
+			return !MMResultIsError(r);
 		}
-		void SetMidiDeviceId(uint32_t devid)
+		// resolves the pacing of each open device by its name, while no engine sends.
+		// a stream is timed by its own batcher and is not paced
+		void ApplyMidiOutPacing()
 		{
-			if(midiDeviceId == devid) return;
-			InternalStop();
-			deviceError = MMSYSERR_NOERROR;
-			midiDeviceId = devid;
-			if(MidiDeviceInfo::IsValidDeviceId(midiDeviceId, true))
+			midiOutPacers.clear();
+			midiOutPacers.resize(1 + extraMidiOutPorts.size());
+			for(size_t i = 0; i < midiOutPacers.size(); ++i)
 			{
-				deviceError = midiOutPort.OpenDevice(midiDeviceId);
-				if(MMResultIsError(deviceError))
-				{
-					if(OnDeviceError) OnDeviceError(deviceError);
-				}
+				MidiOutPort* port = (i == 0) ? &midiOutPort : extraMidiOutPorts[i - 1].get();
+				if(!port->IsDeviceOpen()) continue;
+				std::string spec = (midiOutPacingSpecs.size() == 1) ? midiOutPacingSpecs[0] : (i < midiOutPacingSpecs.size()) ? midiOutPacingSpecs[i] : "";
+				MidiBridgeCore::MidiOutPacingProfile profile;
+				if(MidiBridgeCore::ResultIsError(MidiBridgeCore::ParsePacingProfile(spec, port->GetDeviceName(), &profile)) || !profile.IsEnabled()) continue;
+				midiOutPacers[i] = std::make_unique<MidiBridgeCore::PacedMidiOut>();
+				midiOutPacers[i]->SetMidiOutPort(port);
+				midiOutPacers[i]->SetProfile(profile);
+				midiOutPacers[i]->Start();
+				DebugPrint(L"[DataTransferBridge] port {} paced by {}\n", i + 1, winrt::to_hstring(profile.name).c_str());
 			}
-			InternalStart();
-		}
-		MMRESULT GetDeviceError() const
-		{
-			return deviceError;
-		}
-		HRESULT GetPipeError() const
-		{
-			return pipeError;
-		}
-		operator HANDLE()
-		{
-			return hThread;
-		}
-	};
-
-	class MidiInPipeOut
-	{
-	private:
-		static bool NeedToReportPipeError(HRESULT r, bool isserver)
-		{
-			if(SUCCEEDED(r)) return false;
-			if(isserver && (HRESULT_CODE(r) == ERROR_BROKEN_PIPE)) return false;
-			return true;
-		}
-		HANDLE hPipe = NULL;
-		ManualEvent quitEvent;
-		ManualEvent stoppedEvent;
-		Overlapped overlapped;
-		uint32_t midiDeviceId = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
-		MidiInPort midiInPort;
-		std::mutex reentrantMutex;
-		MMRESULT deviceError = MMSYSERR_NOERROR;
-		HRESULT pipeError = S_OK;
-		bool isServer = false;
-		bool quitFlag = false;
-		bool WritePipeOverlapped(const uint8_t* p, int c, int* cw)
-		{
-			overlapped.Reset();
-			DWORD cb = 0;
-			if(WriteFile(hPipe, p, c, &cb, &overlapped)) { *cw = (int)cb; return true; }
-			if(GetLastError() != ERROR_IO_PENDING) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			if(!GetOverlappedResult(hPipe, &overlapped, &cb, FALSE)) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			*cw = (int)cb;
-			return true;
-		}
-		void OnMidiMessageReceived(const uint8_t* p, int c)
-		{
-			if(FAILED(pipeError)) return;
-			int cw = 0;
-			if(!WritePipeOverlapped(p, c, &cw))
+			if(midiOutDemux)
 			{
-				if(NeedToReportPipeError(pipeError, isServer)) { if(OnPipeError) OnPipeError(pipeError); }
+				for(size_t i = 0; i < midiOutPacers.size(); ++i) midiOutDemux->SetPort((int)i, GetMidiOutPortTarget(i));
 			}
 		}
-		void InternalStart()
+		// a clock regenerator for each port, behind the demux so a clock held back still goes to the port it was sent to.
+		// rebuilt while no engine sends, ahead of the pacing that wires the demux to it
+		void ApplyMidiClockRegen()
 		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			if(!hPipe || !midiInPort.IsDeviceOpen()) return;
-			deviceError = MMSYSERR_NOERROR;
-			pipeError = S_OK;
-			quitFlag = false;
-			quitEvent.Reset();
-			stoppedEvent.Reset();
-			deviceError = midiInPort.StartDevice();
-			if(MMResultIsError(deviceError))
+			midiOutClockRegens.clear();
+			if(midiClockRegenMsec == 0) return;
+			MidiBridgeCore::ClockPllSettings settings;
+			settings.holdback = std::chrono::milliseconds(midiClockRegenMsec);
+			midiOutClockRegens.resize(1 + extraMidiOutPorts.size());
+			for(size_t i = 0; i < midiOutClockRegens.size(); ++i)
 			{
-				quitFlag = true;
-				quitEvent.Set();
-				stoppedEvent.Set();
-				if(OnDeviceError) OnDeviceError(deviceError);
+				midiOutClockRegens[i] = std::make_unique<MidiBridgeCore::ClockRegenMidiOut>();
+				midiOutClockRegens[i]->SetSettings(settings);
+				midiOutClockRegens[i]->SetMidiOutPort(GetMidiOutDevice(i));
+				midiOutClockRegens[i]->Start();
 			}
 		}
-		void InternalStop()
-		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			quitFlag = true;
-			if(hPipe) CancelIoEx(hPipe, &overlapped);
-			quitEvent.Set();
-			midiInPort.StopDevice();
-			stoppedEvent.Set();
-		}
-	public:
-		std::function<void(MMRESULT)> OnDeviceError;
-		std::function<void(HRESULT)> OnPipeError;
-		MidiInPipeOut()
+		// detaching lets go of the devices behind the clock regenerators as well, the clocks they hold are dropped
+		void AttachMidiOutPort(MidiBridgeCore::IMidiOutPort* p)
 		{
-			midiInPort.OnMidiInReceived = [this](const uint8_t* p, int c) { OnMidiMessageReceived(p, c); };
+			if(clientHub)	clientHub->SetMidiOutPort(p);
+			else			pipeInMidiOut.SetMidiOutPort(p);
+			for(size_t i = 0; i < midiOutClockRegens.size(); ++i) midiOutClockRegens[i]->SetMidiOutPort(p ? GetMidiOutDevice(i) : nullptr);
 		}
-		~MidiInPipeOut()
+		void PostPipeError(HRESULT r)
 		{
-			InternalStop();
+			if(!dispatchQueue) { if(outer->OnPipeError) outer->OnPipeError(r); return; }
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); });
 		}
-		HANDLE GetPipeHandle() const
+		void PostMidiInError(MMRESULT r)
 		{
-			return hPipe;
+			if(!dispatchQueue) { if(outer->OnMidiInError) outer->OnMidiInError(r); return; }
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiInError) outer->OnMidiInError(r); });
 		}
-		void SetPipeHandle(HANDLE h, bool server)
+		void PostMidiOutError(MMRESULT r)
 		{
-			InternalStop();
-			pipeError = S_OK;
-			hPipe = h;
-			isServer = server;
-			InternalStart();
+			if(!dispatchQueue) { if(outer->OnMidiOutError) outer->OnMidiOutError(r); return; }
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiOutError) outer->OnMidiOutError(r); });
 		}
-		uint32_t GetMidiDeviceId() const
+		// --------------------------------------------------------------------------------
+		// public APIs
+		uint32_t GetMidiInDeviceId() const
 		{
-			return midiDeviceId;
+			return midiInDeviceId;
 		}
-		void SetMidiDeviceId(uint32_t devid)
+		void SetMidiInDeviceId(uint32_t v)
 		{
-			if(midiDeviceId == devid) return;
-			InternalStop();
-			deviceError = MMSYSERR_NOERROR;
-			midiDeviceId = devid;
-			if(MidiDeviceInfo::IsValidDeviceId(midiDeviceId, false))
+			if(midiInDeviceId == v) return;
+			AttachMidiInPort(nullptr);
+			midiInPort.CloseDevice();
+			midiInDeviceId = v;
+			if(MidiDeviceInfo::IsValidDeviceId(midiInDeviceId, false))
 			{
-				deviceError = midiInPort.OpenDevice(midiDeviceId);
-				if(MMResultIsError(deviceError))
-				{
-					if(OnDeviceError) OnDeviceError(deviceError);
-				}
+				MMRESULT r = midiInPort.OpenDevice(midiInDeviceId);
+				if(MMResultIsError(r)) PostMidiInError(r);
 			}
-			InternalStart();
+			AttachMidiInPort(GetMidiInTarget());
 		}
-		HRESULT GetDeviceError() const
-		{
-			return deviceError;
-		}
-		HRESULT GetPipeError() const
+		uint32_t GetMidiOutDeviceId() const
 		{
-			return pipeError;
+			return midiOutDeviceId;
 		}
-		operator HANDLE()
+		void SetMidiOutDeviceId(uint32_t v)
 		{
-			return stoppedEvent;
-		}
-	};
-
-	// ================================================================================
-	// pipe connection session classes
-
-	struct IPipeSession
-	{
-		std::function<void(HRESULT)> OnSessionError;
-		virtual ~IPipeSession() {}
-		virtual bool StartSession() = 0;
-		virtual void StopSession() = 0;
-		virtual bool IsSessionRunning() const = 0;
-		virtual HRESULT GetSessionError() const = 0;
-	};
-
-	class PipeServer : public IPipeSession, private WinThread
-	{
-	private:
-		std::wstring pipeName;
-		PipeInMidiOut& pipeInMidiOut;
-		MidiInPipeOut& midiInPipeOut;
-		HANDLE hPipe = NULL;
-		Overlapped overlapped;
-		HRESULT sessionError = S_OK;
-		bool ConnectPipeOverlapped()
-		{
-			overlapped.Reset();
-			BOOL rconnect = ConnectNamedPipe(hPipe, &overlapped);
-			DWORD r = GetLastError();
-			if(rconnect) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; } // overlapped ConnectNamedPipe() should return FALSE
-			if(r == ERROR_PIPE_CONNECTED) return true;
-			if((r != ERROR_IO_PENDING) && (r != ERROR_PIPE_LISTENING)) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			return true;
+			SetMidiOutDevice(v, midiOutPacingSpecs);
 		}
-		virtual unsigned int Run() override
+		bool SetMidiOutDevice(uint32_t v, const std::vector<std::string>& pacingspecs)
 		{
-			DebugPrint(L"[PipeServer] thread begin\n");
-			while(1)
+			bool ok = IsValidPacing(pacingspecs);
+			std::vector<std::string> specs = ok ? pacingspecs : std::vector<std::string>();
+			if(midiOutDeviceId == v)
 			{
-				if(quitFlag) break;
-				if(!ConnectPipeOverlapped())
-				{
-					DebugPrint(L"[PipeServer] failed ConnectNamedPipe()\n");
-					if(FAILED(sessionError)) { if(OnSessionError) OnSessionError(sessionError); }
-					break;
-				}
-				DebugPrint(L"[PipeServer] connected\n");
-				pipeInMidiOut.SetPipeHandle(hPipe, true);
-				midiInPipeOut.SetPipeHandle(hPipe, true);
-				while(1)
-				{
-					HANDLE hw[] = { pipeInMidiOut, midiInPipeOut, quitEvent };
-					WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE);
-					if( FAILED(pipeInMidiOut.GetDeviceError()) ||
-						FAILED(pipeInMidiOut.GetPipeError()) ||
-						FAILED(midiInPipeOut.GetDeviceError()) ||
-						FAILED(midiInPipeOut.GetPipeError()) ||
-						quitFlag) break;
-				}
-				// FlushFileBuffers(hPipe); // unnecessary?
-				DisconnectNamedPipe(hPipe);
-				pipeInMidiOut.SetPipeHandle(NULL, false);
-				midiInPipeOut.SetPipeHandle(NULL, false);
-				DebugPrint(L"[PipeServer] disconnected\n");
+				if(specs != midiOutPacingSpecs) SetMidiOutPacing(specs);
+				return ok;
 			}
-			DebugPrint(L"[PipeServer] thread end\n");
-			return 0;
-		}
-		virtual void RequestToQuitThread() override
-		{
-			quitFlag = true;
-			CancelIoEx(hPipe, &overlapped);
-			WinThread::RequestToQuitThread();
-		}
-	public:
-		PipeServer(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
-			: WinThread(L"PipeServer")
-			, pipeName(pipename)
-			, pipeInMidiOut(p2m)
-			, midiInPipeOut(m2p)
-		{
-		}
-		virtual ~PipeServer() override
-		{
-			StopSession();
-		}
-		virtual bool StartSession() override
-		{
-			StopSession();
-			sessionError = S_OK;
-			constexpr DWORD BUFFERSIZE = 1024;
-			hPipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, BUFFERSIZE, BUFFERSIZE, 0, nullptr);
-			if(hPipe == INVALID_HANDLE_VALUE)
-			{
-				hPipe = NULL;
-				sessionError = HRESULT_FROM_WIN32(GetLastError());
-				if(OnSessionError) OnSessionError(sessionError);
-				DebugPrint(L"[PipeServer] failed CreateNamedPipe()\n");
-				return false;
+			// the device is opened and its pacing resolved once
+			AttachMidiOutPort(nullptr);
+			midiOutPacers.clear();
+			midiOutPort.CloseDevice();
+			midiStreamOutPort.CloseDevice();
+			midiOutDeviceId = v;
+			midiOutPacingSpecs = specs;
+			OpenMidiOutDevice();
+			ApplyMidiOutPacing();
+			AttachMidiOutPort(GetMidiOutTarget());
+			return ok;
+		}
+		void SetMidiOutSendTimeout(uint32_t msec)
+		{
+			midiOutPort.SetSendTimeout(msec);
+			midiStreamOutPort.SetSendTimeout(msec);
+			for(auto&& port : extraMidiOutPorts) port->SetSendTimeout(msec);
+		}
+		bool SetPortSelectDeviceIds(const std::vector<uint32_t>& outids, const std::vector<uint32_t>& inids)
+		{
+			AttachMidiOutPort(nullptr);
+			AttachMidiInPort(nullptr);
+			midiOutDemux.reset();
+			midiInMux.reset();
+			midiOutPacers.clear();
+			extraMidiOutPorts.clear();
+			extraMidiInPorts.clear();
+			bool ok = true;
+			for(uint32_t devid : outids)
+			{
+				auto port = std::make_unique<MidiOutPort>();
+				MMRESULT r = port->OpenDevice(devid, midiOutBufferCount);
+				if(MMResultIsError(r)) { PostMidiOutError(r); ok = false; }
+				extraMidiOutPorts.push_back(std::move(port));
+			}
+			for(uint32_t devid : inids)
+			{
+				auto port = std::make_unique<MidiInPort>();
+				MMRESULT r = port->OpenDevice(devid);
+				if(MMResultIsError(r)) { PostMidiInError(r); ok = false; }
+				extraMidiInPorts.push_back(std::move(port));
+			}
+			if(!extraMidiOutPorts.empty())
+			{
+				midiOutDemux = std::make_unique<MidiBridgeCore::PortDemuxMidiOut>(1 + (int)extraMidiOutPorts.size());
+			}
+			ApplyMidiClockRegen();
+			ApplyMidiOutPacing();
+			if(!extraMidiInPorts.empty())
+			{
+				midiInMux = std::make_unique<MidiBridgeCore::PortMuxMidiIn>(1 + (int)extraMidiInPorts.size());
+				midiInMux->SetPort(0, &midiInPort);
+				for(size_t i = 0; i < extraMidiInPorts.size(); ++i) midiInMux->SetPort(1 + (int)i, extraMidiInPorts[i].get());
 			}
-			return StartThread();
+			AttachMidiOutPort(GetMidiOutTarget());
+			AttachMidiInPort(GetMidiInTarget());
+			return ok;
 		}
-		virtual void StopSession() override
+		void SetMidiOutBufferCount(int v)
 		{
-			StopThread();
-			if(hPipe) CloseHandle(hPipe);
-			hPipe = NULL;
+			midiOutBufferCount = v;
 		}
-		virtual bool IsSessionRunning() const override
+		void SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime)
 		{
-			return IsThreadRunning();
+			MidiBridgeCore::CoalescePolicy policy;
+			policy.flushBytes = (int)flushbytes;
+			policy.flushDelay = std::chrono::microseconds(delayusec);
+			policy.flushOnRealTime = flushonrealtime;
+			midiInPipeOut.SetCoalescePolicy(policy);
 		}
-		virtual HRESULT GetSessionError() const override
+		void SetMidiInSerialPacing(double bitrate, int fifobytes)
 		{
-			return sessionError;
+			MidiBridgeCore::SerialPacing pacing;
+			pacing.bitRate = bitrate;
+			pacing.fifoBytes = fifobytes;
+			midiInPipeOut.SetSerialPacing(pacing);
 		}
-	};
-
-	class PipeClient : public IPipeSession
-	{
-	private:
-		std::wstring pipeName;
-		PipeInMidiOut& pipeInMidiOut;
-		MidiInPipeOut& midiInPipeOut;
-		HANDLE hPipe = NULL;
-		HRESULT sessionError = S_OK;
-	public:
-		PipeClient(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
-			: pipeName(pipename)
-			, pipeInMidiOut(p2m)
-			, midiInPipeOut(m2p)
+		void SetPipeReadAhead(int v)
 		{
+			pipeInMidiOut.SetReadAhead(v);
 		}
-		virtual ~PipeClient() override
+		void AttachFlightRecorder(MidiBridgeCore::FlightRecorder* p)
 		{
-			StopSession();
+			pipeInMidiOut.SetFlightRecorder(p);
+			midiInPipeOut.SetFlightRecorder(p);
+			if(clientHub) clientHub->SetFlightRecorder(p);
 		}
-		virtual bool StartSession() override
+		bool SetFlightRecorder(const std::wstring& path, size_t capacity)
 		{
-			StopSession();
-			sessionError = S_OK;
-			hPipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
-			if(hPipe == INVALID_HANDLE_VALUE)
-			{
-				hPipe = NULL;
-				sessionError = HRESULT_FROM_WIN32(GetLastError());
-				if(OnSessionError) OnSessionError(sessionError);
-				DebugPrint(L"[PipeClient] failed CreateFile()\n");
+			AttachFlightRecorder(nullptr);
+			flightRecorder.Close();
+			if(path.empty()) return true;
+			ResultCode r = flightRecorder.Open(path, capacity);
+			if(MidiBridgeCore::ResultIsError(r))
+			{
+				DebugPrint(L"[DataTransferBridge] cannot open the flight recorder log {} ({})\n", path, r);
 				return false;
 			}
-			DWORD mode = PIPE_READMODE_BYTE;
-			SetNamedPipeHandleState(hPipe, &mode, nullptr, nullptr);
-			pipeInMidiOut.SetPipeHandle(hPipe, false);
-			midiInPipeOut.SetPipeHandle(hPipe, false);
+			AttachFlightRecorder(&flightRecorder);
 			return true;
 		}
-		virtual void StopSession() override
+		void AttachMessageFilters(MidiBridgeCore::IMessageFilter* p2m, MidiBridgeCore::IMessageFilter* m2p)
 		{
-			pipeInMidiOut.SetPipeHandle(NULL, false);
-			midiInPipeOut.SetPipeHandle(NULL, false);
-			if(hPipe) CloseHandle(hPipe);
-			hPipe = NULL;
+			pipeInMidiOut.SetMessageFilter(p2m);
+			midiInPipeOut.SetMessageFilter(m2p);
+			if(clientHub)
+			{
+				clientHub->SetPipeToMidiFilter(p2m);
+				clientHub->SetMidiToPipeFilter(m2p);
+			}
 		}
-		virtual bool IsSessionRunning() const override
+		bool SetMessageFilters(const std::string& p2mspec, const std::string& m2pspec)
 		{
-			return hPipe != NULL;
+			std::unique_ptr<MidiBridgeCore::IMessageFilter> p2m, m2p;
+			ResultCode r = MidiBridgeCore::ParseMessageFilter(p2mspec, &p2m);
+			if(!MidiBridgeCore::ResultIsError(r)) r = MidiBridgeCore::ParseMessageFilter(m2pspec, &m2p);
+			if(MidiBridgeCore::ResultIsError(r))
+			{
+				DebugPrint(L"[DataTransferBridge] cannot parse the message filter ({})\n", r);
+				return false;
+			}
+			// the engines let go of the old chains before they are destroyed
+			AttachMessageFilters(p2m.get(), m2p.get());
+			pipeToMidiFilter = std::move(p2m);
+			midiToPipeFilter = std::move(m2p);
+			return true;
 		}
-		virtual HRESULT GetSessionError() const override
+		void SetPipeZeroCopyRead(bool v)
 		{
-			return sessionError;
+			pipeInMidiOut.SetZeroCopyRead(v);
 		}
-	};
-
-	// ================================================================================
-	// the DataTransferBridge
-
-	class DataTransferBridge::Impl
-	{
-	public:
-		DataTransferBridge* outer;
-		Microsoft::UI::Dispatching::DispatcherQueue dispatchQueue;
-		PipeInMidiOut pipeInMidiOut;
-		MidiInPipeOut midiInPipeOut;
-		std::wstring pipeName;
-		bool runAsServer = false;
-		std::unique_ptr<IPipeSession> pipeSession;
-		Impl(DataTransferBridge* p, Microsoft::UI::Dispatching::DispatcherQueue dispqueue) : outer(p), dispatchQueue(dispqueue)
+		void SetPipeRealTimeLane(bool v)
 		{
-			pipeInMidiOut.OnDeviceError = [this](MMRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiOutError) outer->OnMidiOutError(r); }); };
-			pipeInMidiOut.OnPipeError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
-			midiInPipeOut.OnDeviceError = [this](MMRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiInError) outer->OnMidiInError(r); }); };
-			midiInPipeOut.OnPipeError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
+			pipeInMidiOut.SetRealTimeLane(v);
 		}
-		~Impl()
+		static bool IsValidPacing(const std::vector<std::string>& specs)
 		{
-			// prevent async callback
-			pipeInMidiOut.OnDeviceError = nullptr;
-			pipeInMidiOut.OnPipeError = nullptr;
-			midiInPipeOut.OnDeviceError = nullptr;
-			midiInPipeOut.OnPipeError = nullptr;
-			outer->OnPipeError = nullptr;
-			outer->OnMidiInError = nullptr;
-			outer->OnMidiOutError = nullptr;
-			StopSession();
+			for(const auto& spec : specs)
+			{
+				MidiBridgeCore::MidiOutPacingProfile profile;
+				ResultCode r = MidiBridgeCore::ParsePacingProfile(spec, std::string(), &profile);
+				if(MidiBridgeCore::ResultIsError(r))
+				{
+					DebugPrint(L"[DataTransferBridge] cannot parse the pacing {} ({})\n", winrt::to_hstring(spec).c_str(), r);
+					return false;
+				}
+			}
+			return true;
 		}
-		// --------------------------------------------------------------------------------
-		// public APIs
-		uint32_t GetMidiInDeviceId() const
+		bool SetMidiOutPacing(const std::vector<std::string>& specs)
 		{
-			return midiInPipeOut.GetMidiDeviceId();
+			if(!IsValidPacing(specs)) return false;
+			AttachMidiOutPort(nullptr);
+			midiOutPacingSpecs = specs;
+			ApplyMidiOutPacing();
+			AttachMidiOutPort(GetMidiOutTarget());
+			return true;
 		}
-		void SetMidiInDeviceId(uint32_t v)
-		{
-			midiInPipeOut.SetMidiDeviceId(v);
+		bool SetMidiOutTimestamped(bool enable, uint32_t latencymsec, uint32_t smoothingmsec)
+		{
+			AttachMidiOutPort(nullptr);
+			midiOutPacers.clear();
+			midiOutPort.CloseDevice();
+			midiStreamOutPort.CloseDevice();
+			midiOutTimestamped = enable;
+			midiOutStreamTiming.latency = std::chrono::milliseconds(latencymsec);
+			midiOutStreamTiming.smoothing = std::chrono::milliseconds(smoothingmsec);
+			bool ok = OpenMidiOutDevice();
+			ApplyMidiOutPacing();
+			AttachMidiOutPort(GetMidiOutTarget());
+			if(enable) DebugPrint(L"[DataTransferBridge] MIDI out timestamped, latency {} ms, smoothing {} ms\n", latencymsec, smoothingmsec);
+			return ok;
+		}
+		void SetMidiClockRegen(uint32_t holdbackmsec)
+		{
+			AttachMidiOutPort(nullptr);
+			midiClockRegenMsec = holdbackmsec;
+			ApplyMidiClockRegen();
+			if(midiOutDemux)
+			{
+				for(int i = 0; i < midiOutDemux->GetPortCount(); ++i) midiOutDemux->SetPort(i, GetMidiOutPortTarget((size_t)i));
+			}
+			if(0 < holdbackmsec) DebugPrint(L"[DataTransferBridge] MIDI clock regenerated on {} ports, holdback {} ms\n", midiOutClockRegens.size(), holdbackmsec);
+			AttachMidiOutPort(GetMidiOutTarget());
 		}
-		uint32_t GetMidiOutDeviceId() const
+		MidiBridgeCore::BridgeStatistics GetStatistics() const
 		{
-			return pipeInMidiOut.GetMidiDeviceId();
+			if(clientHub) return clientHub->GetStatistics();
+			MidiBridgeCore::BridgeStatistics st;
+			st.pipeToMidi = pipeInMidiOut.GetStatistics();
+			st.midiToPipe = midiInPipeOut.GetStatistics();
+			return st;
 		}
-		void SetMidiOutDeviceId(uint32_t v)
+		void SetMaxPipeInstances(int v)
 		{
-			pipeInMidiOut.SetMidiDeviceId(v);
+			maxPipeInstances = std::clamp(v, 1, MidiBridgeCore::ClientHub::MaxClients);
 		}
 		bool IsRunning() const
 		{
@@ -875,14 +976,36 @@ namespace winrt::MidiPipeBridge::implementation
 			StopSession();
 			pipeName = pipename;
 			runAsServer = runasserver;
-			if(runAsServer)	pipeSession = std::make_unique<PipeServer>(pipeName, pipeInMidiOut, midiInPipeOut);
-			else			pipeSession = std::make_unique<PipeClient>(pipeName, pipeInMidiOut, midiInPipeOut);
-			pipeSession->OnSessionError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
+			if(runAsServer && (1 < maxPipeInstances))
+			{
+				// the ports move from the single client engines to the hub for the session
+				pipeInMidiOut.SetMidiOutPort(nullptr);
+				midiInPipeOut.SetMidiInPort(nullptr);
+				clientHub = std::make_unique<MidiBridgeCore::ClientHub>(maxPipeInstances);
+				clientHub->OnMidiOutError = [this](ResultCode r) { PostMidiOutError((MMRESULT)r); };
+				clientHub->OnMidiInError = [this](ResultCode r) { PostMidiInError((MMRESULT)r); };
+				clientHub->OnPipeError = [this](ResultCode r) { PostPipeError((HRESULT)r); };
+				clientHub->SetMidiOutPort(GetMidiOutTarget());
+				clientHub->SetMidiInPort(GetMidiInTarget());
+				if(flightRecorder.IsOpen()) clientHub->SetFlightRecorder(&flightRecorder);
+				clientHub->SetPipeToMidiFilter(pipeToMidiFilter.get());
+				clientHub->SetMidiToPipeFilter(midiToPipeFilter.get());
+				pipeSession = MidiBridgeCore::CreateNamedPipeServer(pipeName, *clientHub);
+			}
+			else if(runAsServer)	pipeSession = MidiBridgeCore::CreateNamedPipeServer(pipeName, pipeInMidiOut, midiInPipeOut);
+			else					pipeSession = MidiBridgeCore::CreateNamedPipeClient(pipeName, pipeInMidiOut, midiInPipeOut);
+			pipeSession->OnSessionError = [this](ResultCode r) { PostPipeError((HRESULT)r); };
 			return pipeSession->StartSession();
 		}
 		void StopSession()
 		{
 			pipeSession.reset();
+			if(!clientHub) return;
+			clientHub->SetMidiOutPort(nullptr);
+			clientHub->SetMidiInPort(nullptr);
+			clientHub.reset();
+			pipeInMidiOut.SetMidiOutPort(GetMidiOutTarget());
+			midiInPipeOut.SetMidiInPort(GetMidiInTarget());
 		}
 		bool IsSessionRunning() const
 		{
@@ -896,6 +1019,22 @@ namespace winrt::MidiPipeBridge::implementation
 	void DataTransferBridge::SetMidiInDeviceId(uint32_t v) { impl->SetMidiInDeviceId(v); }
 	uint32_t DataTransferBridge::GetMidiOutDeviceId() const { return impl->GetMidiOutDeviceId(); }
 	void DataTransferBridge::SetMidiOutDeviceId(uint32_t v) { impl->SetMidiOutDeviceId(v); }
+	bool DataTransferBridge::SetMidiOutDevice(uint32_t v, const std::vector<std::string>& pacingspecs) { return impl->SetMidiOutDevice(v, pacingspecs); }
+	void DataTransferBridge::SetMidiOutSendTimeout(uint32_t msec) { impl->SetMidiOutSendTimeout(msec); }
+	bool DataTransferBridge::SetPortSelectDeviceIds(const std::vector<uint32_t>& outids, const std::vector<uint32_t>& inids) { return impl->SetPortSelectDeviceIds(outids, inids); }
+	void DataTransferBridge::SetMidiOutBufferCount(int v) { impl->SetMidiOutBufferCount(v); }
+	void DataTransferBridge::SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime) { impl->SetMidiInCoalescing(flushbytes, delayusec, flushonrealtime); }
+	void DataTransferBridge::SetMidiInSerialPacing(double bitrate, int fifobytes) { impl->SetMidiInSerialPacing(bitrate, fifobytes); }
+	void DataTransferBridge::SetPipeReadAhead(int v) { impl->SetPipeReadAhead(v); }
+	bool DataTransferBridge::SetFlightRecorder(const std::wstring& path, size_t capacity) { return impl->SetFlightRecorder(path, capacity); }
+	bool DataTransferBridge::SetMessageFilters(const std::string& pipetomidi, const std::string& miditopipe) { return impl->SetMessageFilters(pipetomidi, miditopipe); }
+	void DataTransferBridge::SetPipeZeroCopyRead(bool v) { impl->SetPipeZeroCopyRead(v); }
+	void DataTransferBridge::SetPipeRealTimeLane(bool v) { impl->SetPipeRealTimeLane(v); }
+	bool DataTransferBridge::SetMidiOutPacing(const std::vector<std::string>& specs) { return impl->SetMidiOutPacing(specs); }
+	bool DataTransferBridge::SetMidiOutTimestamped(bool enable, uint32_t latencymsec, uint32_t smoothingmsec) { return impl->SetMidiOutTimestamped(enable, latencymsec, smoothingmsec); }
+	void DataTransferBridge::SetMidiClockRegen(uint32_t holdbackmsec) { impl->SetMidiClockRegen(holdbackmsec); }
+	MidiBridgeCore::BridgeStatistics DataTransferBridge::GetStatistics() const { return impl->GetStatistics(); }
+	void DataTransferBridge::SetMaxPipeInstances(int v) { impl->SetMaxPipeInstances(v); }
 	bool DataTransferBridge::StartSession(const std::wstring& pipename, bool runasserver) { return impl->StartSession(pipename, runasserver); }
 	void DataTransferBridge::StopSession() { impl->StopSession(); }
 	bool DataTransferBridge::IsSessionRunning() const { return impl->IsSessionRunning(); }
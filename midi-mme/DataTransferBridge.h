@@ -9,6 +9,9 @@
 
 #include <winrt/Microsoft.UI.Dispatching.h>
 #include <functional>
+#include <string>
+#include <vector>
+#include "Statistics.h"
 
 namespace winrt::MidiPipeBridge::implementation
 {
@@ -22,12 +25,56 @@ namespace winrt::MidiPipeBridge::implementation
 		std::function<void(MMRESULT)> OnMidiInError;
 		std::function<void(MMRESULT)> OnMidiOutError;
 		DataTransferBridge() = delete;
+		// the error handlers run on dispqueue, or right on the engine thread that saw the error when it is null (the headless mode)
 		DataTransferBridge(Microsoft::UI::Dispatching::DispatcherQueue dispqueue);
 		~DataTransferBridge();
 		uint32_t GetMidiInDeviceId() const;
 		void SetMidiInDeviceId(uint32_t v);
 		uint32_t GetMidiOutDeviceId() const;
 		void SetMidiOutDeviceId(uint32_t v);
+		// the device and its pacing specs (see SetMidiOutPacing()) together, the device is opened and paced once.
+		// a spec that does not parse falls back to the built-in profiles and returns false
+		bool SetMidiOutDevice(uint32_t v, const std::vector<std::string>& pacingspecs);
+		// how long the pipe reader waits for the MIDI out device to return a buffer before reporting MIDIERR_NOTREADY
+		void SetMidiOutSendTimeout(uint32_t msec);
+		// the further devices of a multi-port serial interface, addressed by the guest with F5 nn port selects:
+		// the device set above is port 1, these are ports 2 and up. empty lists go back to the single devices
+		bool SetPortSelectDeviceIds(const std::vector<uint32_t>& outids, const std::vector<uint32_t>& inids);
+		// number of MIDIHDR buffers in flight, takes effect when the MIDI out device is next opened
+		void SetMidiOutBufferCount(int v);
+		// MIDI in bytes are held back up to delayusec, or until flushbytes are pending, so a burst goes to the pipe in one write
+		void SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime);
+		// meter MIDI in bytes to the guest at a serial line rate (31250 or 38400 bps, 0 disables), fifobytes may run ahead of the line
+		void SetMidiInSerialPacing(double bitrate, int fifobytes);
+		// pipe reads kept in flight ahead of the MIDI out (1..256), 1 reads and sends in turn on one thread
+		void SetPipeReadAhead(int v);
+		// always-on capture of every bridged message into a memory-mapped circular log, read it with the flightdump tool.
+		// an empty path stops the capture, false when the log cannot be opened
+		bool SetFlightRecorder(const std::wstring& path, size_t capacity);
+		// filter and transform chains for each direction in the ParseMessageFilter() syntax, e.g. "droprt;channels:1-9",
+		// an empty spec passes everything, false and nothing changed when a spec does not parse
+		bool SetMessageFilters(const std::string& pipetomidi, const std::string& miditopipe);
+		// pure SysEx reads land directly in a MIDIHDR buffer and are sent without a copy, needs a read-ahead of 1
+		void SetPipeZeroCopyRead(bool v);
+		// real-time bytes are sent with midiOutShortMsg as soon as they are read, ahead of the SysEx queued in the ring
+		// and in the MIDIHDRs. needs a read-ahead of 2 or more, the ring should hold the longest dump
+		void SetPipeRealTimeLane(bool v);
+		// pace the MIDI out devices for slow receivers in the ParsePacingProfile() syntax, one spec for each port in the order
+		// of the ports or a single one for all of them. "auto" or empty picks a built-in profile by the device name, which is
+		// resolved again whenever a device changes. false and nothing changed when a spec does not parse
+		bool SetMidiOutPacing(const std::vector<std::string>& specs);
+		// play port 1 through the stream API: each message is due latencymsec after it arrived and goes to the driver ahead of
+		// time with its tick delta, smoothingmsec spreads a burst back over the pause before it (0 leaves it as it came).
+		// reopens the device, false when it cannot be opened as a stream
+		bool SetMidiOutTimestamped(bool enable, uint32_t latencymsec, uint32_t smoothingmsec);
+		// regenerate the MIDI clock the guest sends through a PLL: each F8 is played holdbackmsec after the loop's estimate of
+		// when it was sent, in order with the start, continue and stop around it. 0 passes the clock through
+		void SetMidiClockRegen(uint32_t holdbackmsec);
+		// a consistent-enough snapshot of the per-direction counters and latency histograms, cheap enough to poll
+		MidiBridgeCore::BridgeStatistics GetStatistics() const;
+		// how many guests the server serves at once, MIDI in is fanned out to all of them and their output is merged,
+		// 1 keeps the single client engines, takes effect at the next StartSession()
+		void SetMaxPipeInstances(int v);
 		bool StartSession(const std::wstring& pipename, bool runasserver);
 		void StopSession();
 		bool IsSessionRunning() const;
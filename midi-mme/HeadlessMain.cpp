@@ -0,0 +1,210 @@
+//
+//  HeadlessMain.cpp
+//  MidiPipeBridge
+//
+//  created by yu2924 on 2026-10-17
+//
+
+#include "pch.h"
+#include "App.xaml.h"
+#include <mmeapi.h>
+#include <WindowsAppSDK-VersionInfo.h>
+#include <MddBootstrap.h>
+#include <chrono>
+#include <cstdio>
+#include "DataTransferBridge.h"
+#include "MidiDeviceInfo.h"
+#include "BridgeOptions.h"
+
+using namespace winrt;
+
+//
+// NOTE:
+// The XAML generated wWinMain() is disabled (DISABLE_XAML_GENERATED_MAIN) and so is the Windows App SDK auto-initializer
+// (WindowsAppSdkBootstrapInitialize), so that a headless launch loads neither. The window launch does both here.
+// ---
+// examples of the headless mode, the same options as the window plus a few of its own:
+//		MidiPipeBridge.exe headless server pipename="\\.\pipe\midipipe" midiout="Microsoft GS Wavetable Synth"
+//		MidiPipeBridge.exe headless config="C:\bridge\bridge.conf" runfor=60000
+//		MidiPipeBridge.exe headless pipename="\\.\pipe\midipipe" midiout="Microsoft GS Wavetable Synth" p2mfilter="droprt;remap:10>16"
+//		MidiPipeBridge.exe headless server midiout="MIDISPORT 4x4 Port A|MIDISPORT 4x4 Port B" midiin="MIDISPORT 4x4 Port A"
+// the console it was started from gets a ready line and, on Ctrl+C or after runfor, the transfer counters
+//
+
+namespace winrt::MidiPipeBridge::implementation
+{
+	static std::string ToUtf8(const std::wstring& s)
+	{
+		if(s.empty()) return std::string();
+		int c = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+		std::string u((size_t)c, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, s.c_str(), (int)s.size(), u.data(), c, nullptr, nullptr);
+		return u;
+	}
+	static std::wstring FromUtf8(const std::string& s)
+	{
+		if(s.empty()) return std::wstring();
+		int c = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), nullptr, 0);
+		std::wstring w((size_t)c, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), w.data(), c);
+		return w;
+	}
+
+	// the device with that szPname, the same name the window stores in its settings, false when none matches
+	static bool ResolveMidiDeviceId(const std::string& name, bool isoutput, uint32_t* devid)
+	{
+		*devid = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
+		if(name.empty()) return true;
+		std::wstring wname = FromUtf8(name);
+		if(isoutput)
+		{
+			for(uint32_t c = midiOutGetNumDevs(), i = 0; i < c; ++i)
+			{
+				MIDIOUTCAPSW caps{};
+				if((midiOutGetDevCapsW(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) && (wname == caps.szPname)) { *devid = i; return true; }
+			}
+		}
+		else
+		{
+			for(uint32_t c = midiInGetNumDevs(), i = 0; i < c; ++i)
+			{
+				MIDIINCAPSW caps{};
+				if((midiInGetDevCapsW(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR) && (wname == caps.szPname)) { *devid = i; return true; }
+			}
+		}
+		return false;
+	}
+
+	static HANDLE stopEvent = nullptr;
+
+	static BOOL WINAPI ConsoleCtrlHandler(DWORD)
+	{
+		SetEvent(stopEvent);
+		return TRUE;
+	}
+
+	// the bridge from the arguments until the stop event, the caller sets up the event and tears it down around it
+	static int RunBridge(const std::vector<std::wstring>& args, std::chrono::steady_clock::time_point t0)
+	{
+		std::vector<std::string> u8args;
+		for(const auto& a : args) u8args.push_back(ToUtf8(a));
+		std::vector<const char*> argv;
+		for(const auto& a : u8args) argv.push_back(a.c_str());
+		MidiBridgeCore::BridgeOptions options;
+		MidiBridgeCore::ResultCode r = options.ParseCommandLine((int)argv.size(), argv.data());
+		if(MidiBridgeCore::ResultIsError(r)) { std::fprintf(stderr, "cannot read %s (%d)\n", options.configFile.value().c_str(), r); return 1; }
+		for(const auto& arg : options.unknown) std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+		// the first device of a list is port 1 of a multi-port interface, the rest are reached through the F5 port select
+		std::vector<uint32_t> midiindevids;
+		std::vector<uint32_t> midioutdevids;
+		for(const auto& name : MidiBridgeCore::BridgeOptions::SplitDeviceList(options.midiInDeviceName.value_or("")))
+		{
+			if(!ResolveMidiDeviceId(name, false, &midiindevids.emplace_back())) { std::fprintf(stderr, "no MIDI in device named %s\n", name.c_str()); return 1; }
+		}
+		for(const auto& name : MidiBridgeCore::BridgeOptions::SplitDeviceList(options.midiOutDeviceName.value_or("")))
+		{
+			if(!ResolveMidiDeviceId(name, true, &midioutdevids.emplace_back())) { std::fprintf(stderr, "no MIDI out device named %s\n", name.c_str()); return 1; }
+		}
+		uint32_t nonedevid = MidiDeviceInfo::NoneMidiDeviceInfo().DeviceId();
+		int exitcode = 0;
+		{
+			// no dispatcher, the errors are reported on the engine threads and end the run
+			DataTransferBridge bridge(nullptr);
+			bridge.OnPipeError = [](HRESULT r) { std::fprintf(stderr, "pipe error 0x%08x\n", (unsigned)r); };
+			bridge.OnMidiInError = [&exitcode](MMRESULT r) { std::fprintf(stderr, "MIDI in error %u\n", r); exitcode = 1; SetEvent(stopEvent); };
+			bridge.OnMidiOutError = [&exitcode](MMRESULT r) { std::fprintf(stderr, "MIDI out error %u\n", r); exitcode = 1; SetEvent(stopEvent); };
+			if(options.flightLog.has_value() && !options.flightLog->empty())
+			{
+				if(!bridge.SetFlightRecorder(FromUtf8(options.flightLog.value()), options.flightLogSize.value_or(MidiBridgeCore::FlightRecorder::DefaultCapacity))) { std::fprintf(stderr, "cannot open the flight log %s\n", options.flightLog->c_str()); return 1; }
+			}
+			if(!bridge.SetMessageFilters(options.pipeToMidiFilter.value_or(""), options.midiToPipeFilter.value_or(""))) { std::fprintf(stderr, "cannot parse the message filters\n"); return 1; }
+			if(options.readAhead.has_value()) bridge.SetPipeReadAhead(options.readAhead.value());
+			if(options.zeroCopyRead.has_value()) bridge.SetPipeZeroCopyRead(options.zeroCopyRead.value());
+			if(options.realTimeLane.has_value()) bridge.SetPipeRealTimeLane(options.realTimeLane.value());
+			if(options.midiOutLatencyMsec.value_or(0) > 0) bridge.SetMidiOutTimestamped(true, (uint32_t)options.midiOutLatencyMsec.value(), (uint32_t)std::max<int>(options.midiOutSmoothingMsec.value_or(0), 0));
+			if(options.midiClockRegenMsec.value_or(0) > 0) bridge.SetMidiClockRegen((uint32_t)options.midiClockRegenMsec.value());
+			if(options.maxInstances.has_value()) bridge.SetMaxPipeInstances(options.maxInstances.value());
+			// the hub reads each guest on its own reader, without a read-ahead ring
+			bool hub = options.runAsServer.value_or(false) && (options.maxInstances.value_or(1) > 1);
+			if(hub && (options.readAhead.has_value() || options.zeroCopyRead.has_value() || options.realTimeLane.has_value())) std::fprintf(stderr, "readahead, zerocopy and rtlane apply to a single guest, ignored with instances=%d\n", options.maxInstances.value());
+			bridge.SetMidiInDeviceId(midiindevids.empty() ? nonedevid : midiindevids[0]);
+			if(!bridge.SetMidiOutDevice(midioutdevids.empty() ? nonedevid : midioutdevids[0], MidiBridgeCore::BridgeOptions::SplitDeviceList(options.midiOutPacing.value_or("")))) { std::fprintf(stderr, "cannot parse the pacing %s\n", options.midiOutPacing->c_str()); return 1; }
+			if((midiindevids.size() > 1) || (midioutdevids.size() > 1))
+			{
+				std::vector<uint32_t> extraoutids(midioutdevids.begin() + std::min<size_t>(1, midioutdevids.size()), midioutdevids.end());
+				std::vector<uint32_t> extrainids(midiindevids.begin() + std::min<size_t>(1, midiindevids.size()), midiindevids.end());
+				bridge.SetPortSelectDeviceIds(extraoutids, extrainids);
+			}
+			std::wstring pipename = FromUtf8(options.pipeName.value_or("\\\\.\\pipe\\midipipe"));
+			if(!bridge.StartSession(pipename, options.runAsServer.value_or(false)))
+			{
+				std::fprintf(stderr, "cannot start the session on %s\n", ToUtf8(pipename).c_str());
+				return 1;
+			}
+			std::printf("ready in %.2f ms on %s\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(), ToUtf8(pipename).c_str());
+			std::fflush(stdout);
+			int runfor = options.runForMsec.value_or(0);
+			WaitForSingleObject(stopEvent, (runfor > 0) ? (DWORD)runfor : INFINITE);
+			bridge.StopSession();
+			MidiBridgeCore::BridgeStatistics s = bridge.GetStatistics();
+			std::printf("pipe->midi: %llu bytes read in %llu calls, %llu messages, %llu filtered, %llu bytes discarded\n",
+				(unsigned long long)s.pipeToMidi.pipeReadBytes, (unsigned long long)s.pipeToMidi.pipeReadCalls, (unsigned long long)s.pipeToMidi.messages, (unsigned long long)s.pipeToMidi.filteredMessages, (unsigned long long)s.pipeToMidi.discardedBytes);
+			std::printf("midi->pipe: %llu messages, %llu filtered, %llu bytes written in %llu calls, %llu bytes dropped\n",
+				(unsigned long long)s.midiToPipe.messages, (unsigned long long)s.midiToPipe.filteredMessages, (unsigned long long)s.midiToPipe.bytes, (unsigned long long)s.midiToPipe.pipeWriteCalls, (unsigned long long)s.midiToPipe.droppedBytes);
+			std::fflush(stdout);
+		}
+		return exitcode;
+	}
+
+	static int RunHeadless(const std::vector<std::wstring>& args)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		// a GUI subsystem process has no console of its own, borrow the one it was started from when there is one
+		if(AttachConsole(ATTACH_PARENT_PROCESS))
+		{
+			FILE* fp = nullptr;
+			freopen_s(&fp, "CONOUT$", "w", stdout);
+			freopen_s(&fp, "CONOUT$", "w", stderr);
+		}
+		stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+		int exitcode = RunBridge(args, t0);
+		SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+		CloseHandle(stopEvent);
+		return exitcode;
+	}
+
+	// what the XAML generated wWinMain() does, plus the Windows App SDK bootstrap the auto-initializer would have done
+	static int RunWindow()
+	{
+		Microsoft::Windows::ApplicationModel::DynamicDependency::Bootstrap::InitializeFailFast();
+		void (WINAPI* pfnXamlCheckProcessRequirements)() = nullptr;
+		if(HMODULE module = LoadLibraryW(L"Microsoft.ui.xaml.dll"))
+		{
+			pfnXamlCheckProcessRequirements = reinterpret_cast<decltype(pfnXamlCheckProcessRequirements)>(GetProcAddress(module, "XamlCheckProcessRequirements"));
+			if(pfnXamlCheckProcessRequirements) pfnXamlCheckProcessRequirements();
+			FreeLibrary(module);
+		}
+		init_apartment(apartment_type::single_threaded);
+		Microsoft::UI::Xaml::Application::Start([](auto&&) { make<App>(); });
+		Microsoft::Windows::ApplicationModel::DynamicDependency::Bootstrap::Shutdown();
+		return 0;
+	}
+}
+
+int WINAPI wWinMain(_In_ HINSTANCE, _In_opt_ HINSTANCE, _In_ LPWSTR, _In_ int)
+{
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	std::vector<std::wstring> args;
+	bool headless = false;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(_wcsicmp(argv[i], L"headless") == 0) headless = true;
+		else args.push_back(argv[i]);
+	}
+	LocalFree(argv);
+	if(!headless) return winrt::MidiPipeBridge::implementation::RunWindow();
+	winrt::init_apartment(winrt::apartment_type::multi_threaded);
+	return winrt::MidiPipeBridge::implementation::RunHeadless(args);
+}
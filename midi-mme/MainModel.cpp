@@ -34,6 +34,8 @@ namespace winrt::MidiPipeBridge::implementation
 		//		midiout="Port 1 on Micro"
 		// - do not select any device:
 		//		midiin="" midiout=""
+		// - serve up to 4 guests at once, MIDI in goes to all of them and their output is merged:
+		//		server instances=4
 		// 
 		struct CommandLineOptions
 		{
@@ -41,12 +43,14 @@ namespace winrt::MidiPipeBridge::implementation
 			std::optional<hstring> midiindevicename;
 			std::optional<hstring> midioutdevicename;
 			std::optional<bool> runasserver;
+			std::optional<int> maxinstances;
 			CommandLineOptions()
 			{
 				static const hstring OptPipeName{ L"pipename=" };
 				static const hstring OptMidiIn	{ L"midiin=" };
 				static const hstring OptMidiOut	{ L"midiout=" };
 				static const hstring OptServer	{ L"server" };
+				static const hstring OptInstances{ L"instances=" };
 				LPCWSTR cmdline = GetCommandLineW();
 				int argc = 0;
 				LPWSTR* argv = CommandLineToArgvW(cmdline, &argc);
@@ -55,8 +59,9 @@ namespace winrt::MidiPipeBridge::implementation
 					LPCWSTR arg = argv[i];
 					if     (!pipename			.has_value() && (_wcsnicmp(arg, OptPipeName	.c_str(), OptPipeName	.size()) == 0)) pipename			= arg + OptPipeName	.size();
 					else if(!midiindevicename	.has_value() && (_wcsnicmp(arg, OptMidiIn	.c_str(), OptMidiIn		.size()) == 0)) midiindevicename	= arg + OptMidiIn	.size();
-					else if(!midiindevicename	.has_value() && (_wcsnicmp(arg, OptMidiOut	.c_str(), OptMidiOut	.size()) == 0)) midiindevicename	= arg + OptMidiOut	.size();
+					else if(!midioutdevicename	.has_value() && (_wcsnicmp(arg, OptMidiOut	.c_str(), OptMidiOut	.size()) == 0)) midioutdevicename	= arg + OptMidiOut	.size();
 					else if(!runasserver		.has_value() && (_wcsnicmp(arg, OptServer	.c_str(), OptServer		.size()) == 0)) runasserver			= true;
+					else if(!maxinstances		.has_value() && (_wcsnicmp(arg, OptInstances.c_str(), OptInstances	.size()) == 0)) maxinstances		= _wtoi(arg + OptInstances.size());
 				}
 				LocalFree(argv);
 			}
@@ -95,6 +100,7 @@ namespace winrt::MidiPipeBridge::implementation
 			dataTtransferBridge->OnPipeError = [this](HRESULT r) { pipeError.Code(r); IsConnecting(false); };
 			dataTtransferBridge->OnMidiInError = [this](MMRESULT r) { midiInError.Code(r); IsConnecting(false); };
 			dataTtransferBridge->OnMidiOutError = [this](MMRESULT r) { midiOutError.Code(r); IsConnecting(false); };
+			if(cmdopt.maxinstances.has_value()) dataTtransferBridge->SetMaxPipeInstances(cmdopt.maxinstances.value());
 			pipeName = cmdopt.pipename.has_value() ? cmdopt.pipename.value() : (appSettings.HasProperty(L"PipeName") ? appSettings.PipeName() : Defaults.pipeName);
 			runAsServer = cmdopt.runasserver.has_value() ? cmdopt.runasserver.value() : (appSettings.HasProperty(L"RunAsServer") ? appSettings.RunAsServer() : Defaults.runAsServer);
 			isConnecting = false;
@@ -200,7 +206,8 @@ namespace winrt::MidiPipeBridge::implementation
 			midiOutDeviceInfo = value;
 			appSettings.MidiOutDeviceName(midiOutDeviceInfo.DeviceName());
 			midiOutError.Reset();
-			dataTtransferBridge->SetMidiOutDeviceId(midiOutDeviceInfo.DeviceId());
+			// with the pacing kept for this device, a spec that does not parse falls back to the built-in profiles
+			dataTtransferBridge->SetMidiOutDevice(midiOutDeviceInfo.DeviceId(), { winrt::to_string(appSettings.GetMidiOutPacing(midiOutDeviceInfo.DeviceName())) });
 			propertyChanged(*outer, Microsoft::UI::Xaml::Data::PropertyChangedEventArgs{ L"MidiOutDeviceInfo" });
 		}
 		Windows::Foundation::Collections::IObservableVector<MidiPipeBridge::MidiDeviceInfo> MidiInDeviceInfoList()
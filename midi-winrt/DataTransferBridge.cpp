@@ -10,610 +10,305 @@
 #include <winrt/Windows.Devices.Midi.h>
 #include <winrt/Windows.Storage.Streams.h>
 #include <mutex>
+#include "TransferEngine.h"
+#include "NamedPipeSession.h"
+#include "ClientHub.h"
+#include "MessageFilter.h"
 #include "MidiDeviceInfo.h"
 #include "DebugPrint.h"
 
+#undef min
+#undef max
+
 using namespace winrt;
+using MidiBridgeCore::ResultCode;
 
 namespace winrt::MidiPipeBridge::implementation
 {
 
 	// ================================================================================
-	// primitive classes
-
-	struct ManualEvent
-	{
-		HANDLE hEvent = NULL;
-		ManualEvent()
-		{
-			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
-		}
-		~ManualEvent()
-		{
-			if(hEvent) CloseHandle(hEvent);
-		}
-		bool Reset()
-		{
-			return hEvent ? ResetEvent(hEvent) : false;
-		}
-		bool Set()
-		{
-			return hEvent ? SetEvent(hEvent) : false;
-		}
-		operator HANDLE()
-		{
-			return hEvent;
-		}
-	};
+	// WinRT midiport wrappers
 
-	struct Overlapped : public OVERLAPPED
+	class MidiOutPort : public MidiBridgeCore::IMidiOutPort
 	{
-		Overlapped()
+	private:
+		static constexpr uint32_t BUFFERSIZE = 256;
+		Windows::Devices::Midi::IMidiOutPort midiOutPort{ nullptr };
+		Windows::Storage::Streams::Buffer buffer{ BUFFERSIZE };
+	public:
+		Windows::Devices::Midi::IMidiOutPort GetPort() const
 		{
-			ZeroMemory(this, sizeof(*this));
-			hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+			return midiOutPort;
 		}
-		~Overlapped()
+		void SetPort(Windows::Devices::Midi::IMidiOutPort port)
 		{
-			if(hEvent) CloseHandle(hEvent);
+			midiOutPort = port;
 		}
-		void Reset()
+		virtual bool IsDeviceOpen() const override
 		{
-			HANDLE hsave = this->hEvent;
-			ZeroMemory(this, sizeof(*this));
-			hEvent = hsave;
-			if(hEvent) ResetEvent(hEvent);
+			return (bool)midiOutPort;
 		}
-	};
-
-	class WinThread
-	{
-	protected:
-		static unsigned int WINAPI threadProc(void* param)
+		virtual ResultCode Send(const uint8_t* p, int c) override
 		{
-			WinThread* pthis = reinterpret_cast<WinThread*>(param);
-			HRESULT r = 0;
+			if(!midiOutPort) return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
 			try
 			{
-				r = pthis->Run();
+				int i = 0; while(i < c)
+				{
+					uint32_t lseg = std::min(buffer.Capacity(), (uint32_t)(c - i));
+					memcpy(buffer.data(), p + i, lseg);
+					buffer.Length(lseg);
+					midiOutPort.SendBuffer(buffer);
+					i += (int)lseg;
+				}
 			}
 			catch(const winrt::hresult_error& e)
 			{
-				r = e.code();
-				DebugPrint(L"[WinThread ({})] exception: {}\n",  pthis->threadName, e.message());
+				return e.code();
 			}
-			catch(...)
-			{
-				r = E_FAIL;
-				DebugPrint(L"[WinThread ({})] exception: unknown\n", pthis->threadName);
-			}
-			return r;
-		}
-		std::wstring threadName;
-		HANDLE hThread = NULL;
-		ManualEvent quitEvent;
-		bool quitFlag = false;
-	public:
-		WinThread(const std::wstring& name) : threadName(name)
-		{
+			return S_OK;
 		}
-		virtual ~WinThread()
+	};
+
+	class MidiInPort : public MidiBridgeCore::IMidiInPort
+	{
+	private:
+		Windows::Devices::Midi::IMidiInPort midiInPort{ nullptr };
+		event_token evtoken{};
+		// message timestamps count from the creation of the port
+		MidiBridgeCore::MidiTimestamp createdTime;
+		void OnMidiMessageReceived(Windows::Devices::Midi::MidiInPort const&, Windows::Devices::Midi::MidiMessageReceivedEventArgs const& args)
 		{
-			StopThread();
+			Windows::Devices::Midi::IMidiMessage message = args.Message();
+			Windows::Storage::Streams::IBuffer buffer = message.RawData();
+			MidiBridgeCore::MidiTimestamp t = createdTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(message.Timestamp());
+			if(OnMidiInReceived) OnMidiInReceived(buffer.data(), (int)buffer.Length(), t);
 		}
-		void StopThread()
+	public:
+		~MidiInPort()
 		{
-			if(!hThread) return;
-			RequestToQuitThread();
-			WaitForExitThread(INFINITE);
-			CloseHandle(hThread);
-			hThread = NULL;
+			StopDevice();
 		}
-		bool WaitForExitThread(DWORD t)
+		Windows::Devices::Midi::IMidiInPort GetPort() const
 		{
-			if(!hThread) return true;
-			return WaitForSingleObject(hThread, t) == WAIT_OBJECT_0;
+			return midiInPort;
 		}
-		bool StartThread()
+		void SetPort(Windows::Devices::Midi::IMidiInPort port)
 		{
-			StopThread();
-			quitEvent.Reset();
-			quitFlag = false;
-			hThread = (HANDLE)_beginthreadex(nullptr, 0, threadProc, this, 0, nullptr);
-			return hThread != NULL;
+			StopDevice();
+			midiInPort = port;
+			createdTime = std::chrono::steady_clock::now();
 		}
-		bool IsThreadRunning() const
+		virtual bool IsDeviceOpen() const override
 		{
-			return (hThread != NULL) && (WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT);
+			return (bool)midiInPort;
 		}
-		operator HANDLE()
+		virtual ResultCode StartDevice() override
 		{
-			return hThread;
+			if(!midiInPort) return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+			if((bool)evtoken) return S_OK;
+			evtoken = midiInPort.MessageReceived([this](Windows::Devices::Midi::MidiInPort const& mp, Windows::Devices::Midi::MidiMessageReceivedEventArgs const& args) { OnMidiMessageReceived(mp, args); });
+			return S_OK;
 		}
-		virtual void RequestToQuitThread()
+		virtual ResultCode StopDevice() override
 		{
-			quitFlag = true;
-			quitEvent.Set();
+			if(!midiInPort) return HRESULT_FROM_WIN32(ERROR_INVALID_HANDLE);
+			if(evtoken) midiInPort.MessageReceived(evtoken);
+			evtoken = {};
+			return S_OK;
 		}
-		virtual unsigned int Run() = 0;
 	};
 
 	// ================================================================================
-	// stream transfer classes
+	// the DataTransferBridge
 
-	class PipeInMidiOut : private WinThread
+	class DataTransferBridge::Impl
 	{
-	private:
-		static bool NeedToReportPipeError(HRESULT r, bool isserver)
-		{
-			if(SUCCEEDED(r)) return false;
-			if(isserver && (HRESULT_CODE(r) == ERROR_BROKEN_PIPE)) return false;
-			return true;
-		}
-		HANDLE hPipe = NULL;
-		Overlapped overlapped;
-		hstring midiDeviceId;
-		Windows::Devices::Midi::IMidiOutPort midiOutPort{ nullptr };
-		std::mutex reentrantMutex;
-		HRESULT deviceError = S_OK;
-		HRESULT pipeError = S_OK;
-		bool isServer = false;
-		bool ReadPipeOverlapped(uint8_t* p, int c, int* cr)
-		{
-			overlapped.Reset();
-			DWORD cb = 0;
-			if(ReadFile(hPipe, p, c, &cb, &overlapped)) { *cr = cb; return true; }
-			DWORD r = GetLastError();
-			if(r != ERROR_IO_PENDING) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(r); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			if(!GetOverlappedResult(hPipe, &overlapped, &cb, FALSE)) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			*cr = cb;
-			return true;
-		}
-		virtual unsigned int Run() override
-		{
-			DebugPrint(L"[PipeInMidiOut] thread begin\n");
-			constexpr uint32_t BUFFERSIZE = 256;
-			Windows::Storage::Streams::Buffer buffer(BUFFERSIZE);
-			while(1)
-			{
-				if(quitFlag || FAILED(pipeError) || FAILED(deviceError)) break;
-				int cr = 0;
-				if(!ReadPipeOverlapped(buffer.data(), buffer.Capacity(), &cr))
-				{
-					if(NeedToReportPipeError(pipeError, isServer)) { if(OnPipeError) OnPipeError(pipeError); }
-					break;
-				}
-				buffer.Length(cr);
-				try
-				{
-					midiOutPort.SendBuffer(buffer);
-				}
-				catch(const winrt::hresult_error& e)
-				{
-					deviceError = e.code();
-				}
-				if(FAILED(deviceError))
-				{
-					if(OnDeviceError) OnDeviceError(deviceError);
-					break;
-				}
-			}
-			DebugPrint(L"[PipeInMidiOut] thread end\n");
-			return 0;
-		}
-		virtual void RequestToQuitThread() override
+	public:
+		DataTransferBridge* outer;
+		Microsoft::UI::Dispatching::DispatcherQueue dispatchQueue;
+		MidiOutPort midiOutPort;
+		MidiInPort midiInPort;
+		hstring midiOutDeviceId;
+		hstring midiInDeviceId;
+		// declared ahead of the engines so they outlive them
+		MidiBridgeCore::FlightRecorder flightRecorder;
+		std::unique_ptr<MidiBridgeCore::IMessageFilter> pipeToMidiFilter;
+		std::unique_ptr<MidiBridgeCore::IMessageFilter> midiToPipeFilter;
+		MidiBridgeCore::PipeInMidiOut pipeInMidiOut;
+		MidiBridgeCore::MidiInPipeOut midiInPipeOut;
+		std::wstring pipeName;
+		bool runAsServer = false;
+		int maxPipeInstances = 1;
+		// owns the ports instead of the single client engines while a multi-instance server runs
+		std::unique_ptr<MidiBridgeCore::ClientHub> clientHub;
+		std::unique_ptr<MidiBridgeCore::IPipeSession> pipeSession;
+		Impl(DataTransferBridge* p, Microsoft::UI::Dispatching::DispatcherQueue dispqueue) : outer(p), dispatchQueue(dispqueue)
 		{
-			quitFlag = true;
-			CancelIoEx(hPipe, &overlapped);
-			WinThread::RequestToQuitThread();
+			pipeInMidiOut.OnDeviceError = [this](ResultCode r) { PostMidiOutError(r); };
+			pipeInMidiOut.OnPipeError = [this](ResultCode r) { PostPipeError(r); };
+			midiInPipeOut.OnDeviceError = [this](ResultCode r) { PostMidiInError(r); };
+			midiInPipeOut.OnPipeError = [this](ResultCode r) { PostPipeError(r); };
 		}
-		void InternalStart()
+		~Impl()
 		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			if(IsThreadRunning()) return;
-			if(!hPipe || !midiOutPort) return;
-			deviceError = S_OK;
-			pipeError = S_OK;
-			StartThread();
+			// prevent async callback
+			pipeInMidiOut.OnDeviceError = nullptr;
+			pipeInMidiOut.OnPipeError = nullptr;
+			midiInPipeOut.OnDeviceError = nullptr;
+			midiInPipeOut.OnPipeError = nullptr;
+			outer->OnPipeError = nullptr;
+			outer->OnMidiInError = nullptr;
+			outer->OnMidiOutError = nullptr;
+			StopSession();
+			// detach the ports before they are released
+			pipeInMidiOut.SetMidiOutPort(nullptr);
+			midiInPipeOut.SetMidiInPort(nullptr);
+			AttachFlightRecorder(nullptr);
+			AttachMessageFilters(nullptr, nullptr);
 		}
-		void InternalStop()
+		// --------------------------------------------------------------------------------
+		// internals
+		void AttachMidiInPort(MidiBridgeCore::IMidiInPort* p)
 		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			StopThread();
+			if(clientHub)	clientHub->SetMidiInPort(p);
+			else			midiInPipeOut.SetMidiInPort(p);
 		}
-	public:
-		std::function<void(HRESULT)> OnDeviceError;
-		std::function<void(HRESULT)> OnPipeError;
-		PipeInMidiOut() : WinThread(L"PipeInMidiOut")
+		void AttachMidiOutPort(MidiBridgeCore::IMidiOutPort* p)
 		{
+			if(clientHub)	clientHub->SetMidiOutPort(p);
+			else			pipeInMidiOut.SetMidiOutPort(p);
 		}
-		HANDLE GetPipeHandle() const
+		void PostPipeError(HRESULT r)
 		{
-			return hPipe;
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); });
 		}
-		void SetPipeHandle(HANDLE h, bool server)
+		void PostMidiInError(HRESULT r)
 		{
-			InternalStop();
-			pipeError = S_OK;
-			hPipe = h;
-			isServer = server;
-			InternalStart();
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiInError) outer->OnMidiInError(r); });
 		}
-		hstring GetMidiDeviceId() const
+		void PostMidiOutError(HRESULT r)
 		{
-			return midiDeviceId;
+			dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiOutError) outer->OnMidiOutError(r); });
 		}
-		Windows::Foundation::IAsyncAction SetMidiDeviceIdAsync(const hstring& devid)
+		Windows::Foundation::IAsyncAction SetMidiInDeviceIdAsync(const hstring& devid)
 		{
-			if(midiDeviceId == devid) co_return;
-			InternalStop();
-			deviceError = S_OK;
-			midiDeviceId = devid;
-			midiOutPort = MidiDeviceInfo::IsValidId(devid) ? co_await Windows::Devices::Midi::MidiOutPort::FromIdAsync(devid) : nullptr;
-			if(!midiDeviceId.empty() && !midiOutPort)
+			if(midiInDeviceId == devid) co_return;
+			AttachMidiInPort(nullptr);
+			midiInDeviceId = devid;
+			midiInPort.SetPort(MidiDeviceInfo::IsValidId(devid) ? co_await Windows::Devices::Midi::MidiInPort::FromIdAsync(devid) : nullptr);
+			if(!midiInDeviceId.empty() && !midiInPort.IsDeviceOpen())
 			{
-				deviceError = HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
-				if(OnDeviceError) OnDeviceError(deviceError);
+				PostMidiInError(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
 			}
-			InternalStart();
-		}
-		HRESULT GetDeviceError() const
-		{
-			return deviceError;
+			AttachMidiInPort(&midiInPort);
 		}
-		HRESULT GetPipeError() const
+		Windows::Foundation::IAsyncAction SetMidiOutDeviceIdAsync(const hstring& devid)
 		{
-			return pipeError;
-		}
-		operator HANDLE()
-		{
-			return hThread;
-		}
-	};
-
-	class MidiInPipeOut
-	{
-	private:
-		static bool NeedToReportPipeError(HRESULT r, bool isserver)
-		{
-			if(SUCCEEDED(r)) return false;
-			if(isserver && (HRESULT_CODE(r) == ERROR_BROKEN_PIPE)) return false;
-			return true;
-		}
-		HANDLE hPipe = NULL;
-		ManualEvent quitEvent;
-		ManualEvent stoppedEvent;
-		Overlapped overlapped;
-		hstring midiDeviceId;
-		Windows::Devices::Midi::IMidiInPort midiInPort{ nullptr };
-		event_token evtoken{};
-		std::mutex reentrantMutex;
-		HRESULT deviceError = S_OK;
-		HRESULT pipeError = S_OK;
-		bool isServer = false;
-		bool quitFlag = false;
-		bool WritePipeOverlapped(const uint8_t* p, int c, int* cw)
-		{
-			overlapped.Reset();
-			DWORD cb = 0;
-			if(WriteFile(hPipe, p, c, &cb, &overlapped)) { *cw = (int)cb; return true; }
-			if(GetLastError() != ERROR_IO_PENDING) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			if(!GetOverlappedResult(hPipe, &overlapped, &cb, FALSE)) { if(!quitFlag) pipeError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			*cw = (int)cb;
-			return true;
-		}
-		void OnMidiMessageReceived(Windows::Devices::Midi::MidiInPort const&, Windows::Devices::Midi::MidiMessageReceivedEventArgs const& args)
-		{
-			if(FAILED(pipeError)) return;
-			Windows::Storage::Streams::IBuffer buffer = args.Message().RawData();
-			int cw = 0;
-			if(!WritePipeOverlapped(buffer.data(), buffer.Length(), &cw))
+			if(midiOutDeviceId == devid) co_return;
+			AttachMidiOutPort(nullptr);
+			midiOutDeviceId = devid;
+			midiOutPort.SetPort(MidiDeviceInfo::IsValidId(devid) ? co_await Windows::Devices::Midi::MidiOutPort::FromIdAsync(devid) : nullptr);
+			if(!midiOutDeviceId.empty() && !midiOutPort.IsDeviceOpen())
 			{
-				if(NeedToReportPipeError(pipeError, isServer)) { if(OnPipeError) OnPipeError(pipeError); }
+				PostMidiOutError(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
 			}
+			AttachMidiOutPort(&midiOutPort);
 		}
-		void InternalStart()
-		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			if((bool)evtoken) return;
-			if(!hPipe || !midiInPort) return;
-			deviceError = S_OK;
-			pipeError = S_OK;
-			quitFlag = false;
-			quitEvent.Reset();
-			stoppedEvent.Reset();
-			evtoken = midiInPort.MessageReceived([this](Windows::Devices::Midi::MidiInPort const& mp, Windows::Devices::Midi::MidiMessageReceivedEventArgs const& args) { OnMidiMessageReceived(mp, args); });
-		}
-		void InternalStop()
-		{
-			std::lock_guard<std::mutex> lock(reentrantMutex);
-			quitFlag = true;
-			if(hPipe) CancelIoEx(hPipe, &overlapped);
-			quitEvent.Set();
-			if(evtoken) midiInPort.MessageReceived(evtoken);
-			evtoken = {};
-			stoppedEvent.Set();
-		}
-	public:
-		std::function<void(HRESULT)> OnDeviceError;
-		std::function<void(HRESULT)> OnPipeError;
-		MidiInPipeOut()
-		{
-		}
-		~MidiInPipeOut()
+		// --------------------------------------------------------------------------------
+		// public APIs
+		hstring GetMidiInDeviceId() const
 		{
-			InternalStop();
+			return midiInDeviceId;
 		}
-		HANDLE GetPipeHandle() const
+		void SetMidiInDeviceId(const hstring& v)
 		{
-			return hPipe;
+			SetMidiInDeviceIdAsync(v);
 		}
-		void SetPipeHandle(HANDLE h, bool server)
+		hstring GetMidiOutDeviceId() const
 		{
-			InternalStop();
-			pipeError = S_OK;
-			hPipe = h;
-			isServer = server;
-			InternalStart();
+			return midiOutDeviceId;
 		}
-		hstring GetMidiDeviceId() const
+		void SetMidiOutDeviceId(const hstring& v)
 		{
-			return midiDeviceId;
+			SetMidiOutDeviceIdAsync(v);
 		}
-		Windows::Foundation::IAsyncAction SetMidiDeviceIdAsync(const hstring& devid)
+		void SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime)
 		{
-			if(midiDeviceId == devid) co_return;
-			InternalStop();
-			deviceError = S_OK;
-			midiDeviceId = devid;
-			midiInPort = MidiDeviceInfo::IsValidId(devid) ? co_await Windows::Devices::Midi::MidiInPort::FromIdAsync(devid) : nullptr;
-			if(!midiDeviceId.empty() && !midiInPort)
-			{
-				deviceError = HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
-				if(OnDeviceError) OnDeviceError(deviceError);
-			}
-			InternalStart();
+			MidiBridgeCore::CoalescePolicy policy;
+			policy.flushBytes = (int)flushbytes;
+			policy.flushDelay = std::chrono::microseconds(delayusec);
+			policy.flushOnRealTime = flushonrealtime;
+			midiInPipeOut.SetCoalescePolicy(policy);
 		}
-		HRESULT GetDeviceError() const
+		void SetMidiInSerialPacing(double bitrate, int fifobytes)
 		{
-			return deviceError;
+			MidiBridgeCore::SerialPacing pacing;
+			pacing.bitRate = bitrate;
+			pacing.fifoBytes = fifobytes;
+			midiInPipeOut.SetSerialPacing(pacing);
 		}
-		HRESULT GetPipeError() const
+		void SetPipeReadAhead(int v)
 		{
-			return pipeError;
+			pipeInMidiOut.SetReadAhead(v);
 		}
-		operator HANDLE()
+		void AttachFlightRecorder(MidiBridgeCore::FlightRecorder* p)
 		{
-			return stoppedEvent;
-		}
-	};
-
-	// ================================================================================
-	// pipe connection session classes
-
-	struct IPipeSession
-	{
-		std::function<void(HRESULT)> OnSessionError;
-		virtual ~IPipeSession() {}
-		virtual bool StartSession() = 0;
-		virtual void StopSession() = 0;
-		virtual bool IsSessionRunning() const = 0;
-		virtual HRESULT GetSessionError() const = 0;
-	};
-
-	class PipeServer : public IPipeSession, private WinThread
-	{
-	private:
-		std::wstring pipeName;
-		PipeInMidiOut& pipeInMidiOut;
-		MidiInPipeOut& midiInPipeOut;
-		HANDLE hPipe = NULL;
-		Overlapped overlapped;
-		HRESULT sessionError = S_OK;
-		bool ConnectPipeOverlapped()
-		{
-			overlapped.Reset();
-			BOOL rconnect = ConnectNamedPipe(hPipe, &overlapped);
-			DWORD r = GetLastError();
-			if(rconnect) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; } // overlapped ConnectNamedPipe() should return FALSE
-			if(r == ERROR_PIPE_CONNECTED) return true;
-			if((r != ERROR_IO_PENDING) && (r != ERROR_PIPE_LISTENING)) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(r); return false; }
-			HANDLE hw[] = { overlapped.hEvent, quitEvent };
-			if(WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE) != WAIT_OBJECT_0) { if(!quitFlag) sessionError = HRESULT_FROM_WIN32(GetLastError()); return false; }
-			return true;
+			pipeInMidiOut.SetFlightRecorder(p);
+			midiInPipeOut.SetFlightRecorder(p);
+			if(clientHub) clientHub->SetFlightRecorder(p);
 		}
-		virtual unsigned int Run() override
+		bool SetFlightRecorder(const std::wstring& path, size_t capacity)
 		{
-			DebugPrint(L"[PipeServer] thread begin\n");
-			while(1)
+			AttachFlightRecorder(nullptr);
+			flightRecorder.Close();
+			if(path.empty()) return true;
+			ResultCode r = flightRecorder.Open(path, capacity);
+			if(MidiBridgeCore::ResultIsError(r))
 			{
-				if(quitFlag) break;
-				if(!ConnectPipeOverlapped())
-				{
-					DebugPrint(L"[PipeServer] failed ConnectNamedPipe()\n");
-					if(FAILED(sessionError)) { if(OnSessionError) OnSessionError(sessionError); }
-					break;
-				}
-				DebugPrint(L"[PipeServer] connected\n");
-				pipeInMidiOut.SetPipeHandle(hPipe, true);
-				midiInPipeOut.SetPipeHandle(hPipe, true);
-				while(1)
-				{
-					HANDLE hw[] = { pipeInMidiOut, midiInPipeOut, quitEvent };
-					WaitForMultipleObjects(_countof(hw), hw, FALSE, INFINITE);
-					if( FAILED(pipeInMidiOut.GetDeviceError()) ||
-						FAILED(pipeInMidiOut.GetPipeError()) ||
-						FAILED(midiInPipeOut.GetDeviceError()) ||
-						FAILED(midiInPipeOut.GetPipeError()) ||
-						quitFlag) break;
-				}
-				// FlushFileBuffers(hPipe); // unnecessary?
-				DisconnectNamedPipe(hPipe);
-				pipeInMidiOut.SetPipeHandle(NULL, false);
-				midiInPipeOut.SetPipeHandle(NULL, false);
-				DebugPrint(L"[PipeServer] disconnected\n");
+				DebugPrint(L"[DataTransferBridge] cannot open the flight recorder log {} ({})\n", path, r);
+				return false;
 			}
-			DebugPrint(L"[PipeServer] thread end\n");
-			return 0;
-		}
-		virtual void RequestToQuitThread() override
-		{
-			quitFlag = true;
-			CancelIoEx(hPipe, &overlapped);
-			WinThread::RequestToQuitThread();
-		}
-	public:
-		PipeServer(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
-			: WinThread(L"PipeServer")
-			, pipeName(pipename)
-			, pipeInMidiOut(p2m)
-			, midiInPipeOut(m2p)
-		{
-		}
-		virtual ~PipeServer() override
-		{
-			StopSession();
+			AttachFlightRecorder(&flightRecorder);
+			return true;
 		}
-		virtual bool StartSession() override
+		void AttachMessageFilters(MidiBridgeCore::IMessageFilter* p2m, MidiBridgeCore::IMessageFilter* m2p)
 		{
-			StopSession();
-			sessionError = S_OK;
-			constexpr DWORD BUFFERSIZE = 1024;
-			hPipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, BUFFERSIZE, BUFFERSIZE, 0, nullptr);
-			if(hPipe == INVALID_HANDLE_VALUE)
+			pipeInMidiOut.SetMessageFilter(p2m);
+			midiInPipeOut.SetMessageFilter(m2p);
+			if(clientHub)
 			{
-				hPipe = NULL;
-				sessionError = HRESULT_FROM_WIN32(GetLastError());
-				if(OnSessionError) OnSessionError(sessionError);
-				DebugPrint(L"[PipeServer] failed CreateNamedPipe()\n");
-				return false;
+				clientHub->SetPipeToMidiFilter(p2m);
+				clientHub->SetMidiToPipeFilter(m2p);
 			}
-			return StartThread();
-		}
-		virtual void StopSession() override
-		{
-			StopThread();
-			if(hPipe) CloseHandle(hPipe);
-			hPipe = NULL;
-		}
-		virtual bool IsSessionRunning() const override
-		{
-			return IsThreadRunning();
-		}
-		virtual HRESULT GetSessionError() const override
-		{
-			return sessionError;
 		}
-	};
-
-	class PipeClient : public IPipeSession
-	{
-	private:
-		std::wstring pipeName;
-		PipeInMidiOut& pipeInMidiOut;
-		MidiInPipeOut& midiInPipeOut;
-		HANDLE hPipe = NULL;
-		HRESULT sessionError = S_OK;
-	public:
-		PipeClient(const std::wstring& pipename, PipeInMidiOut& p2m, MidiInPipeOut& m2p)
-			: pipeName(pipename)
-			, pipeInMidiOut(p2m)
-			, midiInPipeOut(m2p)
+		bool SetMessageFilters(const std::string& p2mspec, const std::string& m2pspec)
 		{
-		}
-		virtual ~PipeClient() override
-		{
-			StopSession();
-		}
-		virtual bool StartSession() override
-		{
-			StopSession();
-			sessionError = S_OK;
-			hPipe = CreateFileW(pipeName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
-			if(hPipe == INVALID_HANDLE_VALUE)
+			std::unique_ptr<MidiBridgeCore::IMessageFilter> p2m, m2p;
+			ResultCode r = MidiBridgeCore::ParseMessageFilter(p2mspec, &p2m);
+			if(!MidiBridgeCore::ResultIsError(r)) r = MidiBridgeCore::ParseMessageFilter(m2pspec, &m2p);
+			if(MidiBridgeCore::ResultIsError(r))
 			{
-				hPipe = NULL;
-				sessionError = HRESULT_FROM_WIN32(GetLastError());
-				if(OnSessionError) OnSessionError(sessionError);
-				DebugPrint(L"[PipeClient] failed CreateFile()\n");
+				DebugPrint(L"[DataTransferBridge] cannot parse the message filter ({})\n", r);
 				return false;
 			}
-			DWORD mode = PIPE_READMODE_BYTE;
-			SetNamedPipeHandleState(hPipe, &mode, nullptr, nullptr);
-			pipeInMidiOut.SetPipeHandle(hPipe, false);
-			midiInPipeOut.SetPipeHandle(hPipe, false);
+			// the engines let go of the old chains before they are destroyed
+			AttachMessageFilters(p2m.get(), m2p.get());
+			pipeToMidiFilter = std::move(p2m);
+			midiToPipeFilter = std::move(m2p);
 			return true;
 		}
-		virtual void StopSession() override
+		MidiBridgeCore::BridgeStatistics GetStatistics() const
 		{
-			pipeInMidiOut.SetPipeHandle(NULL, false);
-			midiInPipeOut.SetPipeHandle(NULL, false);
-			if(hPipe) CloseHandle(hPipe);
-			hPipe = NULL;
+			if(clientHub) return clientHub->GetStatistics();
+			MidiBridgeCore::BridgeStatistics st;
+			st.pipeToMidi = pipeInMidiOut.GetStatistics();
+			st.midiToPipe = midiInPipeOut.GetStatistics();
+			return st;
 		}
-		virtual bool IsSessionRunning() const override
-		{
-			return hPipe != NULL;
-		}
-		virtual HRESULT GetSessionError() const override
-		{
-			return sessionError;
-		}
-	};
-
-	// ================================================================================
-	// the DataTransferBridge
-
-	class DataTransferBridge::Impl
-	{
-	public:
-		DataTransferBridge* outer;
-		Microsoft::UI::Dispatching::DispatcherQueue dispatchQueue;
-		PipeInMidiOut pipeInMidiOut;
-		MidiInPipeOut midiInPipeOut;
-		std::wstring pipeName;
-		bool runAsServer = false;
-		std::unique_ptr<IPipeSession> pipeSession;
-		Impl(DataTransferBridge* p, Microsoft::UI::Dispatching::DispatcherQueue dispqueue) : outer(p), dispatchQueue(dispqueue)
+		void SetMaxPipeInstances(int v)
 		{
-			pipeInMidiOut.OnDeviceError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiOutError) outer->OnMidiOutError(r); }); };
-			pipeInMidiOut.OnPipeError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
-			midiInPipeOut.OnDeviceError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnMidiInError) outer->OnMidiInError(r); }); };
-			midiInPipeOut.OnPipeError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
-		}
-		~Impl()
-		{
-			// prevent async callback
-			pipeInMidiOut.OnDeviceError = nullptr;
-			pipeInMidiOut.OnPipeError = nullptr;
-			midiInPipeOut.OnDeviceError = nullptr;
-			midiInPipeOut.OnPipeError = nullptr;
-			outer->OnPipeError = nullptr;
-			outer->OnMidiInError = nullptr;
-			outer->OnMidiOutError = nullptr;
-			StopSession();
-		}
-		// --------------------------------------------------------------------------------
-		// public APIs
-		hstring GetMidiInDeviceId() const
-		{
-			return midiInPipeOut.GetMidiDeviceId();
-		}
-		void SetMidiInDeviceId(const hstring& v)
-		{
-			midiInPipeOut.SetMidiDeviceIdAsync(v);
-		}
-		hstring GetMidiOutDeviceId() const
-		{
-			return pipeInMidiOut.GetMidiDeviceId();
-		}
-		void SetMidiOutDeviceId(const hstring& v)
-		{
-			pipeInMidiOut.SetMidiDeviceIdAsync(v);
+			maxPipeInstances = std::clamp(v, 1, MidiBridgeCore::ClientHub::MaxClients);
 		}
 		bool IsRunning() const
 		{
@@ -624,14 +319,36 @@ namespace winrt::MidiPipeBridge::implementation
 			StopSession();
 			pipeName = pipename;
 			runAsServer = runasserver;
-			if(runAsServer)	pipeSession = std::make_unique<PipeServer>(pipeName, pipeInMidiOut, midiInPipeOut);
-			else			pipeSession = std::make_unique<PipeClient>(pipeName, pipeInMidiOut, midiInPipeOut);
-			pipeSession->OnSessionError = [this](HRESULT r) { dispatchQueue.TryEnqueue([this, r]() { if(outer->OnPipeError) outer->OnPipeError(r); }); };
+			if(runAsServer && (1 < maxPipeInstances))
+			{
+				// the ports move from the single client engines to the hub for the session
+				pipeInMidiOut.SetMidiOutPort(nullptr);
+				midiInPipeOut.SetMidiInPort(nullptr);
+				clientHub = std::make_unique<MidiBridgeCore::ClientHub>(maxPipeInstances);
+				clientHub->OnMidiOutError = [this](ResultCode r) { PostMidiOutError(r); };
+				clientHub->OnMidiInError = [this](ResultCode r) { PostMidiInError(r); };
+				clientHub->OnPipeError = [this](ResultCode r) { PostPipeError(r); };
+				clientHub->SetMidiOutPort(&midiOutPort);
+				clientHub->SetMidiInPort(&midiInPort);
+				if(flightRecorder.IsOpen()) clientHub->SetFlightRecorder(&flightRecorder);
+				clientHub->SetPipeToMidiFilter(pipeToMidiFilter.get());
+				clientHub->SetMidiToPipeFilter(midiToPipeFilter.get());
+				pipeSession = MidiBridgeCore::CreateNamedPipeServer(pipeName, *clientHub);
+			}
+			else if(runAsServer)	pipeSession = MidiBridgeCore::CreateNamedPipeServer(pipeName, pipeInMidiOut, midiInPipeOut);
+			else					pipeSession = MidiBridgeCore::CreateNamedPipeClient(pipeName, pipeInMidiOut, midiInPipeOut);
+			pipeSession->OnSessionError = [this](ResultCode r) { PostPipeError(r); };
 			return pipeSession->StartSession();
 		}
 		void StopSession()
 		{
 			pipeSession.reset();
+			if(!clientHub) return;
+			clientHub->SetMidiOutPort(nullptr);
+			clientHub->SetMidiInPort(nullptr);
+			clientHub.reset();
+			pipeInMidiOut.SetMidiOutPort(&midiOutPort);
+			midiInPipeOut.SetMidiInPort(&midiInPort);
 		}
 		bool IsSessionRunning() const
 		{
@@ -645,6 +362,13 @@ namespace winrt::MidiPipeBridge::implementation
 	void DataTransferBridge::SetMidiInDeviceId(const hstring& v) { impl->SetMidiInDeviceId(v); }
 	hstring DataTransferBridge::GetMidiOutDeviceId() const { return impl->GetMidiOutDeviceId(); }
 	void DataTransferBridge::SetMidiOutDeviceId(const hstring& v) { impl->SetMidiOutDeviceId(v); }
+	void DataTransferBridge::SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime) { impl->SetMidiInCoalescing(flushbytes, delayusec, flushonrealtime); }
+	void DataTransferBridge::SetMidiInSerialPacing(double bitrate, int fifobytes) { impl->SetMidiInSerialPacing(bitrate, fifobytes); }
+	void DataTransferBridge::SetPipeReadAhead(int v) { impl->SetPipeReadAhead(v); }
+	bool DataTransferBridge::SetFlightRecorder(const std::wstring& path, size_t capacity) { return impl->SetFlightRecorder(path, capacity); }
+	bool DataTransferBridge::SetMessageFilters(const std::string& pipetomidi, const std::string& miditopipe) { return impl->SetMessageFilters(pipetomidi, miditopipe); }
+	MidiBridgeCore::BridgeStatistics DataTransferBridge::GetStatistics() const { return impl->GetStatistics(); }
+	void DataTransferBridge::SetMaxPipeInstances(int v) { impl->SetMaxPipeInstances(v); }
 	bool DataTransferBridge::StartSession(const std::wstring& pipename, bool runasserver) { return impl->StartSession(pipename, runasserver); }
 	void DataTransferBridge::StopSession() { impl->StopSession(); }
 	bool DataTransferBridge::IsSessionRunning() const { return impl->IsSessionRunning(); }
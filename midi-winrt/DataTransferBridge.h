@@ -9,6 +9,7 @@
 
 #include <winrt/Microsoft.UI.Dispatching.h>
 #include <functional>
+#include "Statistics.h"
 
 namespace winrt::MidiPipeBridge::implementation
 {
@@ -28,6 +29,23 @@ namespace winrt::MidiPipeBridge::implementation
 		void SetMidiInDeviceId(const hstring& v);
 		hstring GetMidiOutDeviceId() const;
 		void SetMidiOutDeviceId(const hstring& v);
+		// MIDI in bytes are held back up to delayusec, or until flushbytes are pending, so a burst goes to the pipe in one write
+		void SetMidiInCoalescing(uint32_t flushbytes, uint32_t delayusec, bool flushonrealtime);
+		// meter MIDI in bytes to the guest at a serial line rate (31250 or 38400 bps, 0 disables), fifobytes may run ahead of the line
+		void SetMidiInSerialPacing(double bitrate, int fifobytes);
+		// pipe reads kept in flight ahead of the MIDI out (1..16), 1 reads and sends in turn on one thread
+		void SetPipeReadAhead(int v);
+		// always-on capture of every bridged message into a memory-mapped circular log, read it with the flightdump tool.
+		// an empty path stops the capture, false when the log cannot be opened
+		bool SetFlightRecorder(const std::wstring& path, size_t capacity);
+		// filter and transform chains for each direction in the ParseMessageFilter() syntax, e.g. "droprt;channels:1-9",
+		// an empty spec passes everything, false and nothing changed when a spec does not parse
+		bool SetMessageFilters(const std::string& pipetomidi, const std::string& miditopipe);
+		// a consistent-enough snapshot of the per-direction counters and latency histograms, cheap enough to poll
+		MidiBridgeCore::BridgeStatistics GetStatistics() const;
+		// how many guests the server serves at once, MIDI in is fanned out to all of them and their output is merged,
+		// 1 keeps the single client engines, takes effect at the next StartSession()
+		void SetMaxPipeInstances(int v);
 		bool StartSession(const std::wstring& pipename, bool runasserver);
 		void StopSession();
 		bool IsSessionRunning() const;
@@ -34,6 +34,8 @@ namespace winrt::MidiPipeBridge::implementation
 		//		midiout="\\?\SWD#MMDEVAPI#MIDII_AB3C8B9C.P_0000#{6dc23320-ab33-4ce4-80d4-bbb3ebbf2814}"
 		// - do not select any device:
 		//		midiin="" midiout=""
+		// - serve up to 4 guests at once, MIDI in goes to all of them and their output is merged:
+		//		server instances=4
 		// 
 		struct CommandLineOptions
 		{
@@ -41,12 +43,14 @@ namespace winrt::MidiPipeBridge::implementation
 			std::optional<hstring> midiindeviceid;
 			std::optional<hstring> midioutdeviceid;
 			std::optional<bool> runasserver;
+			std::optional<int> maxinstances;
 			CommandLineOptions()
 			{
 				static const hstring OptPipeName{ L"pipename=" };
 				static const hstring OptMidiIn	{ L"midiin=" };
 				static const hstring OptMidiOut	{ L"midiout=" };
 				static const hstring OptServer	{ L"server" };
+				static const hstring OptInstances{ L"instances=" };
 				LPCWSTR cmdline = GetCommandLineW();
 				int argc = 0;
 				LPWSTR* argv = CommandLineToArgvW(cmdline, &argc);
@@ -55,8 +59,9 @@ namespace winrt::MidiPipeBridge::implementation
 					LPCWSTR arg = argv[i];
 					if     (!pipename		.has_value() && (_wcsnicmp(arg, OptPipeName	.c_str(), OptPipeName	.size()) == 0)) pipename		= arg + OptPipeName	.size();
 					else if(!midiindeviceid	.has_value() && (_wcsnicmp(arg, OptMidiIn	.c_str(), OptMidiIn		.size()) == 0)) midiindeviceid	= arg + OptMidiIn	.size();
-					else if(!midiindeviceid	.has_value() && (_wcsnicmp(arg, OptMidiOut	.c_str(), OptMidiOut	.size()) == 0)) midiindeviceid	= arg + OptMidiOut	.size();
+					else if(!midioutdeviceid	.has_value() && (_wcsnicmp(arg, OptMidiOut	.c_str(), OptMidiOut	.size()) == 0)) midioutdeviceid	= arg + OptMidiOut	.size();
 					else if(!runasserver	.has_value() && (_wcsnicmp(arg, OptServer	.c_str(), OptServer		.size()) == 0)) runasserver		= true;
+					else if(!maxinstances	.has_value() && (_wcsnicmp(arg, OptInstances.c_str(), OptInstances	.size()) == 0)) maxinstances	= _wtoi(arg + OptInstances.size());
 				}
 				LocalFree(argv);
 			}
@@ -98,6 +103,7 @@ namespace winrt::MidiPipeBridge::implementation
 			dataTtransferBridge->OnPipeError = [this](HRESULT r) { pipeError.Code(r); IsConnecting(false); };
 			dataTtransferBridge->OnMidiInError = [this](HRESULT r) { midiInError.Code(r); IsConnecting(false); };
 			dataTtransferBridge->OnMidiOutError = [this](HRESULT r) { midiOutError.Code(r); IsConnecting(false); };
+			if(cmdopt.maxinstances.has_value()) dataTtransferBridge->SetMaxPipeInstances(cmdopt.maxinstances.value());
 			pipeName = cmdopt.pipename.has_value() ? cmdopt.pipename.value() : (appSettings.HasProperty(L"PipeName") ? appSettings.PipeName() : Defaults.pipeName);
 			runAsServer = cmdopt.runasserver.has_value() ? cmdopt.runasserver.value() : (appSettings.HasProperty(L"RunAsServer") ? appSettings.RunAsServer() : Defaults.runAsServer);
 			isConnecting = false;